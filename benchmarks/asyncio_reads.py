@@ -0,0 +1,105 @@
+#!/usr/bin/env python
+"""This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+linuxfd is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+linuxfd is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+
+Written in Python V3."""
+
+# asyncio event throughput: a hand-rolled wrapper (loop.add_reader + Future,
+# one read() per wakeup) versus the native aread()/events() methods. The
+# events() row includes the cost of yielding every event separately.
+#
+# usage: python benchmarks/asyncio_reads.py [events] [burst]
+
+import linuxfd,asyncio,os,shutil,sys,tempfile,time
+
+async def handRolled(obj):
+	"""The wrapper used before aread() existed."""
+	loop = asyncio.get_running_loop()
+	future = loop.create_future()
+	def ready():
+		try:
+			value = obj.read()
+		except BlockingIOError:
+			return
+		if not future.done(): future.set_result(value)
+	loop.add_reader(obj.fileno(),ready)
+	try:
+		return await future
+	finally:
+		loop.remove_reader(obj.fileno())
+
+async def semaphore(native,total,burst):
+	"""Semaphore eventfd, incremented in bursts by a producer task."""
+	efd = linuxfd.eventfd(semaphore=True,nonBlocking=True)
+	async def producer():
+		for i in range(total // burst):
+			efd.write(burst)
+			await asyncio.sleep(0)
+	task = asyncio.ensure_future(producer())
+	received = 0
+	t = time.perf_counter()
+	while received < total:
+		received += await efd.aread() if native else await handRolled(efd)
+	t = time.perf_counter() - t
+	await task
+	efd.close()
+	return total / t
+
+async def inotifyEvents(native,total,burst):
+	"""inotify IN_MODIFY events of two files written alternately in bursts by a
+producer task (alternating names, since the kernel merges identical events)."""
+	directory = tempfile.mkdtemp()
+	files = [os.open(os.path.join(directory,name),os.O_CREAT | os.O_WRONLY) for name in "ab"]
+	ino = linuxfd.inotify(nonBlocking=True)
+	ino.add(directory,linuxfd.IN_MODIFY)
+	async def producer():
+		for i in range(total // burst):
+			for j in range(burst): os.write(files[j % 2],b"x")
+			await asyncio.sleep(0)
+	task = asyncio.ensure_future(producer())
+	received = 0
+	t = time.perf_counter()
+	if native == "events":
+		async for event in ino.events():
+			received += 1
+			if received == total: break
+	elif native:
+		while received < total:
+			received += len(await ino.aread())
+	else:
+		while received < total:
+			received += len(await handRolled(ino))
+	t = time.perf_counter() - t
+	await task
+	ino.close()
+	for fd in files: os.close(fd)
+	shutil.rmtree(directory)
+	return total / t
+
+async def main(total,burst):
+	print("{} events in bursts of {}".format(total,burst))
+	print("{:<20} {:>16} {:>16}".format("source","hand-rolled/s","native/s"))
+	for name,bench,native in (
+		("eventfd aread()",semaphore,True),
+		("inotify aread()",inotifyEvents,True),
+		("inotify events()",inotifyEvents,"events")):
+		rolled = await bench(False,total,burst)
+		native = await bench(native,total,burst)
+		print("{:<20} {:>16.0f} {:>16.0f}".format(name,rolled,native))
+
+if __name__ == "__main__":
+	total = int(sys.argv[1]) if len(sys.argv) > 1 else 20000
+	burst = int(sys.argv[2]) if len(sys.argv) > 2 else 100
+	asyncio.run(main(total,burst))
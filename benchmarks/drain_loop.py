@@ -0,0 +1,102 @@
+#!/usr/bin/env python
+"""This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+linuxfd is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+linuxfd is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+
+Written in Python V3."""
+
+# drain loops on non-blocking files: read() until OSError.EAGAIN
+# (BlockingIOError) versus tryRead() until None. Every drain ends with an empty
+# read, thus short bursts are dominated by the cost of that last call.
+#
+# usage: python benchmarks/drain_loop.py [rounds] [burst]
+
+import linuxfd,os,shutil,signal,sys,tempfile,time
+
+def drainRaising(obj):
+	count = 0
+	while True:
+		try:
+			obj.read()
+		except BlockingIOError:
+			return count
+		count += 1
+
+def drainSentinel(obj):
+	count = 0
+	while obj.tryRead() is not None:
+		count += 1
+	return count
+
+def semaphore(drain,rounds,burst):
+	efd = linuxfd.eventfd(semaphore=True,nonBlocking=True)
+	t = time.perf_counter()
+	for i in range(rounds):
+		if burst: efd.write(burst)
+		drain(efd)
+	t = time.perf_counter() - t
+	efd.close()
+	return t
+
+def timer(drain,rounds,burst):
+	# never armed: every drain consists of the empty read only
+	tfd = linuxfd.timerfd(nonBlocking=True)
+	t = time.perf_counter()
+	for i in range(rounds):
+		drain(tfd)
+	t = time.perf_counter() - t
+	tfd.close()
+	return t
+
+def signals(drain,rounds,burst):
+	signal.pthread_sigmask(signal.SIG_BLOCK,{signal.SIGUSR1})
+	sfd = linuxfd.signalfd({signal.SIGUSR1},nonBlocking=True)
+	pid = os.getpid()
+	t = time.perf_counter()
+	for i in range(rounds):
+		if burst: os.kill(pid,signal.SIGUSR1) # standard signals do not queue
+		drain(sfd)
+	t = time.perf_counter() - t
+	sfd.close()
+	signal.pthread_sigmask(signal.SIG_UNBLOCK,{signal.SIGUSR1})
+	return t
+
+def inotifyEvents(drain,rounds,burst):
+	directory = tempfile.mkdtemp()
+	files = [os.open(os.path.join(directory,name),os.O_CREAT | os.O_WRONLY) for name in "ab"]
+	ino = linuxfd.inotify(nonBlocking=True)
+	ino.add(directory,linuxfd.IN_MODIFY)
+	t = time.perf_counter()
+	for i in range(rounds):
+		for j in range(burst): os.write(files[j % 2],b"x")
+		drain(ino)
+	t = time.perf_counter() - t
+	ino.close()
+	for fd in files: os.close(fd)
+	shutil.rmtree(directory)
+	return t
+
+if __name__ == "__main__":
+	rounds = int(sys.argv[1]) if len(sys.argv) > 1 else 100000
+	burst = int(sys.argv[2]) if len(sys.argv) > 2 else 4
+	print("{} drain loops, bursts of {} (times per drain loop)".format(rounds,burst))
+	print("{:<10} {:>14} {:>14} {:>8}".format("source","read()/us","tryRead()/us","speedup"))
+	for name,bench in (
+		("eventfd",semaphore),
+		("timerfd",timer),
+		("signalfd",signals),
+		("inotify",inotifyEvents)):
+		raising = bench(drainRaising,rounds,burst) / rounds * 1e6
+		sentinel = bench(drainSentinel,rounds,burst) / rounds * 1e6
+		print("{:<10} {:>14.3f} {:>14.3f} {:>7.2f}x".format(name,raising,sentinel,raising / sentinel))
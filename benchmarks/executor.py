@@ -0,0 +1,98 @@
+#!/usr/bin/env python
+"""This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+linuxfd is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+linuxfd is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+
+Written in Python V3."""
+
+# Fine-grained task throughput of linuxfd.executor (work-stealing native
+# workers, eventfd completion) against concurrent.futures.ThreadPoolExecutor
+# (one lock-protected queue, one Future per task). Three workloads: trivial
+# Python callables (pure dispatch overhead), tasks submitting tasks (a binary
+# tree, served from the workers' own deques) and hashing files (GIL-free on
+# the executor, hashlib.blake2b on the thread pool).
+#
+# usage: python benchmarks/executor.py [tasks] [workers]
+
+import concurrent.futures,hashlib,linuxfd,os,shutil,sys,tempfile,threading,time
+
+def timed(function,*args):
+	started = time.perf_counter()
+	function(*args)
+	return time.perf_counter() - started
+
+# trivial tasks: submit a batch, collect all results
+def trivialExecutor(pool,tasks):
+	pool.map(abs,range(-tasks,0))
+
+def trivialThreads(pool,tasks):
+	list(pool.map(abs,range(-tasks,0)))
+
+# task tree: every task submits two children until depth is reached
+def treeExecutor(pool,depth):
+	def node(d):
+		if d > 0:
+			pool.submit(node,d - 1)
+			pool.submit(node,d - 1)
+	pool.submit(node,depth)
+	remaining = 2**(depth + 1) - 1
+	while remaining > 0: remaining -= len(pool.read())
+
+def treeThreads(pool,depth):
+	remaining = [2**(depth + 1) - 1]
+	done = threading.Event()
+	lock = threading.Lock()
+	def node(d):
+		if d > 0:
+			pool.submit(node,d - 1)
+			pool.submit(node,d - 1)
+		with lock:
+			remaining[0] -= 1
+			if remaining[0] == 0: done.set()
+	pool.submit(node,depth)
+	done.wait()
+
+# hashing: files of 64 kB
+def hashExecutor(pool,paths):
+	for path in paths: pool.hashFile(path)
+	remaining = len(paths)
+	while remaining > 0: remaining -= len(pool.read())
+
+def hashFileThreads(path):
+	with open(path,"rb") as f: return hashlib.blake2b(f.read()).digest()
+
+def hashThreads(pool,paths):
+	list(pool.map(hashFileThreads,paths))
+
+if __name__ == "__main__":
+	tasks = int(sys.argv[1]) if len(sys.argv) > 1 else 100000
+	workers = int(sys.argv[2]) if len(sys.argv) > 2 else os.cpu_count() or 1
+	depth = max(1,tasks.bit_length() - 1)
+	directory = tempfile.mkdtemp(prefix="linuxfd-bench-")
+	paths = [os.path.join(directory,str(i)) for i in range(max(1,tasks // 100))]
+	for path in paths:
+		with open(path,"wb") as f: f.write(os.urandom(65536))
+	ex = linuxfd.executor(workers)
+	tp = concurrent.futures.ThreadPoolExecutor(workers)
+	print("{} workers".format(workers))
+	print("{:<24} {:>14} {:>14}".format("workload","executor/s","threadpool/s"))
+	for name,count,runExecutor,runThreads,argument in (
+		("trivial ({})".format(tasks),tasks,trivialExecutor,trivialThreads,tasks),
+		("tree ({})".format(2**(depth + 1) - 1),2**(depth + 1) - 1,treeExecutor,treeThreads,depth),
+		("hash 64kB ({})".format(len(paths)),len(paths),hashExecutor,hashThreads,paths)):
+		print("{:<24} {:>14.0f} {:>14.0f}".format(name,
+			count / timed(runExecutor,ex,argument),count / timed(runThreads,tp,argument)))
+	ex.close()
+	tp.shutdown()
+	shutil.rmtree(directory)
@@ -0,0 +1,68 @@
+#!/usr/bin/env python
+"""This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+linuxfd is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+linuxfd is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+
+Written in Python V3."""
+
+# GIL contention: threads hammering non-blocking eventfds (write, read, empty
+# tryRead) while other threads burn CPU in pure Python. Releasing the GIL for
+# each sub-microsecond syscall makes every I/O thread queue up behind the CPU
+# threads to get it back (convoy effect); keeping it (KEEP_GIL, the default
+# for non-blocking objects) avoids the hand-over.
+#
+# usage: python benchmarks/gil_contention.py [seconds] [ioThreads] [cpuThreads]
+
+import linuxfd,sys,threading,time
+from linuxfd import eventfd_c
+
+def ioWorker(flags,stop,counts,index):
+	efd = linuxfd.eventfd(nonBlocking=True)
+	fd = efd.fileno()
+	count = 0
+	while not stop.is_set():
+		eventfd_c.eventfd_write(fd,1,flags)
+		eventfd_c.eventfd_read(fd,flags)
+		eventfd_c.eventfd_read(fd,flags | eventfd_c.TRY_READ)
+		count += 1
+	counts[index] = count
+	efd.close()
+
+def cpuWorker(stop,counts,index):
+	count = 0
+	while not stop.is_set():
+		for i in range(1000): pass
+		count += 1
+	counts[index] = count
+
+def run(flags,seconds,ioThreads,cpuThreads):
+	stop = threading.Event()
+	counts = [0] * (ioThreads + cpuThreads)
+	threads = [threading.Thread(target=ioWorker,args=(flags,stop,counts,i)) for i in range(ioThreads)]
+	threads += [threading.Thread(target=cpuWorker,args=(stop,counts,ioThreads + i)) for i in range(cpuThreads)]
+	for thread in threads: thread.start()
+	time.sleep(seconds)
+	stop.set()
+	for thread in threads: thread.join()
+	return sum(counts[:ioThreads]) / seconds,sum(counts[ioThreads:]) / seconds
+
+if __name__ == "__main__":
+	seconds = float(sys.argv[1]) if len(sys.argv) > 1 else 2.0
+	ioThreads = int(sys.argv[2]) if len(sys.argv) > 2 else 4
+	cpuThreads = int(sys.argv[3]) if len(sys.argv) > 3 else 1
+	print("{} I/O threads, {} CPU threads, {} s per run".format(ioThreads,cpuThreads,seconds))
+	print("{:<14} {:>16} {:>16}".format("mode","I/O rounds/s","CPU rounds/s"))
+	for name,flags in (("release GIL",0),("keep GIL",eventfd_c.KEEP_GIL)):
+		io,cpu = run(flags,seconds,ioThreads,cpuThreads)
+		print("{:<14} {:>16.0f} {:>16.0f}".format(name,io,cpu))
@@ -0,0 +1,261 @@
+/* This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+    linuxfd is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linuxfd is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Microbenchmarks of the C core liblinuxfd, i.e. of the system call logic of
+   the Python bindings without the interpreter; compare with suite.py to see
+   the binding overhead.
+
+   usage: make bench  (or build/native/bench_core [iterations] [filter]) */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/stat.h>
+#include "liblinuxfd.h"
+
+#define N_DIRS 64    /* watched directories of the inotify benchmarks */
+#define N_EVENTS 256 /* events per batch of inotify_parse */
+
+static char directory[] = "/tmp/linuxfd-bench-XXXXXX";
+static char paths[N_DIRS][64];
+static const char *pathlist[N_DIRS];
+static char eventbuffer[N_EVENTS * (sizeof(struct inotify_event) + 16)]
+	__attribute__((aligned(__alignof__(struct inotify_event))));
+static volatile uint64_t sink; /* keeps results alive */
+
+
+/* helper: current CLOCK_MONOTONIC time in nanoseconds */
+static uint64_t _now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/* benchmarks: run n operations on the prepared descriptor fd, return the
+   number of operations done (batches count each operation) */
+
+static long _eventfd_roundtrip(int fd, long n) {
+	eventfd_t value;
+	long i;
+	for (i = 0; i < n; i++) {
+		eventfd_write(fd, 1);
+		eventfd_read(fd, &value);
+		sink += value;
+	}
+	return n;
+}
+
+static long _eventfd_drain(int fd, long n) {
+	uint64_t sum;
+	long i;
+	for (i = 0; i < n; i++) {
+		eventfd_write(fd, 1);
+		lfd_eventfd_drain(fd, 1, &sum, NULL, NULL);
+		sink += sum;
+	}
+	return n;
+}
+
+static long _eventfd_drain_empty(int fd, long n) {
+	uint64_t sum;
+	long i;
+	for (i = 0; i < n; i++) {
+		lfd_eventfd_drain(fd, 1, &sum, NULL, NULL);
+		sink += sum;
+	}
+	return n;
+}
+
+static long _timerfd_settime(int fd, long n) {
+	double value, interval;
+	long i;
+	for (i = 0; i < n; i++) {
+		lfd_timerfd_settime(fd, 0, 3600.0, 0.0, &value, &interval);
+		sink += (uint64_t)value;
+	}
+	return n;
+}
+
+static long _timerfd_settime_ns(int fd, long n) {
+	long i;
+	for (i = 0; i < n; i++) lfd_timerfd_settime_ns(fd, 0, 3600000000000ULL, 0, NULL, NULL);
+	return n;
+}
+
+static long _timerfd_tryread(int fd, long n) {
+	uint64_t expirations;
+	long i;
+	for (i = 0; i < n; i++) sink += lfd_timerfd_read(fd, &expirations);
+	return n;
+}
+
+static long _signalfd_tryread(int fd, long n) {
+	struct signalfd_siginfo values[16];
+	long i;
+	for (i = 0; i < n; i++) sink += lfd_signalfd_read(fd, values, 16);
+	return n;
+}
+
+static long _inotify_watches(int fd, long n) {
+	int wds[N_DIRS];
+	long i;
+	for (i = 0; i < n; i += N_DIRS) {
+		lfd_inotify_add_watches(fd, pathlist, N_DIRS, IN_CREATE, wds, NULL, NULL);
+		lfd_inotify_rm_watches(fd, wds, N_DIRS, NULL, NULL);
+	}
+	return i;
+}
+
+static long _inotify_parse(int fd, long n) {
+	const struct inotify_event *event;
+	size_t offset;
+	long i = 0;
+	while (i < n) {
+		offset = 0;
+		while ((event = lfd_inotify_next(eventbuffer, sizeof(eventbuffer), &offset)) != NULL) {
+			sink += event->mask;
+			i++;
+		}
+	}
+	return i;
+}
+
+/* includes the chmod() generating the event; alternating between two files
+   keeps the kernel from coalescing identical events */
+static long _inotify_read(int fd, long n) {
+	lfd_readbuffer rb;
+	const struct inotify_event *event;
+	char names[2][96];
+	ssize_t length;
+	size_t offset;
+	int wd, j;
+	long i = 0;
+	lfd_readbuffer_init(&rb, 4096, 1048576);
+	wd = inotify_add_watch(fd, directory, IN_ATTRIB);
+	for (j = 0; j < 2; j++) {
+		snprintf(names[j], sizeof(names[j]), "%s/touched%d", directory, j);
+		close(open(names[j], O_CREAT | O_WRONLY, 0600));
+	}
+	while (i < n) {
+		/* queue a batch of 16 events, then read and parse it */
+		for (j = 0; j < 16; j++) chmod(names[j & 1], 0600);
+		while ((length = read(fd, rb.buffer, rb.size)) > 0) {
+			for (offset = 0; (event = lfd_inotify_next(rb.buffer, length, &offset)) != NULL; i++)
+				sink += event->mask;
+			lfd_readbuffer_adapt(&rb, fd, length);
+		}
+	}
+	inotify_rm_watch(fd, wd);
+	unlink(names[0]);
+	unlink(names[1]);
+	lfd_readbuffer_free(&rb);
+	return i;
+}
+
+
+typedef struct {
+	const char *name;
+	int (*open)(void);
+	long (*run)(int fd, long n);
+} Benchmark;
+
+static int _open_eventfd(void) { return eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC); }
+static int _open_timerfd(void) { return timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC); }
+static int _open_inotify(void) { return inotify_init1(IN_NONBLOCK | IN_CLOEXEC); }
+static int _open_signalfd(void) {
+	int signals[1] = { SIGUSR1 };
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGUSR1);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	return lfd_signalfd(-1, signals, 1, SFD_NONBLOCK | SFD_CLOEXEC);
+}
+
+static const Benchmark benchmarks[] = {
+	{ "eventfd_roundtrip",   _open_eventfd,  _eventfd_roundtrip },
+	{ "eventfd_drain",       _open_eventfd,  _eventfd_drain },
+	{ "eventfd_drain_empty", _open_eventfd,  _eventfd_drain_empty },
+	{ "timerfd_settime",     _open_timerfd,  _timerfd_settime },
+	{ "timerfd_settime_ns",  _open_timerfd,  _timerfd_settime_ns },
+	{ "timerfd_tryread",     _open_timerfd,  _timerfd_tryread },
+	{ "signalfd_tryread",    _open_signalfd, _signalfd_tryread },
+	{ "inotify_watches",     _open_inotify,  _inotify_watches },
+	{ "inotify_parse",       _open_inotify,  _inotify_parse },
+	{ "inotify_read",        _open_inotify,  _inotify_read },
+	{ NULL,                  NULL,           NULL }
+};
+
+
+/* helper: fill eventbuffer with events carrying 16 byte names */
+static void _prepare_events(void) {
+	struct inotify_event *event;
+	size_t offset;
+	int i;
+	for (i = 0, offset = 0; i < N_EVENTS; i++, offset += sizeof(struct inotify_event) + 16) {
+		event = (struct inotify_event *)(eventbuffer + offset);
+		event->wd = 1;
+		event->mask = IN_CREATE;
+		event->cookie = 0;
+		event->len = 16;
+		snprintf(event->name, 16, "file%d", i);
+	}
+}
+
+int main(int argc, char **argv) {
+	long iterations = argc > 1 ? atol(argv[1]) : 100000;
+	const char *filter = argc > 2 ? argv[2] : NULL;
+	const Benchmark *benchmark;
+	uint64_t started;
+	long done;
+	int fd, i;
+
+	if (mkdtemp(directory) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+	for (i = 0; i < N_DIRS; i++) {
+		snprintf(paths[i], sizeof(paths[i]), "%s/%d", directory, i);
+		mkdir(paths[i], 0700);
+		pathlist[i] = paths[i];
+	}
+	_prepare_events();
+
+	for (benchmark = benchmarks; benchmark->name != NULL; benchmark++) {
+		if (filter != NULL && strstr(benchmark->name, filter) == NULL) continue;
+		fd = benchmark->open();
+		if (fd == -1) {
+			printf("%-20s %s\n", benchmark->name, strerror(errno));
+			continue;
+		}
+		benchmark->run(fd, iterations / 10); /* warm up */
+		started = _now();
+		done = benchmark->run(fd, iterations);
+		printf("%-20s %8.1f ns/op\n", benchmark->name, (double)(_now() - started) / done);
+		close(fd);
+	}
+
+	for (i = 0; i < N_DIRS; i++) rmdir(paths[i]);
+	rmdir(directory);
+	return 0;
+}
@@ -0,0 +1,93 @@
+/* This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+    linuxfd is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linuxfd is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Microbenchmarks of the C++ wrapper linuxfd.hpp; the numbers should match
+   those of bench_core, the wrapper adds no cost beyond the error checks.
+
+   usage: make bench  (or build/native/bench_cxx [iterations]) */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "linuxfd.hpp"
+
+using Clock = std::chrono::steady_clock;
+static volatile uint64_t sink; // keeps results alive
+
+template <typename F> static void bench(const char *name, long iterations, F run) {
+	run(iterations / 10); // warm up
+	auto started = Clock::now();
+	long done = run(iterations);
+	auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - started).count();
+	std::printf("%-20s %8.1f ns/op\n", name, elapsed / done);
+}
+
+int main(int argc, char **argv) {
+	long iterations = argc > 1 ? std::atol(argv[1]) : 100000;
+
+	linuxfd::EventFd event(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	bench("eventfd_roundtrip", iterations, [&](long n) {
+		for (long i = 0; i < n; i++) {
+			event.write(1);
+			sink += event.read();
+		}
+		return n;
+	});
+	bench("eventfd_tryread", iterations, [&](long n) {
+		for (long i = 0; i < n; i++) sink += event.tryRead().value_or(0);
+		return n;
+	});
+
+	linuxfd::TimerFd timer(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	bench("timerfd_settime", iterations, [&](long n) {
+		for (long i = 0; i < n; i++) sink += timer.settime(std::chrono::hours(1)).first;
+		return n;
+	});
+	bench("timerfd_tryread", iterations, [&](long n) {
+		for (long i = 0; i < n; i++) sink += timer.tryRead().value_or(0);
+		return n;
+	});
+
+	// inotify: batches of 16 attribute changes (alternating between two files,
+	// identical events are coalesced), read through an adaptive buffer
+	char directory[] = "/tmp/linuxfd-bench-XXXXXX";
+	if (mkdtemp(directory) == nullptr) return 1;
+	std::string names[2] = { std::string(directory) + "/touched0", std::string(directory) + "/touched1" };
+	for (const auto &name : names) ::close(::open(name.c_str(), O_CREAT | O_WRONLY, 0600));
+	linuxfd::Inotify inotify(IN_NONBLOCK | IN_CLOEXEC);
+	linuxfd::ReadBuffer buffer;
+	int wd = inotify.addWatch(directory, IN_ATTRIB);
+	bench("inotify_read", iterations, [&](long n) {
+		long i = 0;
+		while (i < n) {
+			for (int j = 0; j < 16; j++) ::chmod(names[j & 1].c_str(), 0600);
+			for (auto events = inotify.read(buffer); !events.empty(); events = inotify.read(buffer))
+				for (const auto &event : events) {
+					sink += event.mask;
+					i++;
+				}
+		}
+		return i;
+	});
+	inotify.rmWatch(wd);
+	for (const auto &name : names) ::unlink(name.c_str());
+	::rmdir(directory);
+	return 0;
+}
@@ -0,0 +1,96 @@
+#!/usr/bin/env python
+"""This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+linuxfd is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+linuxfd is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+
+Written in Python V3."""
+
+# N interpreters driving timerfds: every worker arms a few periodic timerfds
+# (100 us interval), waits for them with a Reactor and handles each expiration
+# with a bit of pure Python work. Workers run either as threads of the main
+# interpreter, sharing its GIL, or in subinterpreters, which have a GIL of their
+# own from Python 3.12 on (PEP 684); on older versions both modes share one GIL.
+# Each worker reports its number of handled expirations through an eventfd.
+#
+# usage: python benchmarks/subinterpreters.py [seconds] [maxWorkers] [timers]
+
+import linuxfd,sys,threading,time
+
+try:
+	from concurrent import interpreters # Python >= 3.14
+except ImportError:
+	import _xxsubinterpreters as interpreters # Python 3.10 to 3.12
+
+def runIn(interp,script,**shared):
+	"""Run script in interpreter interp; shared: names of ints/strings/bytes."""
+	if hasattr(interp,"exec"):
+		interp.prepare_main(**shared)
+		interp.exec(script)
+	else:
+		interpreters.run_string(interp,script,shared)
+
+WORKER = """
+import linuxfd,time
+from linuxfd import eventfd_c
+handled = 0
+def expired(timer,count):
+	global handled
+	for i in range(count): sum(range(2000)) # per-expiration work, about 20 us
+	handled += count
+reactor = linuxfd.Reactor()
+timers = [linuxfd.timerfd(nonBlocking=True) for i in range(timers)]
+for timer in timers:
+	reactor.register(timer,expired)
+	timer.settime_ns(100000,100000)
+deadline = time.monotonic() + seconds / 1000
+while time.monotonic() < deadline: reactor.run_once(0.01)
+for timer in timers: timer.close()
+reactor.close()
+eventfd_c.eventfd_write(report,handled)
+"""
+
+def run(workers,seconds,timers,isolated):
+	report = linuxfd.eventfd(semaphore=False)
+	shared = dict(report=report.fileno(),seconds=int(seconds * 1000),timers=timers)
+	if isolated:
+		interps = [interpreters.create() for i in range(workers)]
+		threads = [threading.Thread(target=runIn,args=(interp,WORKER),kwargs=shared) for interp in interps]
+	else:
+		def worker():
+			exec(WORKER,dict(shared))
+		threads = [threading.Thread(target=worker) for i in range(workers)]
+	start = time.monotonic()
+	for thread in threads: thread.start()
+	for thread in threads: thread.join()
+	elapsed = time.monotonic() - start # handling a backlog may overrun seconds
+	if isolated:
+		for interp in interps:
+			if hasattr(interp,"close"): interp.close()
+			else: interpreters.destroy(interp)
+	handled = report.read() # sum of all reports
+	report.close()
+	return handled / elapsed
+
+if __name__ == "__main__":
+	seconds = float(sys.argv[1]) if len(sys.argv) > 1 else 2.0
+	maxWorkers = int(sys.argv[2]) if len(sys.argv) > 2 else 4
+	timers = int(sys.argv[3]) if len(sys.argv) > 3 else 4
+	print("{} timerfds per worker, {} s per run".format(timers,seconds))
+	print("workers   threads (expirations/s)   subinterpreters (expirations/s)")
+	workers = 1
+	while workers <= maxWorkers:
+		threaded = run(workers,seconds,timers,False)
+		isolated = run(workers,seconds,timers,True)
+		print("{:>7}   {:>23.0f}   {:>31.0f}".format(workers,threaded,isolated))
+		workers *= 2
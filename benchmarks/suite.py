@@ -0,0 +1,205 @@
+#!/usr/bin/env python
+"""This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+linuxfd is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+linuxfd is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+
+Written in Python V3."""
+
+# pyperf benchmark suite covering the wrappers in their different modes:
+#
+#   eventfd    write+read per mode, empty tryRead, cross-thread ping-pong
+#   timerfd    settime, settime+read of an expired timer, wakeup jitter
+#   signalfd   raise+read per signal
+#   inotify    read cost per event at batch sizes 1, 16 and 256
+#   create     creation+close rate of every file object
+#
+# Values are seconds per operation (per event for inotify; lateness per wakeup
+# for the jitter benchmark). pyperf spawns worker processes and calibrates the
+# loop counts; see "python benchmarks/suite.py --help" for its options.
+#
+# usage: python benchmarks/suite.py -o before.json [--select REGEX]
+#        python benchmarks/suite.py -o after.json
+#        python benchmarks/suite.py compare before.json after.json [threshold%]
+#
+# compare prints one line per benchmark and exits with status 1 if any mean
+# got slower by more than threshold percent (default 10), so upgrades can be
+# gated on it; "python -m pyperf compare_to before.json after.json --table"
+# shows significance tests on top.
+
+import linuxfd,os,re,signal,sys,tempfile,threading,time
+
+def eventfdWriteRead(loops,nonBlocking,semaphore):
+	efd = linuxfd.eventfd(nonBlocking=nonBlocking,semaphore=semaphore)
+	t = time.perf_counter()
+	for i in range(loops):
+		efd.write(1)
+		efd.read()
+	t = time.perf_counter() - t
+	efd.close()
+	return t
+
+def eventfdTryReadEmpty(loops):
+	efd = linuxfd.eventfd(nonBlocking=True)
+	t = time.perf_counter()
+	for i in range(loops): efd.tryRead()
+	t = time.perf_counter() - t
+	efd.close()
+	return t
+
+def eventfdPingPong(loops):
+	"""Round trip latency: the main thread writes ping, the echo thread reads
+it and writes pong; both block in read()."""
+	ping = linuxfd.eventfd()
+	pong = linuxfd.eventfd()
+	def echo():
+		for i in range(loops):
+			ping.read()
+			pong.write(1)
+	thread = threading.Thread(target=echo)
+	thread.start()
+	t = time.perf_counter()
+	for i in range(loops):
+		ping.write(1)
+		pong.read()
+	t = time.perf_counter() - t
+	thread.join()
+	ping.close()
+	pong.close()
+	return t
+
+def timerfdSettime(loops):
+	tfd = linuxfd.timerfd()
+	t = time.perf_counter()
+	for i in range(loops): tfd.settime(3600.0) # far in the future: never expires
+	t = time.perf_counter() - t
+	tfd.close()
+	return t
+
+def timerfdSettimeRead(loops):
+	tfd = linuxfd.timerfd()
+	t = time.perf_counter()
+	for i in range(loops):
+		tfd.settime_ns(1) # expires at once
+		tfd.read()
+	t = time.perf_counter() - t
+	tfd.close()
+	return t
+
+def timerfdJitter(loops):
+	"""Lateness of the wakeups of a periodic 1 ms timer, summed up."""
+	interval = 1000000 # ns
+	tfd = linuxfd.timerfd()
+	tfd.settime_ns(interval,interval)
+	start = time.monotonic_ns()
+	expirations = 0
+	lateness = 0
+	for i in range(loops):
+		expirations += tfd.read()
+		lateness += time.monotonic_ns() - (start + expirations * interval)
+	tfd.close()
+	return lateness / 1e9
+
+def signalfdRead(loops):
+	signal.pthread_sigmask(signal.SIG_BLOCK,{signal.SIGUSR1})
+	sfd = linuxfd.signalfd(signalset={signal.SIGUSR1})
+	tid = threading.get_ident()
+	t = time.perf_counter()
+	for i in range(loops):
+		signal.pthread_kill(tid,signal.SIGUSR1)
+		sfd.read()
+	t = time.perf_counter() - t
+	sfd.close()
+	signal.pthread_sigmask(signal.SIG_UNBLOCK,{signal.SIGUSR1})
+	return t
+
+def inotifyBatch(loops,batch):
+	"""Read cost of batches of IN_ATTRIB events; the events are generated
+outside of the timed section. Distinct names prevent the kernel from merging
+consecutive events."""
+	directory = tempfile.mkdtemp()
+	pathnames = [os.path.join(directory,"f{}".format(i)) for i in range(batch)]
+	for pathname in pathnames: open(pathname,"w").close()
+	ifd = linuxfd.inotify(nonBlocking=True)
+	ifd.add(directory,linuxfd.IN_ATTRIB)
+	t = 0.0
+	for i in range(loops):
+		for pathname in pathnames: os.utime(pathname)
+		t0 = time.perf_counter()
+		count = 0
+		while count < batch: count += len(ifd.read())
+		t += time.perf_counter() - t0
+	ifd.close()
+	for pathname in pathnames: os.unlink(pathname)
+	os.rmdir(directory)
+	return t
+
+def createClose(loops,factory):
+	t = time.perf_counter()
+	for i in range(loops): factory().close()
+	return time.perf_counter() - t
+
+BENCHMARKS = (
+	("eventfd_write_read_blocking",    eventfdWriteRead,   (False,False),  None),
+	("eventfd_write_read_nonblocking", eventfdWriteRead,   (True,False),   None),
+	("eventfd_write_read_semaphore",   eventfdWriteRead,   (True,True),    None),
+	("eventfd_tryread_empty",          eventfdTryReadEmpty,(),             None),
+	("eventfd_pingpong",               eventfdPingPong,    (),             None),
+	("timerfd_settime",                timerfdSettime,     (),             None),
+	("timerfd_settime_read",           timerfdSettimeRead, (),             None),
+	("timerfd_wakeup_jitter",          timerfdJitter,      (),             None),
+	("signalfd_read",                  signalfdRead,       (),             None),
+	("inotify_read_batch_1",           inotifyBatch,       (1,),           1),
+	("inotify_read_batch_16",          inotifyBatch,       (16,),          16),
+	("inotify_read_batch_256",         inotifyBatch,       (256,),         256),
+	("create_eventfd",                 createClose,        (linuxfd.eventfd,), None),
+	("create_timerfd",                 createClose,        (linuxfd.timerfd,), None),
+	("create_signalfd",                createClose,        (lambda: linuxfd.signalfd({signal.SIGUSR1}),), None),
+	("create_inotify",                 createClose,        (linuxfd.inotify,), None),
+)
+
+def compare(before,after,threshold):
+	"""Compare the means of two pyperf result files; returns the number of
+benchmarks slower than threshold (a fraction)."""
+	import pyperf
+	old = {bench.get_name(): bench for bench in pyperf.BenchmarkSuite.load(before).get_benchmarks()}
+	new = {bench.get_name(): bench for bench in pyperf.BenchmarkSuite.load(after).get_benchmarks()}
+	regressions = 0
+	print("{:<32} {:>12} {:>12} {:>8}".format("benchmark","before","after","change"))
+	for name in sorted(set(old) & set(new)):
+		a = old[name].mean()
+		b = new[name].mean()
+		change = (b - a) / a
+		verdict = ""
+		if change > threshold:
+			verdict = "  REGRESSION"
+			regressions += 1
+		print("{:<32} {:>10.3f}us {:>10.3f}us {:>+7.1f}%{}".format(name,a * 1e6,b * 1e6,change * 100,verdict))
+	for name in sorted(set(old) ^ set(new)):
+		print("{:<32} only in {}".format(name,before if name in old else after))
+	return regressions
+
+if __name__ == "__main__":
+	if len(sys.argv) > 1 and sys.argv[1] == "compare":
+		threshold = float(sys.argv[4].rstrip("%")) if len(sys.argv) > 4 else 10.0
+		regressions = compare(sys.argv[2],sys.argv[3],threshold / 100)
+		print("{} regression(s) above {}%".format(regressions,threshold))
+		sys.exit(1 if regressions else 0)
+	import pyperf
+	runner = pyperf.Runner()
+	runner.argparser.add_argument("--select",metavar="REGEX",default="",
+		help="only run benchmarks whose name matches REGEX")
+	args = runner.parse_args()
+	for name,func,funcargs,innerLoops in BENCHMARKS:
+		if not re.search(args.select,name): continue
+		runner.bench_time_func(name,func,*funcargs,inner_loops=innerLoops)
@@ -0,0 +1,79 @@
+#!/usr/bin/env python
+"""This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+linuxfd is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+linuxfd is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+
+Written in Python V3."""
+
+# Syscalls per event: select.epoll + read() per ready fd (Python loop) versus
+# linuxfd.ioEngine with its epoll and io_uring backends. In every round, all
+# eventfds are written to (not counted), then results are collected until
+# every eventfd was read once.
+#
+# usage: python benchmarks/syscalls.py [number of eventfds] [rounds]
+
+import linuxfd,select,sys,time
+
+def pythonEpoll(fds,rounds):
+	"""Reference: the loop of examples/test.py."""
+	epl = select.epoll()
+	byfd = dict()
+	for efd in fds:
+		epl.register(efd.fileno(),select.EPOLLIN)
+		byfd[efd.fileno()] = efd
+	syscalls = 0
+	for r in range(rounds):
+		for efd in fds: efd.write(1)
+		pending = len(fds)
+		while pending:
+			events = epl.poll(-1)
+			syscalls += 1
+			for fd,event in events:
+				byfd[fd].read()
+				syscalls += 1
+				pending -= 1
+	epl.close()
+	return syscalls
+
+def engine(backend):
+	def run(fds,rounds):
+		eng = linuxfd.ioEngine(backend=backend)
+		if backend is not None and eng.backend() != backend: return None
+		if backend is None and eng.backend() != "io_uring": return None
+		for efd in fds: eng.add(efd)
+		for r in range(rounds):
+			for efd in fds: efd.write(1)
+			pending = len(fds)
+			while pending: pending -= len(eng.wait())
+		syscalls = eng.stats()["syscalls"]
+		for efd in fds: eng.remove(efd)
+		eng.close()
+		return syscalls
+	return run
+
+if __name__ == "__main__":
+	n = int(sys.argv[1]) if len(sys.argv) > 1 else 64
+	rounds = int(sys.argv[2]) if len(sys.argv) > 2 else 2000
+	print("{} eventfds, {} rounds ({} events)".format(n,rounds,n * rounds))
+	print("{:<22} {:>14} {:>14}".format("variant","syscalls/event","events/s"))
+	for name,variant in (("select.epoll+read",pythonEpoll),("ioEngine(epoll)",engine("epoll")),("ioEngine(io_uring)",engine(None))):
+		fds = [linuxfd.eventfd(nonBlocking=True) for i in range(n)]
+		t = time.perf_counter()
+		syscalls = variant(fds,rounds)
+		t = time.perf_counter() - t
+		for efd in fds: efd.close()
+		if syscalls is None:
+			print("{:<22} {:>14}".format(name,"unavailable"))
+		else:
+			print("{:<22} {:>14.3f} {:>14.0f}".format(name,syscalls / (n * rounds),n * rounds / t))
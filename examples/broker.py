@@ -0,0 +1,65 @@
+#!/usr/bin/env python
+"""This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+linuxfd is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+linuxfd is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+
+Written in Python V3."""
+
+# Prefork invalidation broadcast: the master watches a directory with inotify
+# and publishes the name of every changed file to its worker processes via a
+# linuxfd.broker. Each worker is forked with its own subscriber, waits on its
+# eventfd in a Reactor and drops the name from its (simulated) cache. The
+# master reports slow workers and their overruns every second.
+#
+# usage: python examples/broker.py directory [workers]
+
+import linuxfd,os,sys,time
+
+def worker(sub):
+	cache = dict()
+	reactor = linuxfd.Reactor()
+	def invalidate(sub,names):
+		for name in names:
+			cache.pop(name,None)
+			print("worker {}: invalidated {}".format(os.getpid(),name.decode()),flush=True)
+	reactor.register(sub,invalidate)
+	try:
+		reactor.run_forever()
+	except OSError: # EPIPE: master closed the broker
+		os._exit(0)
+
+if __name__ == "__main__":
+	directory = sys.argv[1]
+	workers = int(sys.argv[2]) if len(sys.argv) > 2 else 4
+	broker = linuxfd.broker(capacity=4096,messageSize=256,maxSubscribers=workers)
+	pids = list()
+	for i in range(workers):
+		sub = broker.subscribe(nonBlocking=True)
+		pid = os.fork()
+		if pid == 0: worker(sub)
+		sub.close() # the child reads the entry
+		pids.append(pid)
+	inotify = linuxfd.inotify(nonBlocking=True)
+	inotify.add(directory,linuxfd.IN_CLOSE_WRITE | linuxfd.IN_MOVED_TO | linuxfd.IN_DELETE)
+	reactor = linuxfd.Reactor()
+	reactor.register(inotify,lambda fd,events: broker.publishMany(
+		os.fsencode(name) for pathname,name,mask,cookie in events))
+	try:
+		while True:
+			reactor.run_once(1.0)
+			for index,lag,overruns in broker.slowSubscribers():
+				print("master: worker {} lags {} messages, {} lost".format(index,lag,overruns))
+	except KeyboardInterrupt:
+		broker.close()
+		for pid in pids: os.waitpid(pid,0)
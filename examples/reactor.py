@@ -0,0 +1,54 @@
+#!/usr/bin/env python
+"""This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+linuxfd is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+linuxfd is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+
+Written in Python V3."""
+
+# test.py rewritten for linuxfd.Reactor: no fd comparisons, no read() calls
+
+import linuxfd,signal,time
+
+# create special file objects
+efd = linuxfd.eventfd(initval=0,nonBlocking=True)
+sfd = linuxfd.signalfd(signalset={signal.SIGINT},nonBlocking=True)
+tfd = linuxfd.timerfd(rtc=True,nonBlocking=True)
+
+# program timer and mask SIGINT
+tfd.settime(3,3)
+signal.pthread_sigmask(signal.SIG_SETMASK,{signal.SIGINT})
+
+# callbacks receive the object and its already decoded value
+def onEvent(fd,value):
+	print("{0:.3f}: event file received update, exiting...".format(time.time()))
+	reactor.stop()
+
+def onSignal(fd,siginfo):
+	if siginfo["signo"] == signal.SIGINT:
+		print("{0:.3f}: SIGINT received, notifying event file".format(time.time()))
+		efd.write(1)
+
+def onTimer(fd,expirations):
+	print("{0:.3f}: timer has expired".format(time.time()))
+
+# create reactor and register special files
+reactor = linuxfd.Reactor()
+reactor.register(efd,onEvent)
+reactor.register(sfd,onSignal)
+reactor.register(tfd,onTimer)
+
+# start main loop
+print("{0:.3f}: Hello!".format(time.time()))
+reactor.run_forever()
+print("{0:.3f}: Goodbye!".format(time.time()))
@@ -0,0 +1,64 @@
+#!/usr/bin/env python
+"""This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+linuxfd is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+linuxfd is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+
+Written in Python V3."""
+
+# Cross-interpreter eventfd handoff: file descriptors belong to the process, so
+# an eventfd created in the main interpreter is handed to a subinterpreter as a
+# plain integer. The worker interpreter, running in its own thread (and with its
+# own GIL on Python >= 3.12), waits for jobs on one eventfd, squares the counter
+# value and answers on another eventfd; the shared names are plain integers.
+#
+# usage: python examples/subinterpreters.py [jobs]
+
+import linuxfd,sys,threading
+
+try:
+	from concurrent import interpreters # Python >= 3.14
+except ImportError:
+	import _xxsubinterpreters as interpreters # Python 3.10 to 3.12
+
+def runIn(interp,script,**shared):
+	"""Run script in interpreter interp; shared: names of ints/strings/bytes."""
+	if hasattr(interp,"exec"):
+		interp.prepare_main(**shared)
+		interp.exec(script)
+	else:
+		interpreters.run_string(interp,script,shared)
+
+WORKER = """
+from linuxfd import eventfd_c
+for i in range(count):
+	value = eventfd_c.eventfd_read(jobs)
+	eventfd_c.eventfd_write(answers,value * value)
+"""
+
+if __name__ == "__main__":
+	count = int(sys.argv[1]) if len(sys.argv) > 1 else 10
+	jobs = linuxfd.eventfd()
+	answers = linuxfd.eventfd()
+	interp = interpreters.create()
+	worker = threading.Thread(target=runIn,args=(interp,WORKER),
+		kwargs=dict(jobs=jobs.fileno(),answers=answers.fileno(),count=count))
+	worker.start()
+	for value in range(1,count + 1):
+		jobs.write(value)
+		print("   {:>3} squared in subinterpreter: {}".format(value,answers.read()))
+	worker.join()
+	if hasattr(interp,"close"): interp.close()
+	else: interpreters.destroy(interp)
+	jobs.close()
+	answers.close()
@@ -0,0 +1,115 @@
+#!/usr/bin/env python
+"""This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+linuxfd is free software: you can redistribute it and/or modify it under the
+terms of the GNU Lesser General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+linuxfd is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+
+Written in Python V3."""
+
+# Shared objects under thread contention: several threads write to and read
+# from eventfds, add and remove watches of an inotify instance and read
+# events, some of them blocked in read() on blocking descriptors, while the
+# main thread closes all objects once every thread is running. Every thread
+# must keep going until it fails with EBADF; a read must never hit a file
+# descriptor number reused after close(). Meant to be run on a free-threaded
+# interpreter (python3.13t) as well, where the threads truly run in parallel.
+#
+# close() does not interrupt calls in progress: a reader blocked at that time
+# returns once data arrives (the descriptor stays open while it is borrowed),
+# then fails with EBADF on its next call. The main thread feeds such readers
+# via a duplicate of the eventfd and new files in the watched directory.
+#
+# usage: python examples/threads.py [rounds] [threads]
+
+import linuxfd,sys,sysconfig,threading,tempfile,os,errno,time
+
+def eventfdWorker(efd,barrier,exits):
+	barrier.wait()
+	try:
+		while True:
+			efd.write(1)
+			efd.tryRead()
+	except Exception as e:
+		exits.append(e)
+
+def inotifyWorker(ifd,directory,index,barrier,exits):
+	pathname = os.path.join(directory,"f{}".format(index))
+	barrier.wait()
+	try:
+		while True:
+			open(pathname,"w").close()
+			ifd.add(pathname)
+			ifd.tryRead()
+			ifd.remove(pathname)
+			ifd.watchedPaths()
+	except Exception as e:
+		exits.append(e)
+
+def writer(efd,barrier,exits):
+	barrier.wait()
+	try:
+		while True: efd.write(1)
+	except Exception as e:
+		exits.append(e)
+
+def blockingReader(obj,barrier,exits):
+	barrier.wait()
+	try:
+		while True: obj.read()
+	except Exception as e:
+		exits.append(e)
+
+def run(threads):
+	exits = []
+	directory = tempfile.mkdtemp()
+	efd = linuxfd.eventfd(nonBlocking=True)
+	ifd = linuxfd.inotify(nonBlocking=True)
+	befd = linuxfd.eventfd(semaphore=True) # blocking
+	bifd = linuxfd.inotify() # blocking
+	bifd.add(directory,linuxfd.IN_CREATE | linuxfd.IN_CLOSE_WRITE)
+	targets = [(eventfdWorker,(efd,)) for i in range(threads)]
+	targets += [(inotifyWorker,(ifd,directory,i)) for i in range(threads)]
+	targets += [(writer,(befd,))]
+	targets += [(blockingReader,(befd,)) for i in range(threads)]
+	targets += [(blockingReader,(bifd,)) for i in range(threads)]
+	barrier = threading.Barrier(len(targets) + 1)
+	workers = [threading.Thread(target=target,args=args + (barrier,exits),daemon=True) for target,args in targets]
+	for worker in workers: worker.start()
+	barrier.wait() # all threads running
+	time.sleep(0.01)
+	wake = os.dup(befd.fileno())
+	for obj in (efd,ifd,befd,bifd): obj.close()
+	for i in range(1000):
+		if not any(worker.is_alive() for worker in workers): break
+		os.write(wake,threads.to_bytes(8,sys.byteorder))
+		open(os.path.join(directory,"wake{}".format(i)),"w").close()
+		for worker in workers: worker.join(0.01)
+	os.close(wake)
+	failures = [e for e in exits if not isinstance(e,OSError) or e.errno != errno.EBADF]
+	hung = [worker for worker in workers if worker.is_alive()]
+	if hung: failures.append(RuntimeError("{} threads did not exit".format(len(hung))))
+	elif len(exits) != len(workers): failures.append(RuntimeError("{} of {} threads exited with an exception".format(len(exits),len(workers))))
+	for name in os.listdir(directory): os.unlink(os.path.join(directory,name))
+	os.rmdir(directory)
+	return failures
+
+if __name__ == "__main__":
+	rounds = int(sys.argv[1]) if len(sys.argv) > 1 else 50
+	threads = int(sys.argv[2]) if len(sys.argv) > 2 else 4
+	gil = "disabled" if sysconfig.get_config_var("Py_GIL_DISABLED") else "enabled"
+	print("{} rounds, {} threads per object, GIL {}".format(rounds,threads,gil))
+	failures = []
+	for i in range(rounds): failures.extend(run(threads))
+	for failure in failures: print("   unexpected:",repr(failure))
+	print("failures: {}".format(len(failures)))
+	sys.exit(1 if failures else 0)
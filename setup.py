@@ -16,16 +16,30 @@ Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
     along with linuxfd.  If not, see <http://www.gnu.org/licenses/>."""
 
 from distutils.core import setup, Extension
+import os
 
 gccargs = ["-Wall"]#,"-Wextra"]
 
-eventfd_c  = Extension("eventfd_c",  sources=["source/eventfd_c.c"],  extra_compile_args=gccargs)
-signalfd_c = Extension("signalfd_c", sources=["source/signalfd_c.c"], extra_compile_args=gccargs)
-timerfd_c  = Extension("timerfd_c",  sources=["source/timerfd_c.c"],  extra_compile_args=gccargs)
-inotify_c  = Extension("inotify_c",  sources=["source/inotify_c.c"],  extra_compile_args=gccargs)
+# the performance counters (fdowner.stats(), linuxfd.stats()) are compiled out
+# if the environment variable LINUXFD_NO_STATS is set, e.g.
+# LINUXFD_NO_STATS=1 python setup.py install
+macros = [("LINUXFD_NO_STATS","1")] if os.environ.get("LINUXFD_NO_STATS") else []
+
+# a single extension module; every source file implements one of its submodules,
+# the bindings of eventfd/signalfd/timerfd/inotify use the C core liblinuxfd.c
+# (also built as a standalone library by the Makefile)
+linuxfd_c = Extension("linuxfd_c",
+	sources = ["source/liblinuxfd.c","source/linuxfd_c.c","source/eventfd_c.c",
+		"source/signalfd_c.c","source/timerfd_c.c","source/inotify_c.c","source/fanotify_c.c",
+		"source/tailer_c.c","source/sharded_c.c","source/reactor_c.c","source/uring_c.c",
+		"source/executor_c.c","source/broker_c.c"],
+	depends = ["source/liblinuxfd.h","source/linuxfd_c.h","source/xxh64.h"],
+	define_macros = macros,
+	extra_compile_args = gccargs,
+	libraries = ["m","pthread"])
 
 longdescription = """linuxfd provides a Python interface for the Linux system calls 'eventfd',
-'signalfd', 'timerfd' and 'inotify'."""
+'signalfd', 'timerfd', 'inotify' and 'fanotify'."""
 
 setup(
 	name = "linuxfd",
@@ -40,5 +54,5 @@ setup(
 	package_dir = {"linuxfd":"source"},
 	packages = ["linuxfd"],
 	ext_package = "linuxfd",
-	ext_modules = [eventfd_c,signalfd_c,timerfd_c,inotify_c]
+	ext_modules = [linuxfd_c]
 )
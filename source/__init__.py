@@ -16,14 +16,23 @@ along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
 
 Written in Python V3."""
 
-# import helper modules for the syscalls and constants
-import linuxfd.eventfd_c
-import linuxfd.signalfd_c
-import linuxfd.timerfd_c
-import linuxfd.inotify_c
+# import helper modules for the syscalls and constants: submodules of a single
+# extension module (see source/linuxfd_c.c)
+from linuxfd.linuxfd_c import eventfd_c,signalfd_c,timerfd_c,inotify_c,fanotify_c
+from linuxfd.linuxfd_c import tailer_c,sharded_c,reactor_c,uring_c,executor_c,broker_c
+# owner of a file descriptor: closes it once no other thread is using it
+from linuxfd.linuxfd_c import fdowner
+# process-wide performance counters, see stats()
+from linuxfd.linuxfd_c import stats as _processStats
 
 # modules used for raising own OSError 
 import errno,os
+# modules used by watchManager (collections is imported on first use)
+import _thread,time
+# modules used by inotifyReplay
+import struct
+# asyncio, used by the asynchronous read methods, is imported on first use:
+# it dominates the import time of this package otherwise
 
 
 # define constants
@@ -54,6 +63,184 @@ IN_ISDIR         = inotify_c.IN_ISDIR
 IN_Q_OVERFLOW    = inotify_c.IN_Q_OVERFLOW
 IN_UNMOUNT       = inotify_c.IN_UNMOUNT
 
+# native epoll reactor dispatching to callbacks (see help(linuxfd.Reactor))
+Reactor = reactor_c.Reactor
+
+def __getattr__(name):
+	"""Module attribute fallback (PEP 562): provide the remaining constants of the
+extension submodules, e.g. linuxfd.EFD_SEMAPHORE or linuxfd.EPOLLIN, on first
+access instead of copying them at import time."""
+	if name.isupper():
+		for module in (eventfd_c,signalfd_c,timerfd_c,inotify_c,fanotify_c,reactor_c):
+			if hasattr(module,name):
+				value = globals()[name] = getattr(module,name)
+				return value
+	raise AttributeError("module 'linuxfd' has no attribute '{}'".format(name))
+
+
+def stats():
+	"""Return the performance counters aggregated over all file descriptors used by
+linuxfd in this process (including those passed to the *_c functions as plain
+integers). For the structure please refer to eventfd.stats().
+
+Returns:
+   A dictionary, or None if linuxfd was built with LINUXFD_NO_STATS."""
+	return _processStats()
+
+
+def _fdKind(fd):
+	"""Return the kind of an anonymous inode file descriptor ("eventfd",
+"signalfd", "timerfd", "inotify", "fanotify", ...) or None for other files."""
+	target = os.readlink("/proc/self/fd/{}".format(int(fd)))
+	if not target.startswith("anon_inode:"): return None
+	return target[len("anon_inode:"):].strip("[]")
+
+
+def _fdInfo(fd):
+	"""Return /proc/self/fdinfo of a file descriptor as a dictionary mapping keys
+to lists of values (inotify and fanotify list one line per mark)."""
+	info = dict()
+	with open("/proc/self/fdinfo/{}".format(int(fd))) as f:
+		for line in f:
+			words = line.split()
+			if len(words) > 1 and ":" not in words[0] and not words[1].endswith(":"):
+				# "inotify wd:1 ino:71e3b ...": the fields follow the key
+				info.setdefault(words[0],list()).append(" ".join(words[1:]))
+				continue
+			key,sep,value = line.partition(":")
+			if sep: info.setdefault(key.strip(),list()).append(value.strip())
+	return info
+
+
+def _adopt(obj,fd,kind):
+	"""Take over a file descriptor of the given kind in fromFd(): set the
+attributes common to all classes, with the flags recovered via fcntl(). The
+descriptor is left untouched if it is of another kind.
+
+Returns:
+   A dictionary, see _fdInfo().
+
+Raises:
+   OSError.EBADF: fd is not an open file descriptor.
+   OSError.EINVAL: fd is not of the given kind."""
+	obj._fd = None
+	try:
+		fdkind = _fdKind(fd)
+	except FileNotFoundError:
+		raise OSError(errno.EBADF,os.strerror(errno.EBADF))
+	if fdkind != kind:
+		raise OSError(errno.EINVAL,os.strerror(errno.EINVAL))
+	info = _fdInfo(fd)
+	obj._isNonBlocking = not os.get_blocking(fd)
+	obj._isCloseOnExec = not os.get_inheritable(fd)
+	obj._fd = int(fd)
+	return info
+
+
+def sendFds(sock,objects,data=b""):
+	"""Send file descriptors over a Unix domain socket with a single sendmsg().
+
+The descriptors stay open in this process; the receiver gets duplicates
+referring to the same kernel objects, e.g. the same eventfd counter or timer.
+Use recvFds() to receive them.
+
+Args:
+   sock: a socket.socket of family AF_UNIX.
+   objects: an iterable of linuxfd objects (or any objects with a fileno()
+            method) or integer file descriptors; at most 253 (SCM_MAX_FD).
+   data: a bytes-like object sent along with the descriptors.
+
+Raises:
+   OSError.EINVAL: too many descriptors.
+   OSError: sendmsg() failed."""
+	import array,socket
+	fds = array.array("i",(o if isinstance(o,int) else o.fileno() for o in objects))
+	# stream sockets do not deliver ancillary data without payload: the header
+	# (the number of descriptors) is never empty
+	header = struct.pack("=I",len(fds))
+	return sock.sendmsg([header,data],[(socket.SOL_SOCKET,socket.SCM_RIGHTS,fds.tobytes())] if fds else [])
+
+
+def recvFds(sock,maxFds=253,bufsize=65536,closeOnExec=True):
+	"""Receive file descriptors sent by sendFds() and wrap them.
+
+Descriptors of eventfd, signalfd, timerfd, inotify and fanotify instances are
+rebuilt via the fromFd() constructor of their class, others are returned as
+integers. The objects own the received descriptors.
+
+Args:
+   sock: a socket.socket of family AF_UNIX.
+   maxFds: an integer, the maximum number of descriptors.
+   bufsize: an integer, the maximum size of the data.
+   closeOnExec: a boolean; if True (default), the close-on-exec flag of the
+                received descriptors is set.
+
+Returns:
+   A 2-tuple (objects,data): a tuple of objects and integers in the order
+   passed to sendFds(), and the data as bytes object. Both are empty if the
+   peer closed the connection.
+
+Raises:
+   OSError.EMSGSIZE: more than maxFds descriptors or more than bufsize bytes
+                     were sent; the received descriptors are closed.
+   OSError: recvmsg() failed, or a descriptor could not be wrapped (see the
+            fromFd() constructors); all received descriptors are closed."""
+	import array,socket
+	fds = array.array("i")
+	message,ancdata,flags,address = sock.recvmsg(bufsize + 4,socket.CMSG_SPACE(int(maxFds) * fds.itemsize),
+		socket.MSG_CMSG_CLOEXEC if closeOnExec else 0)
+	for level,kind,cmsg in ancdata:
+		if level == socket.SOL_SOCKET and kind == socket.SCM_RIGHTS:
+			fds.frombytes(cmsg[:len(cmsg) - len(cmsg) % fds.itemsize])
+	if not message and not fds: return (),b""
+	if flags & (socket.MSG_CTRUNC | socket.MSG_TRUNC) or len(message) < 4 or struct.unpack_from("=I",message)[0] != len(fds):
+		for fd in fds: os.close(fd)
+		raise OSError(errno.EMSGSIZE,os.strerror(errno.EMSGSIZE))
+	classes = {"eventfd": eventfd,"signalfd": signalfd,"timerfd": timerfd,"inotify": inotify,"fanotify": fanotify}
+	objects = list()
+	try:
+		for fd in fds:
+			cls = classes.get(_fdKind(fd))
+			objects.append(cls.fromFd(fd) if cls is not None else fd)
+	except:
+		# the caller gets none of them: close the objects created so far and
+		# the descriptors not taken over yet
+		for obj in objects:
+			if isinstance(obj,int): os.close(obj)
+			else: obj.close()
+		for fd in fds[len(objects):]: os.close(fd)
+		raise
+	return tuple(objects),message[4:]
+
+
+# sentinel returned by the drain functions of the asynchronous read methods
+_EMPTY = object()
+
+async def _readable(fd,attempt,tryFirst):
+	"""Return the first result of attempt() that is not _EMPTY. attempt() is called
+whenever the running event loop reports fd as readable; if tryFirst is True, it
+is called once before registering fd. The file descriptor is registered with
+the event loop only while waiting, so only one task may wait per descriptor."""
+	if tryFirst:
+		value = attempt()
+		if value is not _EMPTY: return value
+	import asyncio
+	loop = asyncio.get_running_loop()
+	future = loop.create_future()
+	def ready():
+		if future.done(): return
+		try:
+			value = attempt()
+		except Exception as e:
+			future.set_exception(e)
+		else:
+			if value is not _EMPTY: future.set_result(value)
+	loop.add_reader(fd,ready)
+	try:
+		return await future
+	finally:
+		loop.remove_reader(fd)
+
 
 class eventfd:
 	"""Class to manage a file descriptor for event notification.
@@ -63,6 +250,8 @@ Reading and writing this file increments/decrements/resets this counter. As the
 file is pollable via select/poll/epoll it can be used as event notification in
 asynchronous I/O algorithms."""
 	
+	_reactorKind = "eventfd" # read natively by Reactor
+	
 	def __init__(self,initval=0,semaphore=False,nonBlocking=False,closeOnExec=False):
 		"""Constructor: Initialise an event file descriptor. The descriptor itself can be
 retrieved via the fileno() method.
@@ -90,6 +279,8 @@ Raises:
    OSError.ENODEV: could not mount (internal) anonymous inode device.
    OSError.ENOMEM: insufficient memory to create a new eventfd file descriptor."""
 		self._isNonBlocking = bool(nonBlocking)
+		# non-blocking reads return at once: keep the GIL instead of releasing it
+		self._ioFlags = eventfd_c.KEEP_GIL if self._isNonBlocking else 0
 		self._isCloseOnExec = bool(closeOnExec)
 		self._isSemaphore   = bool(semaphore)
 		flags = 0
@@ -103,6 +294,32 @@ Raises:
 			# something went wrong: raise EINVAL (like providing wrong flags)
 			raise OSError(errno.EINVAL,os.strerror(errno.EINVAL))
 		self._fd = eventfd_c.eventfd(initval,flags)
+		self._owner = fdowner(self._fd)
+	
+	
+	@classmethod
+	def fromFd(cls,fd):
+		"""Alternative constructor: Wrap an existing event file descriptor, e.g. one
+received via recvFds() or inherited from a parent process. The object takes
+over the descriptor and closes it. The non-blocking and close-on-exec flags are
+recovered via fcntl(), the semaphore flag via /proc/self/fdinfo (shown by
+recent kernels only, assumed False otherwise).
+
+Args:
+   fd: an integer.
+
+Returns:
+   An eventfd object.
+
+Raises:
+   OSError.EBADF: fd is not an open file descriptor.
+   OSError.EINVAL: fd is not an event file descriptor."""
+		self = cls.__new__(cls)
+		info = _adopt(self,fd,"eventfd")
+		self._ioFlags = eventfd_c.KEEP_GIL if self._isNonBlocking else 0
+		self._isSemaphore = info.get("eventfd-semaphore",["0"])[0] == "1"
+		self._owner = fdowner(self._fd)
+		return self
 	
 	
 	def __del__(self):
@@ -113,7 +330,7 @@ Raises:
 	def close(self):
 		"""Close the file descriptor."""
 		try:    
-			if self._fd: os.close(self._fd)
+			if self._fd: self._owner.close()
 		except: pass
 		self._fd = None
 	
@@ -126,6 +343,24 @@ Returns:
 		return self._fd
 	
 	
+	def stats(self):
+		"""Return the performance counters of this object. They are updated with
+relaxed atomic operations by every call using the file descriptor.
+
+Returns:
+   None if linuxfd was built with LINUXFD_NO_STATS (environment variable set
+   when running setup.py), otherwise a dictionary of the structure
+   {
+      "calls":          int   # wrapper calls using the file descriptor
+      "syscalls":       int   # system calls issued by these calls
+      "eagain":         int   # system calls failed with EAGAIN
+      "bytesRead":      int   # bytes read from the file descriptor
+      "blockedTime":    float # seconds spent in system calls with the GIL released
+      "maxBlockedTime": float # longest of these system calls in seconds
+   }"""
+		return self._owner.stats()
+	
+	
 	def read(self):
 		"""Read the event file and return its value.
 
@@ -142,7 +377,20 @@ Returns:
 Raises:
    OSError.EAGAIN: file is non-blocking and value is zero.
    OSError.EBADF: eventfd file descriptor already closed."""
-		return eventfd_c.eventfd_read(self._fd)
+		return eventfd_c.eventfd_read(self._owner,self._ioFlags)
+	
+	
+	def tryRead(self):
+		"""Like read(), but return None instead of raising OSError.EAGAIN if the
+event file is non-blocking and its counter value is zero. No exception object is
+created in that case, which makes this method the cheaper choice in drain loops.
+
+Returns:
+   An integer or None.
+
+Raises:
+   OSError.EBADF: eventfd file descriptor already closed."""
+		return eventfd_c.eventfd_read(self._owner,self._ioFlags | eventfd_c.TRY_READ)
 	
 	
 	def write(self,value=1):
@@ -163,7 +411,28 @@ Raises:
 		except:
 			# something went wrong: raise EINVAL (like providing wrong flags)
 			raise OSError(errno.EINVAL,os.strerror(errno.EINVAL))
-		eventfd_c.eventfd_write(self._fd,value)
+		eventfd_c.eventfd_write(self._owner,value,self._ioFlags)
+	
+	
+	async def aread(self):
+		"""Coroutine: wait until the counter is non-zero, then read it.
+
+The counter is drained by a single C call: its value is returned and reset to
+zero. In contrast to read(), a semaphore is decreased to zero as well and its
+former value is returned. Must be awaited within a running asyncio event loop;
+only one task may wait per event file at a time.
+
+Returns:
+   An integer.
+
+Raises:
+   OSError.EBADF: eventfd file descriptor already closed."""
+		return await _readable(self._fd,self._drain,True)
+	
+	
+	def _drain(self):
+		"""Read the counter until it is zero; return the sum or _EMPTY."""
+		return eventfd_c.eventfd_drain(self._owner,self._isNonBlocking) or _EMPTY
 	
 	
 	def isSemaphore(self):
@@ -199,6 +468,8 @@ caller and becomes readable if triggered. Reading this file returns the pending
 signals for the process. As the file is pollable via select/poll/epoll it can be
 used as an alternative to the usual signal handlers."""
 	
+	_reactorKind = "signalfd" # read natively by Reactor
+	
 	def __init__(self,signalset,nonBlocking=False,closeOnExec=False):
 		"""Constructor: Initialise a signal file descriptor. The descriptor itself can be
 retrieved via the fileno() method.
@@ -224,6 +495,7 @@ Raises:
    OSError.ENODEV: could not mount (internal) anonymous inode device.
    OSError.ENOMEM: insufficient memory to create a new singalfd file descriptor."""
 		self._isNonBlocking = bool(nonBlocking)
+		self._ioFlags = signalfd_c.KEEP_GIL if self._isNonBlocking else 0
 		self._isCloseOnExec = bool(closeOnExec)
 		flags = 0
 		if self._isNonBlocking: flags |= signalfd_c.SFD_NONBLOCK
@@ -235,6 +507,33 @@ Raises:
 			# something went wrong: raise EINVAL (like providing wrong flags)
 			raise OSError(errno.EINVAL,os.strerror(errno.EINVAL))
 		self._fd = signalfd_c.signalfd(-1,self._signalset,flags)
+		self._owner = fdowner(self._fd)
+	
+	
+	@classmethod
+	def fromFd(cls,fd):
+		"""Alternative constructor: Wrap an existing signal file descriptor, e.g. one
+received via recvFds() or inherited from a parent process. The object takes
+over the descriptor and closes it. The flags are recovered via fcntl(), the
+signal set via /proc/self/fdinfo. The signals still have to be blocked in the
+receiving process.
+
+Args:
+   fd: an integer.
+
+Returns:
+   A signalfd object.
+
+Raises:
+   OSError.EBADF: fd is not an open file descriptor.
+   OSError.EINVAL: fd is not a signal file descriptor."""
+		self = cls.__new__(cls)
+		info = _adopt(self,fd,"signalfd")
+		self._ioFlags = signalfd_c.KEEP_GIL if self._isNonBlocking else 0
+		sigmask = int(info["sigmask"][0],16)
+		self._signalset = tuple(signo for signo in range(1,65) if sigmask & (1 << (signo - 1)))
+		self._owner = fdowner(self._fd)
+		return self
 	
 	
 	def __del__(self):
@@ -245,7 +544,7 @@ Raises:
 	def close(self):
 		"""Close the file descriptor."""
 		try:    
-			if self._fd: os.close(self._fd)
+			if self._fd: self._owner.close()
 		except: pass
 		self._fd = None
 	
@@ -258,6 +557,14 @@ Returns:
 		return self._fd
 	
 	
+	def stats(self):
+		"""Return the performance counters of this object, see eventfd.stats().
+
+Returns:
+   A dictionary, or None if the counters were compiled out."""
+		return self._owner.stats()
+	
+	
 	def modify(self,signalset,nonBlocking,closeOnExec):
 		"""Modify the signalset guarded by this signal file descriptor. The descriptor
 itself can be retrieved via the fileno() method. For details on the arguments,
@@ -272,18 +579,22 @@ Raises:
    OSError.EINVAL: invalid signalset.
    OSError.ENODEV: could not mount (internal) anonymous inode device.
    OSError.EBADF: signalfd file descriptor already closed."""
-		self._isNonBlocking = bool(nonBlocking)
-		self._isCloseOnExec = bool(closeOnExec)
-		flags = 0
-		if self._isNonBlocking: flags |= signalfd_c.SFD_NONBLOCK
-		if self._isCloseOnExec: flags |= signalfd_c.SFD_CLOEXEC
 		try:
 			# evaluate signal set
-			self._signalset = tuple([int(i) for i in set(signalset)])
+			signalset = tuple([int(i) for i in set(signalset)])
 		except:
 			# something went wrong: raise EINVAL (like providing wrong flags)
 			raise OSError(errno.EINVAL,os.strerror(errno.EINVAL))
-		self._fd = signalfd_c.signalfd(self._fd,self._signalset,flags)
+		if self._fd is None:
+			raise OSError(errno.EBADF,os.strerror(errno.EBADF))
+		# signalfd() ignores the flags of an existing descriptor: set them here
+		self._fd = signalfd_c.signalfd(self._fd,signalset,0)
+		self._signalset = signalset
+		os.set_blocking(self._fd,not nonBlocking)
+		os.set_inheritable(self._fd,not closeOnExec)
+		self._isNonBlocking = not os.get_blocking(self._fd)
+		self._ioFlags = signalfd_c.KEEP_GIL if self._isNonBlocking else 0
+		self._isCloseOnExec = not os.get_inheritable(self._fd)
 	
 	
 	def read(self):
@@ -321,7 +632,40 @@ Raises:
    OSError.EWOULDBLOCK: no pending signals.
    OSError.EINTR: read() call interrupted by a signal.
    OSError.EBADF: signalfd file descriptor already closed."""
-		return signalfd_c.signalfd_read(self._fd)
+		return signalfd_c.signalfd_read(self._owner,self._ioFlags)
+	
+	
+	def tryRead(self):
+		"""Like read(), but return None instead of raising OSError.EAGAIN if the
+signal file is non-blocking and no signals are pending. No exception object is
+created in that case, which makes this method the cheaper choice in drain loops.
+
+Returns:
+   A dictionary (please refer to read()) or None.
+
+Raises:
+   OSError.EINTR: read() call interrupted by a signal.
+   OSError.EBADF: signalfd file descriptor already closed."""
+		return signalfd_c.signalfd_read(self._owner,self._ioFlags | signalfd_c.TRY_READ)
+	
+	
+	async def aread(self,count=16):
+		"""Coroutine: wait for signals and consume up to count pending signals with a
+single read() call. Must be awaited within a running asyncio event loop; only
+one task may wait per signal file at a time. Blocking signal files are read
+only after the event loop reported them as readable.
+
+Args:
+   count: an integer in range [1;64].
+
+Returns:
+   A tuple of dictionaries, please refer to read().
+
+Raises:
+   OSError.EBADF: signalfd file descriptor already closed."""
+		def drain():
+			return tuple(signalfd_c.signalfd_read_many(self._owner,count,self._ioFlags)) or _EMPTY
+		return await _readable(self._fd,drain,self._isNonBlocking)
 	
 	
 	def signals(self):
@@ -356,6 +700,8 @@ A timer file descriptor is created, which represents a timer and becomes
 readable if this timer expires. Reading this file returns the number of
 expirations that have occurred since the last read operation."""
 	
+	_reactorKind = "timerfd" # read natively by Reactor
+	
 	def __init__(self,rtc=False,mon_raw=False,nonBlocking=False,closeOnExec=False):
 		"""Constructor: Initialise a timer file descriptor. The descriptor itself can be
 retrieved via the fileno() method.
@@ -383,6 +729,7 @@ Raises:
    OSError.ENOMEM: insufficient memory to create a new singalfd file descriptor."""
 		self._isRTC         = bool(rtc)
 		self._isNonBlocking = bool(nonBlocking)
+		self._ioFlags = timerfd_c.KEEP_GIL if self._isNonBlocking else 0
 		self._isCloseOnExec = bool(closeOnExec)
 		if self._isRTC:
 			clockid = timerfd_c.CLOCK_REALTIME
@@ -394,6 +741,32 @@ Raises:
 		if self._isNonBlocking: flags |= timerfd_c.TFD_NONBLOCK
 		if self._isCloseOnExec: flags |= timerfd_c.TFD_CLOEXEC
 		self._fd = timerfd_c.timerfd_create(clockid,flags)
+		self._owner = fdowner(self._fd)
+	
+	
+	@classmethod
+	def fromFd(cls,fd):
+		"""Alternative constructor: Wrap an existing timer file descriptor, e.g. one
+received via recvFds() or inherited from a parent process. The object takes
+over the descriptor and closes it; the timer keeps running. The flags are
+recovered via fcntl(), the clock via /proc/self/fdinfo.
+
+Args:
+   fd: an integer.
+
+Returns:
+   A timerfd object.
+
+Raises:
+   OSError.EBADF: fd is not an open file descriptor.
+   OSError.EINVAL: fd is not a timer file descriptor."""
+		self = cls.__new__(cls)
+		info = _adopt(self,fd,"timerfd")
+		self._ioFlags = timerfd_c.KEEP_GIL if self._isNonBlocking else 0
+		clockid = int(info.get("clockid",[str(timerfd_c.CLOCK_MONOTONIC)])[0])
+		self._isRTC = clockid == timerfd_c.CLOCK_REALTIME
+		self._owner = fdowner(self._fd)
+		return self
 	
 	
 	def __del__(self):
@@ -404,7 +777,7 @@ Raises:
 	def close(self):
 		"""Close the file descriptor."""
 		try:    
-			if self._fd: os.close(self._fd)
+			if self._fd: self._owner.close()
 		except: pass
 		self._fd = None
 	
@@ -417,6 +790,14 @@ Returns:
 		return self._fd
 	
 	
+	def stats(self):
+		"""Return the performance counters of this object, see eventfd.stats().
+
+Returns:
+   A dictionary, or None if the counters were compiled out."""
+		return self._owner.stats()
+	
+	
 	def gettime(self):
 		"""Return the current timer setting.
 
@@ -430,7 +811,7 @@ Returns:
 
 Raises:
    OSError.EBADF: timerfd file descriptor already closed."""
-		return timerfd_c.timerfd_gettime(self._fd)
+		return timerfd_c.timerfd_gettime(self._owner)
 	
 	
 	def settime(self,value=0,interval=0,absolute=False):
@@ -458,7 +839,7 @@ Raises:
 			flags = timerfd_c.TFD_TIMER_ABSTIME
 		else:
 			flags = 0
-		return timerfd_c.timerfd_settime(self._fd,flags,value,interval)
+		return timerfd_c.timerfd_settime(self._owner,flags,value,interval)
 
 	def settime_ns(self,value=0,interval=0):
 		"""Start or stop the timer using nanosecond values/intervals.
@@ -475,7 +856,7 @@ Returns:
 Raises:
    OSError.EINVAL: invalid timer values specified.
    OSError.EBADF: timerfd file descriptor already closed."""
-		return timerfd_c.timerfd_settime_ns(self._fd,0,value,interval)
+		return timerfd_c.timerfd_settime_ns(self._owner,0,value,interval)
 	
 	def read(self):
 		"""Read the timer file and return an integer denoting the number of
@@ -487,7 +868,37 @@ error EAGAIN if in non-blocking mode.
 Raises:
    OSError.EAGAIN: timer has not yet expired.
    OSError.EBADF: timerfd file descriptor already closed."""
-		return timerfd_c.timerfd_read(self._fd)
+		return timerfd_c.timerfd_read(self._owner,self._ioFlags)
+	
+	
+	def tryRead(self):
+		"""Like read(), but return None instead of raising OSError.EAGAIN if the
+timer file is non-blocking and the timer has not expired yet. No exception object
+is created in that case, which makes this method the cheaper choice in polling
+loops.
+
+Returns:
+   An integer or None.
+
+Raises:
+   OSError.EBADF: timerfd file descriptor already closed."""
+		return timerfd_c.timerfd_read(self._owner,self._ioFlags | timerfd_c.TRY_READ)
+	
+	
+	async def wait(self):
+		"""Coroutine: wait until the timer expired and return the number of
+expirations, like read(). Must be awaited within a running asyncio event loop;
+only one task may wait per timer at a time.
+
+Returns:
+   An integer.
+
+Raises:
+   OSError.EBADF: timerfd file descriptor already closed."""
+		# a timerfd yields an 8 byte counter like an eventfd, so it is drained alike
+		def drain():
+			return eventfd_c.eventfd_drain(self._owner,self._isNonBlocking) or _EMPTY
+		return await _readable(self._fd,drain,True)
 	
 	
 	def isRTC(self):
@@ -523,6 +934,8 @@ An inotify file descriptor is created, which represents an inotify instance.
 Files and directories can be added in order to monitor them. The inotify file
 descriptor becomes readable when such a file alternation event occurs."""
 	
+	_reactorKind = "inotify" # read natively by ioEngine
+	
 	def __init__(self,nonBlocking=False,closeOnExec=False):
 		"""Constructor: Initialise an inotify file descriptor. The descriptor itself can be
 retrieved via the fileno() method.
@@ -544,13 +957,69 @@ Raises:
    OSError.ENFILE: system-wide limit on total number of open files reached.
    OSError.ENOMEM: insufficient kernel memory available."""
 		self._isNonBlocking = bool(nonBlocking)
+		self._ioFlags = inotify_c.KEEP_GIL if self._isNonBlocking else 0
 		self._isCloseOnExec = bool(closeOnExec)
-		self._wd = dict() # mapping pathnames to watch descriptors
-		self._name = dict() # mapping watch descriptors to pathnames
+		self._initState()
 		flags = 0
 		if self._isNonBlocking: flags |= inotify_c.IN_NONBLOCK
 		if self._isCloseOnExec: flags |= inotify_c.IN_CLOEXEC
 		self._fd = inotify_c.inotify_init(flags)
+		self._owner = fdowner(self._fd)
+	
+	
+	def _initState(self):
+		"""Initialise the attributes independent of the file descriptor."""
+		self._wd = dict() # mapping pathnames to watch descriptors
+		self._name = dict() # mapping watch descriptors to pathnames
+		self._lock = _thread.allocate_lock() # guards _wd and _name, see add()
+		self._hashcache = None # content hashes, see suppressUnchanged()
+		self._stats = inotify_c.watchstats() # per-watch statistics, see watchStats()
+		self._journal = None # event journal, see record()
+		self._buffer = inotify_c.readbuffer() # adaptive read buffer, see read()
+	
+	
+	@classmethod
+	def fromFd(cls,fd,pathnames=()):
+		"""Alternative constructor: Wrap an existing inotify file descriptor, e.g. one
+received via recvFds() or inherited from a parent process. The object takes
+over the descriptor and closes it. The flags are recovered via fcntl().
+
+The kernel keeps the watches, but not their pathnames: the events of watches
+not given in pathnames are returned with an empty pathname. The watch of each
+given pathname is looked up by its inode in /proc/self/fdinfo.
+
+Args:
+   fd: an integer.
+   pathnames: an iterable of strings, pathnames watched by the instance.
+
+Returns:
+   An inotify object.
+
+Raises:
+   OSError.EBADF: fd is not an open file descriptor.
+   OSError.EINVAL: fd is not an inotify file descriptor.
+   OSError.ENOENT: a pathname does not exist or is not watched."""
+		self = cls.__new__(cls)
+		info = _adopt(self,fd,"inotify")
+		self._ioFlags = inotify_c.KEEP_GIL if self._isNonBlocking else 0
+		self._initState()
+		# lines "wd:1 ino:71e3b sdev:fe00000 mask:fff ...", sdev in kernel encoding
+		watches = dict()
+		for line in info.get("inotify",()):
+			fields = dict(field.split(":",1) for field in line.split() if ":" in field)
+			watches[(int(fields["ino"],16),int(fields["sdev"],16))] = int(fields["wd"])
+		try:
+			for pathname in pathnames:
+				st = os.stat(pathname)
+				key = (st.st_ino,(os.major(st.st_dev) << 20) | os.minor(st.st_dev))
+				if key not in watches: raise OSError(errno.ENOENT,os.strerror(errno.ENOENT),pathname)
+				self._wd[pathname] = watches[key]
+				self._name[watches[key]] = pathname
+		except:
+			self._fd = None # leave the descriptor to the caller
+			raise
+		self._owner = fdowner(self._fd)
+		return self
 	
 	
 	def __del__(self):
@@ -561,7 +1030,7 @@ Raises:
 	def close(self):
 		"""Close the file descriptor."""
 		try:    
-			if self._fd: os.close(self._fd)
+			if self._fd: self._owner.close()
 		except: pass
 		self._fd = None
 
@@ -575,6 +1044,14 @@ Returns:
 		return self._fd
 	
 	
+	def stats(self):
+		"""Return the performance counters of this object, see eventfd.stats().
+
+Returns:
+   A dictionary, or None if the counters were compiled out."""
+		return self._owner.stats()
+	
+	
 	def add(self,pathname,mask=IN_ALL_EVENTS,replace=True):
 		"""Add another file or directory to this inotify instance in order to monitor it.
 
@@ -632,9 +1109,14 @@ Raises:
 			mask = mask & ~inotify_c.IN_MASK_ADD # make sure MASK_ADD is not set
 		else:
 			mask = mask | inotify_c.IN_MASK_ADD # make sure MASK_ADD is set
-		wd = inotify_c.inotify_add_watch(self._fd,pathname,mask)
-		self._wd[pathname] = wd
-		self._name[wd] = pathname
+		# the lock keeps both mappings consistent if several threads add watches;
+		# it is held across the syscall, as the kernel returns the same watch
+		# descriptor for different pathnames of the same inode (hardlinks)
+		with self._lock:
+			wd = inotify_c.inotify_add_watch(self._owner,pathname,mask)
+			self._wd[pathname] = wd
+			self._name[wd] = pathname
+			if self._journal is not None: self._journal.watch(wd,os.fsdecode(pathname))
 	
 	
 	def remove(self,pathname):
@@ -642,25 +1124,123 @@ Raises:
 Raises:
    OSError.EBADF: inotify file descriptor already closed.
 """
-		wd = self._wd[pathname]
-		inotify_c.inotify_rm_watch(self._fd,wd)
-		del self._wd[pathname]
-		del self._name[wd]
-	
-	
-	def read(self,buffersize=1024):
+		with self._lock:
+			wd = self._wd[pathname]
+			inotify_c.inotify_rm_watch(self._owner,wd)
+			del self._wd[pathname]
+			del self._name[wd]
+			self._stats.forget(wd)
+
+
+	def forget(self,pathname):
+		"""Drop a pathname whose watch the kernel has removed already, as reported by an
+IN_IGNORED event (e.g. the directory was deleted or its filesystem unmounted).
+In contrast to remove(), no system call is made. Unknown pathnames are ignored.
+
+Args:
+   pathname: a string."""
+		with self._lock:
+			wd = self._wd.pop(pathname,None)
+			if wd is not None:
+				self._name.pop(wd,None)
+				self._stats.forget(wd)
+
+
+	def addMany(self,pathnames,mask=IN_ALL_EVENTS,replace=True):
+		"""Add several files or directories to this inotify instance in one call.
+
+All watches are added with the GIL released just once. A failing pathname does
+not abort the batch; its error is reported in the returned dictionary instead.
+For details on mask and replace, please refer to add().
+
+Args:
+   pathnames: an iterable of strings.
+   mask: an integer, a bitmask describing file alternation events; defaults to
+         IN_ALL_EVENTS, i.e. watch for all file events.
+   replace: a boolean; see add().
+
+Returns:
+   A dictionary mapping each failed pathname to an OSError instance (e.g.
+   ENOENT, EACCES or ENOSPC, see add()); empty if all watches were added.
+
+Raises:
+   OSError.EBADF: inotify file descriptor already closed."""
+		if bool(replace):
+			mask = mask & ~inotify_c.IN_MASK_ADD # make sure MASK_ADD is not set
+		else:
+			mask = mask | inotify_c.IN_MASK_ADD # make sure MASK_ADD is set
+		pathnames = tuple(pathnames)
+		errors = dict()
+		added = list()
+		with self._lock:
+			results = inotify_c.inotify_add_watches(self._owner,pathnames,mask)
+			for pathname,wd in zip(pathnames,results):
+				if wd < 0:
+					errors[pathname] = OSError(-wd,os.strerror(-wd),pathname)
+				else:
+					added.append((pathname,wd))
+			if errors and all(e.errno == errno.EBADF for e in errors.values()):
+				raise OSError(errno.EBADF,os.strerror(errno.EBADF))
+			self._wd.update(added)
+			self._name.update((wd,pathname) for pathname,wd in added)
+			if self._journal is not None:
+				for pathname,wd in added: self._journal.watch(wd,os.fsdecode(pathname))
+		return errors
+
+
+	def removeMany(self,pathnames):
+		"""Remove several files or directories from this inotify instance in one call.
+
+Like addMany(), failures do not abort the batch. Pathnames not watched by this
+instance are reported with error EINVAL.
+
+Args:
+   pathnames: an iterable of strings.
+
+Returns:
+   A dictionary mapping each failed pathname to an OSError instance; empty if
+   all watches were removed.
+
+Raises:
+   OSError.EBADF: inotify file descriptor already closed."""
+		errors = dict()
+		watched = list()
+		with self._lock:
+			for pathname in pathnames:
+				try:
+					watched.append((pathname,self._wd[pathname]))
+				except KeyError:
+					errors[pathname] = OSError(errno.EINVAL,os.strerror(errno.EINVAL),pathname)
+			results = inotify_c.inotify_rm_watches(self._owner,[wd for pathname,wd in watched])
+			if watched and all(result == -errno.EBADF for result in results):
+				raise OSError(errno.EBADF,os.strerror(errno.EBADF))
+			for (pathname,wd),result in zip(watched,results):
+				if result < 0:
+					errors[pathname] = OSError(-result,os.strerror(-result),pathname)
+				else:
+					del self._wd[pathname]
+					del self._name[wd]
+					self._stats.forget(wd)
+		return errors
+
+
+	def read(self,buffersize=None):
 		"""Read the inotify file and return a tuple of events.
 
 If there are no inotify events, this method will either block or fail with error
 EAGAIN if in non-blocking mode.
 
 Args:
-   buffersize: an integer, defining the maximum read buffer size in bytes;
-               default = 1024 bytes.
+   buffersize: an integer, defining the maximum read buffer size in bytes; if
+               None (default), a reused buffer is sized adaptively between
+               4 KiB and 1 MiB, according to recent batch sizes and the number
+               of bytes still queued in the kernel (see readBufferInfo()).
 
 Returns:
    A tuple of 4-tuples (pathname,name,mask,cookie):
-    - "pathname" is the name string previously registered using add();
+    - "pathname" is the name string previously registered using add(); it is
+      empty for events not related to a watch (IN_Q_OVERFLOW) or related to a
+      watch already removed (IN_IGNORED after remove());
     - if "pathname" is a directory, the string "name" refers to a file below
       "pathname"; empty string otherwise;
     - "mask" is an integer bitmask describing the occurred events;
@@ -674,65 +1254,1936 @@ Raises:
    OSError.EBADF: inotify file descriptor already closed.
    OSError.EINVAL: buffer size too small.
    OSError.ENOMEM: insufficient memory for buffer allocation."""
-		eventlist = inotify_c.inotify_read(self._fd,int(buffersize))
-		result = list()
-		for wd,mask,cookie,name in eventlist:
-			result.append((self._name[wd],name,mask,cookie))
-		return tuple(result)
+		return self._read(buffersize,0)
 	
 	
-	def watchedPaths(self):
-		"""Return a tuple of all pathnames watched by this inotify instance.
+	def tryRead(self,buffersize=None):
+		"""Like read(), but return None instead of raising OSError.EAGAIN if the
+inotify instance is non-blocking and no events occurred. No exception object is
+created in that case, which makes this method the cheaper choice in drain loops.
+
+Args:
+   buffersize: please refer to read().
 
 Returns:
-   A tuple of strings."""
-		return tuple(self._wd.keys())
+   A tuple of 4-tuples (pathname,name,mask,cookie) or None; please refer to
+   read().
+
+Raises:
+   ValueError,TypeError: buffersize is not integer-castable.
+   OSError.EBADF: inotify file descriptor already closed.
+   OSError.EINVAL: buffer size too small.
+   OSError.ENOMEM: insufficient memory for buffer allocation."""
+		return self._read(buffersize,inotify_c.TRY_READ)
 	
 	
-	def isNonBlocking(self):
-		"""Return True if this event file does not block when no data is available.
+	def _read(self,buffersize,flags):
+		"""Read and map events; None if flags contain TRY_READ and no events queued."""
+		if buffersize is None:
+			buffersize = self._buffer
+		else:
+			buffersize = int(buffersize)
+		eventlist = inotify_c.inotify_read(self._owner,buffersize,self._stats,self._journal,self._ioFlags | flags)
+		if eventlist is None:
+			return None
+		result = list()
+		for wd,mask,cookie,name in eventlist:
+			result.append((self._name.get(wd,""),name,mask,cookie))
+		if self._hashcache is not None:
+			return self._suppressUnchanged(result)
+		return tuple(result)
+
+
+	async def aread(self,buffersize=None):
+		"""Coroutine: wait for inotify events and read them with a single read() call.
+Must be awaited within a running asyncio event loop; only one task may wait per
+inotify instance at a time. Blocking instances are read only after the event
+loop reported them as readable.
+
+Args:
+   buffersize: please refer to read().
 
 Returns:
-   A boolean."""
-		return self._isNonBlocking
+   A tuple of 4-tuples (pathname,name,mask,cookie), please refer to read().
+
+Raises:
+   OSError: please refer to read()."""
+		def drain():
+			result = self._read(buffersize,inotify_c.TRY_READ)
+			return _EMPTY if result is None else result
+		return await _readable(self._fd,drain,self._isNonBlocking)
 	
 	
-	def isCloseOnExec(self):
-		"""Return True if the close-on-exec flag is set.
+	async def events(self,buffersize=None):
+		"""Asynchronous iterator over inotify events: "async for event in ino.events()".
+Batches are read by aread(); the inotify file descriptor is registered with the
+event loop only while the iterator waits for the next batch.
 
-Returns:
-   A boolean."""
-		return self._isCloseOnExec
+Args:
+   buffersize: please refer to read().
+
+Yields:
+   4-tuples (pathname,name,mask,cookie), please refer to read()."""
+		while True:
+			for event in await self.aread(buffersize):
+				yield event
 	
 	
-	def eventStrings(self,mask):
-		"""Return a tuple of event flags identifier strings set in given mask.
+	def suppressUnchanged(self,enabled=True,threads=4,maxEntries=65536):
+		"""Enable or disable suppression of IN_CLOSE_WRITE events for files whose
+contents did not change.
+
+If enabled, read() hashes every file reported by an IN_CLOSE_WRITE event (using
+the fast non-cryptographic hash XXH64 on a pool of native threads) and drops the
+event if the hash equals the one recorded for the same inode by the previous
+IN_CLOSE_WRITE event. Files are always reported on their first IN_CLOSE_WRITE
+and if they could not be read. Recorded hashes take 24 bytes per inode; if
+maxEntries hashes are recorded, the hashes of inodes not reported recently are
+discarded first. Note that read() returns an empty tuple if all events of a
+batch were suppressed.
 
 Args:
-   mask: an integer, a bitmask describing file alternation events.
+   enabled: a boolean; if False, recorded hashes are discarded.
+   threads: an integer, the number of hashing threads in addition to the
+            thread calling read().
+   maxEntries: an integer, the maximum number of recorded hashes; 0 means no
+               limit. Only used when suppression is enabled first."""
+		if bool(enabled):
+			if self._hashcache is None: self._hashcache = inotify_c.hashcache(int(threads),int(maxEntries))
+		else:
+			self._hashcache = None
+
+
+	def _suppressUnchanged(self,events):
+		"""Drop IN_CLOSE_WRITE events of files with unchanged contents from a list of
+event tuples; return the remaining events as tuple."""
+		# without a pathname (unknown wd) there is nothing to compare with
+		indices = [i for i,event in enumerate(events) if event[2] == IN_CLOSE_WRITE and event[0]]
+		if not indices: return tuple(events)
+		# a directly watched file reports itself as pathname with an empty name
+		paths = [os.path.join(events[i][0],events[i][1]) if events[i][1] else events[i][0] for i in indices]
+		for i,changed in zip(indices,self._hashcache.filter(paths)):
+			if not changed: events[i] = None
+		return tuple(event for event in events if event is not None)
+
+
+	def readInto(self,buffer):
+		"""Read the inotify file into a caller-supplied buffer and return the number of
+bytes read. In contrast to read(), no event tuples are created; use rawEvents()
+and decodeEvent() to process the raw struct inotify_event records.
+
+If there are no inotify events, this method will either block or fail with error
+EAGAIN if in non-blocking mode.
+
+Args:
+   buffer: a writable object supporting the buffer protocol (e.g. a bytearray
+           or an mmap), aligned like struct inotify_event (4 bytes).
 
 Returns:
-   A tuple of strings."""
-		retval = list()
-		if mask & inotify_c.IN_ACCESS: retval.append("IN_ACCESS")
-		if mask & inotify_c.IN_ATTRIB: retval.append("IN_ATTRIB")
-		if mask & inotify_c.IN_CLOSE_WRITE: retval.append("IN_CLOSE_WRITE")
-		if mask & inotify_c.IN_CLOSE_NOWRITE: retval.append("IN_CLOSE_NOWRITE")
-		if mask & inotify_c.IN_CREATE: retval.append("IN_CREATE")
-		if mask & inotify_c.IN_DELETE: retval.append("IN_DELETE")
-		if mask & inotify_c.IN_DELETE_SELF: retval.append("IN_DELETE_SELF")
-		if mask & inotify_c.IN_MODIFY: retval.append("IN_MODIFY")
-		if mask & inotify_c.IN_MOVE_SELF: retval.append("IN_MOVE_SELF")
-		if mask & inotify_c.IN_MOVED_FROM: retval.append("IN_MOVED_FROM")
-		if mask & inotify_c.IN_MOVED_TO: retval.append("IN_MOVED_TO")
-		if mask & inotify_c.IN_OPEN: retval.append("IN_OPEN")
-		if mask & inotify_c.IN_DONT_FOLLOW: retval.append("IN_DONT_FOLLOW")
-		if mask & inotify_c.IN_EXCL_UNLINK: retval.append("IN_EXCL_UNLINK")
-		if mask & inotify_c.IN_ONESHOT: retval.append("IN_ONESHOT")
-		if mask & inotify_c.IN_ONLYDIR: retval.append("IN_ONLYDIR")
-		if mask & inotify_c.IN_IGNORED: retval.append("IN_IGNORED")
-		if mask & inotify_c.IN_ISDIR: retval.append("IN_ISDIR")
-		if mask & inotify_c.IN_Q_OVERFLOW: retval.append("IN_Q_OVERFLOW")
-		if mask & inotify_c.IN_UNMOUNT: retval.append("IN_UNMOUNT")
-		return tuple(retval)
+   An integer.
+
+Raises:
+   TypeError: buffer is not writable.
+   OSError.EAGAIN: no inotify events occurred.
+   OSError.EBADF: inotify file descriptor already closed.
+   OSError.EINVAL: buffer too small or not properly aligned."""
+		return inotify_c.inotify_read_into(self._owner,buffer,self._ioFlags)
+
+
+	def rawEvents(self,buffer,length=-1):
+		"""Return an iterator over the struct inotify_event records in a buffer filled
+by readInto(). Each record is yielded as a 2-tuple (offset,size) of integers,
+so memoryview(buffer)[offset:offset+size] covers exactly one event.
+
+Args:
+   buffer: an object supporting the buffer protocol.
+   length: an integer, the number of valid bytes in buffer (i.e. the value
+           returned by readInto()); defaults to the whole buffer.
+
+Returns:
+   An iterator of 2-tuples (offset,size)."""
+		return inotify_c.inotify_events(buffer,length)
 
+
+	def decodeEvent(self,buffer,offset):
+		"""Decode the struct inotify_event record at the given offset of a buffer.
+
+Args:
+   buffer: an object supporting the buffer protocol.
+   offset: an integer, as yielded by rawEvents().
+
+Returns:
+   A 4-tuple (pathname,name,mask,cookie) like the ones returned by read().
+
+Raises:
+   OSError.EINVAL: offset does not point to a complete event record."""
+		wd,mask,cookie,name = inotify_c.inotify_event(buffer,offset)
+		return (self._name.get(wd,""),name,mask,cookie)
+
+
+	def record(self,pathname):
+		"""Start recording all events read by read() to a binary journal file.
+
+The raw event buffers are appended to the journal directly by the C read path,
+together with a monotonic timestamp (nanoseconds) per buffer. The pathnames of
+all watches, current and future ones, are recorded as well, so that the journal
+can be replayed with inotifyReplay without access to the watched files. Records
+are buffered in memory and written in blocks of 64 KiB; write errors do not
+affect read(), but are counted by the journal: all records of a block that
+cannot be written completely are lost, and the block is cut off again so that
+the journal stays readable (if that fails, recording stops). A running
+recording is stopped first. If the journal file exists, the new records are
+appended, starting with a marker so that inotifyReplay does not wait for the
+time between the recordings.
+
+Args:
+   pathname: a string, the journal file.
+
+Raises:
+   OSError: journal file could not be opened or written."""
+		self.stopRecording()
+		journal = inotify_c.journal(pathname)
+		with self._lock:
+			for wd,name in self._name.items(): journal.watch(wd,os.fsdecode(name))
+			self._journal = journal
+
+
+	def stopRecording(self):
+		"""Stop recording events and flush the journal to disk.
+
+Returns:
+   An integer, the number of journal records lost due to write errors; zero if
+   there was no recording.
+
+Raises:
+   OSError: journal file could not be written."""
+		journal,self._journal = self._journal,None
+		if journal is None: return 0
+		journal.close()
+		return journal.dropped()
+
+
+	def readBufferInfo(self):
+		"""Return the sizing state of the adaptive read buffer used by read().
+
+Returns:
+   A dictionary of the structure
+   {
+      "size":      int   # current buffer size in bytes
+      "minimum":   int   # lower size limit
+      "maximum":   int   # upper size limit
+      "highWater": int   # largest batch read so far in bytes
+      "backlog":   int   # bytes queued in the kernel after the last full read
+      "average":   float # exponentially weighted average batch size
+      "reads":     int   # number of reads
+      "grows":     int   # number of buffer enlargements
+      "shrinks":   int   # number of buffer reductions
+   }"""
+		return self._buffer.info()
+
+
+	def watchStats(self,pathname):
+		"""Return event statistics of a watched file or directory.
+
+Statistics are gathered by read() while parsing the events and are always
+enabled. Rates decay exponentially with a half-life of 60 seconds.
+
+Args:
+   pathname: a string.
+
+Returns:
+   None if no event occurred yet, otherwise a dictionary of the structure
+   {
+      "events":    int   # number of events
+      "nameBytes": int   # total length of the name fields (incl. padding)
+      "lastEvent": float # time of the last event (time.monotonic() scale)
+      "rate":      float # exponentially decayed event rate (events/s)
+      "masks":     dict  # mapping event flags (e.g. IN_MODIFY) to counts
+   }
+
+Raises:
+   KeyError: pathname is not watched by this inotify instance."""
+		return self._stats.get(self._wd[pathname])
+
+
+	def hotPaths(self,n=10):
+		"""Return the watched pathnames with the highest decayed event rates.
+
+Args:
+   n: an integer, the maximum number of pathnames returned.
+
+Returns:
+   A tuple of 3-tuples (pathname,rate,events) ordered by decreasing rate."""
+		with self._lock:
+			return tuple((self._name[wd],rate,events) for wd,rate,events in self._stats.top(int(n)) if wd in self._name)
+
+
+	def watchedPaths(self):
+		"""Return a tuple of all pathnames watched by this inotify instance.
+
+Returns:
+   A tuple of strings."""
+		with self._lock:
+			return tuple(self._wd.keys())
+	
+	
+	def isNonBlocking(self):
+		"""Return True if this event file does not block when no data is available.
+
+Returns:
+   A boolean."""
+		return self._isNonBlocking
+	
+	
+	def isCloseOnExec(self):
+		"""Return True if the close-on-exec flag is set.
+
+Returns:
+   A boolean."""
+		return self._isCloseOnExec
+	
+	
+	def eventStrings(self,mask):
+		"""Return a tuple of event flags identifier strings set in given mask.
+
+Args:
+   mask: an integer, a bitmask describing file alternation events.
+
+Returns:
+   A tuple of strings."""
+		retval = list()
+		if mask & inotify_c.IN_ACCESS: retval.append("IN_ACCESS")
+		if mask & inotify_c.IN_ATTRIB: retval.append("IN_ATTRIB")
+		if mask & inotify_c.IN_CLOSE_WRITE: retval.append("IN_CLOSE_WRITE")
+		if mask & inotify_c.IN_CLOSE_NOWRITE: retval.append("IN_CLOSE_NOWRITE")
+		if mask & inotify_c.IN_CREATE: retval.append("IN_CREATE")
+		if mask & inotify_c.IN_DELETE: retval.append("IN_DELETE")
+		if mask & inotify_c.IN_DELETE_SELF: retval.append("IN_DELETE_SELF")
+		if mask & inotify_c.IN_MODIFY: retval.append("IN_MODIFY")
+		if mask & inotify_c.IN_MOVE_SELF: retval.append("IN_MOVE_SELF")
+		if mask & inotify_c.IN_MOVED_FROM: retval.append("IN_MOVED_FROM")
+		if mask & inotify_c.IN_MOVED_TO: retval.append("IN_MOVED_TO")
+		if mask & inotify_c.IN_OPEN: retval.append("IN_OPEN")
+		if mask & inotify_c.IN_DONT_FOLLOW: retval.append("IN_DONT_FOLLOW")
+		if mask & inotify_c.IN_EXCL_UNLINK: retval.append("IN_EXCL_UNLINK")
+		if mask & inotify_c.IN_ONESHOT: retval.append("IN_ONESHOT")
+		if mask & inotify_c.IN_ONLYDIR: retval.append("IN_ONLYDIR")
+		if mask & inotify_c.IN_IGNORED: retval.append("IN_IGNORED")
+		if mask & inotify_c.IN_ISDIR: retval.append("IN_ISDIR")
+		if mask & inotify_c.IN_Q_OVERFLOW: retval.append("IN_Q_OVERFLOW")
+		if mask & inotify_c.IN_UNMOUNT: retval.append("IN_UNMOUNT")
+		return tuple(retval)
+
+
+
+class fanotify:
+	"""Class to manage a filesystem-wide fanotify instance.
+
+A fanotify file descriptor is created, which reports file alternation events for
+whole filesystems or mounts instead of single directories. Thus watching a
+large directory tree neither requires one watch per directory nor is it
+limited by fs.inotify.max_user_watches. Events are returned in the same format
+as inotify.read() does.
+
+Creating a fanotify instance requires the CAP_SYS_ADMIN capability (Linux 5.9 or
+newer). If it is missing, this class transparently falls back to an inotify
+instance that watches every directory below the added pathnames."""
+	
+	def __init__(self,nonBlocking=False,closeOnExec=False):
+		"""Constructor: Initialise a fanotify file descriptor. The descriptor itself can
+be retrieved via the fileno() method.
+
+If no file changes were detected by this instance, any reading operation will
+either fail with error EAGAIN (if "nonBlocking" is set) or will block.
+
+Args:
+   nonBlocking: a boolean.
+   closeOnExec: a boolean; if True, the close-on-exec flag for this event file
+                descriptor is set. This can be useful in multithreaded programs
+                to close a parent's file descriptors when a child takes control
+                via exec(). Please refer to the documentation on exec() for
+                further details.
+
+Raises:
+   OSError.EMFILE: user limit on total number of fanotify/inotify instances
+                   reached.
+   OSError.EMFILE: per-process limit on number of open file descriptors reached.
+   OSError.ENOMEM: insufficient kernel memory available."""
+		self._isNonBlocking = bool(nonBlocking)
+		self._isCloseOnExec = bool(closeOnExec)
+		self._initState()
+		self._fd = None
+		flags = fanotify_c.FAN_CLASS_NOTIF | fanotify_c.FAN_REPORT_DFID_NAME
+		if self._isNonBlocking: flags |= fanotify_c.FAN_NONBLOCK
+		if self._isCloseOnExec: flags |= fanotify_c.FAN_CLOEXEC
+		try:
+			self._fd = fanotify_c.fanotify_init(flags,os.O_RDONLY)
+			self._owner = fdowner(self._fd)
+			# since Linux 5.13 unprivileged users may create fanotify instances,
+			# but only marks on single inodes; removing a non-existing
+			# filesystem mark fails with ENOENT if privileged, EPERM otherwise
+			try:
+				fanotify_c.fanotify_mark(self._owner,fanotify_c.FAN_MARK_REMOVE | fanotify_c.FAN_MARK_FILESYSTEM,IN_ALL_EVENTS,"/")
+			except OSError as e:
+				if e.errno != errno.ENOENT: raise
+		except OSError as e:
+			# EPERM: missing CAP_SYS_ADMIN; EINVAL: FAN_REPORT_DFID_NAME not
+			# supported (Linux < 5.9); ENOSYS: kernel built without fanotify
+			if e.errno not in (errno.EPERM,errno.EINVAL,errno.ENOSYS): raise
+			self.close()
+			self._inotify = inotify(nonBlocking,closeOnExec)
+	
+	
+	def _initState(self):
+		"""Initialise the attributes independent of the file descriptor."""
+		self._roots = dict() # mapping pathnames to (fsid,markflags,mask)
+		self._prefixes = tuple() # pathnames (plus separator) accepted by read()
+		self._mountfd = dict() # mapping filesystem IDs to file descriptors
+		self._inotify = None # fallback inotify instance
+	
+	
+	@classmethod
+	def fromFd(cls,fd,pathnames=()):
+		"""Alternative constructor: Wrap an existing fanotify file descriptor, e.g.
+one received via recvFds() or inherited from a parent process. The object
+takes over the descriptor and closes it. The flags are recovered via fcntl().
+The descriptor of a fallback instance is an inotify instance, see
+inotify.fromFd().
+
+The kernel keeps the marks, but not the trees added: read() only returns the
+events below the given pathnames. The marks of their filesystems (or mounts)
+are looked up in /proc/self/fdinfo.
+
+Args:
+   fd: an integer.
+   pathnames: an iterable of strings, pathnames added to the instance.
+
+Returns:
+   A fanotify object.
+
+Raises:
+   OSError.EBADF: fd is not an open file descriptor.
+   OSError.EINVAL: fd is not a fanotify file descriptor reporting names.
+   OSError.ENOENT: a pathname does not exist or is not marked."""
+		self = cls.__new__(cls)
+		self._initState()
+		info = _adopt(self,fd,"fanotify")
+		# lines "flags:e00 event-flags:8000" and one per mark, e.g.
+		# "sdev:fe00000 mflags:0 mask:3b ..." (filesystem) or "mnt_id:..." (mount)
+		marks = [dict(field.split(":",1) for field in line.split() if ":" in field) for line in info.get("fanotify",())]
+		try:
+			flags = int(marks[0].get("flags","0"),16) if marks else 0
+			if flags & fanotify_c.FAN_REPORT_DFID_NAME != fanotify_c.FAN_REPORT_DFID_NAME:
+				raise OSError(errno.EINVAL,os.strerror(errno.EINVAL))
+			for pathname in pathnames:
+				pathname = os.path.abspath(pathname)
+				st = os.stat(pathname)
+				sdev = "{:x}".format((os.major(st.st_dev) << 20) | os.minor(st.st_dev))
+				mark = [m for m in marks if m.get("sdev") == sdev and "ino" not in m]
+				markflags = fanotify_c.FAN_MARK_FILESYSTEM
+				if not mark:
+					# mount marks carry no device: assume the only one is meant
+					mark = [m for m in marks if "mnt_id" in m]
+					markflags = fanotify_c.FAN_MARK_MOUNT
+				if len(mark) != 1: raise OSError(errno.ENOENT,os.strerror(errno.ENOENT),pathname)
+				mountfd = os.open(pathname,os.O_RDONLY | os.O_CLOEXEC)
+				fsid = fanotify_c.fanotify_fsid(mountfd)
+				if fsid in self._mountfd:
+					os.close(mountfd)
+				else:
+					self._mountfd[fsid] = mountfd
+				self._roots[pathname] = (fsid,markflags,int(mark[0]["mask"],16) & IN_ALL_EVENTS)
+		except:
+			for mountfd in self._mountfd.values(): os.close(mountfd)
+			self._mountfd = dict()
+			self._fd = None # leave the descriptor to the caller
+			raise
+		self._owner = fdowner(self._fd)
+		self._prefixes = tuple(self._roots.keys()) + tuple(os.path.join(p,"") for p in self._roots.keys())
+		return self
+	
+	
+	def __del__(self):
+		"""Destructor: Close the file descriptor."""
+		self.close()
+	
+	
+	def close(self):
+		"""Close the file descriptor."""
+		if self._inotify is not None: self._inotify.close()
+		for fd in self._mountfd.values():
+			try:    os.close(fd)
+			except: pass
+		self._mountfd = dict()
+		try:    
+			if self._fd: self._owner.close()
+		except: pass
+		self._fd = None
+	
+	
+	def fileno(self):
+		"""Return the file descriptor of this event file object.
+
+Returns:
+   An integer."""
+		if self._inotify is not None: return self._inotify.fileno()
+		return self._fd
+	
+	
+	def stats(self):
+		"""Return the performance counters of this object, see eventfd.stats(); those
+of the inotify instance if this instance falls back to inotify.
+
+Returns:
+   A dictionary, or None if the counters were compiled out."""
+		if self._inotify is not None: return self._inotify.stats()
+		return self._owner.stats()
+	
+	
+	def isFallback(self):
+		"""Return True if this instance falls back to inotify because fanotify is
+not available (e.g. due to missing privileges).
+
+Returns:
+   A boolean."""
+		return self._inotify is not None
+	
+	
+	def add(self,pathname,mask=IN_ALL_EVENTS,mount=False):
+		"""Monitor the directory tree below pathname.
+
+The mask is made up of the same event constants as the one of inotify.add()
+(linuxfd.IN_ACCESS to linuxfd.IN_OPEN, or linuxfd.IN_ALL_EVENTS); the flags
+IN_DONT_FOLLOW, IN_EXCL_UNLINK, IN_ONESHOT and IN_ONLYDIR are not supported.
+
+Internally, the whole filesystem (or, if "mount" is True, the whole mount)
+containing pathname is marked; read() drops any event outside of the trees
+added to this instance. In fallback mode, every directory below pathname is
+added to an inotify instance.
+
+Args:
+   pathname: a string.
+   mask: an integer, a bitmask describing file alternation events; defaults to
+         IN_ALL_EVENTS, i.e. watch for all file events.
+   mount: a boolean; if True, mark the mount instead of the filesystem. Mount
+          marks do not support IN_CREATE, IN_DELETE, IN_DELETE_SELF, IN_MOVE
+          and IN_MOVE_SELF.
+
+Raises:
+   OSError.EACCES: read access to given file is not permitted.
+   OSError.EBADF: fanotify file descriptor already closed.
+   OSError.EINVAL: given event mask contains no valid events.
+   OSError.ENOENT: a directory component in pathname does not exist.
+   OSError.ENOSPC: user limit on total number of inotify watches was reached
+                   (fallback mode only).
+   OSError.EXDEV: the filesystem does not support file handles."""
+		pathname = os.path.abspath(pathname)
+		mask = mask & IN_ALL_EVENTS
+		if self._inotify is not None:
+			# fallback: watch every directory of the tree
+			self._inotify.add(pathname,mask | IN_ONLYDIR)
+			self._addSubdirectories(pathname,mask)
+			self._roots[pathname] = (None,0,mask)
+		else:
+			if bool(mount):
+				markflags = fanotify_c.FAN_MARK_MOUNT
+			else:
+				markflags = fanotify_c.FAN_MARK_FILESYSTEM
+			fd = os.open(pathname,os.O_RDONLY | os.O_CLOEXEC) # O_PATH fds are rejected by open_by_handle_at()
+			try:
+				fsid = fanotify_c.fanotify_fsid(fd)
+				fanotify_c.fanotify_mark(self._owner,fanotify_c.FAN_MARK_ADD | markflags,mask | fanotify_c.FAN_ONDIR,pathname)
+			except:
+				os.close(fd)
+				raise
+			if fsid in self._mountfd:
+				os.close(fd)
+			else:
+				self._mountfd[fsid] = fd
+			self._roots[pathname] = (fsid,markflags,mask)
+		self._prefixes = tuple(self._roots.keys()) + tuple(os.path.join(p,"") for p in self._roots.keys())
+	
+	
+	def _addSubdirectories(self,pathname,mask):
+		"""Fallback mode: add all directories below pathname to the inotify instance.
+Directories vanishing in the meantime or exceeding the watch limit are skipped."""
+		subdirs = list()
+		for dirpath,dirnames,filenames in os.walk(pathname):
+			subdirs.extend(os.path.join(dirpath,d) for d in dirnames)
+		self._inotify.addMany(subdirs,mask | IN_ONLYDIR)
+	
+	
+	def remove(self,pathname):
+		"""Stop monitoring the directory tree below pathname.
+
+Args:
+   pathname: a string, as previously passed to add().
+
+Raises:
+   KeyError: pathname is not monitored by this instance.
+   OSError.EBADF: fanotify file descriptor already closed."""
+		pathname = os.path.abspath(pathname)
+		fsid,markflags,mask = self._roots.pop(pathname)
+		self._prefixes = tuple(self._roots.keys()) + tuple(os.path.join(p,"") for p in self._roots.keys())
+		if self._inotify is not None:
+			prefix = os.path.join(pathname,"")
+			self._inotify.removeMany([p for p in self._inotify.watchedPaths() if p == pathname or p.startswith(prefix)])
+		elif not any(r[0] == fsid and r[1] == markflags for r in self._roots.values()):
+			# last tree on this filesystem/mount: remove the mark
+			fanotify_c.fanotify_mark(self._owner,fanotify_c.FAN_MARK_REMOVE | markflags,mask | fanotify_c.FAN_ONDIR,pathname)
+	
+	
+	def read(self,buffersize=4096):
+		"""Read the fanotify file and return a tuple of events.
+
+If there are no events, this method will either block or fail with error
+EAGAIN if in non-blocking mode. Since events outside the added trees are
+dropped, an empty tuple may be returned.
+
+Args:
+   buffersize: an integer, defining the maximum read buffer size in bytes;
+               default = 4096 bytes.
+
+Returns:
+   A tuple of 4-tuples (pathname,name,mask,cookie), just like inotify.read():
+    - "pathname" is the directory containing the affected file;
+    - "name" is the name of the affected file within "pathname";
+    - "mask" is an integer bitmask describing the occurred events; IN_ISDIR
+      is set if the event refers to a directory;
+    - "cookie" is always zero.
+
+Raises:
+   ValueError,TypeError: buffersize is not integer-castable.
+   OSError.EAGAIN: no events occurred.
+   OSError.EBADF: fanotify file descriptor already closed."""
+		if self._inotify is not None:
+			events = self._inotify.read(buffersize)
+			for pathname,name,mask,cookie in events:
+				# keep new directories watched
+				if mask & IN_ISDIR and mask & (IN_CREATE | IN_MOVED_TO):
+					newpath = os.path.join(pathname,name)
+					for root,(fsid,markflags,rootmask) in self._roots.items():
+						if newpath.startswith(os.path.join(root,"")):
+							try:
+								self._inotify.add(newpath,rootmask | IN_ONLYDIR)
+								self._addSubdirectories(newpath,rootmask)
+							except OSError:
+								pass
+							break
+			return events
+		prefixes = self._prefixes
+		return tuple(event for event in fanotify_c.fanotify_read(self._owner,int(buffersize),self._mountfd)
+			if event[0] is not None and (event[0].startswith(prefixes) or event[2] & IN_Q_OVERFLOW))
+	
+	
+	def watchedPaths(self):
+		"""Return a tuple of all pathnames monitored by this instance.
+
+Returns:
+   A tuple of strings."""
+		return tuple(self._roots.keys())
+	
+	
+	def isNonBlocking(self):
+		"""Return True if this event file does not block when no data is available.
+
+Returns:
+   A boolean."""
+		return self._isNonBlocking
+	
+	
+	def isCloseOnExec(self):
+		"""Return True if the close-on-exec flag is set.
+
+Returns:
+   A boolean."""
+		return self._isCloseOnExec
+	
+	
+	def eventStrings(self,mask):
+		"""Return a tuple of event flags identifier strings set in given mask.
+
+Args:
+   mask: an integer, a bitmask describing file alternation events.
+
+Returns:
+   A tuple of strings."""
+		return inotify.eventStrings(self,mask)
+
+
+
+class watchManager:
+	"""Class to manage inotify directory watches within the user's watch limit.
+
+The kernel limits the number of inotify watches per user (sysctl
+fs.inotify.max_user_watches); exceeding it makes inotify.add() fail with error
+ENOSPC. A watch manager keeps track of the watches held by all watch managers of
+this process and, if the budget is exhausted, evicts the directories that were
+least recently active (i.e. had no events for the longest time). Only the
+watches of watch managers are counted: watches of other inotify instances of
+this process or of other processes of the user are not, they are noticed by
+ENOSPC only, which triggers an eviction as well. Evicted
+directories are tracked by cheap periodic stat() polling instead and are
+promoted back to real watches as soon as they change."""
+	
+	# process-wide accounting, shared by all instances
+	_lock = _thread.allocate_lock()
+	_watchesInProcess = 0
+	
+	def __init__(self,mask=IN_ALL_EVENTS,limit=None,pollInterval=1.0,nonBlocking=False,closeOnExec=False):
+		"""Constructor: Initialise a watch manager backed by an inotify instance. The
+inotify file descriptor can be retrieved via the fileno() method.
+
+Args:
+   mask: an integer, the event mask used for all watches; please refer to
+         inotify.add() for details.
+   limit: an integer, the maximum number of watches held by all watch managers
+          of this process (other watches are not counted); defaults to
+          max_user_watches.
+   pollInterval: a float, the minimum interval in seconds between two stat()
+                 scans of evicted directories.
+   nonBlocking: a boolean.
+   closeOnExec: a boolean; please refer to inotify.__init__().
+
+Raises:
+   OSError.EMFILE: user limit on total number of inotify instances reached.
+   OSError.EMFILE: per-process limit on number of open file descriptors reached.
+   OSError.ENFILE: system-wide limit on total number of open files reached.
+   OSError.ENOMEM: insufficient kernel memory available."""
+		if limit is None: limit = watchManager.maxUserWatches()
+		self._mask = int(mask)
+		self._limit = int(limit)
+		self._pollInterval = float(pollInterval)
+		self._lastPoll = time.monotonic()
+		import collections
+		self._active = collections.OrderedDict() # watched pathnames, least recently active first
+		self._polled = dict() # mapping evicted pathnames to their stat signature
+		self._evictions = 0
+		self._promotions = 0
+		self._inotify = inotify(nonBlocking,closeOnExec)
+	
+	
+	def __del__(self):
+		"""Destructor: Release all watches and close the file descriptor."""
+		self.close()
+	
+	
+	def close(self):
+		"""Release all watches and close the file descriptor."""
+		try:
+			self._release(len(self._active))
+			self._active.clear()
+			self._polled.clear()
+			self._inotify.close()
+		except AttributeError: pass # constructor failed
+	
+	
+	def fileno(self):
+		"""Return the file descriptor of the inotify instance.
+
+Returns:
+   An integer."""
+		return self._inotify.fileno()
+	
+	
+	@staticmethod
+	def maxUserWatches():
+		"""Return the kernel's per-user inotify watch limit.
+
+Returns:
+   An integer.
+
+Raises:
+   OSError.ENOENT: /proc is not mounted or inotify is not supported."""
+		with open("/proc/sys/fs/inotify/max_user_watches") as f:
+			return int(f.read())
+	
+	
+	def _reserve(self):
+		"""Account for a new watch; return False if the process-wide budget is exhausted."""
+		with watchManager._lock:
+			if watchManager._watchesInProcess >= self._limit: return False
+			watchManager._watchesInProcess += 1
+			return True
+	
+	
+	def _release(self,count=1):
+		"""Account for removed watches."""
+		with watchManager._lock:
+			watchManager._watchesInProcess -= count
+	
+	
+	def _signature(self,pathname):
+		"""Return the stat() data used to detect changes of a polled directory."""
+		try:
+			st = os.stat(pathname)
+			return (st.st_ino,st.st_mtime_ns,st.st_ctime_ns)
+		except OSError:
+			return None
+	
+	
+	def _evict(self):
+		"""Replace the least recently active watch by stat polling; return False if
+this manager holds no watch."""
+		if not self._active: return False
+		pathname,dummy = self._active.popitem(last=False)
+		self._polled[pathname] = self._signature(pathname)
+		try:
+			self._inotify.remove(pathname)
+		except OSError:
+			pass # watch vanished in the meantime
+		self._release()
+		self._evictions += 1
+		return True
+	
+	
+	def _watch(self,pathname):
+		"""Try to add a real watch, evicting other directories if necessary. Return
+True on success, False if the directory has to be polled."""
+		while not self._reserve():
+			if not self._evict(): return False
+		while True:
+			try:
+				self._inotify.add(pathname,self._mask)
+				self._active[pathname] = None
+				return True
+			except OSError as e:
+				# ENOSPC: other processes of this user hold the remaining watches
+				if e.errno != errno.ENOSPC or not self._evict():
+					self._release()
+					if e.errno == errno.ENOSPC: return False
+					raise
+	
+	
+	def add(self,pathname):
+		"""Watch a directory, either by an inotify watch or, if the watch budget is
+exhausted and no other directory can be evicted, by stat polling.
+
+Args:
+   pathname: a string.
+
+Raises:
+   OSError: see inotify.add(); ENOSPC is handled by polling instead."""
+		if pathname in self._active:
+			self._active.move_to_end(pathname)
+			return
+		# a polled directory is promoted, it must not be managed twice
+		polled = pathname in self._polled
+		signature = self._polled.pop(pathname,None)
+		try:
+			watched = self._watch(pathname)
+		except OSError:
+			if polled: self._polled[pathname] = signature
+			raise
+		if not watched:
+			self._polled[pathname] = self._signature(pathname)
+	
+	
+	def remove(self,pathname):
+		"""Stop watching a directory.
+
+Args:
+   pathname: a string.
+
+Raises:
+   KeyError: pathname is not managed by this instance."""
+		if pathname in self._polled:
+			del self._polled[pathname]
+			return
+		del self._active[pathname]
+		self._release()
+		try:
+			self._inotify.remove(pathname)
+		except OSError:
+			pass # watch vanished in the meantime
+	
+	
+	def read(self,buffersize=None):
+		"""Read the inotify file and return a tuple of events. If the poll interval has
+elapsed, the evicted directories are scanned as well (see poll()).
+
+Args:
+   buffersize: an integer; please refer to inotify.read().
+
+Returns:
+   A tuple of 4-tuples (pathname,name,mask,cookie); please refer to
+   inotify.read() and poll().
+
+Raises:
+   OSError: see inotify.read()."""
+		events = list()
+		for event in self._inotify.read(buffersize):
+			pathname,name,mask,cookie = event
+			if not pathname and mask & IN_IGNORED:
+				continue # acknowledgement of an evicted watch
+			events.append(event)
+			if pathname in self._active:
+				if mask & IN_IGNORED:
+					# watch removed by the kernel (directory deleted or unmounted)
+					del self._active[pathname]
+					self._inotify.forget(pathname)
+					self._release()
+				else:
+					self._active.move_to_end(pathname)
+		if time.monotonic() - self._lastPoll >= self._pollInterval:
+			events.extend(self.poll())
+		return tuple(events)
+	
+	
+	def poll(self):
+		"""Scan all evicted directories for changes. Changed directories are promoted
+back to real watches, evicting the least recently active ones.
+
+Since polling cannot tell what has changed, a synthetic event
+(pathname,"",IN_MODIFY | IN_ISDIR,0) is reported for each changed directory;
+(pathname,"",IN_DELETE_SELF | IN_ISDIR,0) is reported if it vanished.
+
+Returns:
+   A tuple of 4-tuples (pathname,name,mask,cookie)."""
+		self._lastPoll = time.monotonic()
+		result = list()
+		for pathname,signature in list(self._polled.items()):
+			current = self._signature(pathname)
+			if current == signature: continue
+			if current is None:
+				del self._polled[pathname]
+				result.append((pathname,"",IN_DELETE_SELF | IN_ISDIR,0))
+				continue
+			result.append((pathname,"",IN_MODIFY | IN_ISDIR,0))
+			self._polled[pathname] = current
+			if self._watch(pathname):
+				del self._polled[pathname]
+				self._promotions += 1
+		return tuple(result)
+	
+	
+	def watchedPaths(self):
+		"""Return a tuple of all pathnames managed by this instance, watched or polled.
+
+Returns:
+   A tuple of strings."""
+		return tuple(self._active.keys()) + tuple(self._polled.keys())
+	
+	
+	def stats(self):
+		"""Return usage metrics of this watch manager.
+
+Returns:
+   A dictionary of the following structure:
+   {
+      "watches":          int # inotify watches held by this instance
+      "polled":           int # directories tracked by stat polling
+      "evictions":        int # watches replaced by polling so far
+      "promotions":       int # polled directories promoted back to watches
+      "watchesInProcess": int # watches held by all watch managers of this
+                              # process; other inotify watches are not counted
+      "limit":            int # process-wide watch budget
+   }"""
+		return {
+			"watches":          len(self._active),
+			"polled":           len(self._polled),
+			"evictions":        self._evictions,
+			"promotions":       self._promotions,
+			"watchesInProcess": watchManager._watchesInProcess,
+			"limit":            self._limit
+		}
+
+
+
+class tailer:
+	"""Class to follow appended data of (log) files.
+
+A tailer keeps an open file descriptor and a read offset per file and watches
+the files via an inotify instance. Whenever a file is modified, the appended data
+is read with pread() into a buffer shared by all files. Truncated files are
+read from their start again; rotated files (moved or deleted and re-created
+under the same name) are drained and replaced by their successor."""
+	
+	def __init__(self,lines=True,buffersize=65536,nonBlocking=False,closeOnExec=False):
+		"""Constructor: Initialise a tailer. The inotify file descriptor driving it can be
+retrieved via the fileno() method.
+
+Args:
+   lines: a boolean; if True (default), read() returns complete lines only and
+          keeps incomplete ones until they are completed (a line growing
+          beyond 1 MiB without a newline is returned in pieces); otherwise
+          read() returns the appended data in raw chunks.
+   buffersize: an integer, the size of the read buffer in bytes.
+   nonBlocking: a boolean.
+   closeOnExec: a boolean; please refer to inotify.__init__().
+
+Raises:
+   OSError: see inotify.__init__()."""
+		self._slot = dict() # mapping pathnames to tailer_c slot numbers
+		self._dirs = dict() # mapping directories to the basenames tailed therein
+		self._tail = tailer_c.tailer(int(buffersize),bool(lines))
+		self._inotify = inotify(nonBlocking,closeOnExec)
+	
+	
+	def __del__(self):
+		"""Destructor: Close all files and the inotify file descriptor."""
+		self.close()
+	
+	
+	def close(self):
+		"""Close all files and the inotify file descriptor."""
+		try:
+			self._inotify.close()
+			self._tail = None
+			self._slot = dict()
+		except AttributeError: pass # constructor failed
+	
+	
+	def fileno(self):
+		"""Return the file descriptor of the inotify instance.
+
+Returns:
+   An integer."""
+		return self._inotify.fileno()
+	
+	
+	def add(self,pathname,fromStart=False):
+		"""Start following a file.
+
+Args:
+   pathname: a string.
+   fromStart: a boolean; if True, the file's current contents are returned by
+              the next read(); otherwise only data appended from now on.
+
+Raises:
+   OSError.ENOENT: pathname does not exist.
+   OSError.EACCES: read access to given file is not permitted.
+   OSError: see inotify.add()."""
+		pathname = os.path.abspath(pathname)
+		if pathname in self._slot: return
+		dirname,basename = os.path.split(pathname)
+		slot = self._tail.open(pathname,bool(fromStart))
+		try:
+			self._inotify.add(pathname,IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF)
+			if dirname not in self._dirs:
+				self._inotify.add(dirname,IN_CREATE | IN_MOVED_TO | IN_ONLYDIR)
+				self._dirs[dirname] = set()
+		except:
+			self._tail.close(slot)
+			raise
+		self._dirs[dirname].add(basename)
+		self._slot[pathname] = slot
+	
+	
+	def remove(self,pathname):
+		"""Stop following a file.
+
+Args:
+   pathname: a string.
+
+Raises:
+   KeyError: pathname is not followed by this tailer."""
+		pathname = os.path.abspath(pathname)
+		slot = self._slot.pop(pathname)
+		self._tail.close(slot)
+		dirname,basename = os.path.split(pathname)
+		self._dirs[dirname].discard(basename)
+		for p in (pathname,dirname):
+			try:
+				if p != dirname or not self._dirs[dirname]: self._inotify.remove(p)
+			except (KeyError,OSError):
+				pass # watch vanished in the meantime
+		if not self._dirs[dirname]: del self._dirs[dirname]
+	
+	
+	def read(self,buffersize=None):
+		"""Wait for file changes and return the data appended to the followed files.
+
+If there are no file changes, this method will either block or fail with error
+EAGAIN if in non-blocking mode.
+
+Args:
+   buffersize: an integer, the inotify read buffer size; please refer to
+               inotify.read().
+
+Returns:
+   A tuple of 2-tuples (pathname,data), one per file with new data; "data"
+   is a tuple of bytes objects, i.e. complete lines (including the trailing
+   newline) or raw chunks.
+
+Raises:
+   OSError.EAGAIN: no file changes occurred.
+   OSError: see inotify.read()."""
+		result = dict() # insertion-ordered
+		for pathname,name,mask,cookie in self._inotify.read(buffersize):
+			if mask & (IN_CREATE | IN_MOVED_TO):
+				# file (re-)created in a watched directory: rotation completed
+				newpath = os.path.join(pathname,name)
+				if newpath not in self._slot: continue
+				try:
+					data = self._tail.reopen(self._slot[newpath],newpath)
+				except OSError:
+					continue # vanished again, wait for the next creation
+				try:
+					# move the file watch from the old to the new inode
+					self._inotify.remove(newpath)
+				except OSError:
+					pass # old file deleted, watch already gone
+				try:
+					self._inotify.add(newpath,IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF)
+				except OSError:
+					continue # vanished again, wait for the next creation
+				data.extend(self._tail.read(self._slot[newpath]))
+				result.setdefault(newpath,list()).extend(data)
+			elif mask & (IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF) and pathname in self._slot:
+				# appended, truncated or rotated away: drain the open file
+				result.setdefault(pathname,list()).extend(self._tail.read(self._slot[pathname]))
+		return tuple((pathname,tuple(data)) for pathname,data in result.items() if data)
+	
+	
+	def followedPaths(self):
+		"""Return a tuple of all pathnames followed by this tailer.
+
+Returns:
+   A tuple of strings."""
+		return tuple(self._slot.keys())
+
+
+
+class shardedInotify:
+	"""Class to distribute inotify watches over several inotify instances.
+
+Each instance (shard) is drained by a native reader thread, which reads event
+batches into a lock-free ring buffer of its shard without holding the GIL. An
+eventfd shared by all shards becomes readable when events were queued; it can
+be retrieved via fileno() for use with select/poll/epoll.
+
+Watches are assigned to shards by a hash of their pathname or, if subtreeDepth
+is given, of the top-level subtree they belong to. All events of a watch, and
+thus of a watched directory, are read by the same thread and returned in the
+order the kernel reported them. Events of different shards may interleave;
+in particular, the IN_MOVED_FROM and IN_MOVED_TO events of a rename between
+directories of different shards may be returned in any order."""
+	
+	def __init__(self,shards=None,subtreeDepth=None,buffersize=65536,nonBlocking=False):
+		"""Constructor: Start the inotify instances and their reader threads.
+
+Args:
+   shards: an integer, the number of inotify instances; defaults to the number
+           of CPUs.
+   subtreeDepth: None (default) to assign watches by the hash of their complete
+                 pathname, or an integer n to assign all watches below the same
+                 n leading directories of the absolute pathname to one shard.
+   buffersize: an integer, the size of a single read per shard in bytes.
+   nonBlocking: a boolean; if True, read() fails with EAGAIN instead of blocking.
+
+Raises:
+   OSError.EINVAL: shards is smaller than one or buffersize too small.
+   OSError.EMFILE: user limit on total number of inotify instances reached.
+   OSError.ENOMEM: insufficient memory available."""
+		self._isNonBlocking = bool(nonBlocking)
+		self._depth = None if subtreeDepth is None else int(subtreeDepth)
+		self._wd = dict() # mapping pathnames to (shard,watch descriptor)
+		self._name = dict() # mapping (shard,watch descriptor) to pathnames
+		self._shards = int(shards or os.cpu_count() or 1)
+		self._sharded = sharded_c.sharded(self._shards,int(buffersize))
+	
+	
+	def __del__(self):
+		"""Destructor: Stop the reader threads."""
+		self.close()
+	
+	
+	def close(self):
+		"""Stop the reader threads and close all file descriptors."""
+		try:
+			if self._sharded: self._sharded.close()
+		except AttributeError: pass # constructor failed
+		self._sharded = None
+	
+	
+	def fileno(self):
+		"""Return the eventfd signalling queued events.
+
+Returns:
+   An integer."""
+		return self._sharded.fileno()
+	
+	
+	def shardOf(self,pathname):
+		"""Return the index of the shard a pathname is (or would be) assigned to.
+
+Args:
+   pathname: a string.
+
+Returns:
+   An integer."""
+		if self._depth is None:
+			key = pathname
+		else:
+			parts = os.path.abspath(pathname).split(os.sep)
+			key = os.sep.join(parts[:self._depth + 1])
+		return inotify_c.xxh64(os.fsencode(key)) % self._shards
+	
+	
+	def add(self,pathname,mask=IN_ALL_EVENTS,replace=True):
+		"""Add a file or directory to the shard it is assigned to.
+
+Args and exceptions: please refer to inotify.add()."""
+		if bool(replace):
+			mask = mask & ~inotify_c.IN_MASK_ADD # make sure MASK_ADD is not set
+		else:
+			mask = mask | inotify_c.IN_MASK_ADD # make sure MASK_ADD is set
+		shard = self.shardOf(pathname)
+		wd = self._sharded.add_watch(shard,pathname,mask)
+		self._wd[pathname] = (shard,wd)
+		self._name[(shard,wd)] = pathname
+	
+	
+	def remove(self,pathname):
+		"""Remove a file or directory.
+
+Args:
+   pathname: a string.
+
+Raises:
+   KeyError: pathname is not watched.
+   OSError.EBADF: instance already closed."""
+		key = self._wd[pathname]
+		self._sharded.rm_watch(*key)
+		del self._wd[pathname]
+		del self._name[key]
+	
+	
+	def read(self,maxEvents=-1):
+		"""Return the events queued by the reader threads.
+
+If there are no events, this method will either block (with the GIL released)
+or fail with error EAGAIN if in non-blocking mode.
+
+Args:
+   maxEvents: an integer limiting the number of events returned; a negative
+              value (default) returns all queued events. Batches read by the
+              kernel are never split, so the limit may be exceeded slightly.
+
+Returns:
+   A tuple of 4-tuples (pathname,name,mask,cookie), please refer to
+   inotify.read().
+
+Raises:
+   OSError.EAGAIN: no inotify events occurred.
+   OSError.EBADF: instance already closed.
+   OSError: a reader thread failed reading its inotify instance."""
+		return tuple(
+			(self._name.get((shard,wd),""),name,mask,cookie)
+			for shard,wd,mask,cookie,name in self._sharded.drain(int(maxEvents),not self._isNonBlocking)
+		)
+	
+	
+	def pending(self):
+		"""Return the number of queued bytes per shard.
+
+Returns:
+   A tuple of integers."""
+		return tuple(self._sharded.pending())
+	
+	
+	def watchedPaths(self):
+		"""Return a tuple of all watched pathnames.
+
+Returns:
+   A tuple of strings."""
+		return tuple(self._wd.keys())
+	
+	
+	def isNonBlocking(self):
+		"""Return True if read() does not block when no events are queued.
+
+Returns:
+   A boolean."""
+		return self._isNonBlocking
+
+
+
+class executor:
+	"""Class to run CPU-bound callbacks on a pool of native worker threads.
+
+Every worker owns a work-stealing deque: tasks submitted by a running task are
+pushed onto its worker's deque, tasks submitted from outside are queued in a
+shared inbox, and idle workers steal from the inbox and from each other before
+they park on an eventfd. Results are collected via read(); an eventfd becoming
+readable when tasks completed can be retrieved via fileno() for use with
+select/poll/epoll, and the object can be registered with a Reactor directly:
+
+   reactor.register(executor,callback) # callback(executor,completions)
+
+Python callables still need the GIL to run, so they only run in parallel with
+other threads as far as they release it (e.g. hashlib on large data). Hashing
+files via hashFile() runs entirely without the GIL."""
+	
+	def __init__(self,workers=None,nonBlocking=False):
+		"""Constructor: Start the worker threads.
+
+Args:
+   workers: an integer, the number of worker threads; defaults to the number
+            of CPUs.
+   nonBlocking: a boolean; if True, read() fails with EAGAIN instead of blocking.
+
+Raises:
+   OSError.EINVAL: workers is smaller than one.
+   OSError.EMFILE: per-process limit on open file descriptors reached.
+   OSError.ENOMEM: insufficient memory available."""
+		self._isNonBlocking = bool(nonBlocking)
+		self._backlog = list() # completions collected by map() for read()
+		self._executor = executor_c.executor(int(workers or os.cpu_count() or 1))
+	
+	
+	def __del__(self):
+		"""Destructor: Stop the worker threads."""
+		self.close()
+	
+	
+	def close(self):
+		"""Stop the worker threads after their current task and close the
+eventfds; tasks not yet started are dropped.
+
+Raises:
+   OSError.EDEADLK: called by a task of this executor."""
+		try:
+			if self._executor: self._executor.close()
+		except AttributeError: pass # constructor failed
+		self._executor = None
+	
+	
+	def fileno(self):
+		"""Return the eventfd signalling completed tasks.
+
+Returns:
+   An integer."""
+		return self._executor.fileno()
+	
+	
+	def submit(self,function,*args):
+		"""Run function(*args) on a worker.
+
+Args:
+   function: a callable.
+   args: its positional arguments.
+
+Returns:
+   An integer, the id of the task, as returned by read().
+
+Raises:
+   OSError.EBADF: executor already closed."""
+		return self._executor.submit(function,args)
+	
+	
+	def submitMany(self,function,iterable):
+		"""Run function(*args) on a worker for every args sequence of iterable.
+
+The workers are woken once for the whole batch instead of once per task.
+
+Args:
+   function: a callable.
+   iterable: an iterable of argument sequences.
+
+Returns:
+   A range of integers, the ids of the tasks.
+
+Raises:
+   OSError.EBADF: executor already closed."""
+		items = list(iterable)
+		first = self._executor.submit_many(function,items)
+		return range(first,first + len(items))
+	
+	
+	def hashFile(self,pathname):
+		"""Compute the xxh64 hash of a file's contents on a worker.
+
+The task runs without the GIL. Its value is the hash (an integer) or, if
+the file could not be read, an OSError (EAGAIN if the file was truncated or
+appended to while it was read).
+
+Args:
+   pathname: a string or bytes object.
+
+Returns:
+   An integer, the id of the task.
+
+Raises:
+   OSError.EBADF: executor already closed."""
+		return self._executor.submit_hash(pathname)
+	
+	
+	def read(self):
+		"""Return the tasks completed since the last call.
+
+If there are none, this method will either block (with the GIL released) or
+fail with error EAGAIN if in non-blocking mode.
+
+Returns:
+   A tuple of 3-tuples (id,ok,value) in the order of completion: value is
+   the result of the task if ok is True, else the exception it raised.
+
+Raises:
+   OSError.EAGAIN: no task completed.
+   OSError.EBADF: executor already closed."""
+		if self._backlog:
+			completed,self._backlog = tuple(self._backlog),list()
+			return completed
+		return tuple(self._executor.completed(not self._isNonBlocking))
+	
+	
+	def map(self,function,iterable):
+		"""Run function(item) for every item of iterable and wait for the results.
+
+Completions of other tasks arriving meanwhile are kept for read().
+
+Args:
+   function: a callable.
+   iterable: an iterable of arguments.
+
+Returns:
+   A list of the results, in the order of iterable.
+
+Raises:
+   OSError.EBADF: executor already closed.
+   Exception: the exception raised by the first failing item."""
+		ids = self.submitMany(function,((item,) for item in iterable))
+		results = dict()
+		while len(results) < len(ids):
+			for completion in self._executor.completed(True):
+				if completion[0] in ids:
+					results[completion[0]] = completion
+				else:
+					self._backlog.append(completion)
+		if self._backlog:
+			# completed() reset the eventfd: keep it readable for the backlog
+			os.write(self.fileno(),struct.pack("=Q",1))
+		values = list()
+		for taskid in ids:
+			ok,value = results[taskid][1:]
+			if not ok: raise value
+			values.append(value)
+		return values
+	
+	
+	def stats(self):
+		"""Return the state and per-worker counters of the pool.
+
+Returns:
+   A dictionary with the keys "workers", "pending" (tasks submitted but not
+   yet read), "queued" (tasks not yet started), "parked" (idle workers) and
+   the lists "executed", "steals" (tasks taken from another worker) and
+   "parks" (times a worker went idle), one entry per worker."""
+		return self._executor.stats()
+	
+	
+	def isNonBlocking(self):
+		"""Return True if read() does not block when no task completed.
+
+Returns:
+   A boolean."""
+		return self._isNonBlocking
+
+
+
+class broker:
+	"""Class to broadcast messages to subscriber processes via shared memory.
+
+Messages are written into a ring of fixed-size slots in a memfd, which every
+subscriber maps; each subscriber has its own read cursor in the ring and its
+own eventfd. The publisher writes a message once, never waits for subscribers
+and only signals subscribers which caught up and wait for more (parked). A
+subscriber falling behind by more than the capacity loses the oldest messages;
+these are counted as overruns, see stats() and slowSubscribers().
+
+Subscribers are attached in the publishing process via subscribe() and used
+in a child after fork(), or built in another process from the memfd, their
+eventfd and their index, e.g. passed over a Unix socket:
+
+   socket.send_fds(sock,[struct.pack("=I",index)],[b.fileno(),b.eventfd(index)])
+   msg,fds,flags,addr = socket.recv_fds(sock,4,2)
+   sub = linuxfd.subscriber(fds[0],fds[1],struct.unpack("=I",msg)[0])
+
+There is a single publisher per broker; publishing from several processes is
+not supported."""
+	
+	def __init__(self,capacity=1024,messageSize=1024,maxSubscribers=64):
+		"""Constructor: Create the ring and one eventfd per subscriber entry.
+
+Args:
+   capacity: an integer, the number of messages kept; rounded up to a power
+             of two.
+   messageSize: an integer, the maximum size of a message in bytes.
+   maxSubscribers: an integer, the number of subscriber entries.
+
+Raises:
+   OSError.EINVAL: an argument is out of range.
+   OSError.EMFILE: per-process limit on open file descriptors reached.
+   OSError.ENOMEM: insufficient memory available."""
+		self._broker = broker_c.broker(int(capacity),int(messageSize),int(maxSubscribers))
+	
+	
+	def __del__(self):
+		"""Destructor: Close the ring."""
+		self.close()
+	
+	
+	def close(self):
+		"""Close the ring: subscribers read the remaining messages, then their
+read() fails with EPIPE."""
+		try:
+			if self._broker: self._broker.close()
+		except AttributeError: pass # constructor failed
+		self._broker = None
+	
+	
+	def fileno(self):
+		"""Return the memfd holding the ring.
+
+Returns:
+   An integer."""
+		return self._broker.fileno()
+	
+	
+	def eventfd(self,index):
+		"""Return the eventfd of a subscriber entry.
+
+Args:
+   index: an integer, as returned by subscribe().
+
+Returns:
+   An integer.
+
+Raises:
+   OSError.EINVAL: no such entry."""
+		return self._broker.eventfd(int(index))
+	
+	
+	def publish(self,data):
+		"""Broadcast a message to all subscribers.
+
+Args:
+   data: a bytes-like object.
+
+Returns:
+   An integer, the sequence number of the message.
+
+Raises:
+   OSError.EMSGSIZE: data is larger than messageSize.
+   OSError.EBADF: broker already closed."""
+		return self._broker.publish(data)
+	
+	
+	def publishMany(self,messages):
+		"""Broadcast several messages, notifying the subscribers once.
+
+Args:
+   messages: an iterable of bytes-like objects.
+
+Returns:
+   An integer, the sequence number of the last message.
+
+Raises:
+   OSError.EMSGSIZE: a message is larger than messageSize; the messages
+                     before it were published.
+   OSError.EBADF: broker already closed."""
+		return self._broker.publish_many(messages)
+	
+	
+	def subscribe(self,nonBlocking=False):
+		"""Claim a free subscriber entry, reading from the next message on.
+
+Args:
+   nonBlocking: a boolean, passed to the subscriber.
+
+Returns:
+   A subscriber object, see class subscriber.
+
+Raises:
+   OSError.EUSERS: all maxSubscribers entries are in use.
+   OSError.EBADF: broker already closed."""
+		index = self._broker.subscribe()
+		try:
+			return subscriber(self.fileno(),self.eventfd(index),index,nonBlocking)
+		except:
+			self._broker.unsubscribe(index)
+			raise
+	
+	
+	def unsubscribe(self,index):
+		"""Release a subscriber entry; its subscriber fails with EPIPE.
+
+Args:
+   index: an integer.
+
+Raises:
+   OSError.EINVAL: no such entry."""
+		self._broker.unsubscribe(int(index))
+	
+	
+	def stats(self):
+		"""Return the ring geometry and the state of all subscribers.
+
+Returns:
+   A dictionary with the keys "capacity", "messageSize", "entries",
+   "published" (messages), "notified" (eventfd writes) and "subscribers", a
+   list of dictionaries with the keys "index", "lag" (messages published but
+   not yet read), "overruns" (messages lost), "received" and "parked"."""
+		return self._broker.stats()
+	
+	
+	def slowSubscribers(self,maxLag=None):
+		"""Return the subscribers lagging behind.
+
+Args:
+   maxLag: an integer; defaults to half the capacity.
+
+Returns:
+   A tuple of 3-tuples (index,lag,overruns) of all subscribers with a lag
+   above maxLag or with overruns."""
+		stats = self._broker.stats()
+		if maxLag is None: maxLag = stats["capacity"] // 2
+		return tuple(
+			(sub["index"],sub["lag"],sub["overruns"])
+			for sub in stats["subscribers"] if sub["lag"] > maxLag or sub["overruns"] > 0
+		)
+
+
+
+class subscriber:
+	"""Class to read the messages of a broker, possibly in another process.
+
+The eventfd returned by fileno() becomes readable when messages arrived after
+the subscriber read all previous ones; the object can be registered with a
+Reactor directly (the callback receives the tuple returned by read()).
+
+A subscriber entry must be read by a single process at a time. close() only
+detaches this object, e.g. in the parent after forking a child reading the
+entry; unsubscribe() releases the entry."""
+	
+	def __init__(self,memfd,eventfd,index,nonBlocking=False):
+		"""Constructor: Attach to the ring of a broker.
+
+The descriptors are not taken over: the ring is mapped and the eventfd
+duplicated, so the caller may close them afterwards.
+
+Args:
+   memfd: an integer, the broker's fileno().
+   eventfd: an integer, the broker's eventfd(index).
+   index: an integer, the subscriber entry.
+   nonBlocking: a boolean; if True, read() fails with EAGAIN instead of blocking.
+
+Raises:
+   OSError.EINVAL: memfd is not the ring of a broker or index is invalid.
+   OSError.ENOENT: the entry is not subscribed."""
+		self._isNonBlocking = bool(nonBlocking)
+		self._subscriber = broker_c.subscriber(int(memfd),int(eventfd),int(index))
+		self._index = int(index)
+	
+	
+	def __del__(self):
+		"""Destructor: Detach from the ring."""
+		self.close()
+	
+	
+	def close(self):
+		"""Detach from the ring; the entry stays subscribed."""
+		try:
+			if self._subscriber: self._subscriber.close()
+		except AttributeError: pass # constructor failed
+		self._subscriber = None
+	
+	
+	def unsubscribe(self):
+		"""Release the entry and detach from the ring."""
+		if self._subscriber: self._subscriber.unsubscribe()
+		self._subscriber = None
+	
+	
+	def fileno(self):
+		"""Return the eventfd signalling new messages.
+
+Returns:
+   An integer."""
+		return self._subscriber.fileno()
+	
+	
+	def index(self):
+		"""Return the subscriber entry.
+
+Returns:
+   An integer."""
+		return self._index
+	
+	
+	def read(self,maxMessages=-1):
+		"""Return the messages published since the last call.
+
+If there are none, this method will either block (with the GIL released) or
+fail with error EAGAIN if in non-blocking mode. Messages overwritten before
+they were read are skipped and counted as overruns.
+
+Args:
+   maxMessages: an integer limiting the number of messages returned; a
+                negative value (default) returns all pending messages.
+
+Returns:
+   A tuple of bytes objects, in publishing order.
+
+Raises:
+   OSError.EAGAIN: no message pending.
+   OSError.EPIPE: the broker was closed and all messages were read, or the
+                  entry was unsubscribed.
+   OSError.EBADF: subscriber already closed."""
+		return tuple(self._subscriber.read(int(maxMessages),not self._isNonBlocking))
+	
+	
+	def stats(self):
+		"""Return the state of the subscriber entry.
+
+Returns:
+   A dictionary, please refer to broker.stats()."""
+		return self._subscriber.stats()
+	
+	
+	def isNonBlocking(self):
+		"""Return True if read() does not block when no message is pending.
+
+Returns:
+   A boolean."""
+		return self._isNonBlocking
+
+
+
+class ioEngine:
+	"""Class to read eventfd, timerfd, signalfd and inotify objects in batches.
+
+The engine keeps a read posted on every added object using io_uring; a single
+call of wait() submits new reads and reaps all completed ones, i.e. a batch of
+events costs one system call instead of an epoll_wait() plus one read() per
+ready file descriptor. If io_uring is not available (Linux < 5.11 or disabled),
+the engine falls back to exactly that epoll scheme, with identical results.
+
+Objects are read directly by the engine: inotify statistics, journals and
+suppressUnchanged() of inotify objects are bypassed. Objects have to be removed
+before they are closed, as a posted read keeps the file open."""
+	
+	_KINDS = {
+		"eventfd":  uring_c.KIND_COUNTER,
+		"timerfd":  uring_c.KIND_COUNTER,
+		"signalfd": uring_c.KIND_SIGNALFD,
+		"inotify":  uring_c.KIND_INOTIFY
+	}
+	
+	def __init__(self,entries=256,backend=None):
+		"""Constructor: Set up an io_uring instance (or epoll instance).
+
+Args:
+   entries: an integer, the size of the io_uring submission queue.
+   backend: None (default) to use io_uring if available, or "epoll" to force the
+            fallback backend.
+
+Raises:
+   OSError: neither io_uring nor epoll instance could be created."""
+		self._engine = uring_c.engine(int(entries),backend == "epoll")
+		self._objects = dict() # mapping file descriptors to added objects
+	
+	
+	def add(self,obj):
+		"""Start reading an object.
+
+Args:
+   obj: an eventfd, timerfd, signalfd or inotify object.
+
+Raises:
+   TypeError: obj is not one of the supported types.
+   OSError.EEXIST: obj was already added."""
+		try:
+			kind = self._KINDS[obj._reactorKind]
+		except (AttributeError,KeyError):
+			raise TypeError("unsupported object: {}".format(type(obj).__name__))
+		self._engine.add(obj.fileno(),kind,obj)
+		self._objects[obj.fileno()] = obj
+	
+	
+	def remove(self,obj):
+		"""Stop reading an object; a posted read is cancelled.
+
+Args:
+   obj: an object previously added.
+
+Raises:
+   KeyError: obj was not added."""
+		fd = obj.fileno()
+		self._engine.remove(fd)
+		del self._objects[fd]
+	
+	
+	def wait(self,timeout=None):
+		"""Wait for completed reads and return their results.
+
+Args:
+   timeout: a float, the maximum time to wait in seconds; None (default) waits
+            until at least one result is available.
+
+Returns:
+   A tuple of 2-tuples (obj,value), in which "value" is
+    - an integer for eventfd and timerfd objects (see eventfd.read() and
+      timerfd.read()),
+    - a tuple of signal dictionaries for signalfd objects (see signalfd.read()),
+    - a tuple of 4-tuples (pathname,name,mask,cookie) for inotify objects (see
+      inotify.read()),
+    - an OSError instance if reading failed; the object is not read again.
+
+Raises:
+   OSError: io_uring or epoll failed."""
+		result = list()
+		for obj,value in self._engine.wait(-1.0 if timeout is None else float(timeout)):
+			if isinstance(value,list):
+				if obj._reactorKind == "inotify":
+					value = tuple((obj._name.get(wd,""),name,mask,cookie) for wd,mask,cookie,name in value)
+				else:
+					value = tuple(value)
+			result.append((obj,value))
+		return tuple(result)
+	
+	
+	def backend(self):
+		"""Return the backend in use.
+
+Returns:
+   The string "io_uring" or "epoll"."""
+		return self._engine.backend()
+	
+	
+	def stats(self):
+		"""Return the number of system calls issued by the engine and the number of
+results returned so far.
+
+Returns:
+   A dictionary {"syscalls":int,"results":int}."""
+		return self._engine.stats()
+	
+	
+	def close(self):
+		"""Cancel all posted reads and release the engine."""
+		self._engine = None
+		self._objects = dict()
+
+
+
+class inotifyReplay:
+	"""Class to replay an event journal recorded by inotify.record().
+
+The replay source offers the same read() interface as inotify, so consumers of
+inotify events can be benchmarked with reproducible, recorded event streams.
+Event batches are returned exactly as they were read when recording; they are
+delayed according to the recorded timestamps, optionally accelerated."""
+	
+	_HEADER = struct.Struct("=4sIQQ") # magic,version,realtime,monotonic
+	_RECORD = struct.Struct("=B3xIQ") # type,length,timestamp
+	
+	def __init__(self,pathname,speed=1.0):
+		"""Constructor: Open a journal file.
+
+Args:
+   pathname: a string, the journal file.
+   speed: a float, the replay speed relative to the recording (e.g. 10.0 for a
+          ten times faster replay); 0 or None replays without any delay.
+
+Raises:
+   OSError: journal file could not be opened.
+   ValueError: file is not an event journal or has an unsupported version."""
+		self._file = open(pathname,"rb")
+		self._name = dict() # mapping watch descriptors to pathnames
+		self._speed = float(speed or 0.0)
+		self._origin = None # (recorded timestamp, replay time) of the first batch
+		header = self._file.read(self._HEADER.size)
+		if len(header) < self._HEADER.size:
+			self.close()
+			raise ValueError("not an event journal")
+		magic,version,realtime,monotonic = self._HEADER.unpack(header)
+		if magic != b"LFDJ" or version != 1:
+			self.close()
+			raise ValueError("not an event journal or unsupported version")
+		self._recorded = realtime / 1e9
+	
+	
+	def __del__(self):
+		"""Destructor: Close the journal file."""
+		self.close()
+	
+	
+	def close(self):
+		"""Close the journal file."""
+		try:
+			if self._file: self._file.close()
+		except AttributeError: pass # constructor failed
+		self._file = None
+	
+	
+	def recorded(self):
+		"""Return the time the journal was started.
+
+Returns:
+   A float, seconds since the epoch (time.time() scale)."""
+		return self._recorded
+	
+	
+	def read(self,buffersize=None):
+		"""Return the next recorded event batch as a tuple of events.
+
+Blocks until the batch is due according to the recorded timing and the replay
+speed. Watch records preceding the batch are applied first.
+
+Args:
+   buffersize: ignored; accepted for compatibility with inotify.read().
+
+Returns:
+   A tuple of 4-tuples (pathname,name,mask,cookie), please refer to
+   inotify.read().
+
+Raises:
+   EOFError: end of journal reached.
+   ValueError: journal file already closed or truncated."""
+		if self._file is None: raise ValueError("journal file already closed")
+		while True:
+			header = self._file.read(self._RECORD.size)
+			if not header: raise EOFError("end of journal")
+			if len(header) < self._RECORD.size:
+				raise ValueError("truncated journal record")
+			rtype,length,timestamp = self._RECORD.unpack(header)
+			payload = self._file.read(length)
+			if len(payload) < length:
+				raise ValueError("truncated journal record")
+			if rtype == ord("W"):
+				wd, = struct.unpack_from("=i",payload)
+				self._name[wd] = payload[4:].decode()
+			elif rtype == ord("S"):
+				self._origin = None # recording appended later: no gap
+			elif rtype == ord("E"):
+				break
+		self._delay(timestamp)
+		return tuple(
+			(self._name.get(wd,""),name,mask,cookie)
+			for wd,mask,cookie,name in (
+				inotify_c.inotify_event(payload,offset)
+				for offset,size in inotify_c.inotify_events(payload)
+			)
+		)
+	
+	
+	def _delay(self,timestamp):
+		"""Sleep until the batch with the given recorded timestamp is due."""
+		if self._speed <= 0: return
+		now = time.monotonic()
+		if self._origin is None or timestamp < self._origin[0]:
+			self._origin = (timestamp,now) # first batch or appended recording
+			return
+		due = self._origin[1] + (timestamp - self._origin[0]) / 1e9 / self._speed
+		if due > now: time.sleep(due - now)
+	
+	
+	def watchedPaths(self):
+		"""Return a tuple of all pathnames known from the journal so far.
+
+Returns:
+   A tuple of strings."""
+		return tuple(self._name.values())
@@ -0,0 +1,806 @@
+/* This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+    linuxfd is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linuxfd is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Broadcast broker: a ring of fixed-size message slots in a memfd, shared by
+   one publisher and any number of subscriber processes. The publisher never
+   waits: it overwrites the oldest slot, and every slot carries a sequence
+   number (a seqlock), so a subscriber detects messages overwritten before or
+   while it copied them and counts them as overruns. Every subscriber owns a
+   read cursor in the shared header and an eventfd created by the broker; a
+   subscriber that caught up marks itself parked, and the publisher signals
+   the eventfds of parked subscribers only, once per parking.
+   The memfd and the eventfds survive fork() and can be passed via
+   SCM_RIGHTS; all positions live in the shared memory. */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <unistd.h>
+#include <stdlib.h> /* provides malloc and free */
+#include <errno.h>  /* definition of errno */
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include "linuxfd_c.h"
+
+#define RING_MAGIC 0x62646678756e696cULL /* "linuxfdb" */
+#define RING_VERSION 1
+
+/* shared header; the layout is fixed by the creator and validated by every
+   process attaching to it */
+typedef struct {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t capacity;      /* number of slots, power of two */
+	uint32_t slotsize;      /* maximum message size */
+	uint32_t stride;        /* distance of two slots */
+	uint32_t subscribers;   /* number of subscriber entries */
+	uint32_t reserved;
+	uint64_t size;          /* size of the mapping */
+	atomic_int closed;      /* set by the publisher on close */
+	_Alignas(64) atomic_ullong head; /* sequence number of the next message */
+} RingHeader;
+
+/* state is odd while the entry is subscribed and incremented on every
+   subscription and unsubscription, so a stale subscriber notices a reuse */
+typedef struct {
+	_Alignas(64) atomic_uint state;
+	atomic_uint parked;     /* caught up, wants a notification */
+	atomic_ullong cursor;   /* sequence number of the next message to read */
+	atomic_ullong overruns; /* messages lost */
+	atomic_ullong received;
+} RingSubscriber;
+
+typedef struct {
+	atomic_ullong seq;      /* sequence number + 1 of the message, 0 while written */
+	uint32_t length;
+	uint32_t reserved;
+	char data[];
+} RingSlot;
+
+/* ring geometry: every process keeps its own copy of the validated values
+   and never reads them from the shared header again, which any attached
+   process can write to */
+typedef struct {
+	uint32_t capacity;
+	uint32_t slotsize;
+	uint32_t stride;
+	uint32_t subscribers;
+	size_t size;
+} RingGeometry;
+
+#define RING_ALIGN(n) (((n) + 63) & ~(size_t)63)
+
+static size_t _ring_size(uint32_t capacity, uint32_t stride, uint32_t subscribers) {
+	return RING_ALIGN(sizeof(RingHeader)) + RING_ALIGN(subscribers * sizeof(RingSubscriber))
+		+ (size_t)capacity * stride;
+}
+
+static RingSubscriber * _ring_subscriber(RingHeader *ring, uint32_t index) {
+	return (RingSubscriber *)((char *)ring + RING_ALIGN(sizeof(RingHeader))) + index;
+}
+
+static RingSlot * _ring_slot(RingHeader *ring, const RingGeometry *geo, uint64_t seq) {
+	return (RingSlot *)((char *)ring + RING_ALIGN(sizeof(RingHeader))
+		+ RING_ALIGN(geo->subscribers * sizeof(RingSubscriber))
+		+ (size_t)(seq & (geo->capacity - 1)) * geo->stride);
+}
+
+
+/* helper: signal an eventfd */
+static void _signal(int fd) {
+	uint64_t one = 1;
+	while (write(fd, &one, sizeof(one)) == -1 && errno == EINTR);
+}
+
+
+/* helper: reset an eventfd (non-blocking) */
+static void _reset(int fd) {
+	uint64_t value;
+	while (read(fd, &value, sizeof(value)) == -1 && errno == EINTR);
+}
+
+
+/* helper: subscriber statistics as a dictionary */
+static PyObject * _subscriber_dict(RingHeader *ring, const RingGeometry *geo, uint32_t index) {
+	RingSubscriber *sub = _ring_subscriber(ring, index);
+	uint64_t head = atomic_load(&ring->head);
+	uint64_t cursor = atomic_load(&sub->cursor);
+	uint64_t lag = head > cursor ? head - cursor : 0;
+	/* messages already overwritten, counted by the subscriber on its next read */
+	uint64_t lost = lag > geo->capacity ? lag - geo->capacity : 0;
+	return Py_BuildValue("{s:I,s:K,s:K,s:K,s:O}",
+		"index",    index,
+		"lag",      (unsigned long long)lag,
+		"overruns", (unsigned long long)(atomic_load(&sub->overruns) + lost),
+		"received", (unsigned long long)atomic_load(&sub->received),
+		"parked",   atomic_load(&sub->parked) ? Py_True : Py_False);
+}
+
+
+
+/* broker: the publishing side, owns the ring and the subscriber eventfds */
+
+typedef struct {
+	PyObject_HEAD
+	RingHeader *ring;
+	RingGeometry geo;
+	int memfd;
+	int *eventfds;          /* one per subscriber entry, -1 if not created */
+	uint64_t notified;      /* eventfd writes */
+} BrokerObject;
+
+
+/* helper: unmap the ring and close all descriptors */
+static void _broker_release(BrokerObject *self) {
+	uint32_t i, n;
+	if (self->ring != NULL) {
+		n = self->geo.subscribers;
+		/* wake subscribers blocked in read(), they will see closed */
+		atomic_store(&self->ring->closed, 1);
+		for (i = 0; self->eventfds != NULL && i < n; i++)
+			if (self->eventfds[i] != -1 && (atomic_load(&_ring_subscriber(self->ring, i)->state) & 1))
+				_signal(self->eventfds[i]);
+		if (self->eventfds != NULL)
+			for (i = 0; i < n; i++) if (self->eventfds[i] != -1) close(self->eventfds[i]);
+		munmap(self->ring, self->geo.size);
+		self->ring = NULL;
+	}
+	free(self->eventfds);
+	self->eventfds = NULL;
+	if (self->memfd != -1) close(self->memfd);
+	self->memfd = -1;
+}
+
+
+/* Python: broker(capacity,slotsize,subscribers) -> broker object
+   create the ring (capacity is rounded up to a power of two) and one eventfd
+   per subscriber entry */
+static PyObject * _broker_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+	/* variable declarations */
+	BrokerObject *self;
+	unsigned int capacity;
+	unsigned int slotsize;
+	unsigned int subscribers;
+	uint32_t rounded;
+	uint32_t stride;
+	size_t size;
+	uint32_t i;
+	int error;
+
+	/* parse the function's arguments: capacity, maximum message size, subscribers */
+	if (!PyArg_ParseTuple(args, "III", &capacity, &slotsize, &subscribers)) return NULL;
+	if (capacity < 1 || capacity > (1u << 24) || slotsize < 1 || slotsize > (1u << 24)
+	    || subscribers < 1 || subscribers > 4096) {
+		errno = EINVAL;
+		return PyErr_SetFromErrno(PyExc_OSError);
+	}
+	for (rounded = 1; rounded < capacity; rounded <<= 1);
+	stride = RING_ALIGN(sizeof(RingSlot) + slotsize);
+	size = _ring_size(rounded, stride, subscribers);
+
+	self = (BrokerObject *)type->tp_alloc(type, 0);
+	if (self == NULL) return NULL;
+	self->memfd = memfd_create("linuxfd-broker", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (self->memfd == -1) goto error;
+	if (ftruncate(self->memfd, size) == -1) goto error;
+	/* attached processes may rely on the size */
+	if (fcntl(self->memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1) goto error;
+	self->ring = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, self->memfd, 0);
+	if (self->ring == MAP_FAILED) {
+		self->ring = NULL;
+		goto error;
+	}
+	self->geo.capacity = rounded;
+	self->geo.slotsize = slotsize;
+	self->geo.stride = stride;
+	self->geo.subscribers = subscribers;
+	self->geo.size = size;
+	/* the memfd is zero-filled: all entries unsubscribed, all slots empty */
+	self->ring->magic = RING_MAGIC;
+	self->ring->version = RING_VERSION;
+	self->ring->capacity = rounded;
+	self->ring->slotsize = slotsize;
+	self->ring->stride = stride;
+	self->ring->subscribers = subscribers;
+	self->ring->size = size;
+	self->eventfds = malloc(subscribers * sizeof(int));
+	if (self->eventfds == NULL) {
+		errno = ENOMEM;
+		goto error;
+	}
+	for (i = 0; i < subscribers; i++) self->eventfds[i] = -1;
+	for (i = 0; i < subscribers; i++) {
+		self->eventfds[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (self->eventfds[i] == -1) goto error;
+	}
+	return (PyObject *)self;
+
+error:
+	error = errno;
+	_broker_release(self);
+	Py_DECREF(self);
+	errno = error;
+	return PyErr_SetFromErrno(PyExc_OSError);
+}
+
+
+static void _broker_dealloc(BrokerObject *self) {
+	_broker_release(self);
+	linuxfd_free((PyObject *)self);
+}
+
+
+/* helper: check that the broker is open */
+static int _broker_check(BrokerObject *self) {
+	if (self->ring != NULL) return 1;
+	errno = EBADF;
+	PyErr_SetFromErrno(PyExc_OSError);
+	return 0;
+}
+
+
+/* helper: write a message into the next slot; returns its sequence number */
+static uint64_t _broker_write(RingHeader *ring, const RingGeometry *geo, const void *data, uint32_t length) {
+	uint64_t seq = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	RingSlot *slot = _ring_slot(ring, geo, seq);
+	/* seqlock: invalidate, write, then publish the new sequence number */
+	atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	memcpy(slot->data, data, length);
+	slot->length = length;
+	atomic_store_explicit(&slot->seq, seq + 1, memory_order_release);
+	atomic_store_explicit(&ring->head, seq + 1, memory_order_release);
+	return seq;
+}
+
+
+/* helper: signal the parked subscribers */
+static void _broker_notify(BrokerObject *self) {
+	RingHeader *ring = self->ring;
+	RingSubscriber *sub;
+	uint32_t i;
+	/* pairs with the parking in _subscriber_read(): either the subscriber
+	   sees the new head when re-checking, or we see it parked */
+	atomic_thread_fence(memory_order_seq_cst);
+	for (i = 0; i < self->geo.subscribers; i++) {
+		sub = _ring_subscriber(ring, i);
+		if (atomic_load_explicit(&sub->parked, memory_order_relaxed)
+		    && (atomic_load_explicit(&sub->state, memory_order_relaxed) & 1)
+		    && atomic_exchange(&sub->parked, 0)) {
+			_signal(self->eventfds[i]);
+			self->notified++;
+		}
+	}
+}
+
+
+/* Python: broker.publish(data) -> sequence number
+   broadcast a bytes-like object to all subscribers */
+static PyObject * _broker_publish(BrokerObject *self, PyObject *args) {
+	Py_buffer data;
+	uint64_t seq;
+
+	if (!PyArg_ParseTuple(args, "y*", &data)) return NULL;
+	if (!_broker_check(self)) {
+		PyBuffer_Release(&data);
+		return NULL;
+	}
+	if (data.len > self->geo.slotsize) {
+		PyBuffer_Release(&data);
+		errno = EMSGSIZE;
+		return PyErr_SetFromErrno(PyExc_OSError);
+	}
+	seq = _broker_write(self->ring, &self->geo, data.buf, data.len);
+	PyBuffer_Release(&data);
+	_broker_notify(self);
+	return PyLong_FromUnsignedLongLong(seq);
+}
+
+
+/* Python: broker.publish_many(iterable) -> sequence number of the last message
+   broadcast several messages with a single notification pass (-1 if none was
+   ever published); a message exceeding the slot size fails with EMSGSIZE,
+   the messages before it are published */
+static PyObject * _broker_publish_many(BrokerObject *self, PyObject *args) {
+	PyObject *iterable;
+	PyObject *iterator;
+	PyObject *item;
+	Py_buffer data;
+	uint64_t seq;
+	int n = 0;
+
+	if (!PyArg_ParseTuple(args, "O", &iterable)) return NULL;
+	if (!_broker_check(self)) return NULL;
+	iterator = PyObject_GetIter(iterable);
+	if (iterator == NULL) return NULL;
+	seq = atomic_load(&self->ring->head) - 1;
+	while ((item = PyIter_Next(iterator)) != NULL) {
+		if (PyObject_GetBuffer(item, &data, PyBUF_SIMPLE) == -1) {
+			Py_DECREF(item);
+			break;
+		}
+		Py_DECREF(item);
+		if (data.len > self->geo.slotsize) {
+			PyBuffer_Release(&data);
+			errno = EMSGSIZE;
+			PyErr_SetFromErrno(PyExc_OSError);
+			break;
+		}
+		seq = _broker_write(self->ring, &self->geo, data.buf, data.len);
+		PyBuffer_Release(&data);
+		n++;
+	}
+	Py_DECREF(iterator);
+	if (n > 0) _broker_notify(self);
+	if (PyErr_Occurred()) return NULL;
+	return PyLong_FromLongLong((long long)seq);
+}
+
+
+/* Python: broker.subscribe() -> index
+   claim a free subscriber entry, reading from the next message on */
+static PyObject * _broker_subscribe(BrokerObject *self, PyObject *args) {
+	RingSubscriber *sub;
+	unsigned int state;
+	uint32_t i;
+
+	if (!_broker_check(self)) return NULL;
+	for (i = 0; i < self->geo.subscribers; i++) {
+		sub = _ring_subscriber(self->ring, i);
+		state = atomic_load(&sub->state);
+		if (state & 1) continue;
+		atomic_store(&sub->cursor, atomic_load(&self->ring->head));
+		atomic_store(&sub->overruns, 0);
+		atomic_store(&sub->received, 0);
+		atomic_store(&sub->parked, 1); /* caught up */
+		if (!atomic_compare_exchange_strong(&sub->state, &state, state + 1)) continue;
+		_reset(self->eventfds[i]); /* stale notification of a previous subscriber */
+		return PyLong_FromUnsignedLong(i);
+	}
+	errno = EUSERS;
+	return PyErr_SetFromErrno(PyExc_OSError);
+}
+
+
+/* Python: broker.unsubscribe(index)
+   release a subscriber entry; its subscriber fails with EPIPE from now on */
+static PyObject * _broker_unsubscribe(BrokerObject *self, PyObject *args) {
+	RingSubscriber *sub;
+	unsigned int index;
+	unsigned int state;
+
+	if (!PyArg_ParseTuple(args, "I", &index)) return NULL;
+	if (!_broker_check(self)) return NULL;
+	if (index >= self->geo.subscribers) {
+		errno = EINVAL;
+		return PyErr_SetFromErrno(PyExc_OSError);
+	}
+	sub = _ring_subscriber(self->ring, index);
+	state = atomic_load(&sub->state);
+	if ((state & 1) && atomic_compare_exchange_strong(&sub->state, &state, state + 1))
+		_signal(self->eventfds[index]); /* wake it, read() reports EPIPE */
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+/* Python: broker.eventfd(index) -> fd
+   eventfd of a subscriber entry, e.g. to be passed via SCM_RIGHTS */
+static PyObject * _broker_eventfd(BrokerObject *self, PyObject *args) {
+	unsigned int index;
+	if (!PyArg_ParseTuple(args, "I", &index)) return NULL;
+	if (!_broker_check(self)) return NULL;
+	if (index >= self->geo.subscribers) {
+		errno = EINVAL;
+		return PyErr_SetFromErrno(PyExc_OSError);
+	}
+	return PyLong_FromLong(self->eventfds[index]);
+}
+
+
+/* Python: broker.fileno() -> fd
+   the memfd holding the ring */
+static PyObject * _broker_fileno(BrokerObject *self, PyObject *args) {
+	return PyLong_FromLong(self->memfd);
+}
+
+
+/* Python: broker.stats() -> dictionary
+   ring geometry, published messages, notifications and a list of
+   dictionaries describing the subscribed entries */
+static PyObject * _broker_stats(BrokerObject *self, PyObject *args) {
+	PyObject *subscribers;
+	PyObject *item;
+	uint32_t i;
+
+	if (!_broker_check(self)) return NULL;
+	subscribers = PyList_New(0);
+	if (subscribers == NULL) return NULL;
+	for (i = 0; i < self->geo.subscribers; i++) {
+		if (!(atomic_load(&_ring_subscriber(self->ring, i)->state) & 1)) continue;
+		item = _subscriber_dict(self->ring, &self->geo, i);
+		if (item == NULL || PyList_Append(subscribers, item) == -1) {
+			Py_XDECREF(item);
+			Py_DECREF(subscribers);
+			return NULL;
+		}
+		Py_DECREF(item);
+	}
+	return Py_BuildValue("{s:I,s:I,s:I,s:K,s:K,s:N}",
+		"capacity",    self->geo.capacity,
+		"messageSize", self->geo.slotsize,
+		"entries",     self->geo.subscribers,
+		"published",   (unsigned long long)atomic_load(&self->ring->head),
+		"notified",    (unsigned long long)self->notified,
+		"subscribers", subscribers);
+}
+
+
+/* Python: broker.close()
+   wake all subscribers (their read() fails with EPIPE once they drained the
+   ring), then unmap the ring and close all descriptors */
+static PyObject * _broker_close(BrokerObject *self, PyObject *args) {
+	_broker_release(self);
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+LINUXFD_LOCKED(_broker_publish_locked, _broker_publish)
+LINUXFD_LOCKED(_broker_publish_many_locked, _broker_publish_many)
+LINUXFD_LOCKED(_broker_subscribe_locked, _broker_subscribe)
+LINUXFD_LOCKED(_broker_unsubscribe_locked, _broker_unsubscribe)
+LINUXFD_LOCKED(_broker_eventfd_locked, _broker_eventfd)
+LINUXFD_LOCKED(_broker_stats_locked, _broker_stats)
+LINUXFD_LOCKED(_broker_close_locked, _broker_close)
+
+static PyMethodDef broker_methods[] = {
+	{ "publish",      (PyCFunction)_broker_publish_locked,      METH_VARARGS, NULL },
+	{ "publish_many", (PyCFunction)_broker_publish_many_locked, METH_VARARGS, NULL },
+	{ "subscribe",    (PyCFunction)_broker_subscribe_locked,    METH_NOARGS,  NULL },
+	{ "unsubscribe",  (PyCFunction)_broker_unsubscribe_locked,  METH_VARARGS, NULL },
+	{ "eventfd",      (PyCFunction)_broker_eventfd_locked,      METH_VARARGS, NULL },
+	{ "fileno",       (PyCFunction)_broker_fileno,              METH_NOARGS,  NULL },
+	{ "stats",        (PyCFunction)_broker_stats_locked,        METH_NOARGS,  NULL },
+	{ "close",        (PyCFunction)_broker_close_locked,        METH_NOARGS,  NULL },
+	{ NULL,           NULL,                                     0,            NULL }
+};
+
+static PyType_Slot broker_slots[] = {
+	{ Py_tp_dealloc, _broker_dealloc },
+	{ Py_tp_methods, broker_methods },
+	{ Py_tp_new,     _broker_new },
+	{ 0, NULL }
+};
+
+static PyType_Spec broker_spec = {
+	.name      = "broker_c.broker",
+	.basicsize = sizeof(BrokerObject),
+	.flags     = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE,
+	.slots     = broker_slots,
+};
+
+
+
+/* subscriber: the reading side, attached to a ring via its memfd */
+
+typedef struct {
+	PyObject_HEAD
+	RingHeader *ring;
+	RingSubscriber *sub;
+	RingGeometry geo;       /* validated when attaching */
+	unsigned int state;     /* state of the entry when attached */
+	int eventfd;            /* duplicate owned by this object */
+	int waiters;            /* read() calls polling eventfd */
+	uint32_t index;
+} SubscriberObject;
+
+
+static void _subscriber_release(SubscriberObject *self) {
+	if (self->ring != NULL) munmap(self->ring, self->geo.size);
+	self->ring = NULL;
+	self->sub = NULL;
+	if (self->eventfd != -1) {
+		/* wake read() calls polling eventfd; the last of them closes it, so
+		   that its number cannot be reused while they still poll it */
+		if (self->waiters > 0)
+			_signal(self->eventfd);
+		else
+			close(self->eventfd);
+	}
+	self->eventfd = -1;
+}
+
+
+/* Python: subscriber(memfd,eventfd,index) -> subscriber object
+   attach to the ring of a broker as subscriber entry index; eventfd has to
+   be the broker's eventfd of that entry. Both descriptors stay owned by the
+   caller: the ring is mapped and the eventfd duplicated. */
+static PyObject * _subscriber_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+	/* variable declarations */
+	SubscriberObject *self;
+	RingHeader header;
+	struct stat st;
+	int memfd;
+	int fd;
+	unsigned int index;
+	int error;
+
+	/* parse the function's arguments: memfd, eventfd, subscriber index */
+	if (!PyArg_ParseTuple(args, "iiI", &memfd, &fd, &index)) return NULL;
+
+	self = (SubscriberObject *)type->tp_alloc(type, 0);
+	if (self == NULL) return NULL;
+	self->eventfd = -1;
+	/* validate the layout before mapping all of it */
+	if (fstat(memfd, &st) == -1) goto error;
+	if (st.st_size < (off_t)sizeof(header) || pread(memfd, &header, sizeof(header), 0) != sizeof(header)
+	    || header.magic != RING_MAGIC || header.version != RING_VERSION
+	    || header.capacity == 0 || (header.capacity & (header.capacity - 1)) != 0
+	    || header.stride < RING_ALIGN(sizeof(RingSlot) + header.slotsize)
+	    || header.size != _ring_size(header.capacity, header.stride, header.subscribers)
+	    || header.size != (uint64_t)st.st_size || index >= header.subscribers) {
+		errno = EINVAL;
+		goto error;
+	}
+	self->ring = mmap(NULL, header.size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+	if (self->ring == MAP_FAILED) {
+		self->ring = NULL;
+		goto error;
+	}
+	self->geo.capacity = header.capacity;
+	self->geo.slotsize = header.slotsize;
+	self->geo.stride = header.stride;
+	self->geo.subscribers = header.subscribers;
+	self->geo.size = header.size;
+	self->index = index;
+	self->sub = _ring_subscriber(self->ring, index);
+	self->state = atomic_load(&self->sub->state);
+	if (!(self->state & 1)) {
+		errno = ENOENT; /* entry not subscribed */
+		goto error;
+	}
+	self->eventfd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	if (self->eventfd == -1) goto error;
+	return (PyObject *)self;
+
+error:
+	error = errno;
+	_subscriber_release(self);
+	Py_DECREF(self);
+	errno = error;
+	return PyErr_SetFromErrno(PyExc_OSError);
+}
+
+
+static void _subscriber_dealloc(SubscriberObject *self) {
+	_subscriber_release(self);
+	linuxfd_free((PyObject *)self);
+}
+
+
+/* helper: check that the subscriber is attached and its entry still valid */
+static int _subscriber_check(SubscriberObject *self) {
+	if (self->ring == NULL) errno = EBADF;
+	else if (atomic_load(&self->sub->state) != self->state) errno = EPIPE;
+	else return 1;
+	PyErr_SetFromErrno(PyExc_OSError);
+	return 0;
+}
+
+
+/* helper: skip the message at cursor and all others overwritten since; if
+   the oldest one is overwritten meanwhile, the seqlock check skips it too */
+static uint64_t _subscriber_skip(SubscriberObject *self, uint64_t cursor) {
+	uint64_t head = atomic_load_explicit(&self->ring->head, memory_order_acquire);
+	uint64_t oldest = head > self->geo.capacity ? head - self->geo.capacity : 0;
+	if (oldest <= cursor) oldest = cursor + 1;
+	atomic_fetch_add(&self->sub->overruns, oldest - cursor);
+	return oldest;
+}
+
+
+/* Python: subscriber.read(max,block) -> list of bytes
+   read up to max messages (all if negative) in publishing order; if none
+   is pending, block with the GIL released or fail with EAGAIN. Fails with
+   EPIPE once the broker closed and all messages were read, or if the entry
+   was unsubscribed. */
+static PyObject * _subscriber_read(SubscriberObject *self, PyObject *args) {
+	/* variable declarations */
+	Py_ssize_t max;
+	int block;
+	PyObject *result;
+	PyObject *message;
+	RingSlot *slot;
+	uint64_t head, cursor, seq;
+	uint32_t length;
+	struct pollfd pfd;
+	int error;
+
+	if (!PyArg_ParseTuple(args, "np", &max, &block)) return NULL;
+	result = PyList_New(0);
+	if (result == NULL) return NULL;
+	if (max == 0) return result;
+	while (1) {
+		if (!_subscriber_check(self)) goto error;
+		_reset(self->eventfd);
+		cursor = atomic_load_explicit(&self->sub->cursor, memory_order_relaxed);
+		head = atomic_load_explicit(&self->ring->head, memory_order_acquire);
+		if (head - cursor > self->geo.capacity) cursor = _subscriber_skip(self, cursor);
+		while (cursor < head && (max < 0 || PyList_GET_SIZE(result) < max)) {
+			slot = _ring_slot(self->ring, &self->geo, cursor);
+			seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+			length = slot->length;
+			if (seq != cursor + 1 || length > self->geo.slotsize) {
+				cursor = _subscriber_skip(self, cursor); /* overwritten */
+				continue;
+			}
+			message = PyBytes_FromStringAndSize(slot->data, length);
+			if (message == NULL) goto error;
+			atomic_thread_fence(memory_order_acquire);
+			if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq) {
+				Py_DECREF(message); /* overwritten while copying */
+				cursor = _subscriber_skip(self, cursor);
+				continue;
+			}
+			error = PyList_Append(result, message);
+			Py_DECREF(message);
+			if (error == -1) goto error;
+			cursor++;
+		}
+		atomic_store_explicit(&self->sub->cursor, cursor, memory_order_release);
+		atomic_fetch_add_explicit(&self->sub->received, PyList_GET_SIZE(result), memory_order_relaxed);
+
+		if (cursor < atomic_load_explicit(&self->ring->head, memory_order_acquire)) {
+			/* stopped at max: stay readable for poll/epoll */
+			if (PyList_GET_SIZE(result) > 0) _signal(self->eventfd);
+			else continue;
+		} else {
+			/* caught up: park, then re-check (see _broker_notify()) */
+			atomic_store(&self->sub->parked, 1);
+			if (cursor != atomic_load(&self->ring->head)) {
+				if (PyList_GET_SIZE(result) > 0) _signal(self->eventfd);
+				else continue;
+			}
+		}
+		if (PyList_GET_SIZE(result) > 0) return result;
+		if (atomic_load(&self->ring->closed)) {
+			errno = EPIPE;
+			PyErr_SetFromErrno(PyExc_OSError);
+			goto error;
+		}
+		if (!block) {
+			errno = EAGAIN;
+			PyErr_SetFromErrno(PyExc_OSError);
+			goto error;
+		}
+		pfd.fd = self->eventfd;
+		pfd.events = POLLIN;
+		self->waiters++;
+		Py_BEGIN_ALLOW_THREADS
+		error = poll(&pfd, 1, -1);
+		Py_END_ALLOW_THREADS
+		/* closed by another thread in the meantime, see _subscriber_release() */
+		if (--self->waiters == 0 && self->ring == NULL) close(pfd.fd);
+		if (error == -1 && errno == EINTR && PyErr_CheckSignals() == -1) goto error;
+	}
+
+error:
+	Py_DECREF(result);
+	return NULL;
+}
+
+
+/* Python: subscriber.fileno() -> fd
+   eventfd becoming readable when messages arrived after the subscriber
+   caught up */
+static PyObject * _subscriber_fileno(SubscriberObject *self, PyObject *args) {
+	return PyLong_FromLong(self->eventfd);
+}
+
+
+/* Python: subscriber.stats() -> dictionary
+   index, lag (messages published but not read), overruns (messages lost),
+   received messages and whether the subscriber is parked */
+static PyObject * _subscriber_stats(SubscriberObject *self, PyObject *args) {
+	if (self->ring == NULL) {
+		errno = EBADF;
+		return PyErr_SetFromErrno(PyExc_OSError);
+	}
+	return _subscriber_dict(self->ring, &self->geo, self->index);
+}
+
+
+/* Python: subscriber.unsubscribe()
+   release the entry, then detach */
+static PyObject * _subscriber_unsubscribe(SubscriberObject *self, PyObject *args) {
+	unsigned int state = self->state;
+	if (self->ring != NULL) atomic_compare_exchange_strong(&self->sub->state, &state, state + 1);
+	_subscriber_release(self);
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+/* Python: subscriber.close()
+   detach from the ring; the entry stays subscribed (e.g. by a forked copy) */
+static PyObject * _subscriber_close(SubscriberObject *self, PyObject *args) {
+	_subscriber_release(self);
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+LINUXFD_LOCKED(_subscriber_read_locked, _subscriber_read)
+LINUXFD_LOCKED(_subscriber_stats_locked, _subscriber_stats)
+LINUXFD_LOCKED(_subscriber_unsubscribe_locked, _subscriber_unsubscribe)
+LINUXFD_LOCKED(_subscriber_close_locked, _subscriber_close)
+
+static PyMethodDef subscriber_methods[] = {
+	{ "read",        (PyCFunction)_subscriber_read_locked,        METH_VARARGS, NULL },
+	{ "fileno",      (PyCFunction)_subscriber_fileno,             METH_NOARGS,  NULL },
+	{ "stats",       (PyCFunction)_subscriber_stats_locked,       METH_NOARGS,  NULL },
+	{ "unsubscribe", (PyCFunction)_subscriber_unsubscribe_locked, METH_NOARGS,  NULL },
+	{ "close",       (PyCFunction)_subscriber_close_locked,       METH_NOARGS,  NULL },
+	{ NULL,          NULL,                                        0,            NULL }
+};
+
+static PyType_Slot subscriber_slots[] = {
+	{ Py_tp_dealloc, _subscriber_dealloc },
+	{ Py_tp_methods, subscriber_methods },
+	{ Py_tp_new,     _subscriber_new },
+	{ 0, NULL }
+};
+
+static PyType_Spec subscriber_spec = {
+	.name      = "broker_c.subscriber",
+	.basicsize = sizeof(SubscriberObject),
+	.flags     = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE,
+	.slots     = subscriber_slots,
+};
+
+
+static PyMethodDef methods[] = {
+	{ NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef brokermodule = { PyModuleDef_HEAD_INIT, "linuxfd.broker_c", NULL, 0, methods };
+
+/* create submodule linuxfd.broker_c, see linuxfd_c.h */
+PyObject * linuxfd_broker_c(void) {
+	PyType_Spec *specs[] = { &broker_spec, &subscriber_spec };
+	PyObject *m;
+	PyObject *type;
+	size_t i;
+	m = PyModule_Create(&brokermodule);
+	if (m == NULL) return NULL;
+	for (i = 0; i < sizeof(specs) / sizeof(specs[0]); i++) {
+		type = PyType_FromModuleAndSpec(m, specs[i], NULL);
+		if (type == NULL || PyModule_AddType(m, (PyTypeObject *)type) == -1) {
+			Py_XDECREF(type);
+			Py_DECREF(m);
+			return NULL;
+		}
+		Py_DECREF(type);
+	}
+	return m;
+}
@@ -16,7 +16,10 @@ Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
 */
 
 #include <Python.h>
+#include <errno.h>  /* definition of errno */
 #include <sys/eventfd.h>
+#include "liblinuxfd.h"
+#include "linuxfd_c.h"
 
 
 /* Python: eventfd(initval,flags) -> fd
@@ -31,9 +34,11 @@ static PyObject * _eventfd(PyObject *self, PyObject *args) {
 	if (!PyArg_ParseTuple(args, "Ii", &initval, &flags)) return NULL;
 	
 	/* call eventfd(); catch errors by raising an exception */
+	LINUXFD_PROBE_ENTRY(eventfd, -1);
 	Py_BEGIN_ALLOW_THREADS
 	result = eventfd(initval, flags);
 	Py_END_ALLOW_THREADS
+	LINUXFD_PROBE_RETURN(eventfd, result, result, 0);
 	if (result == -1) return PyErr_SetFromErrno(PyExc_OSError);
 	
 	/* everything's fine, return file descriptor returned by eventfd() */
@@ -41,44 +46,121 @@ static PyObject * _eventfd(PyObject *self, PyObject *args) {
 };
 
 
-/* Python: eventfd_read(fd) -> value
-   C:      int eventfd_read(int fd, eventfd_t *value); */
+/* Python: eventfd_read(fd[,flags]) -> value
+   C:      int eventfd_read(int fd, eventfd_t *value);
+   fd is an integer or an fdowner object; with flag TRY_READ, None is returned
+   instead of raising EAGAIN; with flag KEEP_GIL, the GIL is not released (the
+   caller knows fd is non-blocking) */
 static PyObject * _eventfd_read(PyObject *self, PyObject *args) {
 	/* variable declarations */
-	int fd;
+	PyObject *fdobj;
+	FdRef fd;
+	int flags = 0;
 	eventfd_t value;
 	int result;
 	
-	/* parse the function's arguments: int fd */
-	if (!PyArg_ParseTuple(args, "i", &fd)) return NULL;
+	/* parse the function's arguments: fd, optional int flags */
+	if (!PyArg_ParseTuple(args, "O|i", &fdobj, &flags)) return NULL;
+	if (!linuxfd_fd_borrow(fdobj, &fd)) return NULL;
 	
 	/* call eventfd_read(); catch errors by raising an exception */
-	Py_BEGIN_ALLOW_THREADS
-	result = eventfd_read(fd, &value);
-	Py_END_ALLOW_THREADS
-	if (result == -1) return PyErr_SetFromErrno(PyExc_OSError);
+	LINUXFD_PROBE_ENTRY(eventfd_read, fd.fd);
+	if (flags & KEEP_GIL) {
+		result = eventfd_read(fd.fd, &value);
+	} else {
+		fd.started = linuxfd_clock();
+		Py_BEGIN_ALLOW_THREADS
+		result = eventfd_read(fd.fd, &value);
+		Py_END_ALLOW_THREADS
+	}
+	linuxfd_fd_count_read(&fd, result == -1 ? -1 : (ssize_t)sizeof(value));
+	LINUXFD_PROBE_RETURN(eventfd_read, fd.fd, result, result == -1 ? 0 : sizeof(value));
+	linuxfd_fd_return(&fd);
+	if (result == -1) {
+		if (errno == EAGAIN && (flags & TRY_READ)) {
+			/* cheap "empty" result: no exception object, no traceback */
+			Py_INCREF(Py_None);
+			return Py_None;
+		}
+		return PyErr_SetFromErrno(PyExc_OSError);
+	}
 	
 	/* everything's fine, return read value */
 	return PyLong_FromLong(value);
 }
 
 
-/* Python: eventfd_write(fd,value) -> None
-   C:      int eventfd_write(int fd, eventfd_t value); */
+/* helper: lfd_hook of eventfd_drain(), sums up the bytes read for the probe */
+typedef struct {
+	FdRef *fd;
+	size_t bytes;
+} DrainCount;
+
+static void _eventfd_drain_hook(void *arg, ssize_t length) {
+	DrainCount *count = (DrainCount *)arg;
+	if (length > 0) count->bytes += length;
+	linuxfd_fd_count_read(count->fd, length);
+}
+
+
+/* Python: eventfd_drain(fd,nonblocking) -> value
+   read the event file fd (integer or fdowner object) until it is empty and
+   return the sum of all values read (zero if it was empty); a semaphore is
+   thus decreased to zero by a single call. Blocking descriptors are polled
+   before each read; intended for use after readiness was signalled, so the
+   GIL is kept. */
+static PyObject * _eventfd_drain(PyObject *self, PyObject *args) {
+	/* variable declarations */
+	PyObject *fdobj;
+	FdRef fd;
+	int nonblocking;
+	int result;
+	uint64_t sum;
+	DrainCount count = { &fd, 0 };
+	
+	/* parse the function's arguments: fd, bool nonblocking */
+	if (!PyArg_ParseTuple(args, "Op", &fdobj, &nonblocking)) return NULL;
+	if (!linuxfd_fd_borrow(fdobj, &fd)) return NULL;
+	
+	LINUXFD_PROBE_ENTRY(eventfd_drain, fd.fd);
+	result = lfd_eventfd_drain(fd.fd, nonblocking, &sum, _eventfd_drain_hook, &count);
+	LINUXFD_PROBE_RETURN(eventfd_drain, fd.fd, result, count.bytes);
+	linuxfd_fd_return(&fd);
+	if (result == -1) return PyErr_SetFromErrno(PyExc_OSError);
+	return PyLong_FromUnsignedLongLong(sum);
+}
+
+
+/* Python: eventfd_write(fd,value[,flags]) -> None
+   C:      int eventfd_write(int fd, eventfd_t value);
+   fd is an integer or an fdowner object; with flag KEEP_GIL, the GIL is not
+   released */
 static PyObject * _eventfd_write(PyObject *self, PyObject *args) {
 	/* variable declarations */
-	int fd;
+	PyObject *fdobj;
+	FdRef fd;
 	eventfd_t value;
+	int flags = 0;
 	int result;
 	
-	/* parse the function's arguments: int fd, uint64_t value */
+	/* parse the function's arguments: fd, uint64_t value, optional int flags */
 	/* uint64_t in Python API? --> unsigned long long = K */
-	if (!PyArg_ParseTuple(args, "iK", &fd, &value)) return NULL;
+	if (!PyArg_ParseTuple(args, "OK|i", &fdobj, &value, &flags)) return NULL;
+	if (!linuxfd_fd_borrow(fdobj, &fd)) return NULL;
 	
 	/* call eventfd_write(); catch errors by raising an exception */
-	Py_BEGIN_ALLOW_THREADS
-	result = eventfd_write(fd,value);
-	Py_END_ALLOW_THREADS
+	LINUXFD_PROBE_ENTRY(eventfd_write, fd.fd);
+	if (flags & KEEP_GIL) {
+		result = eventfd_write(fd.fd,value);
+	} else {
+		fd.started = linuxfd_clock();
+		Py_BEGIN_ALLOW_THREADS
+		result = eventfd_write(fd.fd,value);
+		Py_END_ALLOW_THREADS
+	}
+	linuxfd_fd_count(&fd, result);
+	LINUXFD_PROBE_RETURN(eventfd_write, fd.fd, result, result == -1 ? 0 : sizeof(value));
+	linuxfd_fd_return(&fd);
 	if (result == -1) return PyErr_SetFromErrno(PyExc_OSError);
 	
 	/* everything's fine, return None value */
@@ -91,32 +173,24 @@ static PyMethodDef methods[] = {
 	{ "eventfd",       _eventfd,      METH_VARARGS, NULL },
 	{ "eventfd_read",  _eventfd_read, METH_VARARGS, NULL },
 	{ "eventfd_write", _eventfd_write,METH_VARARGS, NULL },
+	{ "eventfd_drain", _eventfd_drain,METH_VARARGS, NULL },
     { NULL,            NULL,          0,            NULL }
 };
 
-#if PY_MAJOR_VERSION >= 3
-static struct PyModuleDef eventfdmodule = { PyModuleDef_HEAD_INIT, "eventfd_c", NULL, -1, methods };
-#endif
+static struct PyModuleDef eventfdmodule = { PyModuleDef_HEAD_INIT, "linuxfd.eventfd_c", NULL, 0, methods };
 
-#if PY_MAJOR_VERSION >= 3
-PyMODINIT_FUNC PyInit_eventfd_c(void) {
-#else
-void initeventfd_c(void) {
-#endif
+/* create submodule linuxfd.eventfd_c, see linuxfd_c.h */
+PyObject * linuxfd_eventfd_c(void) {
 	PyObject *m;
-#if PY_MAJOR_VERSION >= 3
 	m = PyModule_Create(&eventfdmodule);
-#else
-	m = Py_InitModule("eventfd_c",methods);
-#endif
 	if (m != NULL) {
 		/* define eventfd constants */
 		PyModule_AddIntConstant( m, "EFD_CLOEXEC",   EFD_CLOEXEC );
 		PyModule_AddIntConstant( m, "EFD_NONBLOCK",  EFD_NONBLOCK );
 		PyModule_AddIntConstant( m, "EFD_SEMAPHORE", EFD_SEMAPHORE );
+		PyModule_AddIntConstant( m, "TRY_READ",      TRY_READ );
+		PyModule_AddIntConstant( m, "KEEP_GIL",      KEEP_GIL );
 	}
-#if PY_MAJOR_VERSION >= 3
 	return m;
-#endif
 }
                                                                                                                                                                                  
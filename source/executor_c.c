@@ -0,0 +1,821 @@
+/* This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+    linuxfd is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linuxfd is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Executor: a pool of native worker threads with work stealing. Every worker
+   owns a Chase-Lev deque (tasks submitted by its own tasks are pushed there,
+   LIFO); tasks submitted from outside go to an inbox deque, whose owner is the
+   submitting Python code (serialised by a critical section on the executor)
+   and which workers only steal from (FIFO). Idle workers park on an eventfd in
+   semaphore mode; a submitter writes one token per parked worker it wants to
+   wake, and only if any are parked. Completed tasks are pushed onto a
+   lock-free stack and signalled via a second eventfd, which is the file
+   descriptor to be registered with epoll or a Reactor.
+   Python callables are run with the worker's own thread state; consecutive
+   Python tasks keep the GIL. File hashing tasks run without it. */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <unistd.h>
+#include <stdlib.h> /* provides malloc and free */
+#include <errno.h>  /* definition of errno */
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include "xxh64.h"
+#include "linuxfd_c.h"
+
+enum { TASK_CALL, TASK_HASH };
+
+typedef struct Task {
+	int kind;
+	uint64_t id;
+	PyObject *callable;     /* TASK_CALL: callable(*args) */
+	PyObject *args;
+	char *pathname;         /* TASK_HASH: xxh64 of the file's contents */
+	PyObject *result;       /* result or exception of a call */
+	int failed;
+	uint64_t hash;
+	int error;              /* errno of a failed hash */
+	struct Task *next;      /* completion stack */
+} Task;
+
+
+/* Chase-Lev deque (Le, Pop, Cohen, Zappa Nardelli: "Correct and Efficient
+   Work-Stealing for Weak Memory Models", PPoPP 2013). The owner pushes and
+   takes at the bottom, thieves steal at the top. Replaced arrays are kept
+   until the deque is destroyed, as a thief may still read from them. */
+typedef struct DequeArray {
+	long long capacity;     /* power of two */
+	struct DequeArray *retired;
+	_Atomic(Task *) slots[];
+} DequeArray;
+
+typedef struct {
+	atomic_llong top;
+	atomic_llong bottom;
+	_Atomic(DequeArray *) array;
+} Deque;
+
+#define DEQUE_ABORT ((Task *)1) /* lost a race, retry */
+
+static DequeArray * _deque_array(long long capacity) {
+	DequeArray *array = malloc(sizeof(DequeArray) + capacity * sizeof(_Atomic(Task *)));
+	if (array == NULL) return NULL;
+	array->capacity = capacity;
+	array->retired = NULL;
+	return array;
+}
+
+static int _deque_init(Deque *deque) {
+	DequeArray *array = _deque_array(256);
+	if (array == NULL) return -1;
+	atomic_init(&deque->top, 0);
+	atomic_init(&deque->bottom, 0);
+	atomic_init(&deque->array, array);
+	return 0;
+}
+
+static void _deque_destroy(Deque *deque) {
+	DequeArray *array = atomic_load(&deque->array);
+	DequeArray *retired;
+	while (array != NULL) {
+		retired = array->retired;
+		free(array);
+		array = retired;
+	}
+	atomic_store(&deque->array, NULL);
+}
+
+/* owner: push task; returns -1 if the array could not be grown */
+static int _deque_push(Deque *deque, Task *task) {
+	long long b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+	long long t = atomic_load_explicit(&deque->top, memory_order_acquire);
+	DequeArray *array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+	DequeArray *grown;
+	long long i;
+
+	if (b - t > array->capacity - 1) {
+		grown = _deque_array(2 * array->capacity);
+		if (grown == NULL) return -1;
+		for (i = t; i < b; i++)
+			atomic_store_explicit(&grown->slots[i & (grown->capacity - 1)],
+				atomic_load_explicit(&array->slots[i & (array->capacity - 1)], memory_order_relaxed),
+				memory_order_relaxed);
+		grown->retired = array;
+		atomic_store_explicit(&deque->array, grown, memory_order_release);
+		array = grown;
+	}
+	atomic_store_explicit(&array->slots[b & (array->capacity - 1)], task, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+	return 0;
+}
+
+/* owner: take the task pushed last, NULL if empty */
+static Task * _deque_take(Deque *deque) {
+	long long b = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+	DequeArray *array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+	long long t;
+	Task *task = NULL;
+
+	atomic_store_explicit(&deque->bottom, b, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+	if (t <= b) {
+		task = atomic_load_explicit(&array->slots[b & (array->capacity - 1)], memory_order_relaxed);
+		if (t == b) {
+			/* last task: race against thieves */
+			if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+			                                             memory_order_seq_cst, memory_order_relaxed))
+				task = NULL;
+			atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+		}
+	} else {
+		atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+	}
+	return task;
+}
+
+/* thief: steal the oldest task; NULL if empty, DEQUE_ABORT if another thread
+   won the race */
+static Task * _deque_steal(Deque *deque) {
+	long long t = atomic_load_explicit(&deque->top, memory_order_acquire);
+	long long b;
+	DequeArray *array;
+	Task *task;
+
+	atomic_thread_fence(memory_order_seq_cst);
+	b = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+	if (t >= b) return NULL;
+	array = atomic_load_explicit(&deque->array, memory_order_acquire);
+	task = atomic_load_explicit(&array->slots[t & (array->capacity - 1)], memory_order_relaxed);
+	if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+	                                             memory_order_seq_cst, memory_order_relaxed))
+		return DEQUE_ABORT;
+	return task;
+}
+
+static long long _deque_size(Deque *deque) {
+	long long size = atomic_load(&deque->bottom) - atomic_load(&deque->top);
+	return size > 0 ? size : 0;
+}
+
+
+struct Pool;
+
+typedef struct {
+	Deque deque;
+	struct Pool *pool;
+	pthread_t thread;
+	int running;
+	PyThreadState *tstate;  /* created on the first Python task */
+	uint32_t seed;          /* victim selection */
+	atomic_ullong executed;
+	atomic_ullong steals;
+	atomic_ullong parks;
+} Worker;
+
+/* state shared with the worker threads; outlives nothing but the object */
+typedef struct Pool {
+	Deque inbox;            /* tasks submitted from outside the workers */
+	Worker *workers;
+	int n_workers;
+	int idle;               /* eventfd (semaphore) parking idle workers */
+	int notify;             /* eventfd signalling completed tasks */
+	atomic_int parked;      /* workers parked or about to park */
+	atomic_int stop;
+	_Atomic(Task *) completed;
+	PyInterpreterState *interp;
+} Pool;
+
+typedef struct {
+	PyObject_HEAD
+	Pool *pool;
+	uint64_t next;          /* id of the next task */
+	uint64_t pending;       /* submitted, but not yet returned by completed() */
+	int waiters;            /* completed() calls polling notify */
+	int orphan;             /* notify left open by close() for the waiters */
+} ExecutorObject;
+
+/* worker running on the current thread, if any */
+static _Thread_local Worker *current_worker = NULL;
+
+
+/* helper: signal an eventfd n times */
+static void _signal(int fd, uint64_t n) {
+	while (write(fd, &n, sizeof(n)) == -1 && errno == EINTR);
+}
+
+
+/* helper: wake up to n parked workers after tasks were pushed */
+static void _pool_wake(Pool *pool, int n) {
+	int parked;
+	/* pairs with the increment of parked in _worker_main(): either the worker
+	   sees the task when re-checking, or we see it parked */
+	atomic_thread_fence(memory_order_seq_cst);
+	parked = atomic_load(&pool->parked);
+	while (parked > 0) {
+		if (n > parked) n = parked;
+		if (atomic_compare_exchange_weak(&pool->parked, &parked, parked - n)) {
+			_signal(pool->idle, n);
+			return;
+		}
+	}
+}
+
+
+/* helper: publish a completed task, signal notify if the stack was empty */
+static void _pool_complete(Pool *pool, Task *task) {
+	Task *head = atomic_load_explicit(&pool->completed, memory_order_relaxed);
+	do {
+		task->next = head;
+	} while (!atomic_compare_exchange_weak_explicit(&pool->completed, &head, task,
+	                                                memory_order_release, memory_order_relaxed));
+	if (head == NULL) _signal(pool->notify, 1);
+}
+
+
+/* helper: find a task for worker: own deque, inbox, then the other workers'
+   deques starting at a random victim; NULL if all are empty */
+static Task * _worker_find(Worker *worker) {
+	Pool *pool = worker->pool;
+	Task *task;
+	int i, victim, retry;
+
+	task = _deque_take(&worker->deque);
+	if (task != NULL) return task;
+	do {
+		retry = 0;
+		task = _deque_steal(&pool->inbox);
+		if (task == DEQUE_ABORT) { retry = 1; task = NULL; }
+		if (task != NULL) return task;
+		worker->seed ^= worker->seed << 13; /* xorshift32 */
+		worker->seed ^= worker->seed >> 17;
+		worker->seed ^= worker->seed << 5;
+		victim = worker->seed % pool->n_workers;
+		for (i = 0; i < pool->n_workers; i++, victim = (victim + 1) % pool->n_workers) {
+			if (&pool->workers[victim] == worker) continue;
+			task = _deque_steal(&pool->workers[victim].deque);
+			if (task == DEQUE_ABORT) { retry = 1; continue; }
+			if (task != NULL) {
+				atomic_fetch_add_explicit(&worker->steals, 1, memory_order_relaxed);
+				return task;
+			}
+		}
+	} while (retry);
+	return NULL;
+}
+
+
+/* helper: run Python tasks, starting with task, as long as the next task
+   found is a Python task too; returns the first other task (or NULL) */
+static Task * _worker_call(Worker *worker, Task *task) {
+	PyObject *type, *value, *traceback;
+
+	if (worker->tstate == NULL) worker->tstate = PyThreadState_New(worker->pool->interp);
+	PyEval_RestoreThread(worker->tstate);
+	do {
+		task->result = PyObject_Call(task->callable, task->args, NULL);
+		if (task->result == NULL) {
+			/* keep the exception object, the traceback is attached to it */
+			PyErr_Fetch(&type, &value, &traceback);
+			PyErr_NormalizeException(&type, &value, &traceback);
+			if (value != NULL && traceback != NULL) PyException_SetTraceback(value, traceback);
+			if (value == NULL) {
+				Py_INCREF(Py_None);
+				value = Py_None;
+			}
+			task->result = value;
+			task->failed = 1;
+			Py_XDECREF(type);
+			Py_XDECREF(traceback);
+		}
+		Py_CLEAR(task->callable);
+		Py_CLEAR(task->args);
+		atomic_fetch_add_explicit(&worker->executed, 1, memory_order_relaxed);
+		_pool_complete(worker->pool, task);
+		task = _worker_find(worker);
+	} while (task != NULL && task->kind == TASK_CALL && !atomic_load(&worker->pool->stop));
+	PyEval_SaveThread();
+	return task;
+}
+
+
+/* worker thread: run tasks until stopped, park if there are none */
+static void * _worker_main(void *arg) {
+	Worker *worker = (Worker *)arg;
+	Pool *pool = worker->pool;
+	Task *task = NULL;
+	uint64_t token;
+	uint64_t dev, ino;
+	int parked;
+
+	current_worker = worker;
+	while (!atomic_load(&pool->stop)) {
+		if (task == NULL) task = _worker_find(worker);
+		if (task == NULL) {
+			/* announce parking, then look again: a submitter either sees us
+			   parked and writes a token, or we see its task */
+			atomic_fetch_add(&pool->parked, 1);
+			task = _worker_find(worker);
+			if (task != NULL || atomic_load(&pool->stop)) {
+				/* withdraw, unless a submitter already did (its token will wake
+				   a worker needlessly, which is harmless) */
+				parked = atomic_load(&pool->parked);
+				while (parked > 0 && !atomic_compare_exchange_weak(&pool->parked, &parked, parked - 1));
+				continue;
+			}
+			atomic_fetch_add_explicit(&worker->parks, 1, memory_order_relaxed);
+			while (read(pool->idle, &token, sizeof(token)) == -1 && errno == EINTR);
+			continue;
+		}
+		if (task->kind == TASK_CALL) {
+			task = _worker_call(worker, task);
+			continue;
+		}
+		/* TASK_HASH: plain C, the GIL is not needed */
+		task->error = xxh64_file(task->pathname, &task->hash, &dev, &ino) == -1 ? errno : 0;
+		atomic_fetch_add_explicit(&worker->executed, 1, memory_order_relaxed);
+		_pool_complete(pool, task);
+		task = NULL;
+	}
+	if (task != NULL) _pool_complete(pool, task); /* stopped: not run, freed by release */
+	if (worker->tstate != NULL) {
+		PyEval_RestoreThread(worker->tstate);
+		PyThreadState_Clear(worker->tstate);
+		PyThreadState_DeleteCurrent();
+		worker->tstate = NULL;
+	}
+	return NULL;
+}
+
+
+/* helper: free a task; requires the GIL */
+static void _task_free(Task *task) {
+	Py_XDECREF(task->callable);
+	Py_XDECREF(task->args);
+	Py_XDECREF(task->result);
+	free(task->pathname);
+	free(task);
+}
+
+
+/* helper: stop the workers and release all resources; requires the GIL */
+static void _executor_release(ExecutorObject *self) {
+	Pool *pool = self->pool;
+	Task *task, *next;
+	int i;
+
+	if (pool == NULL) return;
+	self->pool = NULL;
+	atomic_store(&pool->stop, 1);
+	if (pool->idle != -1) _signal(pool->idle, pool->n_workers);
+	Py_BEGIN_ALLOW_THREADS
+	for (i = 0; i < pool->n_workers; i++)
+		if (pool->workers[i].running) pthread_join(pool->workers[i].thread, NULL);
+	Py_END_ALLOW_THREADS
+	/* tasks not run yet and results not collected */
+	for (i = 0; i < pool->n_workers; i++) {
+		if (atomic_load(&pool->workers[i].deque.array) == NULL) continue;
+		while ((task = _deque_take(&pool->workers[i].deque)) != NULL) _task_free(task);
+		_deque_destroy(&pool->workers[i].deque);
+	}
+	if (atomic_load(&pool->inbox.array) != NULL) {
+		while ((task = _deque_take(&pool->inbox)) != NULL) _task_free(task);
+		_deque_destroy(&pool->inbox);
+	}
+	for (task = atomic_load(&pool->completed); task != NULL; task = next) {
+		next = task->next;
+		_task_free(task);
+	}
+	if (pool->idle != -1) close(pool->idle);
+	if (pool->notify != -1) {
+		/* wake completed() calls polling notify; the last of them closes it,
+		   so that its number cannot be reused while they still poll it */
+		_signal(pool->notify, 1);
+		if (self->waiters > 0)
+			self->orphan = pool->notify;
+		else
+			close(pool->notify);
+	}
+	free(pool->workers);
+	free(pool);
+}
+
+
+/* Python: executor(workers) -> executor object */
+static PyObject * _executor_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+	/* variable declarations */
+	ExecutorObject *self;
+	Pool *pool;
+	Worker *worker;
+	int n_workers;
+	int i;
+	int error;
+
+	/* parse the function's arguments: number of workers */
+	if (!PyArg_ParseTuple(args, "i", &n_workers)) return NULL;
+	if (n_workers < 1) {
+		errno = EINVAL;
+		return PyErr_SetFromErrno(PyExc_OSError);
+	}
+
+	self = (ExecutorObject *)type->tp_alloc(type, 0);
+	if (self == NULL) return NULL;
+	self->orphan = -1;
+	pool = calloc(1, sizeof(Pool));
+	if (pool == NULL) {
+		Py_DECREF(self);
+		return PyErr_NoMemory();
+	}
+	self->pool = pool;
+	pool->idle = pool->notify = -1;
+	pool->interp = PyInterpreterState_Get();
+	pool->workers = calloc(n_workers, sizeof(Worker));
+	if (pool->workers == NULL) {
+		errno = ENOMEM;
+		goto error;
+	}
+	pool->n_workers = n_workers;
+	if (_deque_init(&pool->inbox) == -1) {
+		errno = ENOMEM;
+		goto error;
+	}
+	pool->idle = eventfd(0, EFD_SEMAPHORE | EFD_CLOEXEC);
+	if (pool->idle == -1) goto error;
+	pool->notify = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (pool->notify == -1) goto error;
+	for (i = 0; i < n_workers; i++) {
+		worker = &pool->workers[i];
+		worker->pool = pool;
+		worker->seed = 2654435761u * (i + 1);
+		if (_deque_init(&worker->deque) == -1) {
+			errno = ENOMEM;
+			goto error;
+		}
+	}
+	for (i = 0; i < n_workers; i++) {
+		worker = &pool->workers[i];
+		error = pthread_create(&worker->thread, NULL, _worker_main, worker);
+		if (error != 0) {
+			errno = error;
+			goto error;
+		}
+		worker->running = 1;
+	}
+	return (PyObject *)self;
+
+error:
+	error = errno;
+	_executor_release(self);
+	Py_DECREF(self);
+	errno = error;
+	return PyErr_SetFromErrno(PyExc_OSError);
+}
+
+
+static void _executor_dealloc(ExecutorObject *self) {
+	_executor_release(self);
+	linuxfd_free((PyObject *)self);
+}
+
+
+/* helper: push a task, into the own deque if called by a worker of this
+   executor (a task submitting tasks), into the inbox otherwise; returns -1
+   with exception set on error */
+static int _executor_push(ExecutorObject *self, Task *task) {
+	Pool *pool = self->pool;
+	Deque *deque = current_worker != NULL && current_worker->pool == pool ?
+		&current_worker->deque : &pool->inbox;
+	task->id = self->next;
+	if (_deque_push(deque, task) == -1) {
+		PyErr_NoMemory();
+		return -1;
+	}
+	self->next++;
+	self->pending++;
+	return 0;
+}
+
+
+/* helper: check that the executor is open */
+static int _executor_check(ExecutorObject *self) {
+	if (self->pool != NULL) return 1;
+	errno = EBADF;
+	PyErr_SetFromErrno(PyExc_OSError);
+	return 0;
+}
+
+
+/* helper: allocate a call task */
+static Task * _task_call(PyObject *callable, PyObject *args) {
+	Task *task = calloc(1, sizeof(Task));
+	if (task == NULL) {
+		PyErr_NoMemory();
+		return NULL;
+	}
+	task->kind = TASK_CALL;
+	Py_INCREF(callable);
+	Py_INCREF(args);
+	task->callable = callable;
+	task->args = args;
+	return task;
+}
+
+
+/* Python: executor.submit(callable,args) -> id
+   run callable(*args) on a worker */
+static PyObject * _executor_submit(ExecutorObject *self, PyObject *args) {
+	PyObject *callable;
+	PyObject *callargs;
+	Task *task;
+
+	if (!PyArg_ParseTuple(args, "OO!", &callable, &PyTuple_Type, &callargs)) return NULL;
+	if (!_executor_check(self)) return NULL;
+	task = _task_call(callable, callargs);
+	if (task == NULL) return NULL;
+	if (_executor_push(self, task) == -1) {
+		_task_free(task);
+		return NULL;
+	}
+	_pool_wake(self->pool, 1);
+	return PyLong_FromUnsignedLongLong(task->id);
+}
+
+
+/* Python: executor.submit_many(callable,iterable) -> id of the first task
+   run callable(*args) for every args tuple of iterable; the tasks get
+   consecutive ids. Workers are woken once for the whole batch. */
+static PyObject * _executor_submit_many(ExecutorObject *self, PyObject *args) {
+	PyObject *callable;
+	PyObject *iterable;
+	PyObject *iterator;
+	PyObject *item;
+	PyObject *callargs;
+	Task *task;
+	uint64_t first;
+	int n = 0;
+
+	if (!PyArg_ParseTuple(args, "OO", &callable, &iterable)) return NULL;
+	if (!_executor_check(self)) return NULL;
+	iterator = PyObject_GetIter(iterable);
+	if (iterator == NULL) return NULL;
+	first = self->next;
+	while ((item = PyIter_Next(iterator)) != NULL) {
+		if (PyTuple_Check(item)) {
+			callargs = item;
+		} else {
+			callargs = PySequence_Tuple(item);
+			Py_DECREF(item);
+		}
+		task = callargs != NULL ? _task_call(callable, callargs) : NULL;
+		Py_XDECREF(callargs);
+		if (task == NULL || _executor_push(self, task) == -1) {
+			if (task != NULL) _task_free(task);
+			break;
+		}
+		/* wake workers early for long batches */
+		if (++n % 64 == 0) _pool_wake(self->pool, self->pool->n_workers);
+	}
+	Py_DECREF(iterator);
+	if (n > 0) _pool_wake(self->pool, n);
+	if (PyErr_Occurred()) return NULL; /* tasks pushed so far are run */
+	return PyLong_FromUnsignedLongLong(first);
+}
+
+
+/* Python: executor.submit_hash(pathname) -> id
+   compute the xxh64 hash of a file's contents on a worker, without the GIL */
+static PyObject * _executor_submit_hash(ExecutorObject *self, PyObject *args) {
+	PyObject *pathname;
+	Task *task;
+
+	if (!PyArg_ParseTuple(args, "O&", PyUnicode_FSConverter, &pathname)) return NULL;
+	if (!_executor_check(self)) {
+		Py_DECREF(pathname);
+		return NULL;
+	}
+	task = calloc(1, sizeof(Task));
+	if (task != NULL) task->pathname = strdup(PyBytes_AS_STRING(pathname));
+	Py_DECREF(pathname);
+	if (task == NULL || task->pathname == NULL) {
+		free(task);
+		return PyErr_NoMemory();
+	}
+	task->kind = TASK_HASH;
+	if (_executor_push(self, task) == -1) {
+		_task_free(task);
+		return NULL;
+	}
+	_pool_wake(self->pool, 1);
+	return PyLong_FromUnsignedLongLong(task->id);
+}
+
+
+/* helper: convert a completed task to a tuple (id,ok,value) and free it */
+static PyObject * _task_tuple(Task *task) {
+	PyObject *item;
+	if (task->kind == TASK_HASH && task->error != 0)
+		item = Py_BuildValue("(KON)", (unsigned long long)task->id, Py_False,
+			PyObject_CallFunction(PyExc_OSError, "isN", task->error, strerror(task->error),
+				PyUnicode_DecodeFSDefault(task->pathname)));
+	else if (task->kind == TASK_HASH)
+		item = Py_BuildValue("(KOK)", (unsigned long long)task->id, Py_True, (unsigned long long)task->hash);
+	else
+		item = Py_BuildValue("(KOO)", (unsigned long long)task->id, task->failed ? Py_False : Py_True,
+			task->result);
+	_task_free(task);
+	return item;
+}
+
+
+/* Python: executor.completed(block) -> list of (id,ok,value)
+   collect completed tasks in the order of completion: value is the result or,
+   if ok is False, the exception raised (OSError for a failed hash). Blocks
+   with the GIL released if none completed and block is True, raises EAGAIN
+   otherwise. */
+static PyObject * _executor_completed(ExecutorObject *self, PyObject *args) {
+	int block;
+	Task *task, *next, *list;
+	PyObject *result;
+	PyObject *item;
+	struct pollfd pfd;
+	uint64_t value;
+	int error;
+
+	if (!PyArg_ParseTuple(args, "p", &block)) return NULL;
+	while (1) {
+		if (!_executor_check(self)) return NULL;
+		/* reset the notification before taking the stack, so that tasks
+		   completed afterwards signal the eventfd again */
+		while (read(self->pool->notify, &value, sizeof(value)) == -1 && errno == EINTR);
+		list = atomic_exchange_explicit(&self->pool->completed, NULL, memory_order_acquire);
+		if (list != NULL) break;
+		if (!block) {
+			errno = EAGAIN;
+			return PyErr_SetFromErrno(PyExc_OSError);
+		}
+		pfd.fd = self->pool->notify;
+		pfd.events = POLLIN;
+		self->waiters++;
+		Py_BEGIN_ALLOW_THREADS
+		error = poll(&pfd, 1, -1);
+		Py_END_ALLOW_THREADS
+		if (--self->waiters == 0 && self->orphan != -1) {
+			/* closed by another thread in the meantime, see _executor_release() */
+			close(self->orphan);
+			self->orphan = -1;
+		}
+		if (error == -1 && errno == EINTR && PyErr_CheckSignals() == -1) return NULL;
+	}
+
+	/* the stack is newest first */
+	for (task = list, list = NULL; task != NULL; task = next) {
+		next = task->next;
+		task->next = list;
+		list = task;
+	}
+	result = PyList_New(0);
+	for (task = list; task != NULL; task = next) {
+		next = task->next;
+		self->pending--;
+		item = _task_tuple(task);
+		if (result != NULL && (item == NULL || PyList_Append(result, item) == -1)) Py_CLEAR(result);
+		Py_XDECREF(item);
+	}
+	return result;
+}
+
+
+/* Python: executor.fileno() -> fd
+   eventfd becoming readable whenever tasks completed */
+static PyObject * _executor_fileno(ExecutorObject *self, PyObject *args) {
+	return PyLong_FromLong(self->pool != NULL ? self->pool->notify : -1);
+}
+
+
+/* Python: executor.stats() -> dictionary
+   workers, pending tasks (submitted, not yet collected), queued tasks (not yet
+   started) and per worker lists of executed tasks, steals and parkings */
+static PyObject * _executor_stats(ExecutorObject *self, PyObject *args) {
+	Pool *pool = self->pool;
+	PyObject *executed, *steals, *parks;
+	long long queued;
+	int i;
+
+	if (!_executor_check(self)) return NULL;
+	executed = PyList_New(pool->n_workers);
+	steals = PyList_New(pool->n_workers);
+	parks = PyList_New(pool->n_workers);
+	if (executed == NULL || steals == NULL || parks == NULL) goto error;
+	queued = _deque_size(&pool->inbox);
+	for (i = 0; i < pool->n_workers; i++) {
+		queued += _deque_size(&pool->workers[i].deque);
+		PyList_SET_ITEM(executed, i, PyLong_FromUnsignedLongLong(atomic_load(&pool->workers[i].executed)));
+		PyList_SET_ITEM(steals, i, PyLong_FromUnsignedLongLong(atomic_load(&pool->workers[i].steals)));
+		PyList_SET_ITEM(parks, i, PyLong_FromUnsignedLongLong(atomic_load(&pool->workers[i].parks)));
+	}
+	return Py_BuildValue("{s:i,s:K,s:L,s:i,s:N,s:N,s:N}",
+		"workers",  pool->n_workers,
+		"pending",  (unsigned long long)self->pending,
+		"queued",   queued,
+		"parked",   atomic_load(&pool->parked),
+		"executed", executed,
+		"steals",   steals,
+		"parks",    parks);
+
+error:
+	Py_XDECREF(executed);
+	Py_XDECREF(steals);
+	Py_XDECREF(parks);
+	return NULL;
+}
+
+
+/* Python: executor.close()
+   stop the workers after their current task; queued tasks are dropped */
+static PyObject * _executor_close(ExecutorObject *self, PyObject *args) {
+	/* a task cannot wait for its own worker */
+	if (self->pool != NULL && current_worker != NULL && current_worker->pool == self->pool) {
+		errno = EDEADLK;
+		return PyErr_SetFromErrno(PyExc_OSError);
+	}
+	_executor_release(self);
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+/* methods run in a critical section on self, see linuxfd_c.h; the inbox is
+   only pushed to within it */
+LINUXFD_LOCKED(_executor_submit_locked, _executor_submit)
+LINUXFD_LOCKED(_executor_submit_many_locked, _executor_submit_many)
+LINUXFD_LOCKED(_executor_submit_hash_locked, _executor_submit_hash)
+LINUXFD_LOCKED(_executor_completed_locked, _executor_completed)
+LINUXFD_LOCKED(_executor_stats_locked, _executor_stats)
+LINUXFD_LOCKED(_executor_close_locked, _executor_close)
+
+static PyMethodDef executor_methods[] = {
+	{ "submit",      (PyCFunction)_executor_submit_locked,      METH_VARARGS, NULL },
+	{ "submit_many", (PyCFunction)_executor_submit_many_locked, METH_VARARGS, NULL },
+	{ "submit_hash", (PyCFunction)_executor_submit_hash_locked, METH_VARARGS, NULL },
+	{ "completed",   (PyCFunction)_executor_completed_locked,   METH_VARARGS, NULL },
+	{ "fileno",      (PyCFunction)_executor_fileno,             METH_NOARGS,  NULL },
+	{ "stats",       (PyCFunction)_executor_stats_locked,       METH_NOARGS,  NULL },
+	{ "close",       (PyCFunction)_executor_close_locked,       METH_NOARGS,  NULL },
+	{ NULL,          NULL,                                      0,            NULL }
+};
+
+static PyType_Slot executor_slots[] = {
+	{ Py_tp_dealloc, _executor_dealloc },
+	{ Py_tp_methods, executor_methods },
+	{ Py_tp_new,     _executor_new },
+	{ 0, NULL }
+};
+
+static PyType_Spec executor_spec = {
+	.name      = "executor_c.executor",
+	.basicsize = sizeof(ExecutorObject),
+	.flags     = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE,
+	.slots     = executor_slots,
+};
+
+
+static PyMethodDef methods[] = {
+	{ NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef executormodule = { PyModuleDef_HEAD_INIT, "linuxfd.executor_c", NULL, 0, methods };
+
+/* create submodule linuxfd.executor_c, see linuxfd_c.h */
+PyObject * linuxfd_executor_c(void) {
+	PyObject *m;
+	PyObject *type;
+	m = PyModule_Create(&executormodule);
+	if (m == NULL) return NULL;
+	type = PyType_FromModuleAndSpec(m, &executor_spec, NULL);
+	if (type == NULL || PyModule_AddType(m, (PyTypeObject *)type) == -1) {
+		Py_XDECREF(type);
+		Py_DECREF(m);
+		return NULL;
+	}
+	Py_DECREF(type);
+	return m;
+}
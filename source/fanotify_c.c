@@ -0,0 +1,327 @@
+/* This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+    linuxfd is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linuxfd is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE /* provides open_by_handle_at and struct file_handle */
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <unistd.h>
+#include <stdlib.h> /* provides posix_memalign and free */
+#include <errno.h>  /* definition of errno */
+#include <fcntl.h>
+#include <limits.h> /* definition of PATH_MAX */
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h> /* definition of uint64_t */
+#include <sys/vfs.h> /* provides fstatfs */
+#include <sys/fanotify.h>
+#include "linuxfd_c.h"
+
+/* directory file handle reporting was added in Linux 5.9; older C libraries
+   may lack the corresponding definitions */
+#ifndef FAN_REPORT_DIR_FID
+#define FAN_REPORT_DIR_FID 0x00000400
+#endif
+#ifndef FAN_REPORT_NAME
+#define FAN_REPORT_NAME 0x00000800
+#endif
+#ifndef FAN_REPORT_DFID_NAME
+#define FAN_REPORT_DFID_NAME (FAN_REPORT_DIR_FID | FAN_REPORT_NAME)
+#endif
+#ifndef FAN_MARK_FILESYSTEM
+#define FAN_MARK_FILESYSTEM 0x00000100
+#endif
+#ifndef FAN_EVENT_INFO_TYPE_DFID_NAME
+#define FAN_EVENT_INFO_TYPE_DFID_NAME 2
+#endif
+#ifndef FAN_EVENT_INFO_TYPE_DFID
+#define FAN_EVENT_INFO_TYPE_DFID 3
+#endif
+
+
+/* helper: combine the two words of a filesystem ID to a single 64 bit key */
+static uint64_t _fsid_key(const int *val) {
+	return ((uint64_t)(uint32_t)val[0] << 32) | (uint64_t)(uint32_t)val[1];
+}
+
+
+/* Python: fanotify_init(flags,event_f_flags) -> fd
+   C:      int fanotify_init(unsigned int flags, unsigned int event_f_flags); */
+static PyObject * _fanotify_init(PyObject *self, PyObject *args) {
+	/* variable declarations */
+	unsigned int flags;
+	unsigned int event_f_flags;
+	int fd;
+
+	/* parse the function's arguments: unsigned int flags, unsigned int event_f_flags */
+	if (!PyArg_ParseTuple(args, "II", &flags, &event_f_flags)) return NULL;
+
+	/* call fanotify_init(); catch errors by raising an exception */
+	Py_BEGIN_ALLOW_THREADS
+	fd = fanotify_init(flags, event_f_flags);
+	Py_END_ALLOW_THREADS
+	if (fd == -1) return PyErr_SetFromErrno(PyExc_OSError);
+
+	/* everything's fine, return file descriptor */
+	return PyLong_FromLong(fd);
+}
+
+
+/* Python: fanotify_mark(fd,flags,mask,pathname)
+   C:      int fanotify_mark(int fanotify_fd, unsigned int flags,
+                             uint64_t mask, int dirfd, const char *pathname); */
+static PyObject * _fanotify_mark(PyObject *self, PyObject *args) {
+	/* variable declarations */
+	PyObject *fdobj;
+	FdRef fd;
+	unsigned int flags;
+	unsigned long long mask;
+	char *pathname;
+	int result;
+
+	/* parse the function's arguments: fd, unsigned int flags, uint64_t mask, str pathname */
+	if (!PyArg_ParseTuple(args, "OIKs", &fdobj, &flags, &mask, &pathname)) return NULL;
+	if (!linuxfd_fd_borrow(fdobj, &fd)) return NULL;
+
+	/* call fanotify_mark(); pathname is resolved relative to the current
+	   working directory; catch errors by raising an exception */
+	LINUXFD_PROBE_ENTRY(fanotify_mark, fd.fd);
+	fd.started = linuxfd_clock();
+	Py_BEGIN_ALLOW_THREADS
+	result = fanotify_mark(fd.fd, flags, (uint64_t)mask, AT_FDCWD, pathname);
+	Py_END_ALLOW_THREADS
+	linuxfd_fd_count(&fd, result);
+	LINUXFD_PROBE_RETURN(fanotify_mark, fd.fd, result, 0);
+	linuxfd_fd_return(&fd);
+	if (result == -1) return PyErr_SetFromErrno(PyExc_OSError);
+
+	/* everything's fine, return None value */
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+/* Python: fanotify_fsid(fd) -> fsid
+   C:      int fstatfs(int fd, struct statfs *buf); */
+static PyObject * _fanotify_fsid(PyObject *self, PyObject *args) {
+	/* variable declarations */
+	int fd;
+	int result;
+	struct statfs buf;
+
+	/* parse the function's arguments: int fd */
+	if (!PyArg_ParseTuple(args, "i", &fd)) return NULL;
+
+	/* call fstatfs(); catch errors by raising an exception */
+	Py_BEGIN_ALLOW_THREADS
+	result = fstatfs(fd, &buf);
+	Py_END_ALLOW_THREADS
+	if (result == -1) return PyErr_SetFromErrno(PyExc_OSError);
+
+	/* return filesystem ID in the representation used by fanotify_read() */
+	return PyLong_FromUnsignedLongLong(_fsid_key(buf.f_fsid.__val));
+}
+
+
+/* helper: resolve a directory file handle to a path via open_by_handle_at();
+   returns the length of the path written to buffer or -1 on error */
+static ssize_t _resolve_handle(int mount_fd, struct file_handle *handle, char *buffer) {
+	/* variable declarations */
+	int fd;
+	ssize_t length;
+	char procpath[64];
+
+	fd = open_by_handle_at(mount_fd, handle, O_PATH);
+	if (fd == -1) return -1;
+	snprintf(procpath, sizeof(procpath), "/proc/self/fd/%d", fd);
+	length = readlink(procpath, buffer, PATH_MAX - 1);
+	close(fd);
+	return length;
+}
+
+
+/* Python: fanotify_read(fd,size,mountfds) -> [(pathname,name,mask,cookie), ...]
+   C:      ssize_t read(int fd, void *buf, size_t count);
+   mountfds maps filesystem IDs (see fanotify_fsid()) to file descriptors
+   located on the respective filesystem; they serve as mount_fd argument of
+   open_by_handle_at() when resolving the reported directory handles. The
+   event tuples have the same layout as the ones of inotify.read(); cookie is
+   always zero and pathname is None if the directory could not be resolved
+   (e.g. because it was deleted in the meantime) */
+static PyObject * _fanotify_read(PyObject *self, PyObject *args) {
+	/* variable declarations */
+	PyObject *fdobj;
+	FdRef fd;
+	int size;
+	int result;
+	ssize_t length;
+	char *buffer;
+	char *info;
+	char *name;
+	char *path;
+	ssize_t path_len;
+	struct fanotify_event_metadata *event;
+	struct fanotify_event_info_fid *fid;
+	struct file_handle *handle;
+	struct file_handle *last_handle;
+	PyObject *mountfds;
+	PyObject *key;
+	PyObject *mount_fd;
+	PyObject *pathname;
+	PyObject *last_pathname;
+	PyObject *item;
+	PyObject *data;
+
+	/* parse the function's arguments: fd, int size, dict mountfds */
+	if (!PyArg_ParseTuple(args, "OiO!", &fdobj, &size, &PyDict_Type, &mountfds)) return NULL;
+
+	/* prepare buffers; just like inotify_read() the event buffer has to be
+	   aligned like the structure read into it (posix_memalign() requires a
+	   power of two, which the size of fanotify_event_metadata is not) */
+	if (size < (int)sizeof(struct fanotify_event_metadata)) size = sizeof(struct fanotify_event_metadata);
+	result = posix_memalign((void **)&buffer, __alignof__(struct fanotify_event_metadata), size);
+	if (result != 0) {
+		errno = result;
+		return PyErr_SetFromErrno(PyExc_OSError);
+	}
+	path = malloc(PATH_MAX);
+	if (path == NULL) {
+		free(buffer);
+		return PyErr_NoMemory();
+	}
+
+	/* call read(); catch OSErrors */
+	if (!linuxfd_fd_borrow(fdobj, &fd)) {
+		free(buffer);
+		free(path);
+		return NULL;
+	}
+	LINUXFD_PROBE_ENTRY(fanotify_read, fd.fd);
+	fd.started = linuxfd_clock();
+	Py_BEGIN_ALLOW_THREADS
+	length = read(fd.fd, buffer, size);
+	Py_END_ALLOW_THREADS
+	linuxfd_fd_count_read(&fd, length);
+	LINUXFD_PROBE_RETURN(fanotify_read, fd.fd, length, length == -1 ? 0 : length);
+	linuxfd_fd_return(&fd);
+	if (length == -1) {
+		free(buffer);
+		free(path);
+		return PyErr_SetFromErrno(PyExc_OSError);
+	}
+
+	/* loop over all events in the buffer; consecutive events tend to refer to
+	   the same directory, hence the last resolved handle is remembered */
+	data = PyList_New(0);
+	last_handle = NULL;
+	last_pathname = NULL;
+	for (event = (struct fanotify_event_metadata *)buffer;
+	     data != NULL && FAN_EVENT_OK(event, length);
+	     event = FAN_EVENT_NEXT(event, length)) {
+		if (event->vers != FANOTIFY_METADATA_VERSION) {
+			errno = EPROTO;
+			PyErr_SetFromErrno(PyExc_OSError);
+			Py_CLEAR(data);
+			break;
+		}
+		/* events without information record (e.g. queue overflow) yield an
+		   empty pathname */
+		name = "";
+		Py_INCREF(Py_None);
+		pathname = Py_None;
+		info = (char *)event + event->metadata_len;
+		if (info < (char *)event + event->event_len) {
+			fid = (struct fanotify_event_info_fid *)info;
+			handle = (struct file_handle *)fid->handle;
+			if (fid->hdr.info_type == FAN_EVENT_INFO_TYPE_DFID_NAME)
+				name = (char *)handle->f_handle + handle->handle_bytes;
+			if (last_handle != NULL &&
+			    last_handle->handle_bytes == handle->handle_bytes &&
+			    last_handle->handle_type == handle->handle_type &&
+			    memcmp(last_handle->f_handle, handle->f_handle, handle->handle_bytes) == 0) {
+				/* same directory as the previous event */
+				Py_DECREF(pathname);
+				Py_INCREF(last_pathname);
+				pathname = last_pathname;
+			} else {
+				/* look up mount fd of the reported filesystem and resolve handle */
+				key = PyLong_FromUnsignedLongLong(_fsid_key(fid->fsid.val));
+				mount_fd = key != NULL ? PyDict_GetItem(mountfds, key) : NULL;
+				Py_XDECREF(key);
+				if (mount_fd != NULL) {
+					path_len = _resolve_handle((int)PyLong_AsLong(mount_fd), handle, path);
+					if (path_len >= 0) {
+						Py_DECREF(pathname);
+						pathname = PyUnicode_DecodeFSDefaultAndSize(path, path_len);
+						if (pathname == NULL) {
+							Py_CLEAR(data);
+							break;
+						}
+					}
+				}
+				last_handle = handle;
+				Py_XDECREF(last_pathname);
+				Py_INCREF(pathname);
+				last_pathname = pathname;
+			}
+		} else {
+			Py_DECREF(pathname);
+			pathname = PyUnicode_FromString("");
+		}
+		item = Py_BuildValue("(N,s,K,i)", pathname, name, (unsigned long long)event->mask, 0);
+		if (item == NULL || PyList_Append(data, item) == -1) Py_CLEAR(data);
+		Py_XDECREF(item);
+		/* events are reported with an fd only without FID reporting */
+		if (event->fd >= 0) close(event->fd);
+	}
+	Py_XDECREF(last_pathname);
+	free(buffer); /* thou shalt always free allocated memory! */
+	free(path);
+	return data;
+}
+
+
+static PyMethodDef methods[] = {
+	{ "fanotify_init", _fanotify_init, METH_VARARGS, NULL },
+	{ "fanotify_mark", _fanotify_mark, METH_VARARGS, NULL },
+	{ "fanotify_fsid", _fanotify_fsid, METH_VARARGS, NULL },
+	{ "fanotify_read", _fanotify_read, METH_VARARGS, NULL },
+	{ NULL,            NULL,           0,            NULL }
+};
+
+static struct PyModuleDef fanotifymodule = { PyModuleDef_HEAD_INIT, "linuxfd.fanotify_c", NULL, 0, methods };
+
+/* create submodule linuxfd.fanotify_c, see linuxfd_c.h */
+PyObject * linuxfd_fanotify_c(void) {
+	PyObject *m;
+	m = PyModule_Create(&fanotifymodule);
+	if (m != NULL) {
+		/* define fanotify constants: init flags */
+		PyModule_AddIntConstant( m, "FAN_CLOEXEC",          FAN_CLOEXEC );
+		PyModule_AddIntConstant( m, "FAN_NONBLOCK",         FAN_NONBLOCK );
+		PyModule_AddIntConstant( m, "FAN_CLASS_NOTIF",      FAN_CLASS_NOTIF );
+		PyModule_AddIntConstant( m, "FAN_REPORT_DFID_NAME", FAN_REPORT_DFID_NAME );
+		/* define fanotify constants: mark flags */
+		PyModule_AddIntConstant( m, "FAN_MARK_ADD",         FAN_MARK_ADD );
+		PyModule_AddIntConstant( m, "FAN_MARK_REMOVE",      FAN_MARK_REMOVE );
+		PyModule_AddIntConstant( m, "FAN_MARK_MOUNT",       FAN_MARK_MOUNT );
+		PyModule_AddIntConstant( m, "FAN_MARK_FILESYSTEM",  FAN_MARK_FILESYSTEM );
+		/* define fanotify constants: events (identical to their IN_* counterparts) */
+		PyModule_AddIntConstant( m, "FAN_ONDIR",            FAN_ONDIR );
+		PyModule_AddIntConstant( m, "FAN_Q_OVERFLOW",       FAN_Q_OVERFLOW );
+	}
+	return m;
+}
@@ -15,6 +15,7 @@ Copyright (C) 2016-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
     along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#define PY_SSIZE_T_CLEAN
 #include <Python.h>
 #include <unistd.h>
 #include <stdlib.h> /* provides posix_memalign and free */
@@ -22,6 +23,26 @@ Copyright (C) 2016-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
 #include <sys/inotify.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h> /* definition of uintptr_t */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <math.h>   /* provides exp */
+#include <time.h>   /* provides clock_gettime */
+#include <fcntl.h>
+#include <sys/uio.h> /* provides writev */
+#include <sys/ioctl.h> /* provides FIONREAD */
+#include "xxh64.h"
+#include "liblinuxfd.h"
+#include "linuxfd_c.h"
+
+/* module state: the heap types of this submodule, created per interpreter */
+typedef struct {
+	PyTypeObject *WatchStatsType;
+	PyTypeObject *JournalType;
+	PyTypeObject *ReadBufferType;
+	PyTypeObject *EventIterType;
+	PyTypeObject *HashCacheType;
+} InotifyState;
 
 /* Python: inotify_init(flags) -> fd
    C:      int inotify_init1(int flags); */
@@ -34,9 +55,11 @@ static PyObject * _inotify_init(PyObject *self, PyObject *args) {
 	if (!PyArg_ParseTuple(args, "i", &flags)) return NULL;
 	
 	/* call inotify_init1(); catch errors by raising an exception */
+	LINUXFD_PROBE_ENTRY(inotify_init, -1);
 	Py_BEGIN_ALLOW_THREADS
 	fd = inotify_init1(flags);
 	Py_END_ALLOW_THREADS
+	LINUXFD_PROBE_RETURN(inotify_init, fd, fd, 0);
 	if (fd == -1) return PyErr_SetFromErrno(PyExc_OSError);
 	
 	/* everything's fine, return file descriptor */
@@ -48,18 +71,25 @@ static PyObject * _inotify_init(PyObject *self, PyObject *args) {
    C:      int inotify_add_watch(int fd, const char *pathname, uint32_t mask); */
 static PyObject * _inotify_add_watch(PyObject *self, PyObject *args) {
 	/* variable declarations */
-	int fd;
+	PyObject *fdobj;
+	FdRef fd;
 	int wd;
 	char *pathname;
 	uint32_t mask;
 	
-	/* parse the function's arguments: int fd */
-	if (!PyArg_ParseTuple(args, "isI", &fd, &pathname, &mask)) return NULL;
+	/* parse the function's arguments: fd */
+	if (!PyArg_ParseTuple(args, "OsI", &fdobj, &pathname, &mask)) return NULL;
+	if (!linuxfd_fd_borrow(fdobj, &fd)) return NULL;
 	
 	/* call inotify_add_watch(); catch errors by raising an exception */
+	LINUXFD_PROBE_ENTRY(inotify_add_watch, fd.fd);
+	fd.started = linuxfd_clock();
 	Py_BEGIN_ALLOW_THREADS
-	wd = inotify_add_watch(fd, pathname, mask);
+	wd = inotify_add_watch(fd.fd, pathname, mask);
 	Py_END_ALLOW_THREADS
+	linuxfd_fd_count(&fd, wd);
+	LINUXFD_PROBE_RETURN(inotify_add_watch, fd.fd, wd, 0);
+	linuxfd_fd_return(&fd);
 	if (wd == -1) return PyErr_SetFromErrno(PyExc_OSError);
 	
 	/* everything's fine, return watch descriptor */
@@ -67,21 +97,105 @@ static PyObject * _inotify_add_watch(PyObject *self, PyObject *args) {
 }
 
 
+/* Python: inotify_add_watches(fd,pathnames,mask) -> [wd or -errno, ...]
+   C:      void lfd_inotify_add_watches(int fd, const char * const *paths, size_t n,
+                                    uint32_t mask, int *results, lfd_hook hook,
+                                    void *arg);
+   add a sequence of pathnames releasing the GIL just once; a failed call does
+   not abort the batch, its slot holds the negated error number instead */
+static PyObject * _inotify_add_watches(PyObject *self, PyObject *args) {
+	/* variable declarations */
+	PyObject *fdobj;
+	FdRef fd;
+	uint32_t mask;
+	PyObject *pathnames;
+	PyObject *sequence;
+	PyObject *data;
+	Py_ssize_t n_paths;
+	Py_ssize_t i;
+	const char **paths;
+	int *results;
+	
+	/* parse the function's arguments: fd, sequence of str, uint32_t mask */
+	if (!PyArg_ParseTuple(args, "OOI", &fdobj, &pathnames, &mask)) return NULL;
+	sequence = PySequence_Fast(pathnames, "pathnames must be a sequence");
+	if (sequence == NULL) return NULL;
+	n_paths = PySequence_Fast_GET_SIZE(sequence);
+	
+	/* collect UTF-8 representations (owned by the str objects, which are kept
+	   alive by sequence) before the GIL is released */
+	paths   = PyMem_Malloc(n_paths * sizeof(char *) + 1);
+	results = PyMem_Malloc(n_paths * sizeof(int) + 1);
+	if (paths == NULL || results == NULL) {
+		PyMem_Free(paths);
+		PyMem_Free(results);
+		Py_DECREF(sequence);
+		return PyErr_NoMemory();
+	}
+	for (i = 0; i < n_paths; i++) {
+		paths[i] = PyUnicode_AsUTF8(PySequence_Fast_GET_ITEM(sequence, i));
+		if (paths[i] == NULL) {
+			PyMem_Free(paths);
+			PyMem_Free(results);
+			Py_DECREF(sequence);
+			return NULL;
+		}
+	}
+	
+	/* call inotify_add_watch() for every pathname; a closed descriptor fails
+	   every slot with EBADF, like a plain integer would */
+	if (!linuxfd_fd_borrow(fdobj, &fd)) {
+		if (!PyErr_ExceptionMatches(PyExc_OSError)) {
+			PyMem_Free(paths);
+			PyMem_Free(results);
+			Py_DECREF(sequence);
+			return NULL;
+		}
+		PyErr_Clear();
+		fd.fd = -1;
+		fd.owner = NULL;
+	}
+	LINUXFD_PROBE_ENTRY(inotify_add_watches, fd.fd);
+	fd.started = linuxfd_clock();
+	Py_BEGIN_ALLOW_THREADS
+	lfd_inotify_add_watches(fd.fd, paths, n_paths, mask, results, linuxfd_fd_hook, &fd);
+	Py_END_ALLOW_THREADS
+	LINUXFD_PROBE_RETURN(inotify_add_watches, fd.fd, n_paths, 0); /* result: number of calls */
+	linuxfd_fd_return(&fd);
+	
+	/* return list of watch descriptors / negated error numbers */
+	data = PyList_New(n_paths);
+	for (i = 0; data != NULL && i < n_paths; i++)
+		PyList_SET_ITEM(data, i, PyLong_FromLong(results[i]));
+	PyMem_Free(paths);
+	PyMem_Free(results);
+	Py_DECREF(sequence);
+	return data;
+}
+
+
 /* Python: inotify_rm_watch(fd,wd)
    C:      int inotify_rm_watch(int fd, int wd); */
 static PyObject * _inotify_rm_watch(PyObject *self, PyObject *args) {
 	/* variable declarations */
-	int fd;
+	PyObject *fdobj;
+	FdRef fd;
 	int wd;
 	int result;
 	
-	/* parse the function's arguments: int fd */
-	if (!PyArg_ParseTuple(args, "ii", &fd, &wd)) return NULL;
+	/* parse the function's arguments: fd */
+	if (!PyArg_ParseTuple(args, "Oi", &fdobj, &wd)) return NULL;
+	if (!linuxfd_fd_borrow(fdobj, &fd)) return NULL;
 	
 	/* call inotify_rm_watch(); catch errors by raising an exception */
+	LINUXFD_PROBE_ENTRY(inotify_rm_watch, fd.fd);
+	fd.started = linuxfd_clock();
 	Py_BEGIN_ALLOW_THREADS
-	result = inotify_rm_watch(fd, wd);
+	result = inotify_rm_watch(fd.fd, wd);
 	Py_END_ALLOW_THREADS
+	linuxfd_fd_count(&fd, result);
+	LINUXFD_PROBE_RETURN(inotify_rm_watch, fd.fd, result, 0);
+	linuxfd_fd_return(&fd);
 	if (result == -1) return PyErr_SetFromErrno(PyExc_OSError);
 	
 	/* everything's fine, return None value */
@@ -90,141 +204,1486 @@ static PyObject * _inotify_rm_watch(PyObject *self, PyObject *args) {
 }
 
 
-/* Python: inotify_read(fd,size) -> value
-   C:      ssize_t read(int fd, void *buf, size_t count); */
-static PyObject * _inotify_read(PyObject *self, PyObject *args) {
+/* Python: watchstats(halflife) -> watchstats object
+   per watch descriptor event statistics, updated by inotify_read() while
+   parsing the event buffer; cheap enough to be always enabled: the clock is
+   read once per batch and the rates are decayed once per batch and watch */
+typedef struct {
+	int wd;               /* -1 if the slot is unused */
+	uint64_t events;
+	uint64_t name_bytes;
+	uint64_t by_bit[32];  /* events per mask bit */
+	double last;          /* monotonic time of the last event, seconds */
+	double rate;          /* exponentially decayed events per second */
+} WatchStat;
+
+typedef struct {
+	PyObject_HEAD
+	WatchStat *stats;     /* open-addressing table keyed by live wd */
+	size_t capacity;      /* power of two, 0 before the first event */
+	size_t count;
+	double tau;           /* decay time constant (halflife / ln 2) */
+} WatchStatsObject;
+
+
+/* helper: current CLOCK_MONOTONIC time in seconds */
+static double _monotonic(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+
+/* helper: home slot of wd in a table of the given capacity */
+static size_t _watchstats_home(int wd, size_t capacity) {
+	return (size_t)((uint64_t)wd * XXH_PRIME64_1) & (capacity - 1);
+}
+
+
+/* helper: find the slot of wd in the open-addressing table (an unused one if
+   wd has no record) */
+static WatchStat * _watchstats_slot(WatchStat *table, size_t capacity, int wd) {
+	size_t i = _watchstats_home(wd, capacity);
+	while (table[i].wd != -1 && table[i].wd != wd)
+		i = (i + 1) & (capacity - 1);
+	return &table[i];
+}
+
+
+/* helper: move the records to a table of the given capacity */
+static int _watchstats_resize(WatchStatsObject *self, size_t capacity) {
+	size_t i;
+	WatchStat *table = malloc(capacity * sizeof(WatchStat));
+	if (table == NULL) return -1;
+	for (i = 0; i < capacity; i++) table[i].wd = -1;
+	for (i = 0; i < self->capacity; i++)
+		if (self->stats[i].wd != -1)
+			*_watchstats_slot(table, capacity, self->stats[i].wd) = self->stats[i];
+	free(self->stats);
+	self->stats = table;
+	self->capacity = capacity;
+	return 0;
+}
+
+
+/* helper: return the statistics record of wd, NULL if there is none */
+static WatchStat * _watchstats_find(WatchStatsObject *self, int wd) {
+	WatchStat *stat;
+	if (wd < 0 || self->capacity == 0) return NULL;
+	stat = _watchstats_slot(self->stats, self->capacity, wd);
+	return stat->wd == wd ? stat : NULL;
+}
+
+
+/* helper: return the statistics record of wd, adding it if necessary; NULL if
+   wd is invalid or memory is exhausted */
+static WatchStat * _watchstats_get(WatchStatsObject *self, int wd) {
+	WatchStat *stat;
+	if (wd < 0) return NULL;
+	if ((stat = _watchstats_find(self, wd)) != NULL) return stat;
+	/* keep the load factor at most 1/2; the table holds live watches only,
+	   so its capacity is bounded by twice max_user_watches */
+	if (2 * (self->count + 1) > self->capacity &&
+	    _watchstats_resize(self, self->capacity ? 2 * self->capacity : 64) == -1)
+		return NULL;
+	stat = _watchstats_slot(self->stats, self->capacity, wd);
+	memset(stat, 0, sizeof(WatchStat));
+	stat->wd = wd;
+	self->count++;
+	return stat;
+}
+
+
+/* helper: drop the statistics record of wd, if any; closes the gap by moving
+   later records of the probe sequence back (no tombstones) and shrinks the
+   table once it is mostly empty */
+static void _watchstats_drop(WatchStatsObject *self, int wd) {
+	WatchStat *stat = _watchstats_find(self, wd);
+	size_t mask = self->capacity - 1;
+	size_t i, j, home;
+	if (stat == NULL) return;
+	i = j = stat - self->stats;
+	while (1) {
+		j = (j + 1) & mask;
+		if (self->stats[j].wd == -1) break;
+		home = _watchstats_home(self->stats[j].wd, self->capacity);
+		/* j may fill the gap at i unless its home lies cyclically in (i,j] */
+		if (j > i ? (home <= i || home > j) : (home <= i && home > j)) {
+			self->stats[i] = self->stats[j];
+			i = j;
+		}
+	}
+	self->stats[i].wd = -1;
+	self->count--;
+	if (self->capacity > 64 && 8 * self->count < self->capacity)
+		_watchstats_resize(self, self->capacity / 2); /* or keep the larger one */
+}
+
+
+/* helper: decayed rate of a record at time now */
+static double _watchstats_rate(WatchStatsObject *self, WatchStat *stat, double now) {
+	if (stat->events == 0) return 0.0;
+	return stat->rate * exp(-(now - stat->last) / self->tau);
+}
+
+
+/* helper: account for a single event at time now */
+static void _watchstats_update(WatchStatsObject *self, const struct inotify_event *event, double now) {
+	uint32_t mask;
+	WatchStat *stat;
+	if (event->mask & IN_IGNORED) {
+		_watchstats_drop(self, event->wd); /* watch removed, wd may be reused */
+		return;
+	}
+	stat = _watchstats_get(self, event->wd);
+	if (stat == NULL) return; /* IN_Q_OVERFLOW (wd -1) or out of memory */
+	if (stat->last != now) {
+		stat->rate = _watchstats_rate(self, stat, now);
+		stat->last = now;
+	}
+	stat->rate += 1.0 / self->tau;
+	stat->events++;
+	stat->name_bytes += event->len;
+	for (mask = event->mask; mask != 0; mask &= mask - 1)
+		stat->by_bit[__builtin_ctz(mask)]++;
+}
+
+
+static PyObject * _watchstats_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+	double halflife = 60.0;
+	WatchStatsObject *self;
+
+	/* parse the function's arguments: double halflife */
+	if (!PyArg_ParseTuple(args, "|d", &halflife)) return NULL;
+	if (!(halflife > 0.0)) {
+		errno = EINVAL;
+		return PyErr_SetFromErrno(PyExc_OSError);
+	}
+	self = (WatchStatsObject *)type->tp_alloc(type, 0);
+	if (self == NULL) return NULL;
+	self->stats = NULL;
+	self->capacity = 0;
+	self->count = 0;
+	self->tau = halflife / M_LN2;
+	return (PyObject *)self;
+}
+
+
+static void _watchstats_dealloc(WatchStatsObject *self) {
+	free(self->stats);
+	linuxfd_free((PyObject *)self);
+}
+
+
+/* Python: watchstats.get(wd) -> dict or None */
+static PyObject * _watchstats_get_method(WatchStatsObject *self, PyObject *args) {
+	/* variable declarations */
+	int wd;
+	int bit;
+	WatchStat *stat;
+	PyObject *bymask;
+	PyObject *key;
+	PyObject *count;
+
+	if (!PyArg_ParseTuple(args, "i", &wd)) return NULL;
+	if ((stat = _watchstats_find(self, wd)) == NULL || stat->events == 0) {
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
+
+	/* map every mask bit seen to its event count */
+	bymask = PyDict_New();
+	for (bit = 0; bymask != NULL && bit < 32; bit++) {
+		if (stat->by_bit[bit] == 0) continue;
+		key = PyLong_FromUnsignedLong(1UL << bit);
+		count = PyLong_FromUnsignedLongLong(stat->by_bit[bit]);
+		if (key == NULL || count == NULL || PyDict_SetItem(bymask, key, count) == -1)
+			Py_CLEAR(bymask);
+		Py_XDECREF(key);
+		Py_XDECREF(count);
+	}
+	if (bymask == NULL) return NULL;
+	return Py_BuildValue("{s:K,s:K,s:d,s:d,s:N}",
+		"events",    (unsigned long long)stat->events,
+		"nameBytes", (unsigned long long)stat->name_bytes,
+		"lastEvent", stat->last,
+		"rate",      _watchstats_rate(self, stat, _monotonic()),
+		"masks",     bymask
+	);
+}
+
+
+/* helper for top(): order records by decreasing rate */
+typedef struct {
+	int wd;
+	double rate;
+	uint64_t events;
+} RateItem;
+
+static int _rateitem_cmp(const void *a, const void *b) {
+	double ra = ((const RateItem *)a)->rate;
+	double rb = ((const RateItem *)b)->rate;
+	return (ra < rb) - (ra > rb);
+}
+
+
+/* Python: watchstats.top(n) -> [(wd,rate,events), ...]
+   the n watch descriptors with the highest decayed event rate */
+static PyObject * _watchstats_top(WatchStatsObject *self, PyObject *args) {
+	/* variable declarations */
+	int n;
+	int i;
+	size_t slot;
+	int n_items;
+	double now;
+	RateItem *items;
+	PyObject *data;
+
+	if (!PyArg_ParseTuple(args, "i", &n)) return NULL;
+	items = PyMem_Malloc(self->count * sizeof(RateItem) + 1);
+	if (items == NULL) return PyErr_NoMemory();
+	now = _monotonic();
+	n_items = 0;
+	for (slot = 0; slot < self->capacity; slot++) {
+		if (self->stats[slot].wd == -1 || self->stats[slot].events == 0) continue;
+		items[n_items].wd = self->stats[slot].wd;
+		items[n_items].rate = _watchstats_rate(self, &self->stats[slot], now);
+		items[n_items].events = self->stats[slot].events;
+		n_items++;
+	}
+	qsort(items, n_items, sizeof(RateItem), _rateitem_cmp);
+	if (n > n_items) n = n_items;
+	if (n < 0) n = 0;
+	data = PyList_New(n);
+	for (i = 0; data != NULL && i < n; i++)
+		PyList_SET_ITEM(data, i, Py_BuildValue("(idK)",
+			items[i].wd, items[i].rate, (unsigned long long)items[i].events));
+	PyMem_Free(items);
+	return data;
+}
+
+
+/* Python: watchstats.forget(wd) */
+static PyObject * _watchstats_forget(WatchStatsObject *self, PyObject *args) {
+	int wd;
+	if (!PyArg_ParseTuple(args, "i", &wd)) return NULL;
+	_watchstats_drop(self, wd);
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+/* methods run in a critical section on self, see linuxfd_c.h */
+LINUXFD_LOCKED(_watchstats_get_method_locked, _watchstats_get_method)
+LINUXFD_LOCKED(_watchstats_top_locked, _watchstats_top)
+LINUXFD_LOCKED(_watchstats_forget_locked, _watchstats_forget)
+
+static PyMethodDef watchstats_methods[] = {
+	{ "get",    (PyCFunction)_watchstats_get_method_locked, METH_VARARGS, NULL },
+	{ "top",    (PyCFunction)_watchstats_top_locked,        METH_VARARGS, NULL },
+	{ "forget", (PyCFunction)_watchstats_forget_locked,     METH_VARARGS, NULL },
+	{ NULL,     NULL,                                       0,            NULL }
+};
+
+static PyType_Slot watchstats_slots[] = {
+	{ Py_tp_dealloc, _watchstats_dealloc },
+	{ Py_tp_methods, watchstats_methods },
+	{ Py_tp_new,     _watchstats_new },
+	{ 0, NULL }
+};
+
+static PyType_Spec watchstats_spec = {
+	.name      = "inotify_c.watchstats",
+	.basicsize = sizeof(WatchStatsObject),
+	.flags     = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE,
+	.slots     = watchstats_slots,
+};
+
+
+/* Python: journal(pathname) -> journal object
+   binary recording of inotify event batches for later replay. The file starts
+   with a header (magic "LFDJ", version, CLOCK_REALTIME and CLOCK_MONOTONIC
+   nanoseconds at creation), followed by records of a JournalRecord header and
+   its payload: raw event buffers as read from the inotify file descriptor
+   ('E'), watch descriptor to pathname mappings ('W', int32 wd + UTF-8 path)
+   or the start of a recording appended to an existing journal ('S', uint64
+   CLOCK_REALTIME ns). All values use host byte order. Records are collected
+   in a buffer and written in large blocks; a block that cannot be written
+   completely is cut off again, so the file only holds whole records. */
+#define JOURNAL_MAGIC   "LFDJ"
+#define JOURNAL_VERSION 1
+#define JOURNAL_BUFSIZE 65536
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint64_t realtime;    /* ns */
+	uint64_t monotonic;   /* ns */
+} JournalHeader;
+
+typedef struct {
+	uint8_t type;         /* 'E', 'W' or 'S' */
+	uint8_t reserved[3];
+	uint32_t length;      /* payload bytes following this header */
+	uint64_t timestamp;   /* CLOCK_MONOTONIC ns */
+} JournalRecord;
+
+typedef struct {
+	PyObject_HEAD
+	int fd;
+	char *buffer;
+	size_t used;
+	size_t records;       /* records in buffer */
+	off_t size;           /* file length up to the last whole record */
+	uint64_t dropped;     /* records lost due to write errors */
+} JournalObject;
+
+
+/* helper: current time of a clock in nanoseconds */
+static uint64_t _clock_ns(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+
+/* helper: cut off a partially written block, which replay could not skip;
+   the journal is stopped if that fails */
+static void _journal_cut(JournalObject *self) {
+	int error = errno;
+	if (ftruncate(self->fd, self->size) == -1) {
+		close(self->fd);
+		self->fd = -1;
+	}
+	errno = error;
+}
+
+
+/* helper: write the buffered records to the file; returns -1 and counts all
+   of them as dropped on error. The GIL is kept: another thread appending to
+   the buffer meanwhile would corrupt it, and writing 64 KiB to the page cache
+   is short anyway */
+static int _journal_flush(JournalObject *self) {
+	size_t offset = 0;
+	ssize_t result = 0;
+	while (offset < self->used) {
+		result = write(self->fd, self->buffer + offset, self->used - offset);
+		if (result == -1 && errno == EINTR) continue;
+		if (result == -1) break;
+		offset += result;
+	}
+	if (result == -1) {
+		self->dropped += self->records;
+		if (offset > 0) _journal_cut(self);
+	} else {
+		self->size += offset;
+	}
+	self->used = 0;
+	self->records = 0;
+	return result == -1 ? -1 : 0;
+}
+
+
+/* helper: append a record of one or two payload parts; returns -1 and counts
+   the record as dropped on error */
+static int _journal_append(JournalObject *self, uint8_t type, uint64_t timestamp,
+                           const void *part1, size_t len1, const void *part2, size_t len2) {
+	JournalRecord record;
+	size_t total = sizeof(record) + len1 + len2;
+	ssize_t result;
+
+	if (self->fd == -1) {
+		/* stopped after a write error */
+		self->dropped++;
+		errno = EBADF;
+		return -1;
+	}
+	memset(&record, 0, sizeof(record));
+	record.type = type;
+	record.length = (uint32_t)(len1 + len2);
+	record.timestamp = timestamp;
+	if (self->used + total > JOURNAL_BUFSIZE && _journal_flush(self) == -1) {
+		self->dropped++;
+		return -1;
+	}
+	if (total > JOURNAL_BUFSIZE) {
+		/* oversized record (huge read buffer): write it directly */
+		struct iovec iov[3] = {
+			{ &record, sizeof(record) }, { (void *)part1, len1 }, { (void *)part2, len2 }
+		};
+		result = writev(self->fd, iov, 3);
+		if (result != (ssize_t)total) {
+			self->dropped++;
+			if (result != -1) errno = EIO;
+			if (result > 0) _journal_cut(self);
+			return -1;
+		}
+		self->size += total;
+		return 0;
+	}
+	memcpy(self->buffer + self->used, &record, sizeof(record));
+	memcpy(self->buffer + self->used + sizeof(record), part1, len1);
+	if (len2 > 0) memcpy(self->buffer + self->used + sizeof(record) + len1, part2, len2);
+	self->used += total;
+	self->records++;
+	return 0;
+}
+
+
+static PyObject * _journal_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
 	/* variable declarations */
+	PyObject *pathname;
+	JournalObject *self;
+	JournalHeader header;
+	struct stat st;
+	uint64_t realtime;
+	ssize_t result;
 	int fd;
-	int size;
+
+	/* parse the function's arguments: path-like pathname */
+	if (!PyArg_ParseTuple(args, "O&", PyUnicode_FSConverter, &pathname)) return NULL;
+
+	/* open journal; existing journals are appended to */
+	Py_BEGIN_ALLOW_THREADS
+	fd = open(PyBytes_AS_STRING(pathname), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	Py_END_ALLOW_THREADS
+	Py_DECREF(pathname);
+	if (fd == -1) return PyErr_SetFromErrno(PyExc_OSError);
+
+	/* new journal: write file header right away, records rely on it */
+	realtime = _clock_ns(CLOCK_REALTIME);
+	if (fstat(fd, &st) == -1) goto error;
+	if (st.st_size == 0) {
+		memcpy(header.magic, JOURNAL_MAGIC, 4);
+		header.version = JOURNAL_VERSION;
+		header.realtime = realtime;
+		header.monotonic = _clock_ns(CLOCK_MONOTONIC);
+		result = write(fd, &header, sizeof(header));
+		if (result != (ssize_t)sizeof(header)) {
+			/* leave no partial header behind */
+			if (result > 0 && ftruncate(fd, 0) == 0) errno = EIO;
+			if (result == 0) errno = EIO;
+			goto error;
+		}
+		st.st_size = sizeof(header);
+	}
+
+	self = (JournalObject *)type->tp_alloc(type, 0);
+	if (self == NULL || (self->buffer = malloc(JOURNAL_BUFSIZE)) == NULL) {
+		close(fd);
+		Py_XDECREF(self);
+		return PyErr_NoMemory();
+	}
+	self->fd = fd;
+	self->size = st.st_size;
+
+	/* existing journal: mark the start of this recording, so that replay does
+	   not wait for the time between the recordings */
+	if (st.st_size > (off_t)sizeof(header))
+		_journal_append(self, 'S', _clock_ns(CLOCK_MONOTONIC), &realtime, sizeof(realtime), NULL, 0);
+	return (PyObject *)self;
+
+error:
+	PyErr_SetFromErrno(PyExc_OSError);
+	close(fd);
+	return NULL;
+}
+
+
+static void _journal_dealloc(JournalObject *self) {
+	if (self->fd != -1) _journal_flush(self);
+	if (self->fd != -1) close(self->fd); /* unless stopped by the flush */
+	free(self->buffer);
+	linuxfd_free((PyObject *)self);
+}
+
+
+/* Python: journal.watch(wd,pathname)
+   record the pathname of a watch descriptor */
+static PyObject * _journal_watch(JournalObject *self, PyObject *args) {
+	int32_t wd;
+	const char *pathname;
+	Py_ssize_t length;
+
+	if (!PyArg_ParseTuple(args, "is#", &wd, &pathname, &length)) return NULL;
+	if (_journal_append(self, 'W', _clock_ns(CLOCK_MONOTONIC), &wd, sizeof(wd), pathname, length) == -1)
+		return PyErr_SetFromErrno(PyExc_OSError);
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+/* Python: journal.flush() */
+static PyObject * _journal_flush_method(JournalObject *self, PyObject *args) {
+	if (self->fd != -1 && _journal_flush(self) == -1) return PyErr_SetFromErrno(PyExc_OSError);
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+/* Python: journal.close() */
+static PyObject * _journal_close(JournalObject *self, PyObject *args) {
+	int result = 0;
+	if (self->fd != -1) result = _journal_flush(self);
+	if (self->fd != -1) {
+		close(self->fd);
+		self->fd = -1;
+	}
+	if (result == -1) return PyErr_SetFromErrno(PyExc_OSError);
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+/* Python: journal.dropped() -> number of records lost due to write errors */
+static PyObject * _journal_dropped(JournalObject *self, PyObject *args) {
+	return PyLong_FromUnsignedLongLong(self->dropped);
+}
+
+
+/* methods run in a critical section on self, see linuxfd_c.h */
+LINUXFD_LOCKED(_journal_watch_locked, _journal_watch)
+LINUXFD_LOCKED(_journal_flush_method_locked, _journal_flush_method)
+LINUXFD_LOCKED(_journal_close_locked, _journal_close)
+LINUXFD_LOCKED(_journal_dropped_locked, _journal_dropped)
+
+static PyMethodDef journal_methods[] = {
+	{ "watch",   (PyCFunction)_journal_watch_locked,        METH_VARARGS, NULL },
+	{ "flush",   (PyCFunction)_journal_flush_method_locked, METH_NOARGS,  NULL },
+	{ "close",   (PyCFunction)_journal_close_locked,        METH_NOARGS,  NULL },
+	{ "dropped", (PyCFunction)_journal_dropped_locked,      METH_NOARGS,  NULL },
+	{ NULL,      NULL,                                      0,            NULL }
+};
+
+static PyType_Slot journal_slots[] = {
+	{ Py_tp_dealloc, _journal_dealloc },
+	{ Py_tp_methods, journal_methods },
+	{ Py_tp_new,     _journal_new },
+	{ 0, NULL }
+};
+
+static PyType_Spec journal_spec = {
+	.name      = "inotify_c.journal",
+	.basicsize = sizeof(JournalObject),
+	.flags     = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE,
+	.slots     = journal_slots,
+};
+
+
+/* Python: readbuffer(minimum=4096,maximum=1048576) -> readbuffer object
+   read buffer reused by inotify_read(), adapted to the observed load between
+   reads, see lfd_readbuffer in liblinuxfd.h */
+typedef struct {
+	PyObject_HEAD
+	lfd_readbuffer rb;
+	atomic_int busy;      /* buffer claimed by a read, which may release the GIL */
+} ReadBufferObject;
+
+
+static PyObject * _readbuffer_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+	Py_ssize_t minimum = 4096;
+	Py_ssize_t maximum = 1048576;
+	ReadBufferObject *self;
+
+	if (!PyArg_ParseTuple(args, "|nn", &minimum, &maximum)) return NULL;
+	if (minimum < 0 || maximum < 0) {
+		errno = EINVAL;
+		return PyErr_SetFromErrno(PyExc_OSError);
+	}
+	self = (ReadBufferObject *)type->tp_alloc(type, 0);
+	if (self == NULL) return NULL;
+	if (lfd_readbuffer_init(&self->rb, minimum, maximum) == -1) {
+		Py_DECREF(self);
+		return errno == ENOMEM ? PyErr_NoMemory() : PyErr_SetFromErrno(PyExc_OSError);
+	}
+	return (PyObject *)self;
+}
+
+
+static void _readbuffer_dealloc(ReadBufferObject *self) {
+	lfd_readbuffer_free(&self->rb);
+	linuxfd_free((PyObject *)self);
+}
+
+
+/* Python: readbuffer.size() -> current buffer size in bytes */
+static PyObject * _readbuffer_size(ReadBufferObject *self, PyObject *args) {
+	return PyLong_FromSize_t(self->rb.size);
+}
+
+
+/* Python: readbuffer.info() -> dictionary of sizing statistics */
+static PyObject * _readbuffer_info(ReadBufferObject *self, PyObject *args) {
+	return Py_BuildValue("{s:n,s:n,s:n,s:n,s:n,s:d,s:K,s:K,s:K}",
+		"size",      (Py_ssize_t)self->rb.size,
+		"minimum",   (Py_ssize_t)self->rb.minimum,
+		"maximum",   (Py_ssize_t)self->rb.maximum,
+		"highWater", (Py_ssize_t)self->rb.highwater,
+		"backlog",   (Py_ssize_t)self->rb.backlog,
+		"average",   self->rb.average,
+		"reads",     (unsigned long long)self->rb.reads,
+		"grows",     (unsigned long long)self->rb.grows,
+		"shrinks",   (unsigned long long)self->rb.shrinks);
+}
+
+
+/* methods run in a critical section on self, see linuxfd_c.h */
+LINUXFD_LOCKED(_readbuffer_size_locked, _readbuffer_size)
+LINUXFD_LOCKED(_readbuffer_info_locked, _readbuffer_info)
+
+static PyMethodDef readbuffer_methods[] = {
+	{ "size", (PyCFunction)_readbuffer_size_locked, METH_NOARGS, NULL },
+	{ "info", (PyCFunction)_readbuffer_info_locked, METH_NOARGS, NULL },
+	{ NULL,   NULL,                                 0,           NULL }
+};
+
+static PyType_Slot readbuffer_slots[] = {
+	{ Py_tp_dealloc, _readbuffer_dealloc },
+	{ Py_tp_methods, readbuffer_methods },
+	{ Py_tp_new,     _readbuffer_new },
+	{ 0, NULL }
+};
+
+static PyType_Spec readbuffer_spec = {
+	.name      = "inotify_c.readbuffer",
+	.basicsize = sizeof(ReadBufferObject),
+	.flags     = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE,
+	.slots     = readbuffer_slots,
+};
+
+
+/* helper: convert an inotify_event structure to a tuple (wd,mask,cookie,name) */
+static PyObject * _inotify_event_tuple(const struct inotify_event *event) {
+	return Py_BuildValue("(i,i,i,s)",
+		event->wd,
+		event->mask,
+		event->cookie,
+		event->len > 0 ? event->name : "" /* nasty, I know... */
+	);
+}
+
+
+/* Python: inotify_rm_watches(fd,wds) -> [0 or -errno, ...]
+   C:      void lfd_inotify_rm_watches(int fd, int *wds, size_t n, lfd_hook hook,
+                                   void *arg);
+   batch counterpart of inotify_rm_watch(), see inotify_add_watches() */
+static PyObject * _inotify_rm_watches(PyObject *self, PyObject *args) {
+	/* variable declarations */
+	PyObject *fdobj;
+	FdRef fd;
+	PyObject *wdlist;
+	PyObject *sequence;
+	PyObject *data;
+	Py_ssize_t n_wds;
+	Py_ssize_t i;
+	int *wds;
+	
+	/* parse the function's arguments: fd, sequence of int */
+	if (!PyArg_ParseTuple(args, "OO", &fdobj, &wdlist)) return NULL;
+	sequence = PySequence_Fast(wdlist, "wds must be a sequence");
+	if (sequence == NULL) return NULL;
+	n_wds = PySequence_Fast_GET_SIZE(sequence);
+	
+	/* convert watch descriptors; results are stored in place */
+	wds = PyMem_Malloc(n_wds * sizeof(int) + 1);
+	if (wds == NULL) {
+		Py_DECREF(sequence);
+		return PyErr_NoMemory();
+	}
+	for (i = 0; i < n_wds; i++) {
+		wds[i] = (int)PyLong_AsLong(PySequence_Fast_GET_ITEM(sequence, i));
+		if (wds[i] == -1 && PyErr_Occurred()) {
+			PyMem_Free(wds);
+			Py_DECREF(sequence);
+			return NULL;
+		}
+	}
+	
+	/* call inotify_rm_watch() for every watch descriptor; see above */
+	if (!linuxfd_fd_borrow(fdobj, &fd)) {
+		if (!PyErr_ExceptionMatches(PyExc_OSError)) {
+			PyMem_Free(wds);
+			Py_DECREF(sequence);
+			return NULL;
+		}
+		PyErr_Clear();
+		fd.fd = -1;
+		fd.owner = NULL;
+	}
+	LINUXFD_PROBE_ENTRY(inotify_rm_watches, fd.fd);
+	fd.started = linuxfd_clock();
+	Py_BEGIN_ALLOW_THREADS
+	lfd_inotify_rm_watches(fd.fd, wds, n_wds, linuxfd_fd_hook, &fd);
+	Py_END_ALLOW_THREADS
+	LINUXFD_PROBE_RETURN(inotify_rm_watches, fd.fd, n_wds, 0); /* result: number of calls */
+	linuxfd_fd_return(&fd);
+	
+	/* return list of zeros / negated error numbers */
+	data = PyList_New(n_wds);
+	for (i = 0; data != NULL && i < n_wds; i++)
+		PyList_SET_ITEM(data, i, PyLong_FromLong(wds[i]));
+	PyMem_Free(wds);
+	Py_DECREF(sequence);
+	return data;
+}
+
+
+/* Python: inotify_read(fd,size[,stats[,journal[,flags]]]) -> value
+   C:      ssize_t read(int fd, void *buf, size_t count);
+   size is either an integer, the size of a buffer allocated for this call, or
+   a readbuffer object, which is reused and adapted to the observed load; if a
+   watchstats object is given, it is updated with the events read; if a
+   journal object is given, the raw event buffer is appended to it; with flag
+   TRY_READ, None is returned instead of raising EAGAIN; with flag KEEP_GIL,
+   the GIL is not released (the caller knows fd is non-blocking) */
+static PyObject * _inotify_read(PyObject *self, PyObject *args) {
+	/* variable declarations */
+	PyObject *fdobj;
+	FdRef fd;
 	int result;
-	int length;
+	ssize_t length;
+	size_t size;
 	int n_events;
-	char *pointer;
+	size_t offset;
 	char *buffer;
-	struct inotify_event *event;
+	double now;
+	const struct inotify_event *event;
 	PyObject *data;
+	PyObject *sizeobj;
+	PyObject *stats = Py_None;
+	PyObject *journal = Py_None;
+	ReadBufferObject *readbuffer = NULL;
+	int flags = 0;
+	InotifyState *state = (InotifyState *)PyModule_GetState(self);
 	
-	/* parse the function's argument: int fd, int size */
-	if (!PyArg_ParseTuple(args, "ii", &fd, &size)) return NULL;
-	
-	/* prepare buffer by allocating enough memory
-	   (deal with too small or negative values) */
-	if (size < sizeof(struct inotify_event)) size = sizeof(struct inotify_event);
-	/* taken from the example in man 7 inotify:
-	      "Some systems cannot read integer variables if they are not properly
-	      aligned. On other systems, incorrect alignment may decrease
-	      performance. Hence, the buffer used for reading from the inotify file
-	      descriptor should have the same alignment as struct inotify_event."
-	   Thus use posix_memalign() instead of malloc() */
-	result = posix_memalign((void **)&buffer,sizeof(struct inotify_event),size);
-	if (result != 0) {
-		/* allocation failed, raise OSError with errno set to returned value
-		   (since posix_memalign() won't set it */
-		errno = result;
-		return PyErr_SetFromErrno(PyExc_OSError);
+	/* parse the function's argument: fd, int size or readbuffer, optional watchstats, journal and flags */
+	if (!PyArg_ParseTuple(args, "OO|OOi", &fdobj, &sizeobj, &stats, &journal, &flags)) return NULL;
+	if (stats != Py_None && !PyObject_TypeCheck(stats, state->WatchStatsType)) {
+		PyErr_SetString(PyExc_TypeError, "stats must be a watchstats object or None");
+		return NULL;
+	}
+	if (journal != Py_None && !PyObject_TypeCheck(journal, state->JournalType)) {
+		PyErr_SetString(PyExc_TypeError, "journal must be a journal object or None");
+		return NULL;
+	}
+	
+	if (PyObject_TypeCheck(sizeobj, state->ReadBufferType)) {
+		/* reuse the adaptive buffer, unless another thread is reading into it;
+		   claiming it is atomic, as the claim outlasts a GIL release */
+		readbuffer = (ReadBufferObject *)sizeobj;
+		if (atomic_exchange(&readbuffer->busy, 1) == 0) {
+			size = readbuffer->rb.size;
+		} else {
+			Py_BEGIN_CRITICAL_SECTION(sizeobj);
+			size = readbuffer->rb.size;
+			Py_END_CRITICAL_SECTION();
+			readbuffer = NULL;
+		}
+	} else {
+		length = PyLong_AsSsize_t(sizeobj);
+		if (length == -1 && PyErr_Occurred()) return NULL;
+		size = length > 0 ? (size_t)length : 0;
+	}
+	
+	if (readbuffer != NULL) {
+		buffer = readbuffer->rb.buffer;
+	} else {
+		/* prepare buffer by allocating enough memory
+		   (deal with too small or negative values) */
+		if (size < sizeof(struct inotify_event)) size = sizeof(struct inotify_event);
+		/* taken from the example in man 7 inotify:
+		      "Some systems cannot read integer variables if they are not properly
+		      aligned. On other systems, incorrect alignment may decrease
+		      performance. Hence, the buffer used for reading from the inotify file
+		      descriptor should have the same alignment as struct inotify_event."
+		   Thus use posix_memalign() instead of malloc() */
+		result = posix_memalign((void **)&buffer,sizeof(struct inotify_event),size);
+		if (result != 0) {
+			/* allocation failed, raise OSError with errno set to returned value
+			   (since posix_memalign() won't set it */
+			errno = result;
+			return PyErr_SetFromErrno(PyExc_OSError);
+		}
 	}
 	
 	/* call read(); catch OSErrors */
-	Py_BEGIN_ALLOW_THREADS
-	length = read(fd, buffer, size);
-	Py_END_ALLOW_THREADS
+	if (!linuxfd_fd_borrow(fdobj, &fd)) {
+		length = -1;
+	} else if (flags & KEEP_GIL) {
+		LINUXFD_PROBE_ENTRY(inotify_read, fd.fd);
+		length = read(fd.fd, buffer, size);
+		linuxfd_fd_count_read(&fd, length);
+		LINUXFD_PROBE_RETURN(inotify_read, fd.fd, length, length > 0 ? length : 0);
+	} else {
+		LINUXFD_PROBE_ENTRY(inotify_read, fd.fd);
+		fd.started = linuxfd_clock();
+		Py_BEGIN_ALLOW_THREADS
+		length = read(fd.fd, buffer, size);
+		Py_END_ALLOW_THREADS
+		linuxfd_fd_count_read(&fd, length);
+		LINUXFD_PROBE_RETURN(inotify_read, fd.fd, length, length > 0 ? length : 0);
+	}
 	
 	if (length == -1) {
 		/* read failed, raise OSError with current error number */
-		free(buffer); /* thou shalt always free allocated memory! */
+		if (readbuffer != NULL)
+			atomic_store(&readbuffer->busy, 0);
+		else
+			free(buffer); /* thou shalt always free allocated memory! */
+		if (PyErr_Occurred()) return NULL; /* fd not borrowed */
+		linuxfd_fd_return(&fd);
+		if (errno == EAGAIN && (flags & TRY_READ)) {
+			/* no events: cheap "empty" result without an exception */
+			Py_INCREF(Py_None);
+			return Py_None;
+		}
 		return PyErr_SetFromErrno(PyExc_OSError);
 	}
 	
-	/* loop over all events in the buffer (example again adapted from the one in man 7 inotify) */
+	/* record raw batch; a failing journal must not lose the events read, so
+	   errors are only counted by the journal */
+	if (journal != Py_None) {
+		Py_BEGIN_CRITICAL_SECTION(journal);
+		_journal_append((JournalObject *)journal, 'E', _clock_ns(CLOCK_MONOTONIC), buffer, length, NULL, 0);
+		Py_END_CRITICAL_SECTION();
+	}
+	
+	/* loop over all events in the buffer */
 	/* first run: determine number of events in order to declare a properly sized PyList */
 	n_events = 0;
-	for (pointer = buffer; pointer < buffer + length; pointer += sizeof(struct inotify_event) + event->len) {
-		/* cast current pointer to an inotify_event structure and increase number of events */
-		event = (struct inotify_event *)pointer;
-		n_events++;
-	}
+	offset = 0;
+	while (lfd_inotify_next(buffer, length, &offset) != NULL) n_events++;
 	data = PyList_New(n_events);
 	/* second run: populate PyList with the events via PyList_SetItem */
 	n_events = 0;
-	for (pointer = buffer; pointer < buffer + length; pointer += sizeof(struct inotify_event) + event->len) {
-		/* cast current pointer to an inotify_event structure */
-		event = (struct inotify_event *)pointer;
+	offset = 0;
+	while (data != NULL && (event = lfd_inotify_next(buffer, length, &offset)) != NULL) {
 		/* set a new list item */
-		PyList_SetItem(
-			data,
-			n_events,
-			Py_BuildValue("(i,i,i,s)",
-				event->wd,
-				event->mask,
-				event->cookie,
-				event->len > 0 ? event->name : "" /* nasty, I know... */
-			)
-		);
+		PyList_SetItem(data, n_events, _inotify_event_tuple(event));
 		n_events++; /* keep track of item position */
 	}
-	free(buffer); /* thou shalt always free allocated memory! */
+	/* third run: update statistics */
+	if (stats != Py_None) {
+		now = _monotonic();
+		offset = 0;
+		Py_BEGIN_CRITICAL_SECTION(stats);
+		while ((event = lfd_inotify_next(buffer, length, &offset)) != NULL)
+			_watchstats_update((WatchStatsObject *)stats, event, now);
+		Py_END_CRITICAL_SECTION();
+	}
+	if (readbuffer != NULL) {
+		/* events are decoded, the buffer may be resized now; release the claim
+		   only afterwards */
+		Py_BEGIN_CRITICAL_SECTION((PyObject *)readbuffer);
+		lfd_readbuffer_adapt(&readbuffer->rb, fd.fd, length);
+		Py_END_CRITICAL_SECTION();
+		atomic_store(&readbuffer->busy, 0);
+	} else {
+		free(buffer); /* thou shalt always free allocated memory! */
+	}
+	linuxfd_fd_return(&fd);
 	return data;
 }
 
 
+/* Python: inotify_read_into(fd,buffer[,flags]) -> length
+   C:      ssize_t read(int fd, void *buf, size_t count);
+   with flag KEEP_GIL, the GIL is not released */
+static PyObject * _inotify_read_into(PyObject *self, PyObject *args) {
+	/* variable declarations */
+	PyObject *fdobj;
+	FdRef fd;
+	int flags = 0;
+	ssize_t length;
+	Py_buffer buffer;
+	
+	/* parse the function's arguments: fd, writable buffer, optional int flags */
+	if (!PyArg_ParseTuple(args, "Ow*|i", &fdobj, &buffer, &flags)) return NULL;
+	
+	/* the caller's buffer replaces the posix_memalign()ed one of inotify_read(),
+	   so it has to satisfy the same alignment and minimum size constraints */
+	if ((uintptr_t)buffer.buf % __alignof__(struct inotify_event) != 0 ||
+	    buffer.len < (Py_ssize_t)sizeof(struct inotify_event)) {
+		PyBuffer_Release(&buffer);
+		errno = EINVAL;
+		return PyErr_SetFromErrno(PyExc_OSError);
+	}
+	
+	/* call read(); the buffer export keeps the memory in place while the GIL
+	   is released */
+	if (!linuxfd_fd_borrow(fdobj, &fd)) {
+		PyBuffer_Release(&buffer);
+		return NULL;
+	}
+	LINUXFD_PROBE_ENTRY(inotify_read_into, fd.fd);
+	if (flags & KEEP_GIL) {
+		length = read(fd.fd, buffer.buf, buffer.len);
+	} else {
+		fd.started = linuxfd_clock();
+		Py_BEGIN_ALLOW_THREADS
+		length = read(fd.fd, buffer.buf, buffer.len);
+		Py_END_ALLOW_THREADS
+	}
+	linuxfd_fd_count_read(&fd, length);
+	LINUXFD_PROBE_RETURN(inotify_read_into, fd.fd, length, length > 0 ? length : 0);
+	linuxfd_fd_return(&fd);
+	PyBuffer_Release(&buffer);
+	if (length == -1) return PyErr_SetFromErrno(PyExc_OSError);
+	
+	/* everything's fine, return number of bytes written to the buffer */
+	return PyLong_FromSsize_t(length);
+}
+
+
+/* Python: inotify_event(buffer,offset) -> (wd,mask,cookie,name)
+   decode a single struct inotify_event found at offset in buffer */
+static PyObject * _inotify_event(PyObject *self, PyObject *args) {
+	/* variable declarations */
+	Py_buffer buffer;
+	Py_ssize_t offset;
+	struct inotify_event header;
+	const char *name;
+	size_t namelen;
+	PyObject *result;
+	
+	/* parse the function's arguments: readable buffer, Py_ssize_t offset */
+	if (!PyArg_ParseTuple(args, "y*n", &buffer, &offset)) return NULL;
+	
+	/* check that header and name are located within the buffer; an offset
+	   into a memoryview need not be aligned */
+	if (offset < 0 || lfd_inotify_event_at(buffer.buf, buffer.len, offset, &header, &name, &namelen) == -1) {
+		PyBuffer_Release(&buffer);
+		errno = EINVAL;
+		return PyErr_SetFromErrno(PyExc_OSError);
+	}
+	result = Py_BuildValue("(i,i,i,s#)",
+		header.wd,
+		header.mask,
+		header.cookie,
+		name,
+		(Py_ssize_t)namelen
+	);
+	PyBuffer_Release(&buffer);
+	return result;
+}
+
+
+/* Python: inotify_events(buffer[,length]) -> iterator over (offset,size)
+   iterate over the struct inotify_event records in the first length bytes of
+   buffer without materialising them */
+typedef struct {
+	PyObject_HEAD
+	Py_buffer buffer;
+	Py_ssize_t offset;
+	Py_ssize_t length;
+} EventIterObject;
+
+static void _eventiter_dealloc(EventIterObject *self) {
+	PyBuffer_Release(&self->buffer);
+	linuxfd_free((PyObject *)self);
+}
+
+static PyObject * _eventiter_next(EventIterObject *self) {
+	/* variable declarations */
+	struct inotify_event header;
+	Py_ssize_t offset;
+	Py_ssize_t size;
+	
+	/* stop if there is no complete header left */
+	offset = self->offset;
+	if (offset + (Py_ssize_t)sizeof(struct inotify_event) > self->length) return NULL;
+	memcpy(&header, (char *)self->buffer.buf + offset, sizeof(struct inotify_event));
+	
+	/* stop if the record is truncated (a short buffer was passed) */
+	size = sizeof(struct inotify_event) + header.len;
+	if (offset + size > self->length) return NULL;
+	
+	self->offset += size;
+	return Py_BuildValue("(nn)", offset, size);
+}
+
+static PyType_Slot eventiter_slots[] = {
+	{ Py_tp_dealloc,  _eventiter_dealloc },
+	{ Py_tp_iter,     PyObject_SelfIter },
+	{ Py_tp_iternext, _eventiter_next },
+	{ 0, NULL }
+};
+
+static PyType_Spec eventiter_spec = {
+	.name      = "inotify_c.inotify_events",
+	.basicsize = sizeof(EventIterObject),
+	.flags     = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE | Py_TPFLAGS_DISALLOW_INSTANTIATION,
+	.slots     = eventiter_slots,
+};
+
+static PyObject * _inotify_events(PyObject *self, PyObject *args) {
+	/* variable declarations */
+	Py_buffer buffer;
+	Py_ssize_t length = -1;
+	EventIterObject *iter;
+	InotifyState *state = (InotifyState *)PyModule_GetState(self);
+	
+	/* parse the function's arguments: readable buffer, optional length */
+	if (!PyArg_ParseTuple(args, "y*|n", &buffer, &length)) return NULL;
+	
+	iter = PyObject_New(EventIterObject, state->EventIterType);
+	if (iter == NULL) {
+		PyBuffer_Release(&buffer);
+		return NULL;
+	}
+	
+	/* restrict iteration to the valid part of the buffer, if given */
+	if (length < 0 || length > buffer.len) length = buffer.len;
+	iter->buffer = buffer; /* iterator takes over the buffer export */
+	iter->offset = 0;
+	iter->length = length;
+	return (PyObject *)iter;
+}
+
+
+/* Python: hashcache(threads,maxEntries) -> hashcache object
+   content hashes of files keyed by device and inode, used to suppress
+   IN_CLOSE_WRITE events of files rewritten with identical contents; files are
+   hashed by a pool of native threads with the GIL released. At most
+   maxEntries hashes are kept (no limit if zero); beyond that, entries not
+   looked up recently are evicted (CLOCK algorithm) */
+enum { HASH_FREE, HASH_USED, HASH_REFERENCED };
+
+typedef struct {
+	uint64_t ino;
+	uint64_t hash;
+	uint32_t dev;   /* truncated device number, sufficient to tell mounts apart */
+	uint32_t used;  /* HASH_FREE, HASH_USED or HASH_REFERENCED since the last eviction pass */
+} HashEntry;
+
+typedef struct {
+	const char *pathname;
+	uint64_t hash;
+	uint64_t dev;
+	uint64_t ino;
+	int ok;
+} HashJob;
+
+typedef struct {
+	PyObject_HEAD
+	HashEntry *table;
+	size_t capacity;         /* power of two */
+	size_t count;
+	size_t max_entries;      /* 0: unlimited */
+	size_t hand;             /* eviction clock hand */
+	int n_threads;
+	pthread_t *threads;
+	pthread_mutex_t batch;   /* serialises concurrent filter() calls */
+	pthread_mutex_t lock;    /* protects the fields below */
+	pthread_cond_t start;
+	pthread_cond_t done;
+	HashJob *jobs;
+	size_t n_jobs;
+	size_t next;
+	size_t finished;
+	int shutdown;
+} HashCacheObject;
+
+
+/* helper: hash the job with the next index, if any; called with lock held,
+   returns 0 if there are no jobs left */
+static int _hashcache_work(HashCacheObject *self) {
+	HashJob *job;
+	if (self->next >= self->n_jobs) return 0;
+	job = &self->jobs[self->next++];
+	pthread_mutex_unlock(&self->lock);
+	job->ok = xxh64_file(job->pathname, &job->hash, &job->dev, &job->ino) == 0;
+	pthread_mutex_lock(&self->lock);
+	if (++self->finished == self->n_jobs) pthread_cond_signal(&self->done);
+	return 1;
+}
+
+static void * _hashcache_worker(void *arg) {
+	HashCacheObject *self = (HashCacheObject *)arg;
+	pthread_mutex_lock(&self->lock);
+	while (!self->shutdown) {
+		if (!_hashcache_work(self)) pthread_cond_wait(&self->start, &self->lock);
+	}
+	pthread_mutex_unlock(&self->lock);
+	return NULL;
+}
+
+
+/* helper: home index of (dev,ino); dev is truncated like in HashEntry, so
+   that entries re-inserted by _hashcache_grow() are found again */
+static size_t _hashcache_index(uint32_t dev, uint64_t ino, size_t capacity) {
+	return (size_t)(ino * XXH_PRIME64_1 ^ dev) & (capacity - 1);
+}
+
+
+/* helper: find the slot of (dev,ino) in the open-addressing table */
+static HashEntry * _hashcache_slot(HashEntry *table, size_t capacity, uint32_t dev, uint64_t ino) {
+	size_t i = _hashcache_index(dev, ino, capacity);
+	while (table[i].used && (table[i].ino != ino || table[i].dev != dev))
+		i = (i + 1) & (capacity - 1);
+	return &table[i];
+}
+
+
+/* helper: remove the entry at index i; later entries of the same probe
+   sequence are shifted back, so that lookups need no tombstones */
+static void _hashcache_remove(HashCacheObject *self, size_t i) {
+	size_t mask = self->capacity - 1;
+	size_t j = i;
+	size_t k;
+	self->table[i].used = HASH_FREE;
+	while (1) {
+		j = (j + 1) & mask;
+		if (!self->table[j].used) break;
+		k = _hashcache_index(self->table[j].dev, self->table[j].ino, self->capacity);
+		/* the entry at j may move to i unless its home lies cyclically in (i,j] */
+		if (i <= j ? (k <= i || k > j) : (k <= i && k > j)) {
+			self->table[i] = self->table[j];
+			self->table[j].used = HASH_FREE;
+			i = j;
+		}
+	}
+	self->count--;
+}
+
+
+/* helper: evict the first entry the clock hand finds not referenced since
+   its last pass, clearing the references it passes */
+static void _hashcache_evict(HashCacheObject *self) {
+	HashEntry *entry;
+	while (1) {
+		self->hand = (self->hand + 1) & (self->capacity - 1);
+		entry = &self->table[self->hand];
+		if (entry->used == HASH_REFERENCED) {
+			entry->used = HASH_USED;
+		} else if (entry->used == HASH_USED) {
+			_hashcache_remove(self, self->hand);
+			return;
+		}
+	}
+}
+
+
+/* helper: double the table capacity */
+static int _hashcache_grow(HashCacheObject *self) {
+	size_t i;
+	size_t capacity = self->capacity * 2;
+	HashEntry *table = calloc(capacity, sizeof(HashEntry));
+	if (table == NULL) return -1;
+	for (i = 0; i < self->capacity; i++)
+		if (self->table[i].used)
+			*_hashcache_slot(table, capacity, self->table[i].dev, self->table[i].ino) = self->table[i];
+	free(self->table);
+	self->table = table;
+	self->capacity = capacity;
+	return 0;
+}
+
+
+static PyObject * _hashcache_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+	/* variable declarations */
+	int n_threads = 4;
+	Py_ssize_t max_entries = 0;
+	int i;
+	HashCacheObject *self;
+
+	/* parse the function's arguments: int threads, int maxEntries */
+	if (!PyArg_ParseTuple(args, "|in", &n_threads, &max_entries)) return NULL;
+	if (n_threads < 0) n_threads = 0;
+	if (max_entries < 0) max_entries = 0;
+
+	self = (HashCacheObject *)type->tp_alloc(type, 0);
+	if (self == NULL) return NULL;
+	self->capacity = 1024;
+	self->max_entries = (size_t)max_entries;
+	self->table = calloc(self->capacity, sizeof(HashEntry));
+	self->threads = calloc(n_threads + 1, sizeof(pthread_t));
+	if (self->table == NULL || self->threads == NULL) {
+		free(self->table);
+		free(self->threads);
+		linuxfd_free((PyObject *)self);
+		return PyErr_NoMemory();
+	}
+	pthread_mutex_init(&self->batch, NULL);
+	pthread_mutex_init(&self->lock, NULL);
+	pthread_cond_init(&self->start, NULL);
+	pthread_cond_init(&self->done, NULL);
+
+	/* start worker threads; the calling thread participates, too */
+	for (i = 0; i < n_threads; i++) {
+		errno = pthread_create(&self->threads[i], NULL, _hashcache_worker, self);
+		if (errno != 0) break;
+	}
+	self->n_threads = i;
+	return (PyObject *)self;
+}
+
+
+static void _hashcache_dealloc(HashCacheObject *self) {
+	int i;
+	pthread_mutex_lock(&self->lock);
+	self->shutdown = 1;
+	pthread_cond_broadcast(&self->start);
+	pthread_mutex_unlock(&self->lock);
+	Py_BEGIN_ALLOW_THREADS
+	for (i = 0; i < self->n_threads; i++) pthread_join(self->threads[i], NULL);
+	Py_END_ALLOW_THREADS
+	pthread_mutex_destroy(&self->batch);
+	pthread_mutex_destroy(&self->lock);
+	pthread_cond_destroy(&self->start);
+	pthread_cond_destroy(&self->done);
+	free(self->threads);
+	free(self->table);
+	linuxfd_free((PyObject *)self);
+}
+
+
+/* Python: hashcache.filter(pathnames) -> [changed, ...]
+   hash all files and compare with the recorded hashes; a file is reported as
+   changed (True) if its hash differs, is not known yet or the file could not
+   be read; recorded hashes are updated */
+static PyObject * _hashcache_filter(HashCacheObject *self, PyObject *args) {
+	/* variable declarations */
+	PyObject *pathnames;
+	PyObject *sequence;
+	PyObject *data;
+	Py_ssize_t n_paths;
+	Py_ssize_t i;
+	HashJob *jobs;
+	HashEntry *entry;
+	int changed;
+
+	/* parse the function's arguments: sequence of str */
+	if (!PyArg_ParseTuple(args, "O", &pathnames)) return NULL;
+	sequence = PySequence_Fast(pathnames, "pathnames must be a sequence");
+	if (sequence == NULL) return NULL;
+	n_paths = PySequence_Fast_GET_SIZE(sequence);
+
+	jobs = PyMem_Calloc(n_paths + 1, sizeof(HashJob));
+	if (jobs == NULL) {
+		Py_DECREF(sequence);
+		return PyErr_NoMemory();
+	}
+	for (i = 0; i < n_paths; i++) {
+		jobs[i].pathname = PyUnicode_AsUTF8(PySequence_Fast_GET_ITEM(sequence, i));
+		if (jobs[i].pathname == NULL) {
+			PyMem_Free(jobs);
+			Py_DECREF(sequence);
+			return NULL;
+		}
+	}
+
+	/* hand the batch to the worker pool and help hashing */
+	Py_BEGIN_ALLOW_THREADS
+	pthread_mutex_lock(&self->batch);
+	pthread_mutex_lock(&self->lock);
+	self->jobs = jobs;
+	self->n_jobs = n_paths;
+	self->next = 0;
+	self->finished = 0;
+	pthread_cond_broadcast(&self->start);
+	while (_hashcache_work(self));
+	while (self->finished < self->n_jobs) pthread_cond_wait(&self->done, &self->lock);
+	self->n_jobs = 0;
+	self->next = 0;
+	pthread_mutex_unlock(&self->lock);
+	pthread_mutex_unlock(&self->batch);
+	Py_END_ALLOW_THREADS
+
+	/* compare with and update the recorded hashes */
+	data = PyList_New(n_paths);
+	for (i = 0; data != NULL && i < n_paths; i++) {
+		changed = 1;
+		if (jobs[i].ok) {
+			if (self->count * 4 >= self->capacity * 3 && _hashcache_grow(self) == -1) {
+				Py_CLEAR(data);
+				PyErr_NoMemory();
+				break;
+			}
+			entry = _hashcache_slot(self->table, self->capacity, (uint32_t)jobs[i].dev, jobs[i].ino);
+			if (!entry->used) {
+				if (self->max_entries > 0 && self->count >= self->max_entries) {
+					/* entries move when one is removed: look up again */
+					_hashcache_evict(self);
+					entry = _hashcache_slot(self->table, self->capacity, (uint32_t)jobs[i].dev, jobs[i].ino);
+				}
+				entry->dev = (uint32_t)jobs[i].dev;
+				entry->ino = jobs[i].ino;
+				self->count++;
+			} else if (entry->hash == jobs[i].hash) {
+				changed = 0;
+			}
+			entry->used = HASH_REFERENCED;
+			entry->hash = jobs[i].hash;
+		}
+		PyList_SET_ITEM(data, i, PyBool_FromLong(changed));
+	}
+	PyMem_Free(jobs);
+	Py_DECREF(sequence);
+	return data;
+}
+
+
+/* Python: hashcache.clear() */
+static PyObject * _hashcache_clear(HashCacheObject *self, PyObject *args) {
+	memset(self->table, 0, self->capacity * sizeof(HashEntry));
+	self->count = 0;
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+static Py_ssize_t _hashcache_len(HashCacheObject *self) {
+	return (Py_ssize_t)self->count;
+}
+
+
+/* methods run in a critical section on self, see linuxfd_c.h */
+LINUXFD_LOCKED(_hashcache_filter_locked, _hashcache_filter)
+LINUXFD_LOCKED(_hashcache_clear_locked, _hashcache_clear)
+
+static PyMethodDef hashcache_methods[] = {
+	{ "filter", (PyCFunction)_hashcache_filter_locked, METH_VARARGS, NULL },
+	{ "clear",  (PyCFunction)_hashcache_clear_locked,  METH_NOARGS,  NULL },
+	{ NULL,     NULL,                                  0,            NULL }
+};
+
+static PyType_Slot hashcache_slots[] = {
+	{ Py_tp_dealloc, _hashcache_dealloc },
+	{ Py_tp_methods, hashcache_methods },
+	{ Py_sq_length,  _hashcache_len },
+	{ Py_tp_new,     _hashcache_new },
+	{ 0, NULL }
+};
+
+static PyType_Spec hashcache_spec = {
+	.name      = "inotify_c.hashcache",
+	.basicsize = sizeof(HashCacheObject),
+	.flags     = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE,
+	.slots     = hashcache_slots,
+};
+
+
+/* Python: xxh64(data) -> hash
+   expose the hash function used by hashcache, mainly for verification */
+static PyObject * _xxh64(PyObject *self, PyObject *args) {
+	Py_buffer data;
+	uint64_t hash;
+
+	if (!PyArg_ParseTuple(args, "y*", &data)) return NULL;
+	hash = xxh64(data.buf, data.len, 0);
+	PyBuffer_Release(&data);
+	return PyLong_FromUnsignedLongLong(hash);
+}
+
+
 static PyMethodDef methods[] = {
 	{ "inotify_init",      _inotify_init,      METH_VARARGS, NULL },
 	{ "inotify_add_watch", _inotify_add_watch, METH_VARARGS, NULL },
 	{ "inotify_rm_watch",  _inotify_rm_watch,  METH_VARARGS, NULL },
+	{ "inotify_add_watches", _inotify_add_watches, METH_VARARGS, NULL },
+	{ "inotify_rm_watches",  _inotify_rm_watches,  METH_VARARGS, NULL },
 	{ "inotify_read",      _inotify_read,      METH_VARARGS, NULL },
+	{ "inotify_read_into", _inotify_read_into, METH_VARARGS, NULL },
+	{ "inotify_event",     _inotify_event,     METH_VARARGS, NULL },
+	{ "inotify_events",    _inotify_events,    METH_VARARGS, NULL },
+	{ "xxh64",             _xxh64,             METH_VARARGS, NULL },
     { NULL   ,             NULL,               0,            NULL }
 };
 
-#if PY_MAJOR_VERSION >= 3
-static struct PyModuleDef inotifymodule = { PyModuleDef_HEAD_INIT, "inotify_c", NULL, -1, methods };
-#endif
+static int _traverse(PyObject *m, visitproc visit, void *arg) {
+	InotifyState *state = (InotifyState *)PyModule_GetState(m);
+	Py_VISIT(state->WatchStatsType);
+	Py_VISIT(state->JournalType);
+	Py_VISIT(state->ReadBufferType);
+	Py_VISIT(state->EventIterType);
+	Py_VISIT(state->HashCacheType);
+	return 0;
+}
+
+static int _clear(PyObject *m) {
+	InotifyState *state = (InotifyState *)PyModule_GetState(m);
+	Py_CLEAR(state->WatchStatsType);
+	Py_CLEAR(state->JournalType);
+	Py_CLEAR(state->ReadBufferType);
+	Py_CLEAR(state->EventIterType);
+	Py_CLEAR(state->HashCacheType);
+	return 0;
+}
 
-#if PY_MAJOR_VERSION >= 3
-PyMODINIT_FUNC PyInit_inotify_c(void) {
-#else
-void initinotify_c(void) {
-#endif
+static void _free(void *m) {
+	_clear((PyObject *)m);
+}
+
+static struct PyModuleDef inotifymodule = {
+	PyModuleDef_HEAD_INIT,
+	.m_name     = "linuxfd.inotify_c",
+	.m_size     = sizeof(InotifyState),
+	.m_methods  = methods,
+	.m_traverse = _traverse,
+	.m_clear    = _clear,
+	.m_free     = _free,
+};
+
+/* create a heap type of module m; public types are added as module attribute */
+static PyTypeObject * _add_type(PyObject *m, PyType_Spec *spec, int public) {
+	PyObject *type = PyType_FromModuleAndSpec(m, spec, NULL);
+	if (type == NULL) return NULL;
+	if (public && PyModule_AddType(m, (PyTypeObject *)type) == -1) {
+		Py_DECREF(type);
+		return NULL;
+	}
+	return (PyTypeObject *)type;
+}
+
+/* create submodule linuxfd.inotify_c, see linuxfd_c.h */
+PyObject * linuxfd_inotify_c(void) {
 	PyObject *m;
-#if PY_MAJOR_VERSION >= 3
+	InotifyState *state;
 	m = PyModule_Create(&inotifymodule);
-#else
-	m = Py_InitModule("inotify_c",methods);
-#endif
-	if (m != NULL) {
-		/* define inotify constants: init flags */
-		PyModule_AddIntConstant( m, "IN_NONBLOCK",      IN_NONBLOCK );
-		PyModule_AddIntConstant( m, "IN_CLOEXEC",       IN_CLOEXEC );
-		/* define inotify constants: events */
-		PyModule_AddIntConstant( m, "IN_ACCESS",        IN_ACCESS );
-		PyModule_AddIntConstant( m, "IN_ATTRIB",        IN_ATTRIB );
-		PyModule_AddIntConstant( m, "IN_CLOSE_WRITE",   IN_CLOSE_WRITE );
-		PyModule_AddIntConstant( m, "IN_CLOSE_NOWRITE", IN_CLOSE_NOWRITE );
-		PyModule_AddIntConstant( m, "IN_CREATE",        IN_CREATE );
-		PyModule_AddIntConstant( m, "IN_DELETE",        IN_DELETE );
-		PyModule_AddIntConstant( m, "IN_DELETE_SELF",   IN_DELETE_SELF );
-		PyModule_AddIntConstant( m, "IN_MODIFY",        IN_MODIFY );
-		PyModule_AddIntConstant( m, "IN_MOVE_SELF",     IN_MOVE_SELF );
-		PyModule_AddIntConstant( m, "IN_MOVED_FROM",    IN_MOVED_FROM );
-		PyModule_AddIntConstant( m, "IN_MOVED_TO",      IN_MOVED_TO );
-		PyModule_AddIntConstant( m, "IN_OPEN",          IN_OPEN );
-		/* define inotify constants: event macros (combinations of events) */
-		PyModule_AddIntConstant( m, "IN_ALL_EVENTS",    IN_ALL_EVENTS ); /* = all event flags set */
-		PyModule_AddIntConstant( m, "IN_MOVE",          IN_MOVE ); /* IN_MOVED_FROM | IN_MOVED_TO */
-		PyModule_AddIntConstant( m, "IN_CLOSE",         IN_CLOSE ); /* IN_CLOSE_WRITE | IN_CLOSE_NOWRITE */
-		/* define inotify constants: flags for inotify_add_watch */
-		PyModule_AddIntConstant( m, "IN_DONT_FOLLOW",   IN_DONT_FOLLOW );
-		PyModule_AddIntConstant( m, "IN_EXCL_UNLINK",   IN_EXCL_UNLINK );
-		PyModule_AddIntConstant( m, "IN_MASK_ADD",      IN_MASK_ADD );
-		PyModule_AddIntConstant( m, "IN_ONESHOT",       IN_ONESHOT );
-		PyModule_AddIntConstant( m, "IN_ONLYDIR",       IN_ONLYDIR );
-		/* define inotify constants: mask returned by read */
-		PyModule_AddIntConstant( m, "IN_IGNORED",       IN_IGNORED );
-		PyModule_AddIntConstant( m, "IN_ISDIR",         IN_ISDIR );
-		PyModule_AddIntConstant( m, "IN_Q_OVERFLOW",    IN_Q_OVERFLOW );
-		PyModule_AddIntConstant( m, "IN_UNMOUNT",       IN_UNMOUNT );
-	}
-#if PY_MAJOR_VERSION >= 3
+	if (m == NULL) return NULL;
+	state = (InotifyState *)PyModule_GetState(m);
+	if ((state->HashCacheType  = _add_type(m, &hashcache_spec,  1)) == NULL ||
+	    (state->WatchStatsType = _add_type(m, &watchstats_spec, 1)) == NULL ||
+	    (state->JournalType    = _add_type(m, &journal_spec,    1)) == NULL ||
+	    (state->ReadBufferType = _add_type(m, &readbuffer_spec, 1)) == NULL ||
+	    (state->EventIterType  = _add_type(m, &eventiter_spec,  0)) == NULL) {
+		Py_DECREF(m);
+		return NULL;
+	}
+	/* define inotify constants: init flags */
+	PyModule_AddIntConstant( m, "IN_NONBLOCK",      IN_NONBLOCK );
+	PyModule_AddIntConstant( m, "IN_CLOEXEC",       IN_CLOEXEC );
+	/* define inotify constants: events */
+	PyModule_AddIntConstant( m, "IN_ACCESS",        IN_ACCESS );
+	PyModule_AddIntConstant( m, "IN_ATTRIB",        IN_ATTRIB );
+	PyModule_AddIntConstant( m, "IN_CLOSE_WRITE",   IN_CLOSE_WRITE );
+	PyModule_AddIntConstant( m, "IN_CLOSE_NOWRITE", IN_CLOSE_NOWRITE );
+	PyModule_AddIntConstant( m, "IN_CREATE",        IN_CREATE );
+	PyModule_AddIntConstant( m, "IN_DELETE",        IN_DELETE );
+	PyModule_AddIntConstant( m, "IN_DELETE_SELF",   IN_DELETE_SELF );
+	PyModule_AddIntConstant( m, "IN_MODIFY",        IN_MODIFY );
+	PyModule_AddIntConstant( m, "IN_MOVE_SELF",     IN_MOVE_SELF );
+	PyModule_AddIntConstant( m, "IN_MOVED_FROM",    IN_MOVED_FROM );
+	PyModule_AddIntConstant( m, "IN_MOVED_TO",      IN_MOVED_TO );
+	PyModule_AddIntConstant( m, "IN_OPEN",          IN_OPEN );
+	/* define inotify constants: event macros (combinations of events) */
+	PyModule_AddIntConstant( m, "IN_ALL_EVENTS",    IN_ALL_EVENTS ); /* = all event flags set */
+	PyModule_AddIntConstant( m, "IN_MOVE",          IN_MOVE ); /* IN_MOVED_FROM | IN_MOVED_TO */
+	PyModule_AddIntConstant( m, "IN_CLOSE",         IN_CLOSE ); /* IN_CLOSE_WRITE | IN_CLOSE_NOWRITE */
+	/* define inotify constants: flags for inotify_add_watch */
+	PyModule_AddIntConstant( m, "IN_DONT_FOLLOW",   IN_DONT_FOLLOW );
+	PyModule_AddIntConstant( m, "IN_EXCL_UNLINK",   IN_EXCL_UNLINK );
+	PyModule_AddIntConstant( m, "IN_MASK_ADD",      IN_MASK_ADD );
+	PyModule_AddIntConstant( m, "IN_ONESHOT",       IN_ONESHOT );
+	PyModule_AddIntConstant( m, "IN_ONLYDIR",       IN_ONLYDIR );
+	/* define inotify constants: mask returned by read */
+	PyModule_AddIntConstant( m, "IN_IGNORED",       IN_IGNORED );
+	PyModule_AddIntConstant( m, "IN_ISDIR",         IN_ISDIR );
+	PyModule_AddIntConstant( m, "IN_Q_OVERFLOW",    IN_Q_OVERFLOW );
+	PyModule_AddIntConstant( m, "IN_UNMOUNT",       IN_UNMOUNT );
+	PyModule_AddIntConstant( m, "TRY_READ",         TRY_READ );
+	PyModule_AddIntConstant( m, "KEEP_GIL",         KEEP_GIL );
 	return m;
-#endif
 }
                                                                                                                                                                                  
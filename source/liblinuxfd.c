@@ -0,0 +1,246 @@
+/* This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+    linuxfd is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linuxfd is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* liblinuxfd, see liblinuxfd.h; no Python in here */
+
+#include <unistd.h>
+#include <stdlib.h> /* provides posix_memalign and free */
+#include <string.h>
+#include <errno.h>  /* definition of errno */
+#include <poll.h>
+#include <signal.h>
+#include <limits.h> /* definition of NAME_MAX */
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/ioctl.h> /* provides FIONREAD */
+#include "liblinuxfd.h"
+
+
+int lfd_eventfd_drain(int fd, int nonblocking, uint64_t *sum, lfd_hook hook, void *arg) {
+	/* variable declarations */
+	eventfd_t value;
+	struct pollfd pfd;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	*sum = 0;
+	while (1) {
+		if (!nonblocking && poll(&pfd, 1, 0) < 1) return 0;
+		if (eventfd_read(fd, &value) == -1) {
+			if (hook) hook(arg, -1);
+			if (errno == EAGAIN) return 0;
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		if (hook) hook(arg, sizeof(value));
+		*sum += value;
+	}
+}
+
+
+void lfd_timespec_set(struct timespec *ts, double seconds) {
+	ts->tv_sec  = (time_t)seconds;
+	ts->tv_nsec = (long int)( 1e9 * (seconds - (double)ts->tv_sec) );
+}
+
+double lfd_timespec_get(const struct timespec *ts) {
+	return (double)ts->tv_sec + (double)ts->tv_nsec / 1e9;
+}
+
+
+/* helper: call timerfd_settime() and convert the old setting */
+static int _timerfd_settime(int fd, int flags, struct itimerspec *new_value,
+	double *old_value, double *old_interval) {
+	struct itimerspec old;
+	if (timerfd_settime(fd, flags, new_value, &old) == -1) return -1;
+	if (old_value) *old_value = lfd_timespec_get(&old.it_value);
+	if (old_interval) *old_interval = lfd_timespec_get(&old.it_interval);
+	return 0;
+}
+
+int lfd_timerfd_settime(int fd, int flags, double value, double interval,
+	double *old_value, double *old_interval) {
+	struct itimerspec new_value;
+	lfd_timespec_set(&new_value.it_value, value);
+	lfd_timespec_set(&new_value.it_interval, interval);
+	return _timerfd_settime(fd, flags, &new_value, old_value, old_interval);
+}
+
+int lfd_timerfd_settime_ns(int fd, int flags, uint64_t value, uint64_t interval,
+	double *old_value, double *old_interval) {
+	struct itimerspec new_value;
+	new_value.it_value.tv_sec     = (time_t)(value / 1000000000);
+	new_value.it_value.tv_nsec    = (long int)(value % 1000000000);
+	new_value.it_interval.tv_sec  = (time_t)(interval / 1000000000);
+	new_value.it_interval.tv_nsec = (long int)(interval % 1000000000);
+	return _timerfd_settime(fd, flags, &new_value, old_value, old_interval);
+}
+
+int lfd_timerfd_gettime(int fd, double *value, double *interval) {
+	struct itimerspec curr_value;
+	if (timerfd_gettime(fd, &curr_value) == -1) return -1;
+	*value    = lfd_timespec_get(&curr_value.it_value);
+	*interval = lfd_timespec_get(&curr_value.it_interval);
+	return 0;
+}
+
+int lfd_timerfd_read(int fd, uint64_t *expirations) {
+	ssize_t result = read(fd, expirations, sizeof(uint64_t));
+	if (result == -1) return -1;
+	if (result != sizeof(uint64_t)) {
+		/* read succeeded, but returned not the expected number of bytes */
+		errno = EIO;
+		return -1;
+	}
+	return 0;
+}
+
+
+int lfd_signalfd(int fd, const int *signals, size_t n, int flags) {
+	sigset_t mask;
+	size_t i;
+	sigemptyset(&mask);
+	for (i = 0; i < n; i++) {
+		/* sigaddset() sets errno to EINVAL on an invalid signal number */
+		if (sigaddset(&mask, signals[i]) == -1) return -1;
+	}
+	return signalfd(fd, &mask, flags);
+}
+
+ssize_t lfd_signalfd_read(int fd, struct signalfd_siginfo *values, size_t count) {
+	ssize_t result = read(fd, values, count * sizeof(struct signalfd_siginfo));
+	if (result == -1) return -1;
+	if (result % sizeof(struct signalfd_siginfo) != 0) {
+		errno = EIO;
+		return -1;
+	}
+	return result / sizeof(struct signalfd_siginfo);
+}
+
+
+void lfd_inotify_add_watches(int fd, const char * const *paths, size_t n, uint32_t mask,
+	int *results, lfd_hook hook, void *arg) {
+	size_t i;
+	for (i = 0; i < n; i++) {
+		results[i] = inotify_add_watch(fd, paths[i], mask);
+		if (hook) hook(arg, results[i]);
+		if (results[i] == -1) results[i] = -errno;
+	}
+}
+
+void lfd_inotify_rm_watches(int fd, int *wds, size_t n, lfd_hook hook, void *arg) {
+	size_t i;
+	for (i = 0; i < n; i++) {
+		wds[i] = inotify_rm_watch(fd, wds[i]);
+		if (hook) hook(arg, wds[i]);
+		if (wds[i] == -1) wds[i] = -errno;
+	}
+}
+
+const struct inotify_event * lfd_inotify_next(const char *buffer, size_t length, size_t *offset) {
+	const struct inotify_event *event;
+	if (*offset + sizeof(struct inotify_event) > length) return NULL;
+	event = (const struct inotify_event *)(buffer + *offset);
+	if (*offset + sizeof(struct inotify_event) + event->len > length) return NULL;
+	*offset += sizeof(struct inotify_event) + event->len;
+	return event;
+}
+
+int lfd_inotify_event_at(const void *buffer, size_t length, size_t offset,
+	struct inotify_event *event, const char **name, size_t *namelen) {
+	/* the header is copied since offset need not be aligned */
+	if (offset + sizeof(struct inotify_event) > length) {
+		errno = EINVAL;
+		return -1;
+	}
+	memcpy(event, (const char *)buffer + offset, sizeof(struct inotify_event));
+	if (offset + sizeof(struct inotify_event) + event->len > length) {
+		errno = EINVAL;
+		return -1;
+	}
+	/* name is NUL-padded to event->len bytes */
+	*name = (const char *)buffer + offset + sizeof(struct inotify_event);
+	*namelen = strnlen(*name, event->len);
+	return 0;
+}
+
+
+/* helper: smallest power of two >= value, limited to [minimum,maximum] */
+static size_t _readbuffer_fit(lfd_readbuffer *rb, size_t value) {
+	size_t size = rb->minimum;
+	while (size < value && size < rb->maximum) size <<= 1;
+	return size < rb->maximum ? size : rb->maximum;
+}
+
+/* helper: replace the buffer by one of the given size; keeps the old buffer
+   if allocation fails */
+static void _readbuffer_resize(lfd_readbuffer *rb, size_t size) {
+	char *buffer;
+	if (size == rb->size) return;
+	if (posix_memalign((void **)&buffer, sizeof(struct inotify_event), size) != 0) return;
+	if (size > rb->size) rb->grows++; else rb->shrinks++;
+	free(rb->buffer);
+	rb->buffer = buffer;
+	rb->size = size;
+}
+
+int lfd_readbuffer_init(lfd_readbuffer *rb, size_t minimum, size_t maximum) {
+	int result;
+	memset(rb, 0, sizeof(lfd_readbuffer));
+	if (minimum < sizeof(struct inotify_event) + NAME_MAX + 1 || maximum < minimum) {
+		errno = EINVAL;
+		return -1;
+	}
+	/* the buffer has the alignment of struct inotify_event, see man 7 inotify */
+	result = posix_memalign((void **)&rb->buffer, sizeof(struct inotify_event), minimum);
+	if (result != 0) {
+		rb->buffer = NULL;
+		errno = result;
+		return -1;
+	}
+	rb->minimum = minimum;
+	rb->maximum = maximum;
+	rb->size = minimum;
+	return 0;
+}
+
+void lfd_readbuffer_free(lfd_readbuffer *rb) {
+	free(rb->buffer);
+	rb->buffer = NULL;
+	rb->size = 0;
+}
+
+void lfd_readbuffer_adapt(lfd_readbuffer *rb, int fd, size_t length) {
+	int backlog = 0;
+
+	rb->reads++;
+	rb->average += ((double)length - rb->average) / 8.0;
+	if (length > rb->highwater) rb->highwater = length;
+
+	if (length + sizeof(struct inotify_event) + NAME_MAX + 1 > rb->size) {
+		/* (almost) full buffer: more events are likely queued */
+		rb->small = 0;
+		if (ioctl(fd, FIONREAD, &backlog) == -1) backlog = 0;
+		rb->backlog = backlog;
+		if (backlog > 0) _readbuffer_resize(rb, _readbuffer_fit(rb, length + backlog));
+	} else if (length < rb->size / 4 && ++rb->small >= LFD_READBUFFER_SHRINK_AFTER) {
+		rb->small = 0;
+		_readbuffer_resize(rb, _readbuffer_fit(rb, 4 * (size_t)rb->average));
+	} else if (length >= rb->size / 4) {
+		rb->small = 0;
+	}
+}
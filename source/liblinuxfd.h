@@ -0,0 +1,119 @@
+/* This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+    linuxfd is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linuxfd is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* liblinuxfd: the system call logic of the eventfd/signalfd/timerfd/inotify
+   submodules without any Python dependency; the submodules are bindings over
+   it, C and C++ programs link liblinuxfd.a (see Makefile and linuxfd.hpp).
+   Functions follow the system call convention: -1 with errno set on error.
+   None of them allocates except lfd_readbuffer_*(). */
+
+#ifndef LIBLINUXFD_H
+#define LIBLINUXFD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* observer called after every system call of a batch function with the call's
+   result (bytes read for reads), errno still set; e.g. the Python binding
+   updates its performance counters. May be NULL. */
+typedef void (*lfd_hook)(void *arg, ssize_t result);
+
+/* eventfd: read fd until it is empty and store the sum of all values read in
+   sum (zero if it was empty); blocking descriptors are polled before each
+   read. Returns 0, or -1 on errors other than EAGAIN (sum holds the values
+   read so far). */
+int lfd_eventfd_drain(int fd, int nonblocking, uint64_t *sum, lfd_hook hook, void *arg);
+
+/* timerfd: conversion between seconds as double and struct timespec */
+void lfd_timespec_set(struct timespec *ts, double seconds);
+double lfd_timespec_get(const struct timespec *ts);
+
+/* timerfd: arm (value > 0) or disarm the timer; the old setting is stored in
+   old_value/old_interval if these are not NULL. The _ns variant takes
+   nanoseconds. */
+int lfd_timerfd_settime(int fd, int flags, double value, double interval,
+	double *old_value, double *old_interval);
+int lfd_timerfd_settime_ns(int fd, int flags, uint64_t value, uint64_t interval,
+	double *old_value, double *old_interval);
+int lfd_timerfd_gettime(int fd, double *value, double *interval);
+/* timerfd: read the number of expirations; a short read fails with EIO */
+int lfd_timerfd_read(int fd, uint64_t *expirations);
+
+/* signalfd: create (fd == -1) or update a signalfd for n signal numbers;
+   an invalid number fails with EINVAL */
+int lfd_signalfd(int fd, const int *signals, size_t n, int flags);
+/* signalfd: read up to count pending signals with a single read(); returns
+   the number of signals read, or -1 (EAGAIN if none is pending) */
+ssize_t lfd_signalfd_read(int fd, struct signalfd_siginfo *values, size_t count);
+
+/* inotify: add a watch for each of n pathnames (or remove each of n watch
+   descriptors); a failed call does not abort the batch, its slot holds the
+   negated error number instead of the watch descriptor (or zero) */
+void lfd_inotify_add_watches(int fd, const char * const *paths, size_t n, uint32_t mask,
+	int *results, lfd_hook hook, void *arg);
+void lfd_inotify_rm_watches(int fd, int *wds, size_t n, lfd_hook hook, void *arg);
+
+/* inotify: iterate over the events of an aligned buffer filled by read();
+   returns the event at *offset and advances *offset past it, NULL at the end
+   of the buffer or on a truncated event */
+const struct inotify_event * lfd_inotify_next(const char *buffer, size_t length, size_t *offset);
+/* inotify: decode the event at offset of an arbitrary (unaligned) buffer;
+   the header is copied to event, name points into buffer and namelen is the
+   name's length without NUL padding. Returns 0, or -1 (EINVAL) if the event
+   does not fit into the buffer. */
+int lfd_inotify_event_at(const void *buffer, size_t length, size_t offset,
+	struct inotify_event *event, const char **name, size_t *namelen);
+
+/* inotify: read buffer resized between reads: it grows to hold the last batch
+   plus the backlog still queued in the kernel (FIONREAD, only queried if a
+   read nearly filled the buffer) and shrinks to four times the average batch
+   size after a run of small reads. Sizes are powers of two. */
+#define LFD_READBUFFER_SHRINK_AFTER 64 /* consecutive small reads before shrinking */
+
+typedef struct {
+	char *buffer;
+	size_t size;
+	size_t minimum;
+	size_t maximum;
+	size_t highwater;     /* largest batch read */
+	size_t backlog;       /* last FIONREAD value */
+	double average;       /* exponentially weighted batch size (alpha 1/8) */
+	unsigned small;       /* consecutive reads below a quarter of size */
+	uint64_t reads;
+	uint64_t grows;
+	uint64_t shrinks;
+} lfd_readbuffer;
+
+/* minimum must hold one event with the longest name (EINVAL otherwise) */
+int lfd_readbuffer_init(lfd_readbuffer *rb, size_t minimum, size_t maximum);
+void lfd_readbuffer_free(lfd_readbuffer *rb);
+/* adapt the buffer size after a read of length bytes from fd */
+void lfd_readbuffer_adapt(lfd_readbuffer *rb, int fd, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBLINUXFD_H */
@@ -0,0 +1,273 @@
+/* This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+    linuxfd is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linuxfd is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* C++17 wrapper of liblinuxfd (see liblinuxfd.h): move-only objects owning
+   their descriptor, closed on destruction. Errors raise std::system_error
+   with the errno value, like the Python classes raise OSError; tryRead()
+   returns an empty std::optional instead of failing with EAGAIN. Header-only,
+   link with liblinuxfd.a (see Makefile). */
+
+#ifndef LINUXFD_HPP
+#define LINUXFD_HPP
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <system_error>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include "liblinuxfd.h"
+
+namespace linuxfd {
+
+[[noreturn]] inline void throwErrno(const char *what) {
+	throw std::system_error(errno, std::generic_category(), what);
+}
+
+/* owner of a file descriptor */
+class Fd {
+public:
+	Fd() noexcept = default;
+	explicit Fd(int fd) noexcept : fd_(fd) {}
+	Fd(Fd &&other) noexcept : fd_(other.release()) {}
+	Fd & operator=(Fd &&other) noexcept { reset(other.release()); return *this; }
+	Fd(const Fd &) = delete;
+	Fd & operator=(const Fd &) = delete;
+	~Fd() { reset(); }
+
+	int fileno() const noexcept { return fd_; }
+	explicit operator bool() const noexcept { return fd_ != -1; }
+	/* give up ownership, the caller closes the descriptor */
+	int release() noexcept { return std::exchange(fd_, -1); }
+	/* close the descriptor (if any) and take ownership of fd */
+	void reset(int fd = -1) noexcept {
+		if (fd_ != -1) ::close(fd_);
+		fd_ = fd;
+	}
+	void close() noexcept { reset(); }
+
+protected:
+	/* throw if fd is -1, i.e. creating the descriptor failed */
+	static int check(int fd, const char *what) {
+		if (fd == -1) throwErrno(what);
+		return fd;
+	}
+
+private:
+	int fd_ = -1;
+};
+
+
+class EventFd : public Fd {
+public:
+	explicit EventFd(unsigned int initval = 0, int flags = EFD_CLOEXEC)
+		: Fd(check(::eventfd(initval, flags), "eventfd")) {}
+
+	uint64_t read() {
+		eventfd_t value;
+		if (::eventfd_read(fileno(), &value) == -1) throwErrno("eventfd_read");
+		return value;
+	}
+	std::optional<uint64_t> tryRead() {
+		eventfd_t value;
+		if (::eventfd_read(fileno(), &value) == 0) return value;
+		if (errno != EAGAIN) throwErrno("eventfd_read");
+		return std::nullopt;
+	}
+	void write(uint64_t value) {
+		if (::eventfd_write(fileno(), value) == -1) throwErrno("eventfd_write");
+	}
+	/* read until empty and return the sum of all values read */
+	uint64_t drain(bool nonblocking) {
+		uint64_t sum;
+		if (lfd_eventfd_drain(fileno(), nonblocking, &sum, nullptr, nullptr) == -1) throwErrno("eventfd_drain");
+		return sum;
+	}
+};
+
+
+class TimerFd : public Fd {
+public:
+	using Setting = std::pair<double, double>; /* (value, interval) in seconds */
+
+	explicit TimerFd(int clockid = CLOCK_MONOTONIC, int flags = TFD_CLOEXEC)
+		: Fd(check(::timerfd_create(clockid, flags), "timerfd_create")) {}
+
+	/* arm (value > 0) or disarm the timer; returns the old setting */
+	Setting settime(double value, double interval = 0.0, int flags = 0) {
+		Setting old;
+		if (lfd_timerfd_settime(fileno(), flags, value, interval, &old.first, &old.second) == -1)
+			throwErrno("timerfd_settime");
+		return old;
+	}
+	Setting settime(std::chrono::nanoseconds value, std::chrono::nanoseconds interval = {}, int flags = 0) {
+		Setting old;
+		if (lfd_timerfd_settime_ns(fileno(), flags, value.count(), interval.count(), &old.first, &old.second) == -1)
+			throwErrno("timerfd_settime");
+		return old;
+	}
+	Setting gettime() const {
+		Setting current;
+		if (lfd_timerfd_gettime(fileno(), &current.first, &current.second) == -1) throwErrno("timerfd_gettime");
+		return current;
+	}
+	/* number of expirations since the last read */
+	uint64_t read() {
+		uint64_t expirations;
+		if (lfd_timerfd_read(fileno(), &expirations) == -1) throwErrno("timerfd_read");
+		return expirations;
+	}
+	std::optional<uint64_t> tryRead() {
+		uint64_t expirations;
+		if (lfd_timerfd_read(fileno(), &expirations) == 0) return expirations;
+		if (errno != EAGAIN) throwErrno("timerfd_read");
+		return std::nullopt;
+	}
+};
+
+
+class SignalFd : public Fd {
+public:
+	/* the signals have to be blocked (pthread_sigmask()) by the caller */
+	explicit SignalFd(std::initializer_list<int> signals, int flags = SFD_CLOEXEC)
+		: Fd(check(lfd_signalfd(-1, signals.begin(), signals.size(), flags), "signalfd")) {}
+
+	/* read up to count pending signals into values; returns their number,
+	   zero if none is pending on a non-blocking descriptor */
+	size_t read(struct signalfd_siginfo *values, size_t count) {
+		ssize_t n = lfd_signalfd_read(fileno(), values, count);
+		if (n == -1 && errno != EAGAIN) throwErrno("signalfd_read");
+		return n == -1 ? 0 : static_cast<size_t>(n);
+	}
+	std::optional<struct signalfd_siginfo> tryRead() {
+		struct signalfd_siginfo value;
+		if (read(&value, 1) == 0) return std::nullopt;
+		return value;
+	}
+};
+
+
+/* events of a buffer filled by Inotify::read(), valid until the next read */
+class InotifyEvents {
+public:
+	class iterator {
+	public:
+		iterator(const char *buffer, size_t length, size_t offset) noexcept
+			: buffer_(buffer), length_(length), offset_(offset) { next(); }
+		const struct inotify_event & operator*() const noexcept { return *event_; }
+		const struct inotify_event * operator->() const noexcept { return event_; }
+		iterator & operator++() noexcept { next(); return *this; }
+		bool operator==(const iterator &other) const noexcept { return event_ == other.event_; }
+		bool operator!=(const iterator &other) const noexcept { return event_ != other.event_; }
+	private:
+		void next() noexcept { event_ = lfd_inotify_next(buffer_, length_, &offset_); }
+		const char *buffer_;
+		size_t length_;
+		size_t offset_;
+		const struct inotify_event *event_ = nullptr;
+	};
+
+	InotifyEvents(const char *buffer, size_t length) noexcept : buffer_(buffer), length_(length) {}
+	iterator begin() const noexcept { return iterator(buffer_, length_, 0); }
+	iterator end() const noexcept { return iterator(buffer_, 0, 0); }
+	bool empty() const noexcept { return length_ == 0; }
+	size_t bytes() const noexcept { return length_; }
+
+private:
+	const char *buffer_;
+	size_t length_;
+};
+
+
+/* read buffer adapting its size to the observed load, see lfd_readbuffer */
+class ReadBuffer {
+public:
+	explicit ReadBuffer(size_t minimum = 4096, size_t maximum = 1048576) {
+		if (lfd_readbuffer_init(&rb_, minimum, maximum) == -1) throwErrno("readbuffer");
+	}
+	ReadBuffer(ReadBuffer &&other) noexcept : rb_(other.rb_), last_(std::exchange(other.last_, 0)) {
+		other.rb_.buffer = nullptr;
+		other.rb_.size = 0;
+	}
+	ReadBuffer & operator=(ReadBuffer &&other) noexcept {
+		std::swap(rb_, other.rb_);
+		std::swap(last_, other.last_);
+		return *this;
+	}
+	ReadBuffer(const ReadBuffer &) = delete;
+	ReadBuffer & operator=(const ReadBuffer &) = delete;
+	~ReadBuffer() { lfd_readbuffer_free(&rb_); }
+
+	const lfd_readbuffer & info() const noexcept { return rb_; }
+
+private:
+	friend class Inotify;
+	lfd_readbuffer rb_;
+	size_t last_ = 0; /* length of the last batch, not adapted to yet */
+};
+
+
+class Inotify : public Fd {
+public:
+	explicit Inotify(int flags = IN_CLOEXEC)
+		: Fd(check(::inotify_init1(flags), "inotify_init1")) {}
+
+	int addWatch(const char *pathname, uint32_t mask) {
+		int wd = ::inotify_add_watch(fileno(), pathname, mask);
+		if (wd == -1) throwErrno("inotify_add_watch");
+		return wd;
+	}
+	void rmWatch(int wd) {
+		if (::inotify_rm_watch(fileno(), wd) == -1) throwErrno("inotify_rm_watch");
+	}
+	/* batch variants: a failed call does not throw, its slot holds -errno */
+	std::vector<int> addWatches(const std::vector<const char *> &pathnames, uint32_t mask) {
+		std::vector<int> wds(pathnames.size());
+		lfd_inotify_add_watches(fileno(), pathnames.data(), pathnames.size(), mask, wds.data(), nullptr, nullptr);
+		return wds;
+	}
+	std::vector<int> rmWatches(std::vector<int> wds) {
+		lfd_inotify_rm_watches(fileno(), wds.data(), wds.size(), nullptr, nullptr);
+		return wds;
+	}
+
+	/* read a batch of events into buffer; the events are empty if none is
+	   pending on a non-blocking descriptor */
+	InotifyEvents read(ReadBuffer &buffer) {
+		ssize_t length;
+		/* resizing invalidates the events returned, so the buffer is adapted
+		   to the last batch only now */
+		if (buffer.last_ > 0) lfd_readbuffer_adapt(&buffer.rb_, fileno(), buffer.last_);
+		length = ::read(fileno(), buffer.rb_.buffer, buffer.rb_.size);
+		if (length == -1) {
+			buffer.last_ = 0;
+			if (errno != EAGAIN) throwErrno("inotify_read");
+			return InotifyEvents(buffer.rb_.buffer, 0);
+		}
+		buffer.last_ = length;
+		return InotifyEvents(buffer.rb_.buffer, length);
+	}
+};
+
+} /* namespace linuxfd */
+
+#endif /* LINUXFD_HPP */
@@ -0,0 +1,391 @@
+/* This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+    linuxfd is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linuxfd is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Extension module linuxfd.linuxfd_c: a single shared object bundling all
+   syscall wrappers. It uses multi-phase initialisation (PEP 489) and creates
+   the submodules (eventfd_c, inotify_c, ...) as its attributes. Creating all
+   of them takes microseconds and the package needs nearly all of them at
+   import anyway, so they are not created lazily; importing the package costs
+   a single dlopen().
+   All submodules are safe to use without the GIL (free-threaded builds) and
+   in isolated subinterpreters with their own GIL (PEP 684): every interpreter
+   gets its own module, submodules and heap types. */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <unistd.h>
+#include <errno.h>  /* definition of errno */
+#include <stdatomic.h>
+#include <time.h>   /* provides clock_gettime */
+#include <sys/signalfd.h>
+#include "linuxfd_c.h"
+
+#define FD_CLOSED 0x80000000u /* fdowner state flag; lower bits: borrowers */
+
+
+/* performance counters, see linuxfd_c.h; one set per fdowner object and one
+   for the whole process (shared by all interpreters) */
+typedef struct {
+	atomic_ullong calls;
+	atomic_ullong syscalls;
+	atomic_ullong eagain;
+	atomic_ullong bytes;      /* bytes read */
+	atomic_ullong blocked;    /* ns spent in system calls without the GIL */
+	atomic_ullong maxBlocked; /* ns, longest of these calls */
+} Counters;
+
+#ifndef LINUXFD_NO_STATS
+static Counters process;
+
+#define COUNT(counter, n) atomic_fetch_add_explicit(&(counter), (n), memory_order_relaxed)
+
+static void _counters_max(atomic_ullong *counter, unsigned long long value) {
+	unsigned long long current = atomic_load_explicit(counter, memory_order_relaxed);
+	while (value > current && !atomic_compare_exchange_weak_explicit(counter, &current, value,
+		memory_order_relaxed, memory_order_relaxed));
+}
+
+/* helper: counters as dictionary, times in seconds */
+static PyObject * _counters_dict(Counters *counters) {
+	return Py_BuildValue("{s:K,s:K,s:K,s:K,s:d,s:d}",
+		"calls",          atomic_load_explicit(&counters->calls, memory_order_relaxed),
+		"syscalls",       atomic_load_explicit(&counters->syscalls, memory_order_relaxed),
+		"eagain",         atomic_load_explicit(&counters->eagain, memory_order_relaxed),
+		"bytesRead",      atomic_load_explicit(&counters->bytes, memory_order_relaxed),
+		"blockedTime",    atomic_load_explicit(&counters->blocked, memory_order_relaxed) / 1e9,
+		"maxBlockedTime", atomic_load_explicit(&counters->maxBlocked, memory_order_relaxed) / 1e9);
+}
+#endif
+
+
+/* Python: fdowner(fd) -> fdowner object
+   owns a file descriptor, which is closed by close() or on deallocation;
+   the syscall wrappers borrow it via linuxfd_fd_borrow() */
+typedef struct {
+	PyObject_HEAD
+	int fd;
+	atomic_uint state; /* FD_CLOSED | number of borrowers */
+#ifndef LINUXFD_NO_STATS
+	Counters counters;
+#endif
+} FdOwnerObject;
+
+static void _fdowner_dealloc(FdOwnerObject *self);
+
+/* fdowner types of different interpreters share their slot functions */
+#define FdOwner_Check(op) (Py_TYPE(op)->tp_dealloc == (destructor)_fdowner_dealloc)
+
+int linuxfd_fd_borrow(PyObject *obj, FdRef *ref) {
+	/* variable declarations */
+	FdOwnerObject *owner;
+	unsigned int state;
+	long fd;
+	
+	if (FdOwner_Check(obj)) {
+		/* count this borrower, unless the owner is closed already: borrowers
+		   must not be added after close(), the last one closes fd */
+		owner = (FdOwnerObject *)obj;
+		state = atomic_load(&owner->state);
+		do {
+			if (state & FD_CLOSED) {
+				errno = EBADF;
+				PyErr_SetFromErrno(PyExc_OSError);
+				return 0;
+			}
+		} while (!atomic_compare_exchange_weak(&owner->state, &state, state + 1));
+		ref->fd = owner->fd;
+		ref->owner = obj;
+		ref->started = 0;
+#ifndef LINUXFD_NO_STATS
+		COUNT(owner->counters.calls, 1);
+		COUNT(process.calls, 1);
+#endif
+		return 1;
+	}
+	fd = PyLong_AsLong(obj);
+	if (fd == -1 && PyErr_Occurred()) return 0;
+	ref->fd = (int)fd;
+	ref->owner = NULL;
+	ref->started = 0;
+#ifndef LINUXFD_NO_STATS
+	COUNT(process.calls, 1);
+#endif
+	return 1;
+}
+
+void linuxfd_fd_return(FdRef *ref) {
+	/* variable declarations */
+	FdOwnerObject *owner = (FdOwnerObject *)ref->owner;
+	int saved = errno;
+	
+	if (owner == NULL) return;
+	if (atomic_fetch_sub(&owner->state, 1) == (FD_CLOSED | 1)) close(owner->fd);
+	ref->owner = NULL;
+	errno = saved;
+}
+
+#ifndef LINUXFD_NO_STATS
+uint64_t linuxfd_clock(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void linuxfd_fd_count(FdRef *ref, ssize_t result) {
+	/* variable declarations */
+	Counters *counters = ref->owner ? &((FdOwnerObject *)ref->owner)->counters : NULL;
+	int saved = errno;
+	uint64_t blocked;
+	
+	COUNT(process.syscalls, 1);
+	if (counters) COUNT(counters->syscalls, 1);
+	if (result == -1 && saved == EAGAIN) {
+		COUNT(process.eagain, 1);
+		if (counters) COUNT(counters->eagain, 1);
+	}
+	if (ref->started != 0) {
+		blocked = linuxfd_clock() - ref->started;
+		ref->started = 0;
+		COUNT(process.blocked, blocked);
+		_counters_max(&process.maxBlocked, blocked);
+		if (counters) {
+			COUNT(counters->blocked, blocked);
+			_counters_max(&counters->maxBlocked, blocked);
+		}
+	}
+	errno = saved;
+}
+
+void linuxfd_fd_count_read(FdRef *ref, ssize_t length) {
+	linuxfd_fd_count(ref, length);
+	if (length > 0) {
+		COUNT(process.bytes, length);
+		if (ref->owner) COUNT(((FdOwnerObject *)ref->owner)->counters.bytes, length);
+	}
+}
+
+void linuxfd_fd_hook(void *ref, ssize_t result) {
+	int armed = ((FdRef *)ref)->started != 0;
+	linuxfd_fd_count((FdRef *)ref, result);
+	if (armed) ((FdRef *)ref)->started = linuxfd_clock();
+}
+
+void linuxfd_fd_hook_read(void *ref, ssize_t length) {
+	int armed = ((FdRef *)ref)->started != 0;
+	linuxfd_fd_count_read((FdRef *)ref, length);
+	if (armed) ((FdRef *)ref)->started = linuxfd_clock();
+}
+#endif
+
+static PyObject * _fdowner_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+	/* variable declarations */
+	FdOwnerObject *self;
+	int fd;
+	
+	if (!PyArg_ParseTuple(args, "i", &fd)) return NULL;
+	self = (FdOwnerObject *)type->tp_alloc(type, 0);
+	if (self == NULL) return NULL;
+	self->fd = fd;
+	atomic_init(&self->state, 0); /* tp_alloc zeroed the counters */
+	return (PyObject *)self;
+}
+
+static void _fdowner_dealloc(FdOwnerObject *self) {
+	/* borrowers hold a reference, so nobody uses fd anymore */
+	if (!(atomic_load(&self->state) & FD_CLOSED)) close(self->fd);
+	linuxfd_free((PyObject *)self);
+}
+
+/* Python: fdowner.close() -> None
+   mark closed; the descriptor is closed now or by the last borrower */
+static PyObject * _fdowner_close(FdOwnerObject *self, PyObject *args) {
+	unsigned int state = atomic_fetch_or(&self->state, FD_CLOSED);
+	if (state == 0) close(self->fd);
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+/* Python: fdowner.fileno() -> fd, -1 if closed */
+static PyObject * _fdowner_fileno(FdOwnerObject *self, PyObject *args) {
+	return PyLong_FromLong(atomic_load(&self->state) & FD_CLOSED ? -1 : self->fd);
+}
+
+/* Python: fdowner.stats() -> dictionary of performance counters, None if
+   they were compiled out */
+static PyObject * _fdowner_stats(FdOwnerObject *self, PyObject *args) {
+#ifndef LINUXFD_NO_STATS
+	return _counters_dict(&self->counters);
+#else
+	Py_INCREF(Py_None);
+	return Py_None;
+#endif
+}
+
+static PyMethodDef fdowner_methods[] = {
+	{ "close",  (PyCFunction)_fdowner_close,  METH_NOARGS, NULL },
+	{ "fileno", (PyCFunction)_fdowner_fileno, METH_NOARGS, NULL },
+	{ "stats",  (PyCFunction)_fdowner_stats,  METH_NOARGS, NULL },
+	{ NULL, NULL, 0, NULL }
+};
+
+static PyType_Slot fdowner_slots[] = {
+	{ Py_tp_new,     _fdowner_new },
+	{ Py_tp_dealloc, _fdowner_dealloc },
+	{ Py_tp_methods, fdowner_methods },
+	{ 0, NULL }
+};
+
+static PyType_Spec fdowner_spec = {
+	.name      = "linuxfd.linuxfd_c.fdowner",
+	.basicsize = sizeof(FdOwnerObject),
+	.flags     = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE,
+	.slots     = fdowner_slots,
+};
+
+/* see linuxfd_c.h; the 64 bit fields are truncated to int like they always
+   were */
+PyObject * linuxfd_siginfo_dict(const struct signalfd_siginfo *value) {
+	return Py_BuildValue(
+		"{s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i}",
+		"signo",   (int)value->ssi_signo,
+		"errno",   (int)value->ssi_errno,
+		"code",    (int)value->ssi_code,
+		"pid",     (int)value->ssi_pid,
+		"uid",     (int)value->ssi_uid,
+		"fd",      (int)value->ssi_fd,
+		"tid",     (int)value->ssi_tid,
+		"band",    (int)value->ssi_band,
+		"overrun", (int)value->ssi_overrun,
+		"trapno",  (int)value->ssi_trapno,
+		"status",  (int)value->ssi_status,
+		"int",     (int)value->ssi_int,
+		"ptr",     (int)value->ssi_ptr,
+		"utime",   (int)value->ssi_utime,
+		"stime",   (int)value->ssi_stime,
+		"addr",    (int)value->ssi_addr
+	);
+}
+
+
+/* submodule table: attribute name and constructor */
+static const struct {
+	const char *name;
+	PyObject * (*create)(void);
+} submodules[] = {
+	{ "eventfd_c",  linuxfd_eventfd_c },
+	{ "signalfd_c", linuxfd_signalfd_c },
+	{ "timerfd_c",  linuxfd_timerfd_c },
+	{ "inotify_c",  linuxfd_inotify_c },
+	{ "fanotify_c", linuxfd_fanotify_c },
+	{ "tailer_c",   linuxfd_tailer_c },
+	{ "sharded_c",  linuxfd_sharded_c },
+	{ "reactor_c",  linuxfd_reactor_c },
+	{ "uring_c",    linuxfd_uring_c },
+	{ "executor_c", linuxfd_executor_c },
+	{ "broker_c",   linuxfd_broker_c },
+};
+#define SUBMODULES (sizeof(submodules) / sizeof(submodules[0]))
+
+/* module execution slot: export the fdowner type, the submodules, their
+   names and STATS (1 if the performance counters are compiled in) */
+static int _exec(PyObject *m) {
+	/* variable declarations */
+	PyObject *names;
+	PyObject *type;
+	PyObject *submodule;
+	size_t i;
+	
+	type = PyType_FromModuleAndSpec(m, &fdowner_spec, NULL);
+	if (type == NULL) return -1;
+	if (PyModule_AddType(m, (PyTypeObject *)type) == -1) {
+		Py_DECREF(type);
+		return -1;
+	}
+	Py_DECREF(type);
+	for (i = 0; i < SUBMODULES; i++) {
+		submodule = submodules[i].create();
+		if (submodule == NULL) return -1;
+#ifdef Py_GIL_DISABLED
+		PyUnstable_Module_SetGIL(submodule, Py_MOD_GIL_NOT_USED);
+#endif
+		if (PyModule_AddObject(m, submodules[i].name, submodule) == -1) {
+			Py_DECREF(submodule);
+			return -1;
+		}
+	}
+	names = PyTuple_New(SUBMODULES);
+	if (names == NULL) return -1;
+	for (i = 0; i < SUBMODULES; i++) {
+		PyObject *name = PyUnicode_FromString(submodules[i].name);
+		if (name == NULL) {
+			Py_DECREF(names);
+			return -1;
+		}
+		PyTuple_SET_ITEM(names, i, name);
+	}
+	if (PyModule_AddObject(m, "submodules", names) == -1) {
+		Py_DECREF(names);
+		return -1;
+	}
+#ifndef LINUXFD_NO_STATS
+	return PyModule_AddIntConstant(m, "STATS", 1);
+#else
+	return PyModule_AddIntConstant(m, "STATS", 0);
+#endif
+}
+
+
+/* Python: stats() -> dictionary of the process-wide performance counters (all
+   file descriptors, including those passed as integers), None if they were
+   compiled out */
+static PyObject * _stats(PyObject *self, PyObject *args) {
+#ifndef LINUXFD_NO_STATS
+	return _counters_dict(&process);
+#else
+	Py_INCREF(Py_None);
+	return Py_None;
+#endif
+}
+
+
+static PyMethodDef methods[] = {
+	{ "stats", (PyCFunction)_stats, METH_NOARGS, NULL },
+	{ NULL, NULL, 0, NULL }
+};
+
+static PyModuleDef_Slot slots[] = {
+	{ Py_mod_exec, _exec },
+#ifdef Py_mod_multiple_interpreters
+	{ Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED },
+#endif
+#ifdef Py_mod_gil
+	{ Py_mod_gil, Py_MOD_GIL_NOT_USED },
+#endif
+	{ 0, NULL }
+};
+
+static struct PyModuleDef linuxfdmodule = {
+	PyModuleDef_HEAD_INIT,
+	.m_name     = "linuxfd.linuxfd_c",
+	.m_size     = 0,
+	.m_methods  = methods,
+	.m_slots    = slots,
+};
+
+PyMODINIT_FUNC PyInit_linuxfd_c(void) {
+	return PyModuleDef_Init(&linuxfdmodule);
+}
@@ -0,0 +1,138 @@
+/* This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+    linuxfd is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linuxfd is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Declarations shared by the translation units of the extension module
+   linuxfd.linuxfd_c. Every source file implements one submodule and exports
+   a single function creating it; linuxfd_c.c calls it when the module is
+   executed. The system call logic of eventfd/signalfd/timerfd/inotify lives
+   in the C core, see liblinuxfd.h. Include after <Python.h>. */
+
+#ifndef LINUXFD_C_H
+#define LINUXFD_C_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define TRY_READ 1 /* read flag: return None instead of raising EAGAIN */
+#define KEEP_GIL 2 /* read/write flag: fd is non-blocking, do not release the GIL */
+
+/* free-threaded CPython (PEP 703) guards per-object state with critical
+   sections; these are plain blocks in builds with a GIL and before 3.13 */
+#if PY_VERSION_HEX < 0x030D0000
+#define Py_BEGIN_CRITICAL_SECTION(op) {
+#define Py_END_CRITICAL_SECTION() }
+#endif
+
+/* define method wrapper, which calls method(self,args) in a critical section
+   on self; for METH_VARARGS and METH_NOARGS methods of objects whose state is
+   modified with the GIL held (and thus was protected by it) */
+#define LINUXFD_LOCKED(wrapper, method) \
+	static PyObject * wrapper(PyObject *self, PyObject *args) { \
+		PyObject *result; \
+		Py_BEGIN_CRITICAL_SECTION(self); \
+		result = method((void *)self, args); \
+		Py_END_CRITICAL_SECTION(); \
+		return result; \
+	}
+
+/* types are heap types created per interpreter (PEP 684): their instances own
+   a reference to the type, which deallocation must drop after tp_free */
+static inline void linuxfd_free(PyObject *self) {
+	PyTypeObject *type = Py_TYPE(self);
+	type->tp_free(self);
+	Py_DECREF(type);
+}
+
+/* file descriptor borrowed from an fdowner object (or given as an integer)
+   for the duration of a system call; an fdowner closed meanwhile closes its
+   descriptor only after the last borrower returned it, so that a concurrent
+   close() cannot make a running call use a reused descriptor number */
+typedef struct {
+	int fd;
+	PyObject *owner; /* fdowner object, NULL if fd was given as integer */
+	uint64_t started; /* see linuxfd_fd_count() */
+} FdRef;
+
+/* borrow the descriptor of obj (fdowner or int); returns 1 on success, 0 with
+   exception set otherwise (OSError.EBADF if the fdowner was closed) */
+int linuxfd_fd_borrow(PyObject *obj, FdRef *ref);
+/* return a borrowed descriptor; does not touch errno */
+void linuxfd_fd_return(FdRef *ref);
+
+/* performance counters of fdowner objects and of the process, updated with
+   relaxed atomics: calls (borrows), system calls, EAGAIN errors, bytes read
+   and the time spent in system calls with the GIL released. The wrappers set
+   ref->started = linuxfd_clock() before releasing the GIL and report every
+   system call by linuxfd_fd_count(ref,result) or, for reads,
+   linuxfd_fd_count_read(ref,length); neither touches errno nor needs the GIL.
+   Compiled out if LINUXFD_NO_STATS is defined (see setup.py). */
+#ifndef LINUXFD_NO_STATS
+uint64_t linuxfd_clock(void);
+void linuxfd_fd_count(FdRef *ref, ssize_t result);
+void linuxfd_fd_count_read(FdRef *ref, ssize_t length);
+/* the same as lfd_hook (see liblinuxfd.h) for the batch functions of the C
+   core, with arg an FdRef; started is re-armed for the next call if set */
+void linuxfd_fd_hook(void *ref, ssize_t result);
+void linuxfd_fd_hook_read(void *ref, ssize_t length);
+#else
+#define linuxfd_clock() 0
+#define linuxfd_fd_count(ref, result) ((void)0)
+#define linuxfd_fd_count_read(ref, length) ((void)0)
+#define linuxfd_fd_hook NULL
+#define linuxfd_fd_hook_read NULL
+#endif
+
+/* USDT probes (provider linuxfd) around the system calls of the wrappers:
+   NAME_entry(fd) before and NAME_return(fd,result,bytes) after the call, with
+   NAME the wrapper's C name without underscore (e.g. eventfd_read), result
+   the system call's return value and bytes the number of bytes transferred.
+   A probe is a single nop until a tracer attaches (see examples/bpftrace/).
+   Requires <sys/sdt.h> (systemtap-sdt-dev) at build time, no-ops otherwise
+   or if LINUXFD_NO_SDT is defined. */
+#if defined(__has_include) && !defined(LINUXFD_NO_SDT)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define LINUXFD_PROBE_ENTRY(name, fd) DTRACE_PROBE1(linuxfd, name##_entry, fd)
+#define LINUXFD_PROBE_RETURN(name, fd, result, bytes) \
+	DTRACE_PROBE3(linuxfd, name##_return, fd, result, bytes)
+#endif
+#endif
+#ifndef LINUXFD_PROBE_ENTRY
+#define LINUXFD_PROBE_ENTRY(name, fd) ((void)0)
+#define LINUXFD_PROBE_RETURN(name, fd, result, bytes) ((void)0)
+#endif
+
+/* convert a signalfd_siginfo structure to the dictionary returned by
+   signalfd.read(); shared by signalfd_c, reactor_c and uring_c */
+struct signalfd_siginfo;
+PyObject * linuxfd_siginfo_dict(const struct signalfd_siginfo *value);
+
+/* submodule constructors: return a new reference or NULL with exception set;
+   called once per interpreter, so all state lives in the submodule itself */
+PyObject * linuxfd_eventfd_c(void);
+PyObject * linuxfd_signalfd_c(void);
+PyObject * linuxfd_timerfd_c(void);
+PyObject * linuxfd_inotify_c(void);
+PyObject * linuxfd_fanotify_c(void);
+PyObject * linuxfd_tailer_c(void);
+PyObject * linuxfd_sharded_c(void);
+PyObject * linuxfd_reactor_c(void);
+PyObject * linuxfd_uring_c(void);
+PyObject * linuxfd_executor_c(void);
+PyObject * linuxfd_broker_c(void);
+
+#endif /* LINUXFD_C_H */
@@ -0,0 +1,595 @@
+/* This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+    linuxfd is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linuxfd is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Reactor: an epoll loop dispatching readiness events to callbacks. Waiting
+   happens with the GIL released; eventfd, timerfd and signalfd objects are
+   read in C, other objects with a read() method are read by calling it, and
+   plain file descriptors are passed to their callback along with the epoll
+   event mask. The kind of a registered object is taken from its class
+   attribute "_reactorKind". */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <unistd.h>
+#include <stdlib.h> /* provides realloc and free */
+#include <errno.h>  /* definition of errno */
+#include <string.h>
+#include <stdint.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include "linuxfd_c.h"
+
+#define REACTOR_MAXEVENTS 64  /* epoll events per run_once() */
+#define REACTOR_SIGINFOS  16  /* signals read by a single read() */
+
+enum { KIND_NONE, KIND_FD, KIND_READ, KIND_COUNTER, KIND_SIGNALFD };
+
+/* registration of a file descriptor; the table is indexed by fd */
+typedef struct {
+	int kind;               /* KIND_NONE if the slot is unused */
+	uint32_t events;
+	uint64_t generation;    /* detects re-registration during dispatch */
+	PyObject *object;       /* registered object or int */
+	PyObject *callback;
+} ReactorEntry;
+
+typedef struct {
+	PyObject_HEAD
+	int epfd;
+	ReactorEntry *entries;
+	int n_entries;
+	int n_registered;
+	uint64_t generation;
+	int stopped;
+} ReactorObject;
+
+
+/* helper: determine file descriptor and kind of an object; returns -1 and sets
+   an exception on error */
+static int _reactor_classify(PyObject *object, int *kind) {
+	int fd;
+	PyObject *name;
+
+	if (PyLong_Check(object)) {
+		*kind = KIND_FD;
+		return PyObject_AsFileDescriptor(object);
+	}
+	fd = PyObject_AsFileDescriptor(object);
+	if (fd == -1) return -1;
+	name = PyObject_GetAttrString(object, "_reactorKind");
+	if (name == NULL) {
+		PyErr_Clear();
+		*kind = PyObject_HasAttrString(object, "read") ? KIND_READ : KIND_FD;
+		return fd;
+	}
+	if (PyUnicode_Check(name) && (PyUnicode_CompareWithASCIIString(name, "eventfd") == 0 ||
+	                              PyUnicode_CompareWithASCIIString(name, "timerfd") == 0))
+		*kind = KIND_COUNTER;
+	else if (PyUnicode_Check(name) && PyUnicode_CompareWithASCIIString(name, "signalfd") == 0)
+		*kind = KIND_SIGNALFD;
+	else
+		*kind = PyObject_HasAttrString(object, "read") ? KIND_READ : KIND_FD;
+	Py_DECREF(name);
+	return fd;
+}
+
+
+/* helper: drop a registration */
+static void _reactor_clear(ReactorEntry *entry) {
+	Py_CLEAR(entry->object);
+	Py_CLEAR(entry->callback);
+	entry->kind = KIND_NONE;
+}
+
+
+static PyObject * _reactor_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+	ReactorObject *self;
+
+	if (!PyArg_ParseTuple(args, "")) return NULL;
+	self = (ReactorObject *)type->tp_alloc(type, 0);
+	if (self == NULL) return NULL;
+	self->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (self->epfd == -1) {
+		Py_DECREF(self);
+		return PyErr_SetFromErrno(PyExc_OSError);
+	}
+	return (PyObject *)self;
+}
+
+
+static int _reactor_traverse(ReactorObject *self, visitproc visit, void *arg) {
+	int i;
+	Py_VISIT(Py_TYPE(self)); /* heap type, see linuxfd_c.h */
+	for (i = 0; i < self->n_entries; i++) {
+		Py_VISIT(self->entries[i].object);
+		Py_VISIT(self->entries[i].callback);
+	}
+	return 0;
+}
+
+
+static int _reactor_tp_clear(ReactorObject *self) {
+	int i;
+	for (i = 0; i < self->n_entries; i++) _reactor_clear(&self->entries[i]);
+	self->n_registered = 0;
+	return 0;
+}
+
+
+static void _reactor_dealloc(ReactorObject *self) {
+	PyObject_GC_UnTrack(self);
+	_reactor_tp_clear(self);
+	free(self->entries);
+	if (self->epfd != -1) close(self->epfd);
+	linuxfd_free((PyObject *)self);
+}
+
+
+/* Python: reactor.register(object,callback,events=EPOLLIN)
+   C:      int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event); */
+static PyObject * _reactor_register(ReactorObject *self, PyObject *args) {
+	PyObject *object;
+	PyObject *callback;
+	unsigned int events = EPOLLIN;
+	struct epoll_event event;
+	ReactorEntry *entries;
+	ReactorEntry stale;
+	int fd, kind, n;
+
+	if (!PyArg_ParseTuple(args, "OO|I", &object, &callback, &events)) return NULL;
+	if (!PyCallable_Check(callback)) {
+		PyErr_SetString(PyExc_TypeError, "callback must be callable");
+		return NULL;
+	}
+	fd = _reactor_classify(object, &kind);
+	if (fd == -1) return NULL;
+
+	if (fd >= self->n_entries) {
+		for (n = self->n_entries > 0 ? self->n_entries : 64; n <= fd; n *= 2);
+		entries = realloc(self->entries, n * sizeof(ReactorEntry));
+		if (entries == NULL) return PyErr_NoMemory();
+		memset(entries + self->n_entries, 0, (n - self->n_entries) * sizeof(ReactorEntry));
+		self->entries = entries;
+		self->n_entries = n;
+	}
+
+	event.events = events;
+	event.data.u64 = (uint64_t)fd;
+	if (epoll_ctl(self->epfd, EPOLL_CTL_ADD, fd, &event) == -1) return PyErr_SetFromErrno(PyExc_OSError);
+	/* an occupied slot belongs to a descriptor closed without unregister(),
+	   whose number got reused: replace that registration */
+	stale = self->entries[fd];
+	if (stale.kind == KIND_NONE) self->n_registered++;
+	Py_INCREF(object);
+	Py_INCREF(callback);
+	self->entries[fd].kind = kind;
+	self->entries[fd].events = events;
+	self->entries[fd].generation = ++self->generation;
+	self->entries[fd].object = object;
+	self->entries[fd].callback = callback;
+	/* released last, as this may run arbitrary code */
+	Py_XDECREF(stale.object);
+	Py_XDECREF(stale.callback);
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+/* helper: return the registration of an object or set an exception */
+static ReactorEntry * _reactor_entry(ReactorObject *self, PyObject *object, int *fd) {
+	int kind;
+	*fd = _reactor_classify(object, &kind);
+	if (*fd == -1) return NULL;
+	if (*fd >= self->n_entries || self->entries[*fd].kind == KIND_NONE) {
+		PyErr_SetObject(PyExc_KeyError, object);
+		return NULL;
+	}
+	return &self->entries[*fd];
+}
+
+
+/* Python: reactor.modify(object,events) */
+static PyObject * _reactor_modify(ReactorObject *self, PyObject *args) {
+	PyObject *object;
+	unsigned int events;
+	struct epoll_event event;
+	ReactorEntry *entry;
+	int fd;
+
+	if (!PyArg_ParseTuple(args, "OI", &object, &events)) return NULL;
+	entry = _reactor_entry(self, object, &fd);
+	if (entry == NULL) return NULL;
+	event.events = events;
+	event.data.u64 = (uint64_t)fd;
+	if (epoll_ctl(self->epfd, EPOLL_CTL_MOD, fd, &event) == -1) return PyErr_SetFromErrno(PyExc_OSError);
+	entry->events = events;
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+/* Python: reactor.unregister(object) */
+static PyObject * _reactor_unregister(ReactorObject *self, PyObject *args) {
+	PyObject *object;
+	ReactorEntry *entry;
+	int fd;
+
+	if (!PyArg_ParseTuple(args, "O", &object)) return NULL;
+	entry = _reactor_entry(self, object, &fd);
+	if (entry == NULL) return NULL;
+	/* a closed descriptor is already gone from the epoll set */
+	if (epoll_ctl(self->epfd, EPOLL_CTL_DEL, fd, NULL) == -1 && errno != EBADF && errno != ENOENT)
+		return PyErr_SetFromErrno(PyExc_OSError);
+	_reactor_clear(entry);
+	self->n_registered--;
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+/* helper: read a natively decoded object (eventfd, timerfd, signalfd) the way
+   its wrapper does: borrow the descriptor from the object's fdowner and keep
+   the GIL only if the object is non-blocking (see KEEP_GIL). A blocking
+   descriptor drained by somebody else since epoll_wait() must not block with
+   the GIL held, thus it is polled first. Returns the result of read(), -1 with
+   errno EAGAIN if there was nothing to read, or -2 with exception set */
+static ssize_t _reactor_read(PyObject *object, int fd, void *buffer, size_t size) {
+	PyObject *owner;
+	PyObject *ioflags;
+	struct pollfd pollfd;
+	FdRef ref;
+	long flags = 0;
+	ssize_t length;
+	int error;
+
+	owner = PyObject_GetAttrString(object, "_owner");
+	if (owner == NULL) {
+		PyErr_Clear();
+		owner = PyLong_FromLong(fd);
+		if (owner == NULL) return -2;
+	}
+	ioflags = PyObject_GetAttrString(object, "_ioFlags");
+	if (ioflags == NULL) {
+		PyErr_Clear();
+	} else {
+		flags = PyLong_AsLong(ioflags);
+		Py_DECREF(ioflags);
+		if (flags == -1 && PyErr_Occurred()) {
+			Py_DECREF(owner);
+			return -2;
+		}
+	}
+	if (!linuxfd_fd_borrow(owner, &ref)) {
+		Py_DECREF(owner);
+		return -2;
+	}
+
+	LINUXFD_PROBE_ENTRY(reactor_read, ref.fd);
+	if (flags & KEEP_GIL) {
+		length = read(ref.fd, buffer, size);
+	} else {
+		pollfd.fd = ref.fd;
+		pollfd.events = POLLIN;
+		length = poll(&pollfd, 1, 0);
+		if (length == 1 && (pollfd.revents & POLLIN)) {
+			ref.started = linuxfd_clock();
+			Py_BEGIN_ALLOW_THREADS
+			length = read(ref.fd, buffer, size);
+			Py_END_ALLOW_THREADS
+		} else if (length != -1) {
+			length = -1;
+			errno = EAGAIN;
+		}
+	}
+	linuxfd_fd_count_read(&ref, length);
+	LINUXFD_PROBE_RETURN(reactor_read, ref.fd, length, length == -1 ? 0 : length);
+	linuxfd_fd_return(&ref);
+	error = errno;
+	Py_DECREF(owner);
+	errno = error;
+	return length;
+}
+
+
+/* helper: read a ready file descriptor according to its kind and call its
+   callback; returns the number of callbacks called or -1 on error */
+static int _reactor_dispatch(ReactorObject *self, int fd, uint32_t events) {
+	ReactorEntry *entry = &self->entries[fd];
+	PyObject *object = entry->object;
+	PyObject *callback = entry->callback;
+	PyObject *value = NULL;
+	PyObject *result;
+	PyObject *type = NULL, *error = NULL, *traceback = NULL;
+	struct signalfd_siginfo siginfos[REACTOR_SIGINFOS];
+	uint64_t counter;
+	ssize_t length;
+	int i, n = 0;
+
+	/* the callback may unregister itself (or anything else) */
+	Py_INCREF(object);
+	Py_INCREF(callback);
+
+	switch (entry->kind) {
+	case KIND_COUNTER:
+		/* eventfd value or timerfd expirations */
+		length = _reactor_read(object, fd, &counter, sizeof(counter));
+		if (length == sizeof(counter)) {
+			value = PyLong_FromUnsignedLongLong(counter);
+			if (value == NULL) { n = -1; break; }
+		} else if (length == -2) {
+			n = -1;
+			break;
+		} else if (length == -1 && errno != EAGAIN) {
+			PyErr_SetFromErrno(PyExc_OSError);
+			n = -1;
+			break;
+		} else {
+			break; /* consumed by somebody else in the meantime */
+		}
+		result = PyObject_CallFunctionObjArgs(callback, object, value, NULL);
+		n = result == NULL ? -1 : 1;
+		Py_XDECREF(result);
+		break;
+
+	case KIND_SIGNALFD:
+		/* several pending signals are consumed by a single read */
+		length = _reactor_read(object, fd, siginfos, sizeof(siginfos));
+		if (length == -2) {
+			n = -1;
+			break;
+		}
+		if (length == -1) {
+			if (errno != EAGAIN) {
+				PyErr_SetFromErrno(PyExc_OSError);
+				n = -1;
+			}
+			break;
+		}
+		/* the signals are consumed: deliver all of them, even if a callback
+		   raises, and propagate the first exception afterwards */
+		for (i = 0; i < length / (ssize_t)sizeof(struct signalfd_siginfo); i++) {
+			value = linuxfd_siginfo_dict(&siginfos[i]);
+			result = value != NULL ? PyObject_CallFunctionObjArgs(callback, object, value, NULL) : NULL;
+			Py_CLEAR(value);
+			if (result != NULL) {
+				Py_DECREF(result);
+				n++;
+			} else if (type == NULL) {
+				PyErr_Fetch(&type, &error, &traceback);
+			} else {
+				PyErr_Clear();
+			}
+		}
+		if (type != NULL) {
+			PyErr_Restore(type, error, traceback);
+			n = -1;
+		}
+		break;
+
+	case KIND_READ:
+		/* other linuxfd objects decode their data themselves */
+		value = PyObject_CallMethod(object, "read", NULL);
+		if (value == NULL) {
+			if (PyErr_ExceptionMatches(PyExc_BlockingIOError))
+				PyErr_Clear();
+			else
+				n = -1;
+			break;
+		}
+		result = PyObject_CallFunctionObjArgs(callback, object, value, NULL);
+		n = result == NULL ? -1 : 1;
+		Py_XDECREF(result);
+		break;
+
+	case KIND_FD:
+		value = PyLong_FromUnsignedLong(events);
+		result = value != NULL ? PyObject_CallFunctionObjArgs(callback, object, value, NULL) : NULL;
+		n = result == NULL ? -1 : 1;
+		Py_XDECREF(result);
+		break;
+	}
+
+	Py_XDECREF(value);
+	Py_DECREF(object);
+	Py_DECREF(callback);
+	return n;
+}
+
+
+/* helper: wait for events and dispatch them; returns the number of callbacks
+   called or -1 on error */
+static int _reactor_run_once(ReactorObject *self, int timeout) {
+	struct epoll_event events[REACTOR_MAXEVENTS];
+	uint64_t generations[REACTOR_MAXEVENTS];
+	int i, fd, n_events, n, total = 0;
+
+	if (self->epfd == -1) {
+		errno = EBADF;
+		PyErr_SetFromErrno(PyExc_OSError);
+		return -1;
+	}
+	Py_BEGIN_ALLOW_THREADS
+	n_events = epoll_wait(self->epfd, events, REACTOR_MAXEVENTS, timeout);
+	Py_END_ALLOW_THREADS
+	if (n_events == -1) {
+		if (errno == EINTR) return PyErr_CheckSignals() == -1 ? -1 : 0;
+		PyErr_SetFromErrno(PyExc_OSError);
+		return -1;
+	}
+
+	/* remember the registrations the events belong to */
+	for (i = 0; i < n_events; i++) {
+		fd = (int)events[i].data.u64;
+		generations[i] = fd < self->n_entries ? self->entries[fd].generation : 0;
+	}
+	for (i = 0; i < n_events; i++) {
+		fd = (int)events[i].data.u64;
+		/* skip registrations dropped or replaced by an earlier callback */
+		if (fd >= self->n_entries || self->entries[fd].kind == KIND_NONE ||
+		    self->entries[fd].generation != generations[i]) continue;
+		n = _reactor_dispatch(self, fd, events[i].events);
+		if (n == -1) return -1; /* unread events stay ready (level-triggered) */
+		total += n;
+	}
+	return total;
+}
+
+
+/* Python: reactor.run_once(timeout=-1) -> number of callbacks called
+   wait at most timeout seconds (negative: forever) for events */
+static PyObject * _reactor_run_once_method(ReactorObject *self, PyObject *args) {
+	double timeout = -1.0;
+	int n;
+
+	if (!PyArg_ParseTuple(args, "|d", &timeout)) return NULL;
+	n = _reactor_run_once(self, timeout < 0 ? -1 : (int)(timeout * 1000.0));
+	if (n == -1) return NULL;
+	return PyLong_FromLong(n);
+}
+
+
+/* Python: reactor.run_forever()
+   dispatch events until stop() is called, no object is registered any more or
+   a callback raises an exception */
+static PyObject * _reactor_run_forever(ReactorObject *self, PyObject *args) {
+	self->stopped = 0;
+	while (!self->stopped && self->n_registered > 0)
+		if (_reactor_run_once(self, -1) == -1) return NULL;
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+/* Python: reactor.stop()
+   let run_forever() return after the current callbacks */
+static PyObject * _reactor_stop(ReactorObject *self, PyObject *args) {
+	self->stopped = 1;
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+/* Python: reactor.fileno() -> epoll file descriptor */
+static PyObject * _reactor_fileno(ReactorObject *self, PyObject *args) {
+	return PyLong_FromLong(self->epfd);
+}
+
+
+/* Python: reactor.close()
+   close the epoll instance and drop all registrations */
+static PyObject * _reactor_close(ReactorObject *self, PyObject *args) {
+	_reactor_tp_clear(self);
+	if (self->epfd != -1) close(self->epfd);
+	self->epfd = -1;
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+static Py_ssize_t _reactor_len(ReactorObject *self) {
+	return self->n_registered;
+}
+
+
+/* methods run in a critical section on self, see linuxfd_c.h */
+LINUXFD_LOCKED(_reactor_register_locked, _reactor_register)
+LINUXFD_LOCKED(_reactor_modify_locked, _reactor_modify)
+LINUXFD_LOCKED(_reactor_unregister_locked, _reactor_unregister)
+LINUXFD_LOCKED(_reactor_run_once_method_locked, _reactor_run_once_method)
+LINUXFD_LOCKED(_reactor_run_forever_locked, _reactor_run_forever)
+LINUXFD_LOCKED(_reactor_stop_locked, _reactor_stop)
+LINUXFD_LOCKED(_reactor_close_locked, _reactor_close)
+
+static PyMethodDef reactor_methods[] = {
+	{ "register",    (PyCFunction)_reactor_register_locked,        METH_VARARGS, NULL },
+	{ "modify",      (PyCFunction)_reactor_modify_locked,          METH_VARARGS, NULL },
+	{ "unregister",  (PyCFunction)_reactor_unregister_locked,      METH_VARARGS, NULL },
+	{ "run_once",    (PyCFunction)_reactor_run_once_method_locked, METH_VARARGS, NULL },
+	{ "run_forever", (PyCFunction)_reactor_run_forever_locked,     METH_NOARGS,  NULL },
+	{ "stop",        (PyCFunction)_reactor_stop_locked,            METH_NOARGS,  NULL },
+	{ "fileno",      (PyCFunction)_reactor_fileno,                 METH_NOARGS,  NULL },
+	{ "close",       (PyCFunction)_reactor_close_locked,           METH_NOARGS,  NULL },
+	{ NULL,          NULL,                                         0,            NULL }
+};
+
+PyDoc_STRVAR(reactor_doc,
+"Reactor()\n\
+\n\
+An epoll loop dispatching readiness events to callbacks.\n\
+\n\
+register(object,callback,events=EPOLLIN) registers an eventfd, timerfd,\n\
+signalfd, any other object with fileno() and read() methods, or a plain file\n\
+descriptor. Waiting happens with the GIL released. Callbacks are called as\n\
+callback(object,value): eventfd and timerfd values are read in C, signalfd\n\
+objects yield one signal dictionary per pending signal (see signalfd.read()),\n\
+other objects yield the result of their read() method; plain file descriptors\n\
+yield the epoll event mask and have to be read by the callback.\n\
+\n\
+run_once(timeout=-1) waits at most timeout seconds and returns the number of\n\
+callbacks called; run_forever() runs until stop() is called or nothing is\n\
+registered any more. Exceptions raised by callbacks are propagated.");
+
+static PyType_Slot reactor_slots[] = {
+	{ Py_tp_dealloc,  _reactor_dealloc },
+	{ Py_tp_doc,      (void *)reactor_doc },
+	{ Py_tp_traverse, _reactor_traverse },
+	{ Py_tp_clear,    _reactor_tp_clear },
+	{ Py_sq_length,   _reactor_len },
+	{ Py_tp_methods,  reactor_methods },
+	{ Py_tp_new,      _reactor_new },
+	{ 0, NULL }
+};
+
+static PyType_Spec reactor_spec = {
+	.name      = "linuxfd.Reactor",
+	.basicsize = sizeof(ReactorObject),
+	.flags     = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC | Py_TPFLAGS_IMMUTABLETYPE,
+	.slots     = reactor_slots,
+};
+
+
+static PyMethodDef methods[] = {
+	{ NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef reactormodule = { PyModuleDef_HEAD_INIT, "linuxfd.reactor_c", NULL, 0, methods };
+
+/* create submodule linuxfd.reactor_c, see linuxfd_c.h */
+PyObject * linuxfd_reactor_c(void) {
+	PyObject *m;
+	PyObject *type;
+	m = PyModule_Create(&reactormodule);
+	if (m == NULL) return NULL;
+	type = PyType_FromModuleAndSpec(m, &reactor_spec, NULL);
+	if (type == NULL || PyModule_AddType(m, (PyTypeObject *)type) == -1) {
+		Py_XDECREF(type);
+		Py_DECREF(m);
+		return NULL;
+	}
+	Py_DECREF(type);
+	/* define epoll event constants */
+	PyModule_AddIntConstant( m, "EPOLLIN",      EPOLLIN );
+	PyModule_AddIntConstant( m, "EPOLLOUT",     EPOLLOUT );
+	PyModule_AddIntConstant( m, "EPOLLPRI",     EPOLLPRI );
+	PyModule_AddIntConstant( m, "EPOLLERR",     EPOLLERR );
+	PyModule_AddIntConstant( m, "EPOLLHUP",     EPOLLHUP );
+	PyModule_AddIntConstant( m, "EPOLLRDHUP",   EPOLLRDHUP );
+	PyModule_AddIntConstant( m, "EPOLLET",      EPOLLET );
+	PyModule_AddIntConstant( m, "EPOLLONESHOT", EPOLLONESHOT );
+	return m;
+}
@@ -0,0 +1,502 @@
+/* This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+    linuxfd is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linuxfd is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Sharded inotify: watches are distributed over several inotify instances,
+   each drained by a native reader thread. A reader reads event batches
+   directly into a single-producer/single-consumer ring buffer of its shard;
+   the consumer (the Python thread calling drain(), serialised by the GIL)
+   decodes them. Readers signal new data via one shared eventfd, which is
+   the file descriptor to be registered with epoll. Events of a single watch
+   are always read by the same thread, thus their order is preserved. */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <unistd.h>
+#include <stdlib.h> /* provides malloc and free */
+#include <errno.h>  /* definition of errno */
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include "linuxfd_c.h"
+
+#define SHARD_WRAP 0xFFFFFFFFu /* ring record length marking a wrap-around */
+
+/* state of a single shard; head and tail are free-running byte positions */
+typedef struct {
+	int fd;                 /* inotify instance */
+	int wake;               /* eventfd waking the reader (stop, space freed) */
+	pthread_t thread;
+	int running;
+	char *ring;
+	size_t capacity;        /* power of two */
+	atomic_size_t head;     /* consumer position */
+	atomic_size_t tail;     /* producer position */
+	atomic_int stalled;     /* reader waits for free space */
+	atomic_int error;       /* errno of a failed read, stops the reader */
+	atomic_int stop;
+	int notify;             /* shared eventfd signalling new data */
+	size_t buffersize;      /* maximum size of a single batch */
+} Shard;
+
+typedef struct {
+	PyObject_HEAD
+	Shard *shards;
+	Py_ssize_t n_shards;
+	int notify;
+	int waiters;            /* drain() calls polling notify */
+	Py_ssize_t next;        /* shard drained first by the next drain() */
+} ShardedObject;
+
+
+/* helper: signal an eventfd */
+static void _signal(int fd) {
+	uint64_t one = 1;
+	while (write(fd, &one, sizeof(one)) == -1 && errno == EINTR);
+}
+
+
+/* helper: reset an eventfd (non-blocking) */
+static void _reset(int fd) {
+	uint64_t value;
+	while (read(fd, &value, sizeof(value)) == -1 && errno == EINTR);
+}
+
+
+/* reader thread: read event batches into the ring until stopped */
+static void * _shard_reader(void *arg) {
+	Shard *shard = (Shard *)arg;
+	struct pollfd fds[2] = { { shard->fd, POLLIN, 0 }, { shard->wake, POLLIN, 0 } };
+	size_t head, tail, index, needed;
+	ssize_t length;
+	uint32_t marker;
+
+	while (!atomic_load(&shard->stop)) {
+		/* a batch needs a length word plus the buffer, contiguously */
+		head  = atomic_load_explicit(&shard->head, memory_order_acquire);
+		tail  = atomic_load_explicit(&shard->tail, memory_order_relaxed);
+		index = tail & (shard->capacity - 1);
+		needed = sizeof(uint32_t) + shard->buffersize;
+		if (shard->capacity - index < needed) needed += shard->capacity - index;
+		if (shard->capacity - (tail - head) < needed) {
+			/* ring full: stop reading (the kernel queues further events)
+			   until the consumer frees space; re-check after flagging */
+			atomic_store(&shard->stalled, 1);
+			if (shard->capacity - (tail - atomic_load(&shard->head)) < needed) {
+				fds[0].events = 0;
+				poll(fds, 2, -1);
+				fds[0].events = POLLIN;
+				if (fds[1].revents & POLLIN) _reset(shard->wake);
+			}
+			continue;
+		}
+		if (poll(fds, 2, -1) == -1) continue; /* EINTR */
+		if (fds[1].revents & POLLIN) _reset(shard->wake);
+		if (!(fds[0].revents & POLLIN)) continue;
+
+		/* wrap around if the batch does not fit contiguously */
+		if (shard->capacity - index < sizeof(uint32_t) + shard->buffersize) {
+			marker = SHARD_WRAP;
+			memcpy(shard->ring + index, &marker, sizeof(marker));
+			tail += shard->capacity - index;
+			index = 0;
+		}
+		length = read(shard->fd, shard->ring + index + sizeof(uint32_t), shard->buffersize);
+		if (length == -1) {
+			if (errno == EINTR || errno == EAGAIN) continue;
+			atomic_store(&shard->error, errno);
+			_signal(shard->notify);
+			break;
+		}
+		marker = (uint32_t)length;
+		memcpy(shard->ring + index, &marker, sizeof(marker));
+		/* records stay 4-byte aligned, like struct inotify_event */
+		tail += sizeof(uint32_t) + ((length + 3) & ~(size_t)3);
+		atomic_store_explicit(&shard->tail, tail, memory_order_release);
+		_signal(shard->notify);
+	}
+	return NULL;
+}
+
+
+/* helper: stop the reader threads and release all resources */
+static void _sharded_release(ShardedObject *self) {
+	Py_ssize_t i;
+	if (self->shards == NULL) return;
+	for (i = 0; i < self->n_shards; i++) {
+		if (self->shards[i].running) {
+			atomic_store(&self->shards[i].stop, 1);
+			_signal(self->shards[i].wake);
+		}
+	}
+	Py_BEGIN_ALLOW_THREADS
+	for (i = 0; i < self->n_shards; i++)
+		if (self->shards[i].running) pthread_join(self->shards[i].thread, NULL);
+	Py_END_ALLOW_THREADS
+	for (i = 0; i < self->n_shards; i++) {
+		if (self->shards[i].fd != -1) close(self->shards[i].fd);
+		if (self->shards[i].wake != -1) close(self->shards[i].wake);
+		free(self->shards[i].ring);
+	}
+	free(self->shards);
+	self->shards = NULL;
+	self->n_shards = 0;
+	if (self->notify != -1) {
+		/* wake drain() calls polling notify; the last of them closes it, so
+		   that its number cannot be reused while they still poll it */
+		_signal(self->notify);
+		if (self->waiters == 0) close(self->notify);
+	}
+	self->notify = -1;
+}
+
+
+/* Python: sharded(shards,buffersize=65536,ringsize=1048576) -> sharded object */
+static PyObject * _sharded_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+	/* variable declarations */
+	ShardedObject *self;
+	Shard *shard;
+	Py_ssize_t n_shards;
+	Py_ssize_t buffersize = 65536;
+	Py_ssize_t ringsize = 1048576;
+	Py_ssize_t i;
+	size_t capacity;
+	int error;
+
+	/* parse the function's arguments: number of shards, optional buffer and ring sizes */
+	if (!PyArg_ParseTuple(args, "n|nn", &n_shards, &buffersize, &ringsize)) return NULL;
+	if (n_shards < 1 || ringsize < 0 || buffersize < (Py_ssize_t)(sizeof(struct inotify_event) + NAME_MAX + 1)) {
+		errno = EINVAL;
+		return PyErr_SetFromErrno(PyExc_OSError);
+	}
+	/* the ring holds at least two batches; its capacity is a power of two */
+	for (capacity = 4096; capacity < (size_t)ringsize || capacity < 2 * (size_t)buffersize + 8; capacity <<= 1);
+
+	self = (ShardedObject *)type->tp_alloc(type, 0);
+	if (self == NULL) return NULL;
+	self->notify = -1;
+	self->shards = calloc(n_shards, sizeof(Shard));
+	if (self->shards == NULL) {
+		Py_DECREF(self);
+		return PyErr_NoMemory();
+	}
+	self->n_shards = n_shards;
+	for (i = 0; i < n_shards; i++) self->shards[i].fd = self->shards[i].wake = -1;
+
+	self->notify = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (self->notify == -1) goto error;
+	for (i = 0; i < n_shards; i++) {
+		shard = &self->shards[i];
+		shard->notify = self->notify;
+		shard->buffersize = buffersize;
+		shard->capacity = capacity;
+		shard->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (shard->fd == -1) goto error;
+		shard->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (shard->wake == -1) goto error;
+		shard->ring = malloc(capacity);
+		if (shard->ring == NULL) {
+			errno = ENOMEM;
+			goto error;
+		}
+		error = pthread_create(&shard->thread, NULL, _shard_reader, shard);
+		if (error != 0) {
+			errno = error;
+			goto error;
+		}
+		shard->running = 1;
+	}
+	return (PyObject *)self;
+
+error:
+	error = errno;
+	_sharded_release(self);
+	Py_DECREF(self);
+	errno = error;
+	return PyErr_SetFromErrno(PyExc_OSError);
+}
+
+
+static void _sharded_dealloc(ShardedObject *self) {
+	_sharded_release(self);
+	linuxfd_free((PyObject *)self);
+}
+
+
+/* helper: return a shard by index or set an exception */
+static Shard * _sharded_shard(ShardedObject *self, Py_ssize_t index) {
+	if (self->shards == NULL) {
+		errno = EBADF;
+		PyErr_SetFromErrno(PyExc_OSError);
+		return NULL;
+	}
+	if (index < 0 || index >= self->n_shards) {
+		PyErr_SetString(PyExc_IndexError, "shard index out of range");
+		return NULL;
+	}
+	return &self->shards[index];
+}
+
+
+/* Python: sharded.add_watch(shard,pathname,mask) -> wd
+   C:      int inotify_add_watch(int fd, const char *pathname, uint32_t mask); */
+static PyObject * _sharded_add_watch(ShardedObject *self, PyObject *args) {
+	Py_ssize_t index;
+	PyObject *pathname;
+	uint32_t mask;
+	Shard *shard;
+	int wd;
+
+	if (!PyArg_ParseTuple(args, "nO&I", &index, PyUnicode_FSConverter, &pathname, &mask)) return NULL;
+	shard = _sharded_shard(self, index);
+	if (shard == NULL) {
+		Py_DECREF(pathname);
+		return NULL;
+	}
+	Py_BEGIN_ALLOW_THREADS
+	wd = inotify_add_watch(shard->fd, PyBytes_AS_STRING(pathname), mask);
+	Py_END_ALLOW_THREADS
+	Py_DECREF(pathname);
+	if (wd == -1) return PyErr_SetFromErrno(PyExc_OSError);
+	return PyLong_FromLong(wd);
+}
+
+
+/* Python: sharded.rm_watch(shard,wd)
+   C:      int inotify_rm_watch(int fd, int wd); */
+static PyObject * _sharded_rm_watch(ShardedObject *self, PyObject *args) {
+	Py_ssize_t index;
+	int wd;
+	int result;
+	Shard *shard;
+
+	if (!PyArg_ParseTuple(args, "ni", &index, &wd)) return NULL;
+	shard = _sharded_shard(self, index);
+	if (shard == NULL) return NULL;
+	result = inotify_rm_watch(shard->fd, wd);
+	if (result == -1) return PyErr_SetFromErrno(PyExc_OSError);
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+/* helper: decode the queued batches of one shard into a list of tuples
+   (shard,wd,mask,cookie,name), at most until the list holds limit items;
+   returns -1 on error, leaving the failed batch queued and out of the list */
+static int _sharded_decode(ShardedObject *self, Py_ssize_t index, PyObject *list, Py_ssize_t limit) {
+	Shard *shard = &self->shards[index];
+	size_t head = atomic_load_explicit(&shard->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&shard->tail, memory_order_acquire);
+	size_t start = head;
+	uint32_t length;
+	const char *ptr, *end;
+	const struct inotify_event *event;
+	PyObject *name, *item;
+	Py_ssize_t size;
+	int result = 0;
+
+	while (head != tail && PyList_GET_SIZE(list) < limit) {
+		memcpy(&length, shard->ring + (head & (shard->capacity - 1)), sizeof(length));
+		if (length == SHARD_WRAP) {
+			head += shard->capacity - (head & (shard->capacity - 1));
+			continue;
+		}
+		/* batches are consumed as a whole, even if this exceeds limit */
+		ptr = shard->ring + (head & (shard->capacity - 1)) + sizeof(uint32_t);
+		size = PyList_GET_SIZE(list);
+		for (end = ptr + length; ptr < end; ptr += sizeof(struct inotify_event) + event->len) {
+			event = (const struct inotify_event *)ptr;
+			/* undecodable bytes are kept as surrogates, like os.fsdecode() */
+			name = event->len ? PyUnicode_DecodeFSDefault(event->name) : PyUnicode_FromString("");
+			item = name != NULL ? Py_BuildValue("(niIIN)", index, event->wd, event->mask, event->cookie, name) : NULL;
+			if (item == NULL || PyList_Append(list, item) == -1) {
+				Py_XDECREF(item);
+				result = -1;
+				break;
+			}
+			Py_DECREF(item);
+		}
+		if (result == -1) {
+			/* keep the batch queued, so that no event of it gets lost */
+			PyList_SetSlice(list, size, PY_SSIZE_T_MAX, NULL);
+			break;
+		}
+		head += sizeof(uint32_t) + ((length + 3) & ~(size_t)3);
+	}
+
+	/* free the space; wake the reader if it waits for it */
+	if (head != start) {
+		atomic_store_explicit(&shard->head, head, memory_order_release);
+		if (atomic_exchange(&shard->stalled, 0)) _signal(shard->wake);
+	}
+	return result;
+}
+
+
+/* Python: sharded.drain(maxevents=-1,block=True) -> list of (shard,wd,mask,cookie,name)
+   collect queued events of all shards; shards are visited round-robin, so a
+   busy shard cannot starve the others. Blocks with the GIL released if no
+   events are queued and block is True; raises EAGAIN otherwise. If a batch
+   cannot be decoded, the events collected before it are returned and the
+   batch stays queued, so that the next call raises the error. */
+static PyObject * _sharded_drain(ShardedObject *self, PyObject *args) {
+	Py_ssize_t limit = -1;
+	int block = 1;
+	Py_ssize_t i, index;
+	int error;
+	struct pollfd pfd;
+	PyObject *list;
+
+	if (!PyArg_ParseTuple(args, "|np", &limit, &block)) return NULL;
+	if (self->shards == NULL) {
+		errno = EBADF;
+		return PyErr_SetFromErrno(PyExc_OSError);
+	}
+	if (limit < 0) limit = PY_SSIZE_T_MAX;
+	list = PyList_New(0);
+	if (list == NULL) return NULL;
+
+	while (1) {
+		/* reset the notification before looking at the rings, so that data
+		   published afterwards signals the eventfd again */
+		_reset(self->notify);
+		error = 0;
+		for (i = 0; i < self->n_shards && PyList_GET_SIZE(list) < limit; i++) {
+			index = (self->next + i) % self->n_shards;
+			if (_sharded_decode(self, index, list, limit) == -1) {
+				/* the events in list are consumed already: return them */
+				if (PyList_GET_SIZE(list) > 0) {
+					PyErr_Clear();
+					return list;
+				}
+				Py_DECREF(list);
+				return NULL;
+			}
+			if (error == 0) error = atomic_load(&self->shards[index].error);
+		}
+		self->next = (self->next + 1) % self->n_shards;
+		if (PyList_GET_SIZE(list) > 0) return list;
+		if (error != 0 || !block) {
+			Py_DECREF(list);
+			errno = error != 0 ? error : EAGAIN;
+			return PyErr_SetFromErrno(PyExc_OSError);
+		}
+		pfd.fd = self->notify;
+		pfd.events = POLLIN;
+		self->waiters++;
+		Py_BEGIN_ALLOW_THREADS
+		error = poll(&pfd, 1, -1);
+		Py_END_ALLOW_THREADS
+		self->waiters--;
+		if (self->shards == NULL) {
+			/* closed by another thread in the meantime */
+			if (self->waiters == 0) close(pfd.fd);
+			Py_DECREF(list);
+			errno = EBADF;
+			return PyErr_SetFromErrno(PyExc_OSError);
+		}
+		if (error == -1 && errno == EINTR && PyErr_CheckSignals() == -1) {
+			Py_DECREF(list);
+			return NULL;
+		}
+	}
+}
+
+
+/* Python: sharded.fileno() -> fd
+   eventfd becoming readable whenever events were queued */
+static PyObject * _sharded_fileno(ShardedObject *self, PyObject *args) {
+	return PyLong_FromLong(self->notify);
+}
+
+
+/* Python: sharded.pending() -> list of queued bytes per shard */
+static PyObject * _sharded_pending(ShardedObject *self, PyObject *args) {
+	Py_ssize_t i;
+	PyObject *list = PyList_New(self->n_shards);
+	if (list == NULL) return NULL;
+	for (i = 0; i < self->n_shards; i++)
+		PyList_SET_ITEM(list, i, PyLong_FromSize_t(
+			atomic_load(&self->shards[i].tail) - atomic_load(&self->shards[i].head)));
+	return list;
+}
+
+
+/* Python: sharded.close() */
+static PyObject * _sharded_close(ShardedObject *self, PyObject *args) {
+	_sharded_release(self);
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+/* methods run in a critical section on self, see linuxfd_c.h */
+LINUXFD_LOCKED(_sharded_add_watch_locked, _sharded_add_watch)
+LINUXFD_LOCKED(_sharded_rm_watch_locked, _sharded_rm_watch)
+LINUXFD_LOCKED(_sharded_drain_locked, _sharded_drain)
+LINUXFD_LOCKED(_sharded_pending_locked, _sharded_pending)
+LINUXFD_LOCKED(_sharded_close_locked, _sharded_close)
+
+static PyMethodDef sharded_methods[] = {
+	{ "add_watch", (PyCFunction)_sharded_add_watch_locked, METH_VARARGS, NULL },
+	{ "rm_watch",  (PyCFunction)_sharded_rm_watch_locked,  METH_VARARGS, NULL },
+	{ "drain",     (PyCFunction)_sharded_drain_locked,     METH_VARARGS, NULL },
+	{ "fileno",    (PyCFunction)_sharded_fileno,           METH_NOARGS,  NULL },
+	{ "pending",   (PyCFunction)_sharded_pending_locked,   METH_NOARGS,  NULL },
+	{ "close",     (PyCFunction)_sharded_close_locked,     METH_NOARGS,  NULL },
+	{ NULL,        NULL,                                   0,            NULL }
+};
+
+static PyType_Slot sharded_slots[] = {
+	{ Py_tp_dealloc, _sharded_dealloc },
+	{ Py_tp_methods, sharded_methods },
+	{ Py_tp_new,     _sharded_new },
+	{ 0, NULL }
+};
+
+static PyType_Spec sharded_spec = {
+	.name      = "sharded_c.sharded",
+	.basicsize = sizeof(ShardedObject),
+	.flags     = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE,
+	.slots     = sharded_slots,
+};
+
+
+static PyMethodDef methods[] = {
+	{ NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef shardedmodule = { PyModuleDef_HEAD_INIT, "linuxfd.sharded_c", NULL, 0, methods };
+
+/* create submodule linuxfd.sharded_c, see linuxfd_c.h */
+PyObject * linuxfd_sharded_c(void) {
+	PyObject *m;
+	PyObject *type;
+	m = PyModule_Create(&shardedmodule);
+	if (m == NULL) return NULL;
+	type = PyType_FromModuleAndSpec(m, &sharded_spec, NULL);
+	if (type == NULL || PyModule_AddType(m, (PyTypeObject *)type) == -1) {
+		Py_XDECREF(type);
+		Py_DECREF(m);
+		return NULL;
+	}
+	Py_DECREF(type);
+	return m;
+}
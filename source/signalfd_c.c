@@ -16,42 +16,49 @@ Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
 */
 
 #include <Python.h>
-#include <unistd.h>
 #include <signal.h>
 #include <errno.h>  /* definition of errno */
 #include <sys/signalfd.h>
+#include "liblinuxfd.h"
+#include "linuxfd_c.h"
 
 
 /* Python: signalfd(fd,signalset,flags) -> fd
-   C:      int signalfd(int fd, const sigset_t *mask, int flags); */
+   C:      int lfd_signalfd(int fd, const int *signals, size_t n, int flags); */
 static PyObject * _signalfd(PyObject *self, PyObject *args) {
 	/* variable declarations */
 	int fd;
 	int flags;
 	int result;
-	sigset_t mask;
-	int setsize;
-	int i;
+	int *signals;
+	Py_ssize_t setsize;
+	Py_ssize_t i;
 	
 	/* problem: signalset is a tuple of variable length 
 	   => parse it as generic object and check if a tuple was received */
 	PyObject* pySignalSet;
 	if (!PyArg_ParseTuple(args, "iOi", &fd, &pySignalSet, &flags) || !PyTuple_Check(pySignalSet)) return NULL;
 	
-	/* iterate over python tuple and add signals to empty signal set */
-	result = sigemptyset(&mask);
+	/* convert python tuple to an array of signal numbers */
 	setsize = PyTuple_Size(pySignalSet);
+	signals = PyMem_Malloc(setsize * sizeof(int) + 1);
+	if (signals == NULL) return PyErr_NoMemory();
 	for (i = 0; i < setsize; i++) {
-		result = sigaddset(&mask,(int)PyLong_AsLong(PyTuple_GetItem(pySignalSet,i)));
-		/* if -1 is returned, the item did not specify a valid signal number
-		   errno will be set to EINVAL, thus OSError is raised */
-		if (result == -1) return PyErr_SetFromErrno(PyExc_OSError);
+		signals[i] = (int)PyLong_AsLong(PyTuple_GetItem(pySignalSet,i));
+		if (signals[i] == -1 && PyErr_Occurred()) {
+			PyMem_Free(signals);
+			return NULL;
+		}
 	}
 	
-	/* call signalfd(); catch errors by raising an exception */
+	/* call signalfd(); catch errors by raising an exception: if an item did
+	   not specify a valid signal number, errno is set to EINVAL */
+	LINUXFD_PROBE_ENTRY(signalfd, fd);
 	Py_BEGIN_ALLOW_THREADS
-	result = signalfd(fd, &mask, flags);
+	result = lfd_signalfd(fd, signals, setsize, flags);
 	Py_END_ALLOW_THREADS
+	LINUXFD_PROBE_RETURN(signalfd, fd, result, 0);
+	PyMem_Free(signals);
 	if (result == -1) return PyErr_SetFromErrno(PyExc_OSError);
 	
 	/* everything's fine, return file descriptor returned by signalfd() */
@@ -59,86 +66,125 @@ static PyObject * _signalfd(PyObject *self, PyObject *args) {
 };
 
 
-/* Python: signalfd_read(fd) -> value
-   C:      int signalfd_read(int fd, eventfd_t *value); */
+/* Python: signalfd_read(fd[,flags]) -> value
+   C:      ssize_t lfd_signalfd_read(int fd, struct signalfd_siginfo *values,
+                                 size_t count);
+   with flag TRY_READ, None is returned instead of raising EAGAIN; with flag
+   KEEP_GIL, the GIL is not released (the caller knows fd is non-blocking) */
 static PyObject * _signalfd_read(PyObject *self, PyObject *args) {
 	/* variable declarations */
-	int fd;
+	PyObject *fdobj;
+	FdRef fd;
+	int flags = 0;
 	struct signalfd_siginfo value;
-	int result;
+	ssize_t result;
 	PyObject *dictvalue;
 	
-	/* parse the function's arguments: int fd */
-	if (!PyArg_ParseTuple(args, "i", &fd)) return NULL;
+	/* parse the function's arguments: fd, optional int flags */
+	if (!PyArg_ParseTuple(args, "O|i", &fdobj, &flags)) return NULL;
+	if (!linuxfd_fd_borrow(fdobj, &fd)) return NULL;
 	
-	/* call read; catch errors by raising an exception */
-	Py_BEGIN_ALLOW_THREADS
-	result = read(fd, &value, sizeof(struct signalfd_siginfo));
-	Py_END_ALLOW_THREADS
-	if (result == -1)
+	/* call read; catch errors by raising an exception (EIO if interrupted by
+	   a short read) */
+	LINUXFD_PROBE_ENTRY(signalfd_read, fd.fd);
+	if (flags & KEEP_GIL) {
+		result = lfd_signalfd_read(fd.fd, &value, 1);
+	} else {
+		fd.started = linuxfd_clock();
+		Py_BEGIN_ALLOW_THREADS
+		result = lfd_signalfd_read(fd.fd, &value, 1);
+		Py_END_ALLOW_THREADS
+	}
+	if (result > 0) result *= sizeof(struct signalfd_siginfo);
+	linuxfd_fd_count_read(&fd, result);
+	LINUXFD_PROBE_RETURN(signalfd_read, fd.fd, result, result > 0 ? result : 0);
+	linuxfd_fd_return(&fd);
+	if (result == -1 && errno == EAGAIN && (flags & TRY_READ)) {
+		/* no signal pending: cheap "empty" result without an exception */
+		Py_INCREF(Py_None);
+		return Py_None;
+	} else if (result == -1)
 		/* read failed, raise OSError with current error number */
 		return PyErr_SetFromErrno(PyExc_OSError);
-	else if (result != sizeof(struct signalfd_siginfo)) {
-		/* read succeeded, but returned not the expected number of bytes;
-		   perhaps interrupted, raise an I/O error */
-		errno = EIO;
-		return PyErr_SetFromErrno(PyExc_OSError);
-	}
 	
 	/* construct signal dictionary */
-	dictvalue = Py_BuildValue(
-		"{s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i}",
-		"signo",   value.ssi_signo,
-		"errno",   value.ssi_errno,
-		"code",    value.ssi_code,
-		"pid",     value.ssi_pid,
-		"uid",     value.ssi_uid,
-		"fd",      value.ssi_fd,
-		"tid",     value.ssi_tid,
-		"band",    value.ssi_band,
-		"overrun", value.ssi_overrun,
-		"trapno",  value.ssi_trapno,
-		"status",  value.ssi_status,
-		"int",     value.ssi_int,
-		"ptr",     value.ssi_ptr,
-		"utime",   value.ssi_utime,
-		"stime",   value.ssi_stime,
-		"addr",    value.ssi_addr
-	);
+	dictvalue = linuxfd_siginfo_dict(&value);
 
 	/* everything's fine, return read value */
 	return dictvalue;
 }
 
 
+/* Python: signalfd_read_many(fd,count) -> list of values
+   C:      ssize_t lfd_signalfd_read(int fd, struct signalfd_siginfo *values,
+                                 size_t count);
+   consume up to count pending signals with a single read(); returns an empty
+   list instead of raising EAGAIN if no signal is pending */
+static PyObject * _signalfd_read_many(PyObject *self, PyObject *args) {
+	/* variable declarations */
+	PyObject *fdobj;
+	FdRef fd;
+	int count;
+	int flags = 0;
+	int i;
+	ssize_t result;
+	struct signalfd_siginfo values[64];
+	PyObject *list;
+	PyObject *dictvalue;
+	
+	/* parse the function's arguments: fd, int count, optional int flags */
+	if (!PyArg_ParseTuple(args, "Oi|i", &fdobj, &count, &flags)) return NULL;
+	if (!linuxfd_fd_borrow(fdobj, &fd)) return NULL;
+	if (count < 1) count = 1;
+	if (count > 64) count = 64;
+	
+	/* call read; catch errors by raising an exception */
+	LINUXFD_PROBE_ENTRY(signalfd_read_many, fd.fd);
+	if (flags & KEEP_GIL) {
+		result = lfd_signalfd_read(fd.fd, values, count);
+	} else {
+		fd.started = linuxfd_clock();
+		Py_BEGIN_ALLOW_THREADS
+		result = lfd_signalfd_read(fd.fd, values, count);
+		Py_END_ALLOW_THREADS
+	}
+	if (result > 0) result *= sizeof(struct signalfd_siginfo);
+	linuxfd_fd_count_read(&fd, result);
+	LINUXFD_PROBE_RETURN(signalfd_read_many, fd.fd, result, result > 0 ? result : 0);
+	linuxfd_fd_return(&fd);
+	if (result == -1 && errno != EAGAIN) return PyErr_SetFromErrno(PyExc_OSError);
+	
+	/* construct list of signal dictionaries */
+	list = PyList_New(0);
+	for (i = 0; list != NULL && i < result / (ssize_t)sizeof(struct signalfd_siginfo); i++) {
+		dictvalue = linuxfd_siginfo_dict(&values[i]);
+		if (dictvalue == NULL || PyList_Append(list, dictvalue) == -1) Py_CLEAR(list);
+		Py_XDECREF(dictvalue);
+	}
+	return list;
+}
+
+
 static PyMethodDef methods[] = {
-	{ "signalfd",       _signalfd,      METH_VARARGS, NULL },
-	{ "signalfd_read",  _signalfd_read, METH_VARARGS, NULL },
-    { NULL,             NULL,           0,            NULL }
+	{ "signalfd",           _signalfd,           METH_VARARGS, NULL },
+	{ "signalfd_read",      _signalfd_read,      METH_VARARGS, NULL },
+	{ "signalfd_read_many", _signalfd_read_many, METH_VARARGS, NULL },
+    { NULL,                 NULL,                0,            NULL }
 };
 
-#if PY_MAJOR_VERSION >= 3
-static struct PyModuleDef signalfdmodule = { PyModuleDef_HEAD_INIT, "signalfd_c", NULL, -1, methods };
-#endif
+static struct PyModuleDef signalfdmodule = { PyModuleDef_HEAD_INIT, "linuxfd.signalfd_c", NULL, 0, methods };
 
-#if PY_MAJOR_VERSION >= 3
-PyMODINIT_FUNC PyInit_signalfd_c(void) {
-#else
-void initsignalfd_c(void) {
-#endif
+/* create submodule linuxfd.signalfd_c, see linuxfd_c.h */
+PyObject * linuxfd_signalfd_c(void) {
 	PyObject *m;
-#if PY_MAJOR_VERSION >= 3
 	m = PyModule_Create(&signalfdmodule);
-#else
-	m = Py_InitModule("signalfd_c",methods);
-#endif
 	if (m != NULL) {
 		/* define signalfd constants */
 		PyModule_AddIntConstant( m, "SFD_CLOEXEC",   SFD_CLOEXEC );
 		PyModule_AddIntConstant( m, "SFD_NONBLOCK",  SFD_NONBLOCK );
+		PyModule_AddIntConstant( m, "TRY_READ",      TRY_READ );
+		PyModule_AddIntConstant( m, "KEEP_GIL",      KEEP_GIL );
 	}
-#if PY_MAJOR_VERSION >= 3
 	return m;
-#endif
 }
                                                                                                                                                                                  
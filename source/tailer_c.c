@@ -0,0 +1,501 @@
+/* This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+    linuxfd is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linuxfd is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <unistd.h>
+#include <stdlib.h> /* provides malloc, realloc and free */
+#include <errno.h>  /* definition of errno */
+#include <fcntl.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include "linuxfd_c.h"
+
+#define TAILER_MAXLINE (1 << 20) /* longer lines are returned in pieces */
+
+
+/* state of a single tailed file */
+typedef struct {
+	int fd;         /* -1 if the slot is unused */
+	off_t offset;   /* position up to which the file was consumed */
+	char *partial;  /* incomplete last line (line mode only) */
+	size_t partial_len;
+	int draining;   /* claimed by a read, which releases the GIL */
+	int closed;     /* closed during a read, released when it ends */
+} TailEntry;
+
+/* tailer object: a table of tailed files sharing one read buffer; reads
+   address their entry by slot, as open() may move the table meanwhile */
+typedef struct {
+	PyObject_HEAD
+	TailEntry *entries;
+	Py_ssize_t n_entries;
+	char *buffer;
+	size_t buffersize;
+	atomic_int busy; /* buffer claimed by a read, which releases the GIL */
+	int lines;      /* if non-zero, return complete lines instead of chunks */
+} TailerObject;
+
+
+/* helper: return the entry of a slot number or set an exception */
+static TailEntry * _tailer_entry(TailerObject *self, Py_ssize_t slot) {
+	if (slot < 0 || slot >= self->n_entries || self->entries[slot].fd == -1 || self->entries[slot].closed) {
+		errno = EBADF;
+		PyErr_SetFromErrno(PyExc_OSError);
+		return NULL;
+	}
+	return &self->entries[slot];
+}
+
+
+/* helper: close a slot and release its partial line */
+static void _tailer_release(TailEntry *entry) {
+	if (entry->fd != -1) close(entry->fd);
+	free(entry->partial);
+	entry->fd = -1;
+	entry->partial = NULL;
+	entry->partial_len = 0;
+	entry->draining = 0;
+	entry->closed = 0;
+}
+
+
+/* helper: claim the entry of a slot for a read, so that neither a concurrent
+   read nor reopen() touches it and close() is deferred until the read ends;
+   returns NULL with exception set (OSError.EBUSY if claimed already) */
+static TailEntry * _tailer_claim(TailerObject *self, Py_ssize_t slot) {
+	TailEntry *entry;
+
+	if ((entry = _tailer_entry(self, slot)) == NULL) return NULL;
+	if (entry->draining) {
+		errno = EBUSY;
+		PyErr_SetFromErrno(PyExc_OSError);
+		return NULL;
+	}
+	entry->draining = 1;
+	return entry;
+}
+
+
+/* helper: end the claim of a slot; returns -1 with OSError.EBADF set if the
+   slot was closed meanwhile, which releases it now */
+static int _tailer_unclaim(TailerObject *self, Py_ssize_t slot) {
+	TailEntry *entry = &self->entries[slot];
+
+	entry->draining = 0;
+	if (!entry->closed) return 0;
+	_tailer_release(entry);
+	errno = EBADF;
+	PyErr_SetFromErrno(PyExc_OSError);
+	return -1;
+}
+
+
+/* helper: open pathname and store it in entry; returns -1 and sets errno on
+   failure */
+static int _tailer_open(TailEntry *entry, const char *pathname, int fromStart) {
+	/* variable declarations */
+	int fd;
+	struct stat st;
+
+	fd = open(pathname, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) return -1;
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return -1;
+	}
+	entry->fd = fd;
+	entry->offset = fromStart ? 0 : st.st_size;
+	entry->partial = NULL;
+	entry->partial_len = 0;
+	entry->draining = 0;
+	entry->closed = 0;
+	return 0;
+}
+
+
+/* helper: read everything appended to the file of a claimed slot since the
+   last call. Returns a list of complete lines (line mode) or a list of chunks,
+   one per pread() call (raw mode); incomplete lines are kept until they are
+   completed or exceed TAILER_MAXLINE. The entry is fetched anew whenever the
+   GIL was released; a slot closed meanwhile ends the read */
+static PyObject * _tailer_drain(TailerObject *self, Py_ssize_t slot) {
+	/* variable declarations */
+	TailEntry *entry = &self->entries[slot];
+	int fd = entry->fd;
+	off_t offset;
+	char *buffer;
+	ssize_t length;
+	char *start;
+	char *end;
+	char *newline;
+	char *joined;
+	struct stat st;
+	int truncated;
+	PyObject *data;
+	PyObject *item;
+
+	data = PyList_New(0);
+	if (data == NULL) return NULL;
+
+	/* use the shared buffer unless another slot is being read into it */
+	if (atomic_exchange(&self->busy, 1) == 0) {
+		buffer = self->buffer;
+	} else {
+		buffer = malloc(self->buffersize);
+		if (buffer == NULL) {
+			Py_DECREF(data);
+			return PyErr_NoMemory();
+		}
+	}
+
+	/* a file shorter than the current offset was truncated (e.g. by
+	   logrotate's copytruncate): start over at its beginning */
+	offset = entry->offset;
+	Py_BEGIN_ALLOW_THREADS
+	truncated = fstat(fd, &st) == 0 && st.st_size < offset;
+	Py_END_ALLOW_THREADS
+	entry = &self->entries[slot];
+	if (truncated) {
+		entry->offset = 0;
+		free(entry->partial);
+		entry->partial = NULL;
+		entry->partial_len = 0;
+	}
+
+	while (!entry->closed) {
+		/* call pread(); the slot's descriptor stays open while it is claimed */
+		offset = entry->offset;
+		Py_BEGIN_ALLOW_THREADS
+		length = pread(fd, buffer, self->buffersize, offset);
+		Py_END_ALLOW_THREADS
+		entry = &self->entries[slot];
+		if (length == -1) {
+			Py_CLEAR(data);
+			PyErr_SetFromErrno(PyExc_OSError);
+			break;
+		}
+		if (length == 0 || entry->closed) break;
+		entry->offset += length;
+
+		if (!self->lines) {
+			/* raw mode: one chunk per pread() */
+			item = PyBytes_FromStringAndSize(buffer, length);
+			if (item == NULL || PyList_Append(data, item) == -1) {
+				Py_XDECREF(item);
+				Py_CLEAR(data);
+				break;
+			}
+			Py_DECREF(item);
+		} else {
+			/* line mode: split buffer at newlines, prepending a partial line
+			   left over from the previous read */
+			start = buffer;
+			end = buffer + length;
+			while ((newline = memchr(start, '\n', end - start)) != NULL) {
+				if (entry->partial != NULL) {
+					item = PyBytes_FromStringAndSize(NULL, entry->partial_len + (newline - start) + 1);
+					if (item != NULL) {
+						joined = PyBytes_AS_STRING(item);
+						memcpy(joined, entry->partial, entry->partial_len);
+						memcpy(joined + entry->partial_len, start, newline - start + 1);
+					}
+					free(entry->partial);
+					entry->partial = NULL;
+					entry->partial_len = 0;
+				} else {
+					item = PyBytes_FromStringAndSize(start, newline - start + 1);
+				}
+				if (item == NULL || PyList_Append(data, item) == -1) {
+					Py_XDECREF(item);
+					Py_CLEAR(data);
+					break;
+				}
+				Py_DECREF(item);
+				start = newline + 1;
+			}
+			if (data == NULL) break;
+			if (start < end) {
+				/* keep incomplete line */
+				joined = realloc(entry->partial, entry->partial_len + (end - start));
+				if (joined == NULL) {
+					Py_CLEAR(data);
+					PyErr_NoMemory();
+					break;
+				}
+				memcpy(joined + entry->partial_len, start, end - start);
+				entry->partial = joined;
+				entry->partial_len += end - start;
+			}
+			if (entry->partial_len > TAILER_MAXLINE) {
+				/* no newline in sight: return the overlong line in pieces */
+				item = PyBytes_FromStringAndSize(entry->partial, entry->partial_len);
+				free(entry->partial);
+				entry->partial = NULL;
+				entry->partial_len = 0;
+				if (item == NULL || PyList_Append(data, item) == -1) {
+					Py_XDECREF(item);
+					Py_CLEAR(data);
+					break;
+				}
+				Py_DECREF(item);
+			}
+		}
+		if ((size_t)length < self->buffersize) break;
+	}
+
+	if (buffer == self->buffer)
+		atomic_store(&self->busy, 0);
+	else
+		free(buffer);
+	return data;
+}
+
+
+/* Python: tailer(buffersize,lines) -> tailer object */
+static PyObject * _tailer_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+	/* variable declarations */
+	Py_ssize_t buffersize = 65536;
+	int lines = 1;
+	TailerObject *self;
+
+	/* parse the function's arguments: Py_ssize_t buffersize, bool lines */
+	if (!PyArg_ParseTuple(args, "|np", &buffersize, &lines)) return NULL;
+	if (buffersize < 1) buffersize = 1;
+
+	self = (TailerObject *)type->tp_alloc(type, 0);
+	if (self == NULL) return NULL;
+	self->buffer = malloc(buffersize);
+	if (self->buffer == NULL) {
+		Py_DECREF(self);
+		return PyErr_NoMemory();
+	}
+	self->buffersize = buffersize;
+	atomic_init(&self->busy, 0);
+	self->lines = lines;
+	self->entries = NULL;
+	self->n_entries = 0;
+	return (PyObject *)self;
+}
+
+
+static void _tailer_dealloc(TailerObject *self) {
+	Py_ssize_t i;
+	for (i = 0; i < self->n_entries; i++) _tailer_release(&self->entries[i]);
+	free(self->entries);
+	free(self->buffer);
+	linuxfd_free((PyObject *)self);
+}
+
+
+/* Python: tailer.open(pathname,fromStart) -> slot
+   open a file for tailing; unless fromStart is True, only data appended from
+   now on is returned */
+static PyObject * _tailer_open_method(TailerObject *self, PyObject *args) {
+	/* variable declarations */
+	PyObject *pathname;
+	int fromStart = 0;
+	int result;
+	Py_ssize_t slot;
+	TailEntry entry;
+	TailEntry *entries;
+
+	/* parse the function's arguments: path-like pathname, bool fromStart */
+	if (!PyArg_ParseTuple(args, "O&|p", PyUnicode_FSConverter, &pathname, &fromStart)) return NULL;
+
+	/* call open(); catch errors by raising an exception */
+	Py_BEGIN_ALLOW_THREADS
+	result = _tailer_open(&entry, PyBytes_AS_STRING(pathname), fromStart);
+	Py_END_ALLOW_THREADS
+	Py_DECREF(pathname);
+	if (result == -1) return PyErr_SetFromErrno(PyExc_OSError);
+
+	/* reuse a free slot or grow the table */
+	for (slot = 0; slot < self->n_entries; slot++)
+		if (self->entries[slot].fd == -1) break;
+	if (slot == self->n_entries) {
+		entries = realloc(self->entries, (self->n_entries + 1) * sizeof(TailEntry));
+		if (entries == NULL) {
+			close(entry.fd);
+			return PyErr_NoMemory();
+		}
+		self->entries = entries;
+		self->n_entries++;
+	}
+	self->entries[slot] = entry;
+	return PyLong_FromSsize_t(slot);
+}
+
+
+/* Python: tailer.close(slot) */
+static PyObject * _tailer_close_method(TailerObject *self, PyObject *args) {
+	Py_ssize_t slot;
+	TailEntry *entry;
+
+	if (!PyArg_ParseTuple(args, "n", &slot)) return NULL;
+	if ((entry = _tailer_entry(self, slot)) == NULL) return NULL;
+	if (entry->draining)
+		entry->closed = 1; /* released by the read, which then raises EBADF */
+	else
+		_tailer_release(entry);
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+/* Python: tailer.read(slot) -> [bytes, ...]
+   C:      ssize_t pread(int fd, void *buf, size_t count, off_t offset); */
+static PyObject * _tailer_read_method(TailerObject *self, PyObject *args) {
+	Py_ssize_t slot;
+	TailEntry *entry;
+	PyObject *data;
+
+	if (!PyArg_ParseTuple(args, "n", &slot)) return NULL;
+	if ((entry = _tailer_entry(self, slot)) == NULL) return NULL;
+	/* read by another thread right now: the data goes to that thread */
+	if (entry->draining) return PyList_New(0);
+	if (_tailer_claim(self, slot) == NULL) return NULL;
+	data = _tailer_drain(self, slot);
+	if (_tailer_unclaim(self, slot) == -1) Py_CLEAR(data);
+	return data;
+}
+
+
+/* Python: tailer.reopen(slot,pathname) -> [bytes, ...]
+   handle rotation: drain the old file, then continue with the new file found
+   at pathname from its start; returns the data drained from the old file */
+static PyObject * _tailer_reopen_method(TailerObject *self, PyObject *args) {
+	/* variable declarations */
+	Py_ssize_t slot;
+	PyObject *pathname;
+	PyObject *data;
+	PyObject *item;
+	TailEntry *entry;
+	TailEntry fresh;
+	int result;
+
+	/* parse the function's arguments: Py_ssize_t slot, path-like pathname */
+	if (!PyArg_ParseTuple(args, "nO&", &slot, PyUnicode_FSConverter, &pathname)) return NULL;
+	if (_tailer_claim(self, slot) == NULL) {
+		Py_DECREF(pathname);
+		return NULL;
+	}
+
+	/* open new file first, so that a failure leaves the old one in place */
+	Py_BEGIN_ALLOW_THREADS
+	result = _tailer_open(&fresh, PyBytes_AS_STRING(pathname), 1);
+	Py_END_ALLOW_THREADS
+	Py_DECREF(pathname);
+	if (result == -1) {
+		result = errno;
+		if (_tailer_unclaim(self, slot) == -1) return NULL;
+		errno = result;
+		return PyErr_SetFromErrno(PyExc_OSError);
+	}
+
+	data = _tailer_drain(self, slot);
+	entry = &self->entries[slot];
+	if (data == NULL || entry->closed) {
+		close(fresh.fd);
+		if (_tailer_unclaim(self, slot) == -1) Py_CLEAR(data);
+		return data;
+	}
+	/* a trailing incomplete line of the old file is complete by now */
+	if (entry->partial != NULL && self->lines) {
+		item = PyBytes_FromStringAndSize(entry->partial, entry->partial_len);
+		if (item == NULL || PyList_Append(data, item) == -1) {
+			Py_XDECREF(item);
+			Py_DECREF(data);
+			close(fresh.fd);
+			_tailer_unclaim(self, slot);
+			return NULL;
+		}
+		Py_DECREF(item);
+	}
+	_tailer_release(entry);
+	*entry = fresh;
+	return data;
+}
+
+
+/* Python: tailer.identity(slot) -> (st_dev,st_ino)
+   C:      int fstat(int fd, struct stat *statbuf); */
+static PyObject * _tailer_identity_method(TailerObject *self, PyObject *args) {
+	Py_ssize_t slot;
+	TailEntry *entry;
+	struct stat st;
+
+	if (!PyArg_ParseTuple(args, "n", &slot)) return NULL;
+	if ((entry = _tailer_entry(self, slot)) == NULL) return NULL;
+	if (fstat(entry->fd, &st) == -1) return PyErr_SetFromErrno(PyExc_OSError);
+	return Py_BuildValue("(KK)", (unsigned long long)st.st_dev, (unsigned long long)st.st_ino);
+}
+
+
+/* methods run in a critical section on self, see linuxfd_c.h */
+LINUXFD_LOCKED(_tailer_open_method_locked, _tailer_open_method)
+LINUXFD_LOCKED(_tailer_close_method_locked, _tailer_close_method)
+LINUXFD_LOCKED(_tailer_read_method_locked, _tailer_read_method)
+LINUXFD_LOCKED(_tailer_reopen_method_locked, _tailer_reopen_method)
+LINUXFD_LOCKED(_tailer_identity_method_locked, _tailer_identity_method)
+
+static PyMethodDef tailer_methods[] = {
+	{ "open",     (PyCFunction)_tailer_open_method_locked,     METH_VARARGS, NULL },
+	{ "close",    (PyCFunction)_tailer_close_method_locked,    METH_VARARGS, NULL },
+	{ "read",     (PyCFunction)_tailer_read_method_locked,     METH_VARARGS, NULL },
+	{ "reopen",   (PyCFunction)_tailer_reopen_method_locked,   METH_VARARGS, NULL },
+	{ "identity", (PyCFunction)_tailer_identity_method_locked, METH_VARARGS, NULL },
+	{ NULL,       NULL,                                        0,            NULL }
+};
+
+static PyType_Slot tailer_slots[] = {
+	{ Py_tp_dealloc, _tailer_dealloc },
+	{ Py_tp_methods, tailer_methods },
+	{ Py_tp_new,     _tailer_new },
+	{ 0, NULL }
+};
+
+static PyType_Spec tailer_spec = {
+	.name      = "tailer_c.tailer",
+	.basicsize = sizeof(TailerObject),
+	.flags     = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE,
+	.slots     = tailer_slots,
+};
+
+
+static PyMethodDef methods[] = {
+	{ NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef tailermodule = { PyModuleDef_HEAD_INIT, "linuxfd.tailer_c", NULL, 0, methods };
+
+/* create submodule linuxfd.tailer_c, see linuxfd_c.h */
+PyObject * linuxfd_tailer_c(void) {
+	PyObject *m;
+	PyObject *type;
+	m = PyModule_Create(&tailermodule);
+	if (m == NULL) return NULL;
+	type = PyType_FromModuleAndSpec(m, &tailer_spec, NULL);
+	if (type == NULL || PyModule_AddType(m, (PyTypeObject *)type) == -1) {
+		Py_XDECREF(type);
+		Py_DECREF(m);
+		return NULL;
+	}
+	Py_DECREF(type);
+	return m;
+}
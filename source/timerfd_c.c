@@ -16,11 +16,12 @@ Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
 */
 
 #include <Python.h>
-#include <unistd.h>
 #include <time.h>
 #include <stdint.h> /* definition of uint64_t */
 #include <errno.h>  /* definition of errno */
 #include <sys/timerfd.h>
+#include "liblinuxfd.h"
+#include "linuxfd_c.h"
 
 
 /* Python: timerfd_create(clockid,flags) -> fd
@@ -35,9 +36,11 @@ static PyObject * _timerfd_create(PyObject *self, PyObject *args) {
 	if (!PyArg_ParseTuple(args, "ii", &clockid, &flags)) return NULL;
 	
 	/* call timerfd_create(); catch errors by raising an exception */
+	LINUXFD_PROBE_ENTRY(timerfd_create, -1);
 	Py_BEGIN_ALLOW_THREADS
 	result = timerfd_create(clockid, flags);
 	Py_END_ALLOW_THREADS
+	LINUXFD_PROBE_RETURN(timerfd_create, result, result, 0);
 	if (result == -1) return PyErr_SetFromErrno(PyExc_OSError);
 	
 	/* everything's fine, return file descriptor returned by timerfd_create() */
@@ -45,142 +48,139 @@ static PyObject * _timerfd_create(PyObject *self, PyObject *args) {
 };
 
 /* Python: timerfd_settime_ns(fd,flags,value,interval) -> value,interval
-   C:      int timerfd_settime_ns(int fd, int flags,
-                                  const struct itimerspec *new_value,
-                                  struct itimerspec *old_value); */
+   C:      int lfd_timerfd_settime_ns(int fd, int flags, uint64_t value,
+                                      uint64_t interval, double *old_value,
+                                      double *old_interval); */
 static PyObject * _timerfd_settime_ns(PyObject *self, PyObject *args) {
 	/* variable declarations */
-	int fd;
+	PyObject *fdobj;
+	FdRef fd;
 	int flags;
 	int result;
-	int value;
-	int interval;
-    double value_out;
-    double interval_out;
-	struct itimerspec old_value;
-	struct itimerspec new_value;
-	PyObject *resulttuple;
+	unsigned long long value;
+	unsigned long long interval;
+	double value_out;
+	double interval_out;
 	
-	/* parse the function's arguments: int fd, int flags, int value, int interval */
-	if (!PyArg_ParseTuple(args, "iill", &fd, &flags, &value, &interval)) return NULL;
-	
-	/* prepare struct itimerspec */
-	new_value.it_value.tv_sec  = (time_t)0;
-	new_value.it_value.tv_nsec = (long int)value;
-	
-	new_value.it_interval.tv_sec  = (time_t)0;
-	new_value.it_interval.tv_nsec = (long int)interval;
+	/* parse the function's arguments: fd, int flags, uint64_t value, uint64_t interval */
+	if (!PyArg_ParseTuple(args, "OiKK", &fdobj, &flags, &value, &interval)) return NULL;
+	if (!linuxfd_fd_borrow(fdobj, &fd)) return NULL;
 	
 	/* call timerfd_settime(); catch errors by raising an exception */
+	LINUXFD_PROBE_ENTRY(timerfd_settime_ns, fd.fd);
+	fd.started = linuxfd_clock();
 	Py_BEGIN_ALLOW_THREADS
-	result = timerfd_settime(fd, flags, &new_value, &old_value);
+	result = lfd_timerfd_settime_ns(fd.fd, flags, value, interval, &value_out, &interval_out);
 	Py_END_ALLOW_THREADS
+	linuxfd_fd_count(&fd, result);
+	LINUXFD_PROBE_RETURN(timerfd_settime_ns, fd.fd, result, 0);
+	linuxfd_fd_return(&fd);
 	if (result == -1) return PyErr_SetFromErrno(PyExc_OSError);
 	
-	/* convert returned struct old_value */
-	value_out    = (double)old_value.it_value.tv_sec    + (double)old_value.it_value.tv_nsec / 1e9;
-	interval_out = (double)old_value.it_interval.tv_sec + (double)old_value.it_interval.tv_nsec / 1e9;
-	resulttuple = Py_BuildValue("(dd)", value_out, interval_out);
-	
-	/* everything's fine, return tuple (value,interval) created from old_value */
-	return resulttuple;
+	/* everything's fine, return tuple (value,interval) of the old setting */
+	return Py_BuildValue("(dd)", value_out, interval_out);
 };
 
 /* Python: timerfd_settime(fd,flags,value,interval) -> value,interval
-   C:      int timerfd_settime(int fd, int flags,
-                               const struct itimerspec *new_value,
-                               struct itimerspec *old_value); */
+   C:      int lfd_timerfd_settime(int fd, int flags, double value,
+                                   double interval, double *old_value,
+                                   double *old_interval); */
 static PyObject * _timerfd_settime(PyObject *self, PyObject *args) {
 	/* variable declarations */
-	int fd;
+	PyObject *fdobj;
+	FdRef fd;
 	int flags;
 	int result;
 	double value;
 	double interval;
-	struct itimerspec old_value;
-	struct itimerspec new_value;
-	PyObject *resulttuple;
-	
-	/* parse the function's arguments: int fd, int flags, double value, double interval */
-	if (!PyArg_ParseTuple(args, "iidd", &fd, &flags, &value, &interval)) return NULL;
 	
-	/* prepare struct itimerspec */
-	new_value.it_value.tv_sec  = (time_t)value;
-	new_value.it_value.tv_nsec = (long int)( 1e9 * (value - (int)value) );
+	/* parse the function's arguments: fd, int flags, double value, double interval */
+	if (!PyArg_ParseTuple(args, "Oidd", &fdobj, &flags, &value, &interval)) return NULL;
+	if (!linuxfd_fd_borrow(fdobj, &fd)) return NULL;
 	
-	new_value.it_interval.tv_sec  = (time_t)interval;
-	new_value.it_interval.tv_nsec = (long int)( 1e9 * (interval - (int)interval) );
-	
-	/* call timerfd_settime(); catch errors by raising an exception */
+	/* call timerfd_settime(); catch errors by raising an exception; value and
+	   interval are replaced by the old setting */
+	LINUXFD_PROBE_ENTRY(timerfd_settime, fd.fd);
+	fd.started = linuxfd_clock();
 	Py_BEGIN_ALLOW_THREADS
-	result = timerfd_settime(fd, flags, &new_value, &old_value);
+	result = lfd_timerfd_settime(fd.fd, flags, value, interval, &value, &interval);
 	Py_END_ALLOW_THREADS
+	linuxfd_fd_count(&fd, result);
+	LINUXFD_PROBE_RETURN(timerfd_settime, fd.fd, result, 0);
+	linuxfd_fd_return(&fd);
 	if (result == -1) return PyErr_SetFromErrno(PyExc_OSError);
 	
-	/* convert returned struct old_value */
-	value    = (double)old_value.it_value.tv_sec    + (double)old_value.it_value.tv_nsec / 1e9;
-	interval = (double)old_value.it_interval.tv_sec + (double)old_value.it_interval.tv_nsec / 1e9;
-	resulttuple = Py_BuildValue("(dd)", value, interval);
-	
-	/* everything's fine, return tuple (value,interval) created from old_value */
-	return resulttuple;
+	/* everything's fine, return tuple (value,interval) of the old setting */
+	return Py_BuildValue("(dd)", value, interval);
 };
 
 
 /* Python: timerfd_gettime(fd) -> value,interval
-   C:      int timerfd_gettime(int fd, struct itimerspec *curr_value); */
+   C:      int lfd_timerfd_gettime(int fd, double *value, double *interval); */
 static PyObject * _timerfd_gettime(PyObject *self, PyObject *args) {
 	/* variable declarations */
-	int fd;
+	PyObject *fdobj;
+	FdRef fd;
 	int result;
 	double value;
 	double interval;
-	struct itimerspec curr_value;
-	PyObject *resulttuple;
 	
-	/* parse the function's arguments: int fd */
-	if (!PyArg_ParseTuple(args, "i", &fd)) return NULL;
+	/* parse the function's arguments: fd */
+	if (!PyArg_ParseTuple(args, "O", &fdobj)) return NULL;
+	if (!linuxfd_fd_borrow(fdobj, &fd)) return NULL;
 	
 	/* call timerfd_gettime(); catch errors by raising an exception */
+	LINUXFD_PROBE_ENTRY(timerfd_gettime, fd.fd);
+	fd.started = linuxfd_clock();
 	Py_BEGIN_ALLOW_THREADS
-	result = timerfd_gettime(fd, &curr_value);
+	result = lfd_timerfd_gettime(fd.fd, &value, &interval);
 	Py_END_ALLOW_THREADS
+	linuxfd_fd_count(&fd, result);
+	LINUXFD_PROBE_RETURN(timerfd_gettime, fd.fd, result, 0);
+	linuxfd_fd_return(&fd);
 	if(result == -1) return PyErr_SetFromErrno(PyExc_OSError);
 	
-	/* convert returned struct curr_value */
-	value    = (double)curr_value.it_value.tv_sec    + (double)curr_value.it_value.tv_nsec / 1e9;
-	interval = (double)curr_value.it_interval.tv_sec + (double)curr_value.it_interval.tv_nsec / 1e9;
-	resulttuple = Py_BuildValue("(dd)", value, interval);
-	
-	/* everything's fine, return tuple (value,interval) created from curr_value */
-	return resulttuple;
+	/* everything's fine, return tuple (value,interval) of the current setting */
+	return Py_BuildValue("(dd)", value, interval);
 };
 
 
-/* Python: timerfd_read(fd) -> value
-   C:      ssize_t read(int fd, void *buf, size_t count); */
+/* Python: timerfd_read(fd[,flags]) -> value
+   C:      int lfd_timerfd_read(int fd, uint64_t *expirations);
+   with flag TRY_READ, None is returned instead of raising EAGAIN; with flag
+   KEEP_GIL, the GIL is not released (the caller knows fd is non-blocking) */
 static PyObject * _timerfd_read(PyObject *self, PyObject *args) {
 	/* variable declarations */
-	int fd;
+	PyObject *fdobj;
+	FdRef fd;
+	int flags = 0;
 	uint64_t buffer;
-	ssize_t result;
-	
-	/* parse the function's arguments: int fd */
-	if (!PyArg_ParseTuple(args, "i", &fd)) return NULL;
+	int result;
 	
-	/* call read(); catch OSErrors */
-	Py_BEGIN_ALLOW_THREADS
-	result = read(fd, &buffer, sizeof(uint64_t));
-	Py_END_ALLOW_THREADS
-	if (result == -1)
+	/* parse the function's arguments: fd, optional int flags */
+	if (!PyArg_ParseTuple(args, "O|i", &fdobj, &flags)) return NULL;
+	if (!linuxfd_fd_borrow(fdobj, &fd)) return NULL;
+	
+	/* call read(); catch OSErrors (EIO if interrupted by a short read) */
+	LINUXFD_PROBE_ENTRY(timerfd_read, fd.fd);
+	if (flags & KEEP_GIL) {
+		result = lfd_timerfd_read(fd.fd, &buffer);
+	} else {
+		fd.started = linuxfd_clock();
+		Py_BEGIN_ALLOW_THREADS
+		result = lfd_timerfd_read(fd.fd, &buffer);
+		Py_END_ALLOW_THREADS
+	}
+	linuxfd_fd_count_read(&fd, result == -1 ? -1 : (ssize_t)sizeof(buffer));
+	LINUXFD_PROBE_RETURN(timerfd_read, fd.fd, result, result == -1 ? 0 : sizeof(buffer));
+	linuxfd_fd_return(&fd);
+	if (result == -1 && errno == EAGAIN && (flags & TRY_READ)) {
+		/* timer not expired: cheap "empty" result without an exception */
+		Py_INCREF(Py_None);
+		return Py_None;
+	} else if (result == -1)
 		/* read failed, raise OSError with current error number */
 		return PyErr_SetFromErrno(PyExc_OSError);
-	else if (result != sizeof(uint64_t)) {
-		/* read succeeded, but returned not the expected number of bytes;
-		   perhaps interrupted, raise an I/O error */
-		errno = EIO;
-		return PyErr_SetFromErrno(PyExc_OSError);
-	}
 	
 	return PyLong_FromLong(buffer);
 }
@@ -195,21 +195,12 @@ static PyMethodDef methods[] = {
     { NULL,                 NULL,                   0,            NULL }
 };
 
-#if PY_MAJOR_VERSION >= 3
-static struct PyModuleDef timerfdmodule = { PyModuleDef_HEAD_INIT, "timerfd_c", NULL, -1, methods };
-#endif
+static struct PyModuleDef timerfdmodule = { PyModuleDef_HEAD_INIT, "linuxfd.timerfd_c", NULL, 0, methods };
 
-#if PY_MAJOR_VERSION >= 3
-PyMODINIT_FUNC PyInit_timerfd_c(void) {
-#else
-void inittimerfd_c(void) {
-#endif
+/* create submodule linuxfd.timerfd_c, see linuxfd_c.h */
+PyObject * linuxfd_timerfd_c(void) {
 	PyObject *m;
-#if PY_MAJOR_VERSION >= 3
 	m = PyModule_Create(&timerfdmodule);
-#else
-	m = Py_InitModule("timerfd_c",methods);
-#endif
 	if (m != NULL) {
 		/* define timerfd constants */
 		PyModule_AddIntConstant( m, "CLOCK_REALTIME",    CLOCK_REALTIME );
@@ -218,8 +209,8 @@ void inittimerfd_c(void) {
 		PyModule_AddIntConstant( m, "TFD_CLOEXEC",       TFD_CLOEXEC );
 		PyModule_AddIntConstant( m, "TFD_NONBLOCK",      TFD_NONBLOCK );
 		PyModule_AddIntConstant( m, "TFD_TIMER_ABSTIME", TFD_TIMER_ABSTIME );
+		PyModule_AddIntConstant( m, "TRY_READ",          TRY_READ );
+		PyModule_AddIntConstant( m, "KEEP_GIL",          KEEP_GIL );
 	}
-#if PY_MAJOR_VERSION >= 3
 	return m;
-#endif
 }
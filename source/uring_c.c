@@ -0,0 +1,721 @@
+/* This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+    linuxfd is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linuxfd is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* I/O engine: keeps a read posted on every registered eventfd, timerfd,
+   signalfd and inotify file descriptor via io_uring (raw syscalls, no
+   liburing). Completed reads are decoded and re-armed; the re-arming SQEs are
+   submitted by the io_uring_enter() call of the next wait(), which also reaps
+   the completions, so a batch of events costs a single syscall. If io_uring is
+   not available (kernel < 5.11, seccomp, io_uring_disabled), the engine falls
+   back to epoll_wait() plus one read() per ready file descriptor. */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <unistd.h>
+#include <stdlib.h> /* provides posix_memalign, realloc and free */
+#include <errno.h>  /* definition of errno */
+#include <string.h>
+#include <stdint.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/inotify.h>
+#include <linux/io_uring.h>
+#include "linuxfd_c.h"
+
+#define URING_SIGINFOS   16       /* signals read at once */
+#define URING_INOTIFYBUF 65536    /* inotify read buffer size */
+#define URING_POLLFLAG   (1ULL << 63) /* user_data of a poll request */
+#define URING_IGNORE     (~0ULL)  /* user_data of a cancel request */
+#define URING_MAXEVENTS  256      /* epoll events per wait() */
+
+enum { KIND_COUNTER = 1, KIND_SIGNALFD = 2, KIND_INOTIFY = 3 };
+enum { SLOT_FREE, SLOT_ACTIVE, SLOT_REMOVED };
+
+/* registered file descriptor */
+typedef struct {
+	int state;
+	int fd;
+	int kind;
+	uint32_t generation;    /* distinguishes completions of reused slots */
+	int inflight;           /* a read or poll request is pending (io_uring) */
+	PyObject *key;          /* object returned with the results */
+	char *buffer;
+	size_t size;
+} Slot;
+
+/* mapped io_uring rings */
+typedef struct {
+	int fd;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned sq_entries;
+	struct io_uring_sqe *sqes;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+	void *sq_ptr, *cq_ptr;
+	size_t sq_size, cq_size, sqes_size;
+	unsigned pending;       /* queued, not yet submitted SQEs */
+} Ring;
+
+typedef struct {
+	PyObject_HEAD
+	int uring;              /* non-zero: io_uring backend, zero: epoll */
+	Ring ring;
+	int epfd;
+	Slot *slots;
+	Py_ssize_t n_slots;
+	unsigned long long syscalls;
+	unsigned long long results;
+	PyObject *backlog;      /* results of a wait() that raised, or NULL */
+} EngineObject;
+
+
+static int _io_uring_setup(unsigned entries, struct io_uring_params *params) {
+	return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int _io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsize) {
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsize);
+}
+
+
+/* helper: set up and map an io_uring instance; returns -1 on error */
+static int _ring_init(Ring *ring, unsigned entries) {
+	struct io_uring_params params;
+	char *sq;
+
+	memset(&params, 0, sizeof(params));
+	ring->fd = _io_uring_setup(entries, &params);
+	if (ring->fd == -1) return -1;
+	if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP)) {
+		/* timeouts and lossless completion queues need Linux >= 5.11 */
+		close(ring->fd);
+		ring->fd = -1;
+		errno = ENOSYS;
+		return -1;
+	}
+	ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_size > ring->sq_size) ring->sq_size = ring->cq_size;
+		ring->cq_size = ring->sq_size;
+	}
+	ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ptr == MAP_FAILED) goto error;
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_ptr = ring->sq_ptr;
+	} else {
+		ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if (ring->cq_ptr == MAP_FAILED) goto error;
+	}
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) goto error;
+
+	sq = ring->sq_ptr;
+	ring->sq_head    = (unsigned *)(sq + params.sq_off.head);
+	ring->sq_tail    = (unsigned *)(sq + params.sq_off.tail);
+	ring->sq_mask    = (unsigned *)(sq + params.sq_off.ring_mask);
+	ring->sq_array   = (unsigned *)(sq + params.sq_off.array);
+	ring->sq_entries = params.sq_entries;
+	ring->cq_head    = (unsigned *)((char *)ring->cq_ptr + params.cq_off.head);
+	ring->cq_tail    = (unsigned *)((char *)ring->cq_ptr + params.cq_off.tail);
+	ring->cq_mask    = (unsigned *)((char *)ring->cq_ptr + params.cq_off.ring_mask);
+	ring->cqes       = (struct io_uring_cqe *)((char *)ring->cq_ptr + params.cq_off.cqes);
+	return 0;
+
+error:
+	if (ring->sq_ptr != MAP_FAILED && ring->sq_ptr != NULL) munmap(ring->sq_ptr, ring->sq_size);
+	if (ring->cq_ptr != MAP_FAILED && ring->cq_ptr != NULL && ring->cq_ptr != ring->sq_ptr) munmap(ring->cq_ptr, ring->cq_size);
+	close(ring->fd);
+	ring->fd = -1;
+	return -1;
+}
+
+
+/* helper: unmap and close an io_uring instance */
+static void _ring_release(Ring *ring) {
+	if (ring->fd == -1) return;
+	munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_ptr != ring->sq_ptr) munmap(ring->cq_ptr, ring->cq_size);
+	munmap(ring->sq_ptr, ring->sq_size);
+	close(ring->fd);
+	ring->fd = -1;
+}
+
+
+/* helper: submit queued SQEs without waiting */
+static int _engine_submit(EngineObject *self) {
+	int result;
+	if (self->ring.pending == 0) return 0;
+	result = _io_uring_enter(self->ring.fd, self->ring.pending, 0, 0, NULL, 0);
+	self->syscalls++;
+	if (result < 0) return -1;
+	self->ring.pending -= result;
+	return 0;
+}
+
+
+/* helper: return the next free SQE, submitting queued ones if the SQ ring is
+   full; returns NULL on error */
+static struct io_uring_sqe * _engine_sqe(EngineObject *self) {
+	Ring *ring = &self->ring;
+	unsigned tail = *ring->sq_tail;
+	struct io_uring_sqe *sqe;
+
+	if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries) {
+		if (_engine_submit(self) == -1) return NULL;
+		if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries) {
+			errno = EBUSY;
+			return NULL;
+		}
+	}
+	sqe = &ring->sqes[tail & *ring->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	ring->sq_array[tail & *ring->sq_mask] = tail & *ring->sq_mask;
+	return sqe;
+}
+
+
+/* helper: publish the SQE returned by _engine_sqe() */
+static void _engine_queue(EngineObject *self) {
+	__atomic_store_n(self->ring.sq_tail, *self->ring.sq_tail + 1, __ATOMIC_RELEASE);
+	self->ring.pending++;
+}
+
+
+/* helper: user_data of the requests of a slot */
+static uint64_t _engine_userdata(EngineObject *self, Py_ssize_t index) {
+	return ((uint64_t)self->slots[index].generation << 32) | (uint64_t)index;
+}
+
+
+/* helper: post a read (or a poll, if the descriptor is non-blocking and empty)
+   for a slot; returns -1 on error */
+static int _engine_arm(EngineObject *self, Py_ssize_t index, int poll) {
+	Slot *slot = &self->slots[index];
+	struct io_uring_sqe *sqe = _engine_sqe(self);
+	if (sqe == NULL) return -1;
+	sqe->fd = slot->fd;
+	if (poll) {
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->poll32_events = POLLIN;
+		sqe->user_data = _engine_userdata(self, index) | URING_POLLFLAG;
+	} else {
+		sqe->opcode = IORING_OP_READ;
+		sqe->addr = (uint64_t)(uintptr_t)slot->buffer;
+		sqe->len = (uint32_t)slot->size;
+		sqe->off = (uint64_t)-1; /* current position, i.e. stream read */
+		sqe->user_data = _engine_userdata(self, index);
+	}
+	_engine_queue(self);
+	slot->inflight = 1;
+	return 0;
+}
+
+
+/* helper: convert read data of a slot to a Python object */
+static PyObject * _engine_decode(Slot *slot, size_t length) {
+	PyObject *list, *item;
+	struct signalfd_siginfo *value;
+	struct inotify_event *event;
+	PyObject *name;
+	uint64_t counter;
+	char *pointer;
+	size_t i;
+
+	switch (slot->kind) {
+	case KIND_COUNTER:
+		memcpy(&counter, slot->buffer, sizeof(counter));
+		return PyLong_FromUnsignedLongLong(counter);
+
+	case KIND_SIGNALFD:
+		/* one dictionary per signal, like signalfd_c.signalfd_read() */
+		list = PyList_New(0);
+		for (i = 0; list != NULL && i < length / sizeof(struct signalfd_siginfo); i++) {
+			value = &((struct signalfd_siginfo *)slot->buffer)[i];
+			item = linuxfd_siginfo_dict(value);
+			if (item == NULL || PyList_Append(list, item) == -1) Py_CLEAR(list);
+			Py_XDECREF(item);
+		}
+		return list;
+
+	case KIND_INOTIFY:
+		/* (wd,mask,cookie,name) tuples, like inotify_c.inotify_read() */
+		list = PyList_New(0);
+		for (pointer = slot->buffer; list != NULL && pointer < slot->buffer + length; pointer += sizeof(struct inotify_event) + event->len) {
+			event = (struct inotify_event *)pointer;
+			/* undecodable bytes are kept as surrogates, like os.fsdecode() */
+			name = event->len ? PyUnicode_DecodeFSDefault(event->name) : PyUnicode_FromString("");
+			item = name != NULL ? Py_BuildValue("(iIIN)", event->wd, event->mask, event->cookie, name) : NULL;
+			if (item == NULL || PyList_Append(list, item) == -1) Py_CLEAR(list);
+			Py_XDECREF(item);
+		}
+		return list;
+	}
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+/* helper: append (key,value) to a result list; value is decoded from the slot
+   buffer or, if error is non-zero, an OSError instance; returns -1 on error */
+static int _engine_result(EngineObject *self, Slot *slot, PyObject *results, ssize_t length, int error) {
+	PyObject *value, *item;
+	if (error != 0)
+		value = PyObject_CallFunction(PyExc_OSError, "is", error, strerror(error));
+	else
+		value = _engine_decode(slot, (size_t)length);
+	if (value == NULL) return -1;
+	item = PyTuple_Pack(2, slot->key, value);
+	Py_DECREF(value);
+	if (item == NULL || PyList_Append(results, item) == -1) {
+		Py_XDECREF(item);
+		return -1;
+	}
+	Py_DECREF(item);
+	self->results++;
+	return 0;
+}
+
+
+/* helper: free the resources of a slot */
+static void _engine_free(Slot *slot) {
+	Py_CLEAR(slot->key);
+	free(slot->buffer);
+	slot->buffer = NULL;
+	slot->state = SLOT_FREE;
+}
+
+
+/* helper: append the result of a slot like _engine_result(); a Python error
+   is stashed in error (the first one is kept), so that the caller can go on
+   with the remaining slots and raise it afterwards */
+static void _engine_report(EngineObject *self, Slot *slot, PyObject *results, ssize_t length, int error, PyObject *stash[3]) {
+	PyObject *type, *value, *traceback;
+	if (_engine_result(self, slot, results, length, error) == 0) return;
+	PyErr_Fetch(&type, &value, &traceback);
+	if (stash[0] == NULL) {
+		stash[0] = type;
+		stash[1] = value;
+		stash[2] = traceback;
+	} else {
+		Py_XDECREF(type);
+		Py_XDECREF(value);
+		Py_XDECREF(traceback);
+	}
+}
+
+
+/* helper: re-arm a slot, reporting an OSError result if that fails (the slot
+   is not read again then) */
+static void _engine_rearm(EngineObject *self, Py_ssize_t index, int poll, PyObject *results, PyObject *stash[3]) {
+	if (_engine_arm(self, index, poll) == -1)
+		_engine_report(self, &self->slots[index], results, 0, errno, stash);
+}
+
+
+/* helper: process all available completions: every slot is re-armed or its
+   failure reported, even if decoding another one raised; returns -1 with the
+   first exception set in that case */
+static int _engine_reap(EngineObject *self, PyObject *results) {
+	Ring *ring = &self->ring;
+	unsigned head = *ring->cq_head;
+	unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	struct io_uring_cqe *cqe;
+	Py_ssize_t index;
+	Slot *slot;
+	PyObject *stash[3] = { NULL, NULL, NULL };
+
+	for (; head != tail; head++) {
+		cqe = &ring->cqes[head & *ring->cq_mask];
+		if (cqe->user_data == URING_IGNORE) continue;
+		index = (Py_ssize_t)(cqe->user_data & 0xffffffffULL);
+		if (index >= self->n_slots) continue;
+		slot = &self->slots[index];
+		if (slot->generation != (uint32_t)((cqe->user_data & ~URING_POLLFLAG) >> 32)) continue;
+		slot->inflight = 0;
+		if (slot->state == SLOT_REMOVED) {
+			/* read cancelled (or completed just before): buffer may go now */
+			_engine_free(slot);
+			continue;
+		}
+		if (cqe->user_data & URING_POLLFLAG) {
+			/* non-blocking descriptor became readable: read it now */
+			if (cqe->res < 0)
+				_engine_report(self, slot, results, 0, -cqe->res, stash);
+			else
+				_engine_rearm(self, index, 0, results, stash);
+		} else if (cqe->res == -EAGAIN || cqe->res == -EINTR) {
+			/* non-blocking descriptor without data: wait for readiness */
+			_engine_rearm(self, index, 1, results, stash);
+		} else if (cqe->res <= 0) {
+			/* failed (or EOF): report and do not re-arm */
+			_engine_report(self, slot, results, 0, cqe->res < 0 ? -cqe->res : EIO, stash);
+		} else {
+			/* the data is consumed: re-arm even if it could not be decoded */
+			_engine_report(self, slot, results, cqe->res, 0, stash);
+			_engine_rearm(self, index, 0, results, stash);
+		}
+	}
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+	if (stash[0] == NULL) return 0;
+	PyErr_Restore(stash[0], stash[1], stash[2]);
+	return -1;
+}
+
+
+static PyObject * _engine_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+	EngineObject *self;
+	unsigned int entries = 256;
+	int epoll = 0;
+
+	/* parse the function's arguments: ring size, force epoll backend */
+	if (!PyArg_ParseTuple(args, "|Ip", &entries, &epoll)) return NULL;
+	self = (EngineObject *)type->tp_alloc(type, 0);
+	if (self == NULL) return NULL;
+	self->ring.fd = -1;
+	self->epfd = -1;
+	if (!epoll && _ring_init(&self->ring, entries) == 0) {
+		self->uring = 1;
+		return (PyObject *)self;
+	}
+	self->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (self->epfd == -1) {
+		Py_DECREF(self);
+		return PyErr_SetFromErrno(PyExc_OSError);
+	}
+	return (PyObject *)self;
+}
+
+
+static void _engine_dealloc(EngineObject *self) {
+	Py_ssize_t i;
+	int inflight, round;
+	struct io_uring_sqe *sqe;
+	struct __kernel_timespec ts = { 0, 100000000 };
+	struct io_uring_getevents_arg arg = { 0, 0, 0, (uint64_t)(uintptr_t)&ts };
+
+	if (self->uring && self->ring.fd != -1) {
+		/* buffers must outlive pending reads: cancel them and wait for the
+		   completions (bounded, in case a cancellation never completes) */
+		for (i = 0; i < self->n_slots; i++) {
+			if (self->slots[i].state == SLOT_ACTIVE) self->slots[i].state = SLOT_REMOVED;
+			if (self->slots[i].inflight && (sqe = _engine_sqe(self)) != NULL) {
+				sqe->opcode = IORING_OP_ASYNC_CANCEL;
+				sqe->addr = _engine_userdata(self, i);
+				sqe->user_data = URING_IGNORE;
+				_engine_queue(self);
+			}
+		}
+		for (round = 0; round < 10; round++) {
+			for (inflight = 0, i = 0; i < self->n_slots; i++) inflight += self->slots[i].inflight;
+			if (inflight == 0) break;
+			_io_uring_enter(self->ring.fd, self->ring.pending, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+			self->ring.pending = 0;
+			_engine_reap(self, NULL);
+		}
+		if (inflight != 0) {
+			/* leak the buffers rather than risk the kernel writing to freed memory */
+			for (i = 0; i < self->n_slots; i++) if (self->slots[i].inflight) self->slots[i].buffer = NULL;
+		}
+	}
+	for (i = 0; i < self->n_slots; i++) {
+		if (self->slots[i].state != SLOT_FREE) _engine_free(&self->slots[i]);
+	}
+	free(self->slots);
+	Py_CLEAR(self->backlog);
+	_ring_release(&self->ring);
+	if (self->epfd != -1) close(self->epfd);
+	linuxfd_free((PyObject *)self);
+}
+
+
+/* Python: engine.add(fd,kind,key)
+   start reading fd; kind is KIND_COUNTER (eventfd, timerfd), KIND_SIGNALFD or
+   KIND_INOTIFY; key is returned along with the results of fd */
+static PyObject * _engine_add(EngineObject *self, PyObject *args) {
+	int fd, kind;
+	PyObject *key;
+	Py_ssize_t index, i;
+	Slot *slots, *slot;
+	struct epoll_event event;
+	size_t size;
+
+	if (!PyArg_ParseTuple(args, "iiO", &fd, &kind, &key)) return NULL;
+	switch (kind) {
+	case KIND_COUNTER:  size = sizeof(uint64_t); break;
+	case KIND_SIGNALFD: size = URING_SIGINFOS * sizeof(struct signalfd_siginfo); break;
+	case KIND_INOTIFY:  size = URING_INOTIFYBUF; break;
+	default:
+		errno = EINVAL;
+		return PyErr_SetFromErrno(PyExc_OSError);
+	}
+	for (i = 0; i < self->n_slots; i++) {
+		if (self->slots[i].state == SLOT_ACTIVE && self->slots[i].fd == fd) {
+			errno = EEXIST;
+			return PyErr_SetFromErrno(PyExc_OSError);
+		}
+	}
+
+	/* find a free slot, growing the table if necessary */
+	for (index = 0; index < self->n_slots && self->slots[index].state != SLOT_FREE; index++);
+	if (index == self->n_slots) {
+		slots = realloc(self->slots, (self->n_slots + 16) * sizeof(Slot));
+		if (slots == NULL) return PyErr_NoMemory();
+		memset(slots + self->n_slots, 0, 16 * sizeof(Slot));
+		self->slots = slots;
+		self->n_slots += 16;
+	}
+	slot = &self->slots[index];
+	if (posix_memalign((void **)&slot->buffer, sizeof(struct inotify_event), size) != 0) return PyErr_NoMemory();
+	slot->fd = fd;
+	slot->kind = kind;
+	slot->size = size;
+	slot->generation = (slot->generation + 1) & 0x7fffffff;
+	slot->inflight = 0;
+	slot->state = SLOT_ACTIVE;
+	Py_INCREF(key);
+	slot->key = key;
+
+	if (self->uring) {
+		/* submitted by the next wait() */
+		if (_engine_arm(self, index, 0) == 0) {
+			Py_INCREF(Py_None);
+			return Py_None;
+		}
+	} else {
+		event.events = EPOLLIN;
+		event.data.u64 = (uint64_t)index;
+		if (epoll_ctl(self->epfd, EPOLL_CTL_ADD, fd, &event) == 0) {
+			Py_INCREF(Py_None);
+			return Py_None;
+		}
+	}
+	_engine_free(slot);
+	return PyErr_SetFromErrno(PyExc_OSError);
+}
+
+
+/* Python: engine.remove(fd)
+   stop reading fd; a pending read is cancelled */
+static PyObject * _engine_remove(EngineObject *self, PyObject *args) {
+	int fd;
+	Py_ssize_t i;
+	Slot *slot;
+	struct io_uring_sqe *sqe;
+
+	if (!PyArg_ParseTuple(args, "i", &fd)) return NULL;
+	for (i = 0; i < self->n_slots; i++) {
+		slot = &self->slots[i];
+		if (slot->state != SLOT_ACTIVE || slot->fd != fd) continue;
+		if (!self->uring) {
+			if (epoll_ctl(self->epfd, EPOLL_CTL_DEL, fd, NULL) == -1 && errno != EBADF && errno != ENOENT)
+				return PyErr_SetFromErrno(PyExc_OSError);
+			_engine_free(slot);
+		} else if (!slot->inflight) {
+			_engine_free(slot);
+		} else {
+			/* the buffer is released when the cancelled read completes */
+			sqe = _engine_sqe(self);
+			if (sqe == NULL) return PyErr_SetFromErrno(PyExc_OSError);
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->addr = _engine_userdata(self, i);
+			sqe->user_data = URING_IGNORE;
+			_engine_queue(self);
+			Py_CLEAR(slot->key);
+			slot->state = SLOT_REMOVED;
+			if (_engine_submit(self) == -1) return PyErr_SetFromErrno(PyExc_OSError);
+		}
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
+	PyErr_SetObject(PyExc_KeyError, PyTuple_GET_ITEM(args, 0));
+	return NULL;
+}
+
+
+/* helper: wait() of the epoll backend */
+static int _engine_wait_epoll(EngineObject *self, PyObject *results, int timeout) {
+	struct epoll_event events[URING_MAXEVENTS];
+	int i, n_events;
+	ssize_t length;
+	Slot *slot;
+	PyObject *stash[3] = { NULL, NULL, NULL };
+
+	Py_BEGIN_ALLOW_THREADS
+	n_events = epoll_wait(self->epfd, events, URING_MAXEVENTS, timeout);
+	Py_END_ALLOW_THREADS
+	self->syscalls++;
+	if (n_events == -1) return errno == EINTR ? PyErr_CheckSignals() : -1;
+	for (i = 0; i < n_events; i++) {
+		slot = &self->slots[events[i].data.u64];
+		if (slot->state != SLOT_ACTIVE) continue;
+		length = read(slot->fd, slot->buffer, slot->size);
+		self->syscalls++;
+		if (length == -1 && (errno == EAGAIN || errno == EINTR)) continue;
+		_engine_report(self, slot, results, length, length > 0 ? 0 : (length == 0 ? EIO : errno), stash);
+	}
+	if (stash[0] == NULL) return 0;
+	PyErr_Restore(stash[0], stash[1], stash[2]);
+	return -1;
+}
+
+
+/* helper: wait() of the io_uring backend */
+static int _engine_wait_uring(EngineObject *self, PyObject *results, int timeout) {
+	struct __kernel_timespec ts;
+	struct io_uring_getevents_arg arg;
+	unsigned flags = IORING_ENTER_GETEVENTS;
+	unsigned submit = self->ring.pending;
+	int result;
+
+	memset(&arg, 0, sizeof(arg));
+	if (timeout >= 0) {
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = (long long)(timeout % 1000) * 1000000;
+		arg.ts = (uint64_t)(uintptr_t)&ts;
+	}
+	flags |= IORING_ENTER_EXT_ARG;
+	/* completions already queued need no syscall at all */
+	if (submit == 0 && *self->ring.cq_head != __atomic_load_n(self->ring.cq_tail, __ATOMIC_ACQUIRE))
+		return _engine_reap(self, results);
+	Py_BEGIN_ALLOW_THREADS
+	result = _io_uring_enter(self->ring.fd, submit, timeout == 0 ? 0 : 1, flags, &arg, sizeof(arg));
+	Py_END_ALLOW_THREADS
+	self->syscalls++;
+	if (result >= 0) {
+		self->ring.pending -= result;
+	} else if (errno == ETIME) {
+		/* timeout expired; submission happened nevertheless */
+		self->ring.pending = 0;
+	} else if (errno == EINTR) {
+		if (PyErr_CheckSignals() == -1) return -1;
+	} else if (errno != EBUSY) {
+		return -1;
+	}
+	return _engine_reap(self, results);
+}
+
+
+/* Python: engine.wait(timeout=-1) -> list of (key,value)
+   submit pending reads and wait at most timeout seconds (negative: forever)
+   for results. value is an integer (eventfd, timerfd), a list of signal
+   dictionaries (signalfd), a list of (wd,mask,cookie,name) tuples (inotify)
+   or an OSError instance if reading failed; failed descriptors are not read
+   again. If it raises, the results collected so far are returned by the next
+   call. */
+static PyObject * _engine_wait(EngineObject *self, PyObject *args) {
+	double timeout = -1.0;
+	int ms, result;
+	PyObject *results;
+
+	if (!PyArg_ParseTuple(args, "|d", &timeout)) return NULL;
+	ms = timeout < 0 ? -1 : (int)(timeout * 1000.0);
+	if (self->backlog != NULL) {
+		/* left over from a call that raised: only collect what is ready */
+		results = self->backlog;
+		self->backlog = NULL;
+		ms = 0;
+	} else {
+		results = PyList_New(0);
+		if (results == NULL) return NULL;
+	}
+	do {
+		/* completions of polls and cancellations produce no results */
+		result = self->uring ? _engine_wait_uring(self, results, ms) : _engine_wait_epoll(self, results, ms);
+		if (result == -1) {
+			if (!PyErr_Occurred()) PyErr_SetFromErrno(PyExc_OSError);
+			if (PyList_GET_SIZE(results) > 0)
+				self->backlog = results;
+			else
+				Py_DECREF(results);
+			return NULL;
+		}
+	} while (ms < 0 && PyList_GET_SIZE(results) == 0);
+	return results;
+}
+
+
+/* Python: engine.backend() -> "io_uring" or "epoll" */
+static PyObject * _engine_backend(EngineObject *self, PyObject *args) {
+	return PyUnicode_FromString(self->uring ? "io_uring" : "epoll");
+}
+
+
+/* Python: engine.stats() -> {"syscalls":int,"results":int} */
+static PyObject * _engine_stats(EngineObject *self, PyObject *args) {
+	return Py_BuildValue("{s:K,s:K}", "syscalls", self->syscalls, "results", self->results);
+}
+
+
+/* methods run in a critical section on self, see linuxfd_c.h */
+LINUXFD_LOCKED(_engine_add_locked, _engine_add)
+LINUXFD_LOCKED(_engine_remove_locked, _engine_remove)
+LINUXFD_LOCKED(_engine_wait_locked, _engine_wait)
+LINUXFD_LOCKED(_engine_stats_locked, _engine_stats)
+
+static PyMethodDef engine_methods[] = {
+	{ "add",     (PyCFunction)_engine_add_locked,    METH_VARARGS, NULL },
+	{ "remove",  (PyCFunction)_engine_remove_locked, METH_VARARGS, NULL },
+	{ "wait",    (PyCFunction)_engine_wait_locked,   METH_VARARGS, NULL },
+	{ "backend", (PyCFunction)_engine_backend,       METH_NOARGS,  NULL },
+	{ "stats",   (PyCFunction)_engine_stats_locked,  METH_NOARGS,  NULL },
+	{ NULL,      NULL,                               0,            NULL }
+};
+
+static PyType_Slot engine_slots[] = {
+	{ Py_tp_dealloc, _engine_dealloc },
+	{ Py_tp_methods, engine_methods },
+	{ Py_tp_new,     _engine_new },
+	{ 0, NULL }
+};
+
+static PyType_Spec engine_spec = {
+	.name      = "uring_c.engine",
+	.basicsize = sizeof(EngineObject),
+	.flags     = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE,
+	.slots     = engine_slots,
+};
+
+
+static PyMethodDef methods[] = {
+	{ NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef uringmodule = { PyModuleDef_HEAD_INIT, "linuxfd.uring_c", NULL, 0, methods };
+
+/* create submodule linuxfd.uring_c, see linuxfd_c.h */
+PyObject * linuxfd_uring_c(void) {
+	PyObject *m;
+	PyObject *type;
+	m = PyModule_Create(&uringmodule);
+	if (m == NULL) return NULL;
+	type = PyType_FromModuleAndSpec(m, &engine_spec, NULL);
+	if (type == NULL || PyModule_AddType(m, (PyTypeObject *)type) == -1) {
+		Py_XDECREF(type);
+		Py_DECREF(m);
+		return NULL;
+	}
+	Py_DECREF(type);
+	PyModule_AddIntConstant( m, "KIND_COUNTER",  KIND_COUNTER );
+	PyModule_AddIntConstant( m, "KIND_SIGNALFD", KIND_SIGNALFD );
+	PyModule_AddIntConstant( m, "KIND_INOTIFY",  KIND_INOTIFY );
+	return m;
+}
@@ -0,0 +1,261 @@
+/* This file is part of linuxfd (Python wrapper for eventfd/signalfd/timerfd)
+Copyright (C) 2014-2020 Frank Abelbeck <frank.abelbeck@googlemail.com>
+
+    linuxfd is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    linuxfd is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with linuxfd.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* XXH64: fast non-cryptographic 64 bit hash (algorithm by Yann Collet, see
+   https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md); the four
+   independent accumulators of the main loop are vectorised by the compiler.
+   Header-only, shared by the extension modules hashing file contents. */
+
+#ifndef LINUXFD_XXH64_H
+#define LINUXFD_XXH64_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t _xxh_rotl64(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t _xxh_read64(const unsigned char *p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v)); /* unaligned load, little endian assumed */
+	return v;
+}
+
+static inline uint32_t _xxh_read32(const unsigned char *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t _xxh_round(uint64_t acc, uint64_t input) {
+	acc += input * XXH_PRIME64_2;
+	acc  = _xxh_rotl64(acc, 31);
+	return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t _xxh_merge(uint64_t acc, uint64_t val) {
+	acc ^= _xxh_round(0, val);
+	return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+/* hash length bytes at data */
+static inline uint64_t xxh64(const void *data, size_t length, uint64_t seed) {
+	const unsigned char *p = (const unsigned char *)data;
+	const unsigned char *end = p + length;
+	uint64_t h;
+	uint64_t v1, v2, v3, v4;
+
+	if (length >= 32) {
+		v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+		v2 = seed + XXH_PRIME64_2;
+		v3 = seed;
+		v4 = seed - XXH_PRIME64_1;
+		do {
+			v1 = _xxh_round(v1, _xxh_read64(p));
+			v2 = _xxh_round(v2, _xxh_read64(p + 8));
+			v3 = _xxh_round(v3, _xxh_read64(p + 16));
+			v4 = _xxh_round(v4, _xxh_read64(p + 24));
+			p += 32;
+		} while (p + 32 <= end);
+		h = _xxh_rotl64(v1, 1) + _xxh_rotl64(v2, 7) + _xxh_rotl64(v3, 12) + _xxh_rotl64(v4, 18);
+		h = _xxh_merge(h, v1);
+		h = _xxh_merge(h, v2);
+		h = _xxh_merge(h, v3);
+		h = _xxh_merge(h, v4);
+	} else {
+		h = seed + XXH_PRIME64_5;
+	}
+	h += (uint64_t)length;
+
+	while (p + 8 <= end) {
+		h ^= _xxh_round(0, _xxh_read64(p));
+		h  = _xxh_rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+		p += 8;
+	}
+	if (p + 4 <= end) {
+		h ^= (uint64_t)_xxh_read32(p) * XXH_PRIME64_1;
+		h  = _xxh_rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		p += 4;
+	}
+	while (p < end) {
+		h ^= (*p) * XXH_PRIME64_5;
+		h  = _xxh_rotl64(h, 11) * XXH_PRIME64_1;
+		p++;
+	}
+
+	h ^= h >> 33;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= XXH_PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+/* streaming variant: feed the data in pieces of any size, the digest equals
+   xxh64() of the concatenation */
+typedef struct {
+	uint64_t v1, v2, v3, v4;
+	uint64_t total;
+	unsigned char buffer[32]; /* bytes not yet consumed by a round */
+	size_t buffered;
+	uint64_t seed;
+} xxh64_state;
+
+static inline void xxh64_reset(xxh64_state *state, uint64_t seed) {
+	state->v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+	state->v2 = seed + XXH_PRIME64_2;
+	state->v3 = seed;
+	state->v4 = seed - XXH_PRIME64_1;
+	state->total = 0;
+	state->buffered = 0;
+	state->seed = seed;
+}
+
+static inline void _xxh_stripe(xxh64_state *state, const unsigned char *p) {
+	state->v1 = _xxh_round(state->v1, _xxh_read64(p));
+	state->v2 = _xxh_round(state->v2, _xxh_read64(p + 8));
+	state->v3 = _xxh_round(state->v3, _xxh_read64(p + 16));
+	state->v4 = _xxh_round(state->v4, _xxh_read64(p + 24));
+}
+
+static inline void xxh64_update(xxh64_state *state, const void *data, size_t length) {
+	const unsigned char *p = (const unsigned char *)data;
+	const unsigned char *end = p + length;
+	size_t n;
+
+	state->total += length;
+	if (state->buffered > 0) {
+		n = 32 - state->buffered < length ? 32 - state->buffered : length;
+		memcpy(state->buffer + state->buffered, p, n);
+		state->buffered += n;
+		p += n;
+		if (state->buffered < 32) return;
+		_xxh_stripe(state, state->buffer);
+		state->buffered = 0;
+	}
+	for (; p + 32 <= end; p += 32) _xxh_stripe(state, p);
+	memcpy(state->buffer, p, end - p);
+	state->buffered = end - p;
+}
+
+static inline uint64_t xxh64_digest(const xxh64_state *state) {
+	const unsigned char *p = state->buffer;
+	const unsigned char *end = p + state->buffered;
+	uint64_t h;
+
+	if (state->total >= 32) {
+		h = _xxh_rotl64(state->v1, 1) + _xxh_rotl64(state->v2, 7)
+		  + _xxh_rotl64(state->v3, 12) + _xxh_rotl64(state->v4, 18);
+		h = _xxh_merge(h, state->v1);
+		h = _xxh_merge(h, state->v2);
+		h = _xxh_merge(h, state->v3);
+		h = _xxh_merge(h, state->v4);
+	} else {
+		h = state->seed + XXH_PRIME64_5;
+	}
+	h += state->total;
+
+	while (p + 8 <= end) {
+		h ^= _xxh_round(0, _xxh_read64(p));
+		h  = _xxh_rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+		p += 8;
+	}
+	if (p + 4 <= end) {
+		h ^= (uint64_t)_xxh_read32(p) * XXH_PRIME64_1;
+		h  = _xxh_rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		p += 4;
+	}
+	while (p < end) {
+		h ^= (*p) * XXH_PRIME64_5;
+		h  = _xxh_rotl64(h, 11) * XXH_PRIME64_1;
+		p++;
+	}
+
+	h ^= h >> 33;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= XXH_PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+#define XXH64_FILE_CHUNK 65536
+
+/* hash the contents of a file, read with pread() into a fixed buffer (a
+   mapping would raise SIGBUS if the file is truncated meanwhile); stores the
+   file's device and inode numbers in dev/ino. Returns 0 on success, -1 on
+   error (errno is set); EAGAIN if the file shrank or grew while it was read,
+   i.e. it changed. Does not touch any Python object, thus may be called
+   without holding the GIL. */
+static inline int xxh64_file(const char *pathname, uint64_t *hash, uint64_t *dev, uint64_t *ino) {
+	unsigned char buffer[XXH64_FILE_CHUNK];
+	xxh64_state state;
+	struct stat st;
+	off_t offset = 0;
+	ssize_t n;
+	int fd;
+	int error;
+
+	fd = open(pathname, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) return -1;
+	if (fstat(fd, &st) == -1) goto error;
+	*dev = (uint64_t)st.st_dev;
+	*ino = (uint64_t)st.st_ino;
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	xxh64_reset(&state, 0);
+	while (offset < st.st_size) {
+		n = pread(fd, buffer, st.st_size - offset < XXH64_FILE_CHUNK ? st.st_size - offset : XXH64_FILE_CHUNK, offset);
+		if (n == -1 && errno == EINTR) continue;
+		if (n == -1) goto error;
+		if (n == 0) {
+			errno = EAGAIN; /* truncated */
+			goto error;
+		}
+		xxh64_update(&state, buffer, n);
+		offset += n;
+	}
+	/* appended to meanwhile */
+	while ((n = pread(fd, buffer, 1, offset)) == -1 && errno == EINTR);
+	if (n == -1) goto error;
+	if (n > 0) {
+		errno = EAGAIN;
+		goto error;
+	}
+	close(fd);
+	*hash = xxh64_digest(&state);
+	return 0;
+
+error:
+	error = errno;
+	close(fd);
+	errno = error;
+	return -1;
+}
+
+#endif /* LINUXFD_XXH64_H */